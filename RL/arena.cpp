@@ -0,0 +1,65 @@
+#include "pch.h"
+
+#include "arena.h"
+
+Arena::Arena(size_t blockSize)
+    : m_blockSize(blockSize)
+{
+}
+
+void * Arena::Allocate(size_t size, size_t alignment)
+{
+    // The current block, then the ones after it kept from busier frames, then a new one big
+    // enough for the allocation whatever its alignment.
+    for (;;)
+    {
+        if (m_block == m_blocks.size())
+        {
+            size_t blockSize = std::max(m_blockSize, size + alignment);
+            m_blocks.push_back({ std::make_unique<uint8_t[]>(blockSize), blockSize });
+        }
+
+        Block & block = m_blocks[m_block];
+        uintptr_t start = uintptr_t(block.memory.get());
+        uintptr_t aligned = (start + m_offset + alignment - 1) & ~uintptr_t(alignment - 1);
+        if (aligned + size <= start + block.size)
+        {
+            m_offset = size_t(aligned - start) + size;
+            m_stats.highWater = std::max(m_stats.highWater, m_used + m_offset);
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        m_used += m_offset;
+        m_offset = 0;
+        m_block++;
+    }
+}
+
+void Arena::Deallocate(void * memory, size_t size)
+{
+#if RL_ARENA_DEBUG
+    memset(memory, DeadByte, size);
+#else
+    (void)memory;
+    (void)size;
+#endif
+}
+
+void Arena::Reset()
+{
+#if RL_ARENA_DEBUG
+    for (size_t i = 0; i < m_block; i++)
+    {
+        memset(m_blocks[i].memory.get(), DeadByte, m_blocks[i].size);
+    }
+    if (m_block < m_blocks.size())
+    {
+        memset(m_blocks[m_block].memory.get(), DeadByte, m_offset);
+    }
+#endif
+
+    m_block = 0;
+    m_offset = 0;
+    m_used = 0;
+    m_stats.resets++;
+}
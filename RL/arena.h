@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+
+// With RL_ARENA_DEBUG set, memory an arena takes back is overwritten with DeadByte, so code
+// still reading it sees garbage straight away instead of last frame's data. On by default in
+// debug builds; build with -DRL_ARENA_DEBUG=1 to turn it on elsewhere.
+#if !defined(RL_ARENA_DEBUG)
+#if defined(_DEBUG)
+#define RL_ARENA_DEBUG 1
+#else
+#define RL_ARENA_DEBUG 0
+#endif
+#endif
+
+// Linear allocator for data that lives for one frame or one turn. Allocating bumps an offset
+// in the current block, and Reset rewinds to the first block in O(1), keeping every block, so
+// once the arena has grown to fit its busiest frame it takes nothing more from the heap.
+// Destructors are not run: it holds plain data, and the memory of containers using an
+// ArenaAllocator, none of which may be used after the next Reset.
+struct Arena
+{
+    static constexpr size_t DefaultBlockSize = 64 * 1024;
+    static constexpr uint8_t DeadByte = 0xdd;
+
+    explicit Arena(size_t blockSize = DefaultBlockSize);
+
+    void * Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template<typename T>
+    T * Allocate(size_t count)
+    {
+        return static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Memory is only reused after Reset; this just poisons it in debug builds.
+    void Deallocate(void * memory, size_t size);
+
+    void Reset();
+
+    // Bytes handed out since the last Reset, alignment padding included.
+    size_t Used() const { return m_used + m_offset; }
+
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> memory;
+        size_t size;
+    };
+
+    size_t m_blockSize;
+    std::vector<Block> m_blocks;
+
+    // The block allocations come from, and how much of it is taken. m_used counts what was
+    // taken from the blocks before it.
+    size_t m_block = 0;
+    size_t m_offset = 0;
+    size_t m_used = 0;
+
+    struct {
+        uint64_t resets = 0;
+        size_t highWater = 0;      // Most bytes in use between two resets.
+    } m_stats;
+};
+
+// Lets standard containers take their memory from an arena.
+template<typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena & arena) : m_arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(ArenaAllocator<U> const & other) : m_arena(other.m_arena) {}
+
+    T * allocate(size_t count) { return m_arena->Allocate<T>(count); }
+    void deallocate(T * memory, size_t count) { m_arena->Deallocate(memory, count * sizeof(T)); }
+
+    template<typename U>
+    bool operator==(ArenaAllocator<U> const & other) const { return m_arena == other.m_arena; }
+    template<typename U>
+    bool operator!=(ArenaAllocator<U> const & other) const { return m_arena != other.m_arena; }
+
+    Arena * m_arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,90 @@
+#include "pch.h"
+
+#include "camera.h"
+
+void Camera::SetViewport(uint32_t width, uint32_t height)
+{
+    m_viewWidth = width;
+    m_viewHeight = height;
+    Clamp();
+}
+
+void Camera::SetMapSize(uint32_t width, uint32_t height)
+{
+    m_mapWidth = width;
+    m_mapHeight = height;
+    Clamp();
+}
+
+void Camera::CenterOn(int32_t x, int32_t y)
+{
+    m_x = x - int32_t(m_viewWidth / 2);
+    m_y = y - int32_t(m_viewHeight / 2);
+    Clamp();
+}
+
+void Camera::Scroll(int32_t dx, int32_t dy)
+{
+    m_x += dx;
+    m_y += dy;
+    Clamp();
+}
+
+// Returns the new origin along one axis so that target stays margin cells inside the view.
+static int32_t FollowAxis(int32_t origin, int32_t target, uint32_t view, uint32_t margin)
+{
+    if (view == 0)
+    {
+        return origin;
+    }
+
+    int32_t m = int32_t(std::min(margin, (view - 1) / 2));
+    if (target - origin < m)
+    {
+        return target - m;
+    }
+    if (target - origin > int32_t(view) - 1 - m)
+    {
+        return target - (int32_t(view) - 1 - m);
+    }
+    return origin;
+}
+
+void Camera::Follow(int32_t x, int32_t y)
+{
+    m_x = FollowAxis(m_x, x, m_viewWidth, m_followMargin);
+    m_y = FollowAxis(m_y, y, m_viewHeight, m_followMargin);
+    Clamp();
+}
+
+static int32_t ClampAxis(int32_t origin, uint32_t view, uint32_t map)
+{
+    if (map <= view)
+    {
+        return -int32_t((view - map) / 2);
+    }
+    return std::min(std::max(origin, 0), int32_t(map - view));
+}
+
+void Camera::Clamp()
+{
+    m_x = ClampAxis(m_x, m_viewWidth, m_mapWidth);
+    m_y = ClampAxis(m_y, m_viewHeight, m_mapHeight);
+}
+
+VisibleRange Camera::Visible() const
+{
+    int64_t left = std::max<int64_t>(m_x, 0);
+    int64_t top = std::max<int64_t>(m_y, 0);
+    int64_t right = std::min<int64_t>(int64_t(m_x) + m_viewWidth, m_mapWidth);
+    int64_t bottom = std::min<int64_t>(int64_t(m_y) + m_viewHeight, m_mapHeight);
+
+    VisibleRange range;
+    range.mapX = int32_t(left);
+    range.mapY = int32_t(top);
+    range.screenX = int32_t(left - m_x);
+    range.screenY = int32_t(top - m_y);
+    range.width = right > left ? uint32_t(right - left) : 0;
+    range.height = bottom > top ? uint32_t(bottom - top) : 0;
+    return range;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// The part of the map that is on screen: a width x height block of tiles starting at
+// map tile (mapX, mapY), drawn starting at screen cell (screenX, screenY).
+struct VisibleRange
+{
+    int32_t screenX;
+    int32_t screenY;
+    int32_t mapX;
+    int32_t mapY;
+    uint32_t width;
+    uint32_t height;
+
+    bool Empty() const { return width == 0 || height == 0; }
+};
+
+// Maps screen cells to map tiles. Screen cell (0, 0) shows map tile (m_x, m_y);
+// the position may be negative or past the map edge, in which case those cells are blank.
+struct Camera
+{
+    // Sets the screen size in cells and the map size in tiles, then re-clamps.
+    void SetViewport(uint32_t width, uint32_t height);
+    void SetMapSize(uint32_t width, uint32_t height);
+
+    void CenterOn(int32_t x, int32_t y);
+    void Scroll(int32_t dx, int32_t dy);
+
+    // Scrolls the minimum amount that keeps the target at least m_followMargin cells from the screen edge.
+    void Follow(int32_t x, int32_t y);
+
+    // Keeps the view inside the map. Axes where the map is smaller than the screen are centred.
+    void Clamp();
+
+    // Intersection of the screen and the map.
+    VisibleRange Visible() const;
+
+    int32_t m_x = 0;
+    int32_t m_y = 0;
+    uint32_t m_viewWidth = 0;
+    uint32_t m_viewHeight = 0;
+    uint32_t m_mapWidth = 0;
+    uint32_t m_mapHeight = 0;
+    uint32_t m_followMargin = 4;
+};
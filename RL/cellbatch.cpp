@@ -0,0 +1,95 @@
+#include "pch.h"
+
+#include "cellbatch.h"
+
+void BuildCellBatches(
+    CellGrid const & grid,
+    CellRect const & region,
+    GridLayout const & layout,
+    GlyphAtlas & atlas,
+    CellBatches & batches)
+{
+    auto & spans = batches.spans;
+    batches.open.clear();
+
+    for (uint32_t y = region.top; y < region.bottom; y++)
+    {
+        Cell const * row = &grid.At(0, y);
+        int32_t top = layout.originY + int32_t(y * layout.tileHeight);
+        int32_t bottom = top + int32_t(layout.tileHeight);
+
+        // Both the runs of this row and the open spans go left to right, so one pass over
+        // each finds the span directly above a run, if there is one.
+        batches.nextOpen.clear();
+        size_t above = 0;
+        uint32_t x = region.left;
+        while (x < region.right)
+        {
+            uint32_t color = row[x].background;
+            uint32_t runLeft = x;
+            while (x < region.right && row[x].background == color)
+            {
+                x++;
+            }
+
+            int32_t left = layout.originX + int32_t(runLeft * layout.tileWidth);
+            int32_t right = layout.originX + int32_t(x * layout.tileWidth);
+            while (above < batches.open.size() && spans[batches.open[above]].left < left)
+            {
+                above++;
+            }
+
+            if (above < batches.open.size())
+            {
+                BackgroundSpan & span = spans[batches.open[above]];
+                if (span.left == left && span.right == right && span.color == color && span.bottom == top)
+                {
+                    span.bottom = bottom;
+                    batches.nextOpen.push_back(batches.open[above]);
+                    continue;
+                }
+            }
+
+            batches.nextOpen.push_back(uint32_t(spans.size()));
+            spans.push_back({ left, top, right, bottom, color });
+        }
+        std::swap(batches.open, batches.nextOpen);
+    }
+
+    BuildGlyphQuads(grid, region, layout, atlas, batches.quads);
+}
+
+void FinishCellBatches(CellBatches & batches)
+{
+    // Cells never overlap, so the order glyphs are drawn in does not matter; ties are broken by
+    // position to keep the output the same from run to run. An in-place sort, unlike a stable
+    // one, needs no buffer, so a frame allocates nothing here.
+    auto & quads = batches.quads;
+    std::sort(quads.begin(), quads.end(), [](GlyphQuad const & a, GlyphQuad const & b)
+    {
+        if (a.color != b.color)
+        {
+            return a.color < b.color;
+        }
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+
+    batches.batches.clear();
+    for (uint32_t i = 0; i < quads.size(); i++)
+    {
+        if (batches.batches.empty() || batches.batches.back().color != quads[i].color)
+        {
+            batches.batches.push_back({ quads[i].color, i, 0 });
+        }
+        batches.batches.back().count++;
+    }
+}
+
+void CompositeCellBatches(CellBatches const & batches, GlyphAtlas const & atlas, BgraSurface & surface)
+{
+    for (auto const & span : batches.spans)
+    {
+        surface.FillRect(span.left, span.top, span.right, span.bottom, span.color);
+    }
+    CompositeGlyphQuads(batches.quads, atlas, surface);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "glyphatlas.h"
+
+// A pixel rectangle of one background color: one fill.
+struct BackgroundSpan
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+    uint32_t color;
+};
+
+// A run of consecutive quads in CellBatches::quads that share a color: one brush.
+struct GlyphBatch
+{
+    uint32_t color;
+    uint32_t first;
+    uint32_t count;
+};
+
+// The draw calls for a set of dirty regions of the grid. Backgrounds are run-length encoded
+// along each row, and runs that line up with the run above are merged into one rectangle, so a
+// screen of mostly one background is a handful of fills rather than one per cell. Glyphs are
+// grouped by color so that each color is set once.
+struct CellBatches
+{
+    void Clear()
+    {
+        spans.clear();
+        quads.clear();
+        batches.clear();
+    }
+
+    std::vector<BackgroundSpan> spans;
+
+    // Sorted by color once Finish has been called.
+    std::vector<GlyphQuad> quads;
+    std::vector<GlyphBatch> batches;
+
+    // Indices of the spans that reached the row above, and that the next row can extend.
+    std::vector<uint32_t> open;
+    std::vector<uint32_t> nextOpen;
+};
+
+// Appends the background spans and glyph quads of region, rasterizing uncached glyphs on the way.
+void BuildCellBatches(
+    CellGrid const & grid,
+    CellRect const & region,
+    GridLayout const & layout,
+    GlyphAtlas & atlas,
+    CellBatches & batches);
+
+// Groups the quads of every region added since Clear by color.
+void FinishCellBatches(CellBatches & batches);
+
+// Fills every span, then blends every quad over the surface.
+void CompositeCellBatches(CellBatches const & batches, GlyphAtlas const & atlas, BgraSurface & surface);
@@ -0,0 +1,60 @@
+#pragma once
+
+// Bits of Cell::style.
+enum CellStyle : uint32_t
+{
+    CellStyle_Normal = 0,
+    CellStyle_Dim = 1 << 0,     // Outside the player's field of view.
+};
+
+// A single console cell: the codepoint to draw, the style it is drawn with, and its colors
+// as opaque 0xAARRGGBB.
+struct Cell
+{
+    char32_t glyph = U' ';
+    uint32_t style = 0;
+    uint32_t foreground = 0xffffffff;
+    uint32_t background = 0xff000000;
+};
+
+inline bool operator==(Cell const & a, Cell const & b)
+{
+    return a.glyph == b.glyph && a.style == b.style && a.foreground == b.foreground && a.background == b.background;
+}
+
+inline bool operator!=(Cell const & a, Cell const & b)
+{
+    return !(a == b);
+}
+
+// Half-open rectangle of cells: [left, right) x [top, bottom).
+struct CellRect
+{
+    uint32_t left;
+    uint32_t top;
+    uint32_t right;
+    uint32_t bottom;
+};
+
+// Row-major grid of console cells covering the whole screen.
+struct CellGrid
+{
+    void Resize(uint32_t width, uint32_t height)
+    {
+        m_width = width;
+        m_height = height;
+        m_cells.assign(size_t(width) * height, Cell{});
+    }
+
+    void Clear(Cell cell = {})
+    {
+        std::fill(m_cells.begin(), m_cells.end(), cell);
+    }
+
+    Cell & At(uint32_t x, uint32_t y) { return m_cells[size_t(y) * m_width + x]; }
+    Cell const & At(uint32_t x, uint32_t y) const { return m_cells[size_t(y) * m_width + x]; }
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<Cell> m_cells;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+// Component types stored in the game's EntityStore.
+
+struct Position
+{
+    int32_t x;
+    int32_t y;
+};
+
+// How an entity is drawn: a glyph and its colour (0xAARRGGBB).
+struct Appearance
+{
+    char32_t glyph;
+    uint32_t color;
+};
+
+// Marks an entity as a monster that acts whenever the game's TurnScheduler says it is ready.
+struct Monster
+{
+    uint16_t kind;
+    uint32_t turn; // id in the TurnScheduler
+};
+
+// The entity has a field of view, kept in the game's FovSystem at this index.
+struct Sight
+{
+    uint32_t viewer;
+};
@@ -1,19 +1,12 @@
 #include "pch.h"
 
 #include "deviceresources.h"
+#include "profiler.h"
 
 using namespace Microsoft::WRL;
 
-DeviceResources::DeviceResources()
+void DeviceResources::InitializeD2DFactory()
 {
-    InitializeDeviceIndependentResources();
-    InitializeDeviceResources();
-}
-
-void DeviceResources::InitializeDeviceIndependentResources()
-{
-    DeviceIndependentResources resources = {};
-
     // Initialize Direct2D resources.
     D2D1_FACTORY_OPTIONS options;
     ZeroMemory(&options, sizeof(D2D1_FACTORY_OPTIONS));
@@ -23,35 +16,39 @@ void DeviceResources::InitializeDeviceIndependentResources()
     options.debugLevel = D2D1_DEBUG_LEVEL_INFORMATION;
 #endif
 
-    // Initialize the Direct2D Factory.
+    // Initialize the Direct2D Factory. Startup creates the D2D device and the renderer's glyph
+    // target from it on different threads, so it has to be multithreaded.
     ReturnIfFailed(D2D1CreateFactory(
-        D2D1_FACTORY_TYPE_SINGLE_THREADED,
+        D2D1_FACTORY_TYPE_MULTI_THREADED,
         __uuidof(ID2D1Factory3),
         &options,
-        &resources.d2d.factory));
+        &m_deviceIndependentResources.d2d.factory));
+}
 
+void DeviceResources::InitializeDWriteFactory()
+{
     // Initialize the DirectWrite Factory.
     ReturnIfFailed(DWriteCreateFactory(
         DWRITE_FACTORY_TYPE_SHARED,
         __uuidof(IDWriteFactory3),
-        &resources.dwrite.factory
+        &m_deviceIndependentResources.dwrite.factory
     ));
+}
 
+void DeviceResources::InitializeWicFactory()
+{
     // Initialize the Windows Imaging Component (WIC) Factory.
     ReturnIfFailed(CoCreateInstance(
         CLSID_WICImagingFactory2,
         nullptr,
         CLSCTX_INPROC_SERVER,
-        IID_PPV_ARGS(&resources.dwrite.wicFactory)
+        IID_PPV_ARGS(&m_deviceIndependentResources.dwrite.wicFactory)
     ));
-
-    // Store resources if initialization succeeded.
-    m_deviceIndependentResources = resources;
 }
 
-void DeviceResources::InitializeDeviceResources()
+void DeviceResources::InitializeD3DDevice()
 {
-    DeviceDependentResources resources = {};
+    auto & resources = m_deviceDependentResources;
 
     HRESULT hr = S_OK;
 
@@ -127,6 +124,11 @@ void DeviceResources::InitializeDeviceResources()
             &resources.d3d.context
         ));
     }
+}
+
+void DeviceResources::InitializeD2DDevice()
+{
+    auto & resources = m_deviceDependentResources;
 
     // Create the Direct2D device object and a corresponding context.
     ComPtr<IDXGIDevice3> dxgiDevice;
@@ -139,97 +141,112 @@ void DeviceResources::InitializeDeviceResources()
     ReturnIfFailed(resources.d2d.device->CreateDeviceContext(
         D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
         &resources.d2d.context));
-
-    // Store resources if initialization succeeded.
-    m_deviceDependentResources = resources;
 }
 
 void DeviceResources::InitializeWindowResources(winrt::Windows::UI::Core::CoreWindow const & window)
 {
-    WindowDependentResources resources = {};
+    uint32_t width = uint32_t(lround(window.Bounds().Width));
+    uint32_t height = uint32_t(lround(window.Bounds().Height));
+    if (m_windowDependentResources.d3d.swapChain)
+    {
+        ResizeWindowResources(width, height);
+        return;
+    }
+
+    // Create a new swap chain using the same adapter as the existing Direct3D device.
+    DXGI_SCALING scaling = DXGI_SCALING_NONE;
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = { 0 };
+
+    swapChainDesc.Width = width;                                            // Match the size of the window.
+    swapChainDesc.Height = height;
+    swapChainDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;                      // This is the most common swap chain format.
+    swapChainDesc.Stereo = false;
+    swapChainDesc.SampleDesc.Count = 1;                                     // Don't use multi-sampling.
+    swapChainDesc.SampleDesc.Quality = 0;
+    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    swapChainDesc.BufferCount = 2;                                          // Use double-buffering to minimize latency.
+    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;            // All Windows Store apps must use this SwapEffect.
+    swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;  // Lets the render loop wait for the swap chain before drawing.
+    swapChainDesc.Scaling = scaling;
+    swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
+
+    // This sequence obtains the DXGI factory that was used to create the Direct3D device above.
+    ComPtr<IDXGIDevice3> dxgiDevice;
+    ReturnIfFailed(m_deviceDependentResources.d3d.device.As(&dxgiDevice));
+
+    ComPtr<IDXGIAdapter> dxgiAdapter;
+    ReturnIfFailed(dxgiDevice->GetAdapter(&dxgiAdapter));
+
+    ComPtr<IDXGIFactory4> dxgiFactory;
+    ReturnIfFailed(dxgiAdapter->GetParent(IID_PPV_ARGS(&dxgiFactory)));
+
+    auto & resources = m_windowDependentResources;
+    auto windowUnkown = window.as<IUnknown>();
+    HRESULT hr = dxgiFactory->CreateSwapChainForCoreWindow(
+        m_deviceDependentResources.d3d.device.Get(),
+        &*windowUnkown,
+        &swapChainDesc,
+        nullptr,
+        &resources.d3d.swapChain);
+
+    ReturnIfFailed(hr);
+
+    // Ensure that DXGI does not queue more than one frame at a time. This both reduces latency and
+    // ensures that the application will only render after each VSync, minimizing power consumption.
+    // A waitable swap chain takes its latency from the swap chain rather than the device.
+    ComPtr<IDXGISwapChain2> swapChain2;
+    ReturnIfFailed(resources.d3d.swapChain.As(&swapChain2));
+    ReturnIfFailed(swapChain2->SetMaximumFrameLatency(1));
+    resources.d3d.frameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+
+    InitializeSizeDependentResources(width, height);
+}
+
+void DeviceResources::ResizeWindowResources(uint32_t width, uint32_t height)
+{
+    ProfileScope("ResizeWindow");
+    auto & resources = m_windowDependentResources;
 
-    // Clear the previous window size specific context.
+    // The buffers can only be resized once nothing refers to them.
     ID3D11RenderTargetView* nullViews[] = { nullptr };
     m_deviceDependentResources.d3d.context->OMSetRenderTargets(ARRAYSIZE(nullViews), nullViews, nullptr);
-    m_windowDependentResources.d3d.renderTargetView = nullptr;
+    resources.d3d.renderTargetView = nullptr;
     m_deviceDependentResources.d2d.context->SetTarget(nullptr);
-    m_windowDependentResources.d2d.targetBitmap = nullptr;
-    m_windowDependentResources.d3d.depthStencilView = nullptr;
+    resources.d2d.targetBitmap = nullptr;
+    resources.d3d.depthStencilView = nullptr;
     m_deviceDependentResources.d3d.context->Flush();
 
-    // Calculate the size of the window.
-    resources.d3d.renderTargetSize.Width = window.Bounds().Width;
-    resources.d3d.renderTargetSize.Height = window.Bounds().Height;
+    HRESULT hr = resources.d3d.swapChain->ResizeBuffers(
+        2, // Double-buffered swap chain.
+        width,
+        height,
+        DXGI_FORMAT_B8G8R8A8_UNORM,
+        DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT
+    );
 
-    if (m_windowDependentResources.d3d.swapChain)
+    if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
     {
-        // If the swap chain already exists, resize it.
-        resources.d3d.swapChain = m_windowDependentResources.d3d.swapChain;
-
-        HRESULT hr = resources.d3d.swapChain->ResizeBuffers(
-            2, // Double-buffered swap chain.
-            lround(resources.d3d.renderTargetSize.Width),
-            lround(resources.d3d.renderTargetSize.Height),
-            DXGI_FORMAT_B8G8R8A8_UNORM,
-            0
-        );
+        // If the device was removed for any reason, a new device and swap chain will need to be created.
+        //HandleDeviceLost();
 
-        if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
-        {
-            // If the device was removed for any reason, a new device and swap chain will need to be created.
-            //HandleDeviceLost();
-
-            // Everything is set up now. Do not continue execution of this method. HandleDeviceLost will reenter this method 
-            // and correctly set up the new device.
-            return;
-        }
-        else
-        {
-            ReturnIfFailed(hr);
-        }
+        // Everything is set up now. Do not continue execution of this method. HandleDeviceLost will reenter this method 
+        // and correctly set up the new device.
+        return;
     }
     else
     {
-        // Otherwise, create a new one using the same adapter as the existing Direct3D device.
-        DXGI_SCALING scaling = DXGI_SCALING_NONE;
-        DXGI_SWAP_CHAIN_DESC1 swapChainDesc = { 0 };
-
-        swapChainDesc.Width = lround(resources.d3d.renderTargetSize.Width);     // Match the size of the window.
-        swapChainDesc.Height = lround(resources.d3d.renderTargetSize.Height);
-        swapChainDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;                      // This is the most common swap chain format.
-        swapChainDesc.Stereo = false;
-        swapChainDesc.SampleDesc.Count = 1;                                     // Don't use multi-sampling.
-        swapChainDesc.SampleDesc.Quality = 0;
-        swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-        swapChainDesc.BufferCount = 2;                                          // Use double-buffering to minimize latency.
-        swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;            // All Windows Store apps must use this SwapEffect.
-        swapChainDesc.Flags = 0;
-        swapChainDesc.Scaling = scaling;
-        swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
-
-        // This sequence obtains the DXGI factory that was used to create the Direct3D device above.
-        ComPtr<IDXGIDevice3> dxgiDevice;
-        ReturnIfFailed(m_deviceDependentResources.d3d.device.As(&dxgiDevice));
-
-        ComPtr<IDXGIAdapter> dxgiAdapter;
-        ReturnIfFailed(dxgiDevice->GetAdapter(&dxgiAdapter));
-
-        ComPtr<IDXGIFactory4> dxgiFactory;
-        ReturnIfFailed(dxgiAdapter->GetParent(IID_PPV_ARGS(&dxgiFactory)));
-
-        auto windowUnkown = window.as<IUnknown>();
-        HRESULT hr = dxgiFactory->CreateSwapChainForCoreWindow(
-            m_deviceDependentResources.d3d.device.Get(),
-            &*windowUnkown,
-            &swapChainDesc,
-            nullptr,
-            &resources.d3d.swapChain);
-
-        // Ensure that DXGI does not queue more than one frame at a time. This both reduces latency and
-        // ensures that the application will only render after each VSync, minimizing power consumption.
-        ReturnIfFailed(dxgiDevice->SetMaximumFrameLatency(1));
+        ReturnIfFailed(hr);
     }
 
+    InitializeSizeDependentResources(width, height);
+}
+
+void DeviceResources::InitializeSizeDependentResources(uint32_t width, uint32_t height)
+{
+    auto & resources = m_windowDependentResources;
+    resources.d3d.renderTargetSize.Width = float(width);
+    resources.d3d.renderTargetSize.Height = float(height);
+
     // Create a render target view of the swap chain back buffer.
     ComPtr<ID3D11Texture2D1> backBuffer;
     ReturnIfFailed(resources.d3d.swapChain->GetBuffer(0, IID_PPV_ARGS(&backBuffer)));
@@ -240,26 +257,29 @@ void DeviceResources::InitializeWindowResources(winrt::Windows::UI::Core::CoreWi
         &resources.d3d.renderTargetView));
 
     // Create a depth stencil view for use with 3D rendering if needed.
-    CD3D11_TEXTURE2D_DESC depthStencilDesc(
-        DXGI_FORMAT_D24_UNORM_S8_UINT,
-        lround(resources.d3d.renderTargetSize.Width),
-        lround(resources.d3d.renderTargetSize.Height),
-        1, // This depth stencil view has only one texture.
-        1, // Use a single mipmap level.
-        D3D11_BIND_DEPTH_STENCIL
-    );
+    if (m_useDepthStencil)
+    {
+        CD3D11_TEXTURE2D_DESC depthStencilDesc(
+            DXGI_FORMAT_D24_UNORM_S8_UINT,
+            width,
+            height,
+            1, // This depth stencil view has only one texture.
+            1, // Use a single mipmap level.
+            D3D11_BIND_DEPTH_STENCIL
+        );
 
-    ComPtr<ID3D11Texture2D> depthStencil;
-    ReturnIfFailed(m_deviceDependentResources.d3d.device->CreateTexture2D(
-        &depthStencilDesc,
-        nullptr,
-        &depthStencil));
+        ComPtr<ID3D11Texture2D> depthStencil;
+        ReturnIfFailed(m_deviceDependentResources.d3d.device->CreateTexture2D(
+            &depthStencilDesc,
+            nullptr,
+            &depthStencil));
 
-    CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D);
-    ReturnIfFailed(m_deviceDependentResources.d3d.device->CreateDepthStencilView(
-        depthStencil.Get(),
-        &depthStencilViewDesc,
-        &resources.d3d.depthStencilView));
+        CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D);
+        ReturnIfFailed(m_deviceDependentResources.d3d.device->CreateDepthStencilView(
+            depthStencil.Get(),
+            &depthStencilViewDesc,
+            &resources.d3d.depthStencilView));
+    }
 
     // Set the 3D rendering viewport to target the entire window.
     resources.d3d.screenViewport = CD3D11_VIEWPORT(
@@ -294,28 +314,39 @@ void DeviceResources::InitializeWindowResources(winrt::Windows::UI::Core::CoreWi
 
     // Grayscale text anti-aliasing is recommended for all Windows Store apps.
     m_deviceDependentResources.d2d.context->SetTextAntialiasMode(D2D1_TEXT_ANTIALIAS_MODE_GRAYSCALE);
-
-    m_windowDependentResources = resources;
 }
 
-void DeviceResources::Present()
+void DeviceResources::Present(std::vector<RECT> const & dirtyRects)
 {
+    ProfileScope("Present");
+
     Microsoft::WRL::ComPtr<ID3D11DeviceContext3> context;
     ReturnIfFailed(m_deviceDependentResources.d3d.context.As(&context));
 
+    // Dirty rectangles let DXGI compose only the parts of the frame that changed.
+    DXGI_PRESENT_PARAMETERS parameters = { 0 };
+    parameters.DirtyRectsCount = UINT(dirtyRects.size());
+    parameters.pDirtyRects = dirtyRects.empty() ? nullptr : const_cast<RECT *>(dirtyRects.data());
+
     // The first argument instructs DXGI to block until VSync, putting the application
     // to sleep until the next VSync. This ensures we don't waste any cycles rendering
     // frames that will never be displayed to the screen.
-    DXGI_PRESENT_PARAMETERS parameters = { 0 };
     HRESULT hr = m_windowDependentResources.d3d.swapChain->Present1(1, 0, &parameters);
+    m_frameReady = false;
 
     // Discard the contents of the render target.
     // This is a valid operation only when the existing contents will be entirely
-    // overwritten. If dirty or scroll rects are used, this call should be removed.
-    context->DiscardView1(m_windowDependentResources.d3d.renderTargetView.Get(), nullptr, 0);
+    // overwritten, so it is skipped when only the dirty rectangles were redrawn.
+    if (dirtyRects.empty())
+    {
+        context->DiscardView1(m_windowDependentResources.d3d.renderTargetView.Get(), nullptr, 0);
+    }
 
-    // Discard the contents of the depth stencil.
-    context->DiscardView1(m_windowDependentResources.d3d.depthStencilView.Get(), nullptr, 0);
+    // Discard the contents of the depth stencil, if there is one.
+    if (m_windowDependentResources.d3d.depthStencilView)
+    {
+        context->DiscardView1(m_windowDependentResources.d3d.depthStencilView.Get(), nullptr, 0);
+    }
 
     // If the device was removed either by a disconnection or a driver upgrade, we 
     // must recreate all device resources.
@@ -328,3 +359,26 @@ void DeviceResources::Present()
         ReturnIfFailed(hr);
     }
 }
+
+void DeviceResources::WaitForVBlank()
+{
+    ProfileScope("WaitForVBlank");
+    Microsoft::WRL::ComPtr<IDXGIOutput> output;
+    ReturnIfFailed(m_windowDependentResources.d3d.swapChain->GetContainingOutput(&output));
+    ReturnIfFailed(output->WaitForVBlank());
+}
+
+void DeviceResources::WaitForFrame()
+{
+    HANDLE waitable = m_windowDependentResources.d3d.frameLatencyWaitable;
+    if (m_frameReady || !waitable)
+    {
+        return;
+    }
+
+    // The swap chain signals once per finished present, so a wait that was not followed by a
+    // present is kept for the next frame rather than waited for again.
+    ProfileScope("WaitForFrame");
+    WaitForSingleObjectEx(waitable, 1000, TRUE);
+    m_frameReady = true;
+}
@@ -1,12 +1,22 @@
 #pragma once
 
-#define ReturnIfFailed(hr) { if (FAILED(hr)) { __debugbreak(); return; } }
+#define ReturnIfFailed(hr, ...) { if (FAILED(hr)) { __debugbreak(); return __VA_ARGS__; } }
 
+// Created in steps so startup can run them on different threads: the three factories and the
+// D3D device have no dependencies, the D2D device needs the D2D factory and the D3D device, and
+// the window resources need both devices.
 struct DeviceResources
 {
-    DeviceResources();
+    // Presents the back buffer. An empty dirtyRects presents (and then discards) the whole frame.
+    void Present(std::vector<RECT> const & dirtyRects = {});
 
-    void Present();
+    // Blocks until the next vertical blank, for frames where nothing was presented.
+    void WaitForVBlank();
+
+    // Blocks until the swap chain can take another frame without queueing it behind the last
+    // one, so a frame is drawn from the newest input rather than a frame early. Returns at once
+    // if the previous wait was not used up by a Present.
+    void WaitForFrame();
 
     struct DeviceIndependentResources
     {
@@ -19,7 +29,9 @@ struct DeviceResources
         } dwrite;
     } m_deviceIndependentResources;
 
-    void InitializeDeviceIndependentResources();
+    void InitializeD2DFactory();
+    void InitializeDWriteFactory();
+    void InitializeWicFactory();
 
     struct DeviceDependentResources
     {
@@ -34,13 +46,15 @@ struct DeviceResources
         } d2d;
     } m_deviceDependentResources;
 
-    void InitializeDeviceResources();
+    void InitializeD3DDevice();
+    void InitializeD2DDevice();
 
     struct WindowDependentResources
     {
         struct {
             winrt::Windows::Foundation::Size renderTargetSize;
             Microsoft::WRL::ComPtr<IDXGISwapChain1> swapChain;
+            HANDLE frameLatencyWaitable = nullptr;
             Microsoft::WRL::ComPtr<ID3D11RenderTargetView> renderTargetView;
             Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthStencilView;
             D3D11_VIEWPORT screenViewport;
@@ -50,5 +64,21 @@ struct DeviceResources
         } d2d;
     } m_windowDependentResources;
 
+    // Creates the swap chain at the window's size, or resizes it if it exists.
     void InitializeWindowResources(winrt::Windows::UI::Core::CoreWindow const & window);
+
+    // Resizes the swap chain's buffers and recreates the views of them. Flushes the context, so
+    // call it at most once a frame; the render loop coalesces size changes to do so.
+    void ResizeWindowResources(uint32_t width, uint32_t height);
+
+    // The render target view, viewport, optional depth stencil and D2D target of the current
+    // back buffer.
+    void InitializeSizeDependentResources(uint32_t width, uint32_t height);
+
+    // The console is drawn in 2D and needs no depth stencil buffer; set this before creating
+    // the window resources to have one made at every size.
+    bool m_useDepthStencil = false;
+
+    // Set by WaitForFrame and cleared by Present.
+    bool m_frameReady = false;
 };
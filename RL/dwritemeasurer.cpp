@@ -0,0 +1,65 @@
+#include "pch.h"
+
+#include "deviceresources.h"
+#include "dwritemeasurer.h"
+
+using namespace Microsoft::WRL;
+
+TextMeasurer CreateDWriteMeasurer(IDWriteTextFormat * format, float cellWidth)
+{
+    // The text format only names its font; find the face it resolves to.
+    ComPtr<IDWriteFontCollection> collection;
+    ReturnIfFailed(format->GetFontCollection(&collection), MonospaceWidth);
+
+    WCHAR familyName[128];
+    ReturnIfFailed(format->GetFontFamilyName(familyName, ARRAYSIZE(familyName)), MonospaceWidth);
+
+    UINT32 familyIndex = 0;
+    BOOL exists = FALSE;
+    ReturnIfFailed(collection->FindFamilyName(familyName, &familyIndex, &exists), MonospaceWidth);
+    if (!exists)
+    {
+        return MonospaceWidth;
+    }
+
+    ComPtr<IDWriteFontFamily> family;
+    ReturnIfFailed(collection->GetFontFamily(familyIndex, &family), MonospaceWidth);
+
+    ComPtr<IDWriteFont> font;
+    ReturnIfFailed(family->GetFirstMatchingFont(format->GetFontWeight(), format->GetFontStretch(), format->GetFontStyle(), &font), MonospaceWidth);
+
+    ComPtr<IDWriteFontFace> face;
+    ReturnIfFailed(font->CreateFontFace(&face), MonospaceWidth);
+
+    DWRITE_FONT_METRICS metrics;
+    face->GetMetrics(&metrics);
+    float pixelsPerDesignUnit = format->GetFontSize() / metrics.designUnitsPerEm;
+
+    // Layout only measures text it has not seen, but the same few codepoints come up again and
+    // again, so remember every answer.
+    auto widths = std::make_shared<std::unordered_map<char32_t, uint32_t>>();
+    return [face, pixelsPerDesignUnit, cellWidth, widths](char32_t codepoint) -> uint32_t
+    {
+        auto found = widths->find(codepoint);
+        if (found != widths->end())
+        {
+            return found->second;
+        }
+
+        UINT32 value = codepoint;
+        UINT16 glyph = 0;
+        uint32_t cells = MonospaceWidth(codepoint);
+        if (SUCCEEDED(face->GetGlyphIndices(&value, 1, &glyph)) && glyph != 0)
+        {
+            DWRITE_GLYPH_METRICS glyphMetrics;
+            if (SUCCEEDED(face->GetDesignGlyphMetrics(&glyph, 1, &glyphMetrics)))
+            {
+                float advance = glyphMetrics.advanceWidth * pixelsPerDesignUnit;
+                cells = advance <= 0.0f ? 0 : std::max<uint32_t>(1, uint32_t(lround(advance / cellWidth)));
+            }
+        }
+
+        widths->emplace(codepoint, cells);
+        return cells;
+    };
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "textlayout.h"
+
+// Measures codepoints with the font of a DirectWrite text format: each glyph's advance, rounded
+// to whole cells of cellWidth pixels, so zero-width and double-width glyphs take the cells they
+// draw in. Codepoints the font has no glyph for are measured with MonospaceWidth.
+TextMeasurer CreateDWriteMeasurer(IDWriteTextFormat * format, float cellWidth);
@@ -0,0 +1,157 @@
+#include "pch.h"
+
+#include "entities.h"
+
+#include <atomic>
+
+static std::atomic<uint32_t> s_componentCount{ 0 };
+static uint32_t s_componentSizes[MaxComponentTypes];
+
+uint32_t RegisterComponent(uint32_t size)
+{
+    uint32_t id = s_componentCount++;
+    if (id >= MaxComponentTypes)
+    {
+        // More component types than mask bits is a programming error.
+        std::abort();
+    }
+    s_componentSizes[id] = size;
+    return id;
+}
+
+uint32_t ComponentSize(uint32_t id)
+{
+    return s_componentSizes[id];
+}
+
+Archetype::Archetype(ComponentMask mask)
+    : m_mask(mask)
+{
+    std::fill(std::begin(m_columnIndex), std::end(m_columnIndex), int8_t(-1));
+    for (uint32_t id = 0; id < MaxComponentTypes; id++)
+    {
+        if (mask & (ComponentMask(1) << id))
+        {
+            m_columnIndex[id] = int8_t(m_columns.size());
+            m_columns.push_back({ id, ComponentSize(id), {} });
+        }
+    }
+}
+
+uint32_t Archetype::AddRow(EntityHandle entity)
+{
+    for (auto & column : m_columns)
+    {
+        column.data.resize(column.data.size() + column.size);
+    }
+    m_entities.push_back(entity);
+    return uint32_t(m_entities.size() - 1);
+}
+
+EntityHandle Archetype::RemoveRow(uint32_t row)
+{
+    uint32_t last = uint32_t(m_entities.size() - 1);
+    EntityHandle moved;
+    if (row != last)
+    {
+        for (auto & column : m_columns)
+        {
+            memcpy(column.data.data() + size_t(row) * column.size, column.data.data() + size_t(last) * column.size, column.size);
+        }
+        m_entities[row] = m_entities[last];
+        moved = m_entities[row];
+    }
+
+    for (auto & column : m_columns)
+    {
+        column.data.resize(column.data.size() - column.size);
+    }
+    m_entities.pop_back();
+    return moved;
+}
+
+EntityHandle EntityStore::Allocate()
+{
+    EntityHandle entity;
+    if (!m_freeIndices.empty())
+    {
+        entity.index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+    }
+    else
+    {
+        entity.index = uint32_t(m_records.size());
+        m_records.push_back({ UINT32_MAX, 0, 0 });
+    }
+    entity.generation = m_records[entity.index].generation;
+    return entity;
+}
+
+uint32_t EntityStore::FindArchetype(ComponentMask mask)
+{
+    auto it = m_archetypeByMask.find(mask);
+    if (it != m_archetypeByMask.end())
+    {
+        return it->second;
+    }
+
+    uint32_t index = uint32_t(m_archetypes.size());
+    m_archetypeByMask.emplace(mask, index);
+    m_archetypes.push_back(std::make_unique<Archetype>(mask));
+    return index;
+}
+
+void EntityStore::Place(EntityHandle entity, uint32_t archetype, uint32_t row)
+{
+    Record & record = m_records[entity.index];
+    record.archetype = archetype;
+    record.row = row;
+}
+
+void EntityStore::Destroy(EntityHandle entity)
+{
+    if (!IsAlive(entity))
+    {
+        return;
+    }
+
+    Record & record = m_records[entity.index];
+    EntityHandle moved = m_archetypes[record.archetype]->RemoveRow(record.row);
+    if (moved.index != UINT32_MAX)
+    {
+        m_records[moved.index].row = record.row;
+    }
+
+    record.archetype = UINT32_MAX;
+    record.generation++;
+    m_freeIndices.push_back(entity.index);
+}
+
+void EntityStore::Move(EntityHandle entity, ComponentMask mask)
+{
+    Record & record = m_records[entity.index];
+    Archetype & source = *m_archetypes[record.archetype];
+    if (source.m_mask == mask)
+    {
+        return;
+    }
+
+    // FindArchetype may grow m_archetypes, but the tables themselves do not move.
+    uint32_t destinationIndex = FindArchetype(mask);
+    Archetype & destination = *m_archetypes[destinationIndex];
+    uint32_t row = destination.AddRow(entity);
+    for (auto const & column : source.m_columns)
+    {
+        if (destination.Has(column.component))
+        {
+            memcpy(destination.Element(column.component, row), source.Element(column.component, record.row), column.size);
+        }
+    }
+
+    EntityHandle moved = source.RemoveRow(record.row);
+    if (moved.index != UINT32_MAX)
+    {
+        m_records[moved.index].row = record.row;
+    }
+    Place(entity, destinationIndex, row);
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+// Generational handle to an entity. A handle goes stale when its entity is destroyed,
+// even if the slot is reused by a new entity.
+struct EntityHandle
+{
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+inline bool operator==(EntityHandle const & a, EntityHandle const & b)
+{
+    return a.index == b.index && a.generation == b.generation;
+}
+
+inline bool operator!=(EntityHandle const & a, EntityHandle const & b)
+{
+    return !(a == b);
+}
+
+// One bit per component type.
+using ComponentMask = uint64_t;
+static const uint32_t MaxComponentTypes = 64;
+
+// Assigns the next component id and records its size. Use ComponentId<T>() instead.
+uint32_t RegisterComponent(uint32_t size);
+uint32_t ComponentSize(uint32_t id);
+
+// Components are plain data: they are moved between tables with memcpy.
+template<typename T>
+uint32_t ComponentId()
+{
+    static_assert(std::is_trivially_copyable<T>::value, "components must be trivially copyable");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "components must not be over-aligned");
+    static const uint32_t id = RegisterComponent(uint32_t(sizeof(T)));
+    return id;
+}
+
+template<typename... Ts>
+ComponentMask MaskOf()
+{
+    ComponentMask mask = 0;
+    for (uint32_t id : { ComponentId<Ts>()..., MaxComponentTypes })
+    {
+        if (id < MaxComponentTypes)
+        {
+            mask |= ComponentMask(1) << id;
+        }
+    }
+    return mask;
+}
+
+// Table of every entity with exactly one set of components, one contiguous column per component.
+struct Archetype
+{
+    struct Column
+    {
+        uint32_t component;
+        uint32_t size;
+        std::vector<uint8_t> data;
+    };
+
+    explicit Archetype(ComponentMask mask);
+
+    size_t Size() const { return m_entities.size(); }
+
+    bool Has(uint32_t component) const { return m_columnIndex[component] >= 0; }
+
+    template<typename T>
+    T * Data()
+    {
+        return reinterpret_cast<T *>(m_columns[m_columnIndex[ComponentId<T>()]].data.data());
+    }
+
+    void * Element(uint32_t component, uint32_t row)
+    {
+        Column & column = m_columns[m_columnIndex[component]];
+        return column.data.data() + size_t(row) * column.size;
+    }
+
+    // Appends a zeroed row for entity and returns its index.
+    uint32_t AddRow(EntityHandle entity);
+
+    // Removes row by moving the last row into it. Returns the entity that moved, if any.
+    EntityHandle RemoveRow(uint32_t row);
+
+    ComponentMask m_mask;
+    std::vector<Column> m_columns;
+    int8_t m_columnIndex[MaxComponentTypes];
+    std::vector<EntityHandle> m_entities;
+};
+
+// Entity store grouping entities by component set into structure-of-arrays archetype tables.
+// Adding and removing entities is O(1) (swap-remove), and queries walk contiguous columns.
+struct EntityStore
+{
+    template<typename... Ts>
+    EntityHandle Create(Ts const & ... components)
+    {
+        EntityHandle entity = Allocate();
+        uint32_t index = FindArchetype(MaskOf<Ts...>());
+        Archetype & archetype = *m_archetypes[index];
+        uint32_t row = archetype.AddRow(entity);
+        Place(entity, index, row);
+
+        int expand[] = { 0, (*reinterpret_cast<Ts *>(archetype.Element(ComponentId<Ts>(), row)) = components, 0)... };
+        (void)expand;
+        return entity;
+    }
+
+    void Destroy(EntityHandle entity);
+
+    bool IsAlive(EntityHandle entity) const
+    {
+        return entity.index < m_records.size() && m_records[entity.index].generation == entity.generation && m_records[entity.index].archetype != UINT32_MAX;
+    }
+
+    // Returns the entity's component, or null if it is dead or does not have one.
+    template<typename T>
+    T * Get(EntityHandle entity)
+    {
+        if (!IsAlive(entity))
+        {
+            return nullptr;
+        }
+
+        Record const & record = m_records[entity.index];
+        Archetype & archetype = *m_archetypes[record.archetype];
+        uint32_t id = ComponentId<T>();
+        return archetype.Has(id) ? static_cast<T *>(archetype.Element(id, record.row)) : nullptr;
+    }
+
+    // Adds (or overwrites) a component, moving the entity to the matching archetype.
+    template<typename T>
+    void Add(EntityHandle entity, T const & component)
+    {
+        if (!IsAlive(entity))
+        {
+            return;
+        }
+
+        uint32_t id = ComponentId<T>();
+        Move(entity, m_archetypes[m_records[entity.index].archetype]->m_mask | (ComponentMask(1) << id));
+        *Get<T>(entity) = component;
+    }
+
+    template<typename T>
+    void Remove(EntityHandle entity)
+    {
+        if (IsAlive(entity))
+        {
+            Move(entity, m_archetypes[m_records[entity.index].archetype]->m_mask & ~(ComponentMask(1) << ComponentId<T>()));
+        }
+    }
+
+    // Calls fn(count, entities, Ts * columns...) once per archetype that has every T.
+    template<typename... Ts, typename Fn>
+    void ForEachChunk(Fn && fn)
+    {
+        ComponentMask mask = MaskOf<Ts...>();
+        for (auto & archetype : m_archetypes)
+        {
+            if ((archetype->m_mask & mask) == mask && archetype->Size() > 0)
+            {
+                fn(archetype->Size(), archetype->m_entities.data(), archetype->template Data<Ts>()...);
+            }
+        }
+    }
+
+    // Calls fn(Ts & components...) for every entity that has every T.
+    template<typename... Ts, typename Fn>
+    void Each(Fn && fn)
+    {
+        ForEachChunk<Ts...>([&](size_t count, EntityHandle const *, Ts * ... columns)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                fn(columns[i]...);
+            }
+        });
+    }
+
+    template<typename... Ts>
+    size_t Count() const
+    {
+        ComponentMask mask = MaskOf<Ts...>();
+        size_t count = 0;
+        for (auto const & archetype : m_archetypes)
+        {
+            if ((archetype->m_mask & mask) == mask)
+            {
+                count += archetype->Size();
+            }
+        }
+        return count;
+    }
+
+    struct Record
+    {
+        uint32_t archetype;
+        uint32_t row;
+        uint32_t generation;
+    };
+
+    EntityHandle Allocate();
+    uint32_t FindArchetype(ComponentMask mask);
+    void Place(EntityHandle entity, uint32_t archetype, uint32_t row);
+    void Move(EntityHandle entity, ComponentMask mask);
+
+    // Archetypes are held by pointer so tables stay put while new ones are created.
+    std::vector<std::unique_ptr<Archetype>> m_archetypes;
+    std::unordered_map<ComponentMask, uint32_t> m_archetypeByMask;
+    std::vector<Record> m_records;
+    std::vector<uint32_t> m_freeIndices;
+};
@@ -0,0 +1,63 @@
+#include "pch.h"
+
+#include "files.h"
+
+#if defined(_WIN32)
+std::wstring Widen(std::string const & text)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), int(text.size()), nullptr, 0);
+    std::wstring wide(size_t(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), int(text.size()), &wide[0], length);
+    return wide;
+}
+#endif
+
+FILE * OpenFile(std::string const & path, char const * mode)
+{
+#if defined(_WIN32)
+    FILE * file = nullptr;
+    return _wfopen_s(&file, Widen(path).c_str(), Widen(mode).c_str()) == 0 ? file : nullptr;
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+void RemoveFile(std::string const & path)
+{
+#if defined(_WIN32)
+    _wremove(Widen(path).c_str());
+#else
+    remove(path.c_str());
+#endif
+}
+
+bool MoveOver(std::string const & from, std::string const & to)
+{
+#if defined(_WIN32)
+    return MoveFileExW(Widen(from).c_str(), Widen(to).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    // A mapping of the old file stays valid: it keeps the old inode alive.
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool ReadFile(std::string const & path, std::vector<uint8_t> & contents)
+{
+    FILE * file = OpenFile(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    contents.clear();
+    uint8_t block[64 * 1024];
+    size_t read;
+    while ((read = fread(block, 1, sizeof(block), file)) > 0)
+    {
+        contents.insert(contents.end(), block, block + read);
+    }
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
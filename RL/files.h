@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdio>
+
+// File helpers taking UTF-8 paths on every platform.
+
+#if defined(_WIN32)
+std::wstring Widen(std::string const & text);
+#endif
+
+// fopen with a UTF-8 path. Returns null on failure.
+FILE * OpenFile(std::string const & path, char const * mode);
+
+void RemoveFile(std::string const & path);
+
+// Renames from to to, replacing to if it exists.
+bool MoveOver(std::string const & from, std::string const & to);
+
+// Reads a whole file. Returns false if it could not be opened or read.
+bool ReadFile(std::string const & path, std::vector<uint8_t> & contents);
@@ -0,0 +1,374 @@
+#include "pch.h"
+
+#include "flowfield.h"
+
+static const int32_t NeighborOffsets[8][2] = {
+    { -1, -1 }, { 0, -1 }, { 1, -1 },
+    { -1, 0 }, { 1, 0 },
+    { -1, 1 }, { 0, 1 }, { 1, 1 },
+};
+
+// Rows per band below which splitting the sweep across the job system is not worth it.
+static const uint32_t MinimumBandRows = 64;
+
+// One more step than d, saturating at Unreachable.
+static inline uint16_t Step(uint16_t d)
+{
+    return uint16_t(d + (d != FlowField::Unreachable));
+}
+
+void FlowField::Reset(WorldMap const & map)
+{
+    m_width = map.m_width;
+    m_height = map.m_height;
+    m_blocked.resize(size_t(m_width) * m_height);
+    ResetRegion(map, 0, 0, m_width, m_height);
+}
+
+void FlowField::ResetRegion(WorldMap const & map, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom)
+{
+    if (m_width != map.m_width || m_height != map.m_height || m_blocked.empty())
+    {
+        // Nothing cached yet; the next build reads the whole map.
+        return;
+    }
+
+    bottom = std::min(bottom, m_height);
+    for (uint32_t y = top; y < bottom; y++)
+    {
+        uint16_t * blocked = m_blocked.data() + size_t(y) * m_width;
+        map.ForEachRowSpan(y, left, right, [&](uint32_t x, uint32_t count, MapChunk const & chunk, uint32_t index)
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                blocked[x + i] = IsBlocked(chunk.tiles[index + i]) ? Unreachable : 0;
+            }
+        });
+    }
+}
+
+void FlowField::Build(WorldMap const & map, Goal const * goals, size_t count, uint16_t maxDistance)
+{
+    if (m_width != map.m_width || m_height != map.m_height || m_blocked.empty())
+    {
+        Reset(map);
+    }
+    m_distance.assign(m_blocked.size(), Unreachable);
+    m_maxDistance = std::min<uint16_t>(maxDistance, Unreachable - 1);
+
+    m_queue.clear();
+    for (size_t g = 0; g < count; g++)
+    {
+        Goal const & goal = goals[g];
+        if (map.Contains(goal.x, goal.y))
+        {
+            size_t i = size_t(goal.y) * m_width + goal.x;
+            if (!m_blocked[i] && m_distance[i] != 0)
+            {
+                m_distance[i] = 0;
+                m_queue.push_back(uint32_t(i));
+            }
+        }
+    }
+
+    Propagate(0);
+}
+
+// Breadth-first relaxation of every tile in m_queue from position head onwards. Distances only decrease.
+void FlowField::Propagate(size_t head)
+{
+    for (; head < m_queue.size(); head++)
+    {
+        uint32_t index = m_queue[head];
+        uint16_t next = uint16_t(m_distance[index] + 1);
+        if (next > m_maxDistance)
+        {
+            continue;
+        }
+
+        int32_t x = int32_t(index % m_width);
+        int32_t y = int32_t(index / m_width);
+        for (auto const & offset : NeighborOffsets)
+        {
+            int32_t nx = x + offset[0];
+            int32_t ny = y + offset[1];
+            if (nx < 0 || ny < 0 || uint32_t(nx) >= m_width || uint32_t(ny) >= m_height)
+            {
+                continue;
+            }
+
+            size_t n = size_t(ny) * m_width + nx;
+            if (!m_blocked[n] && m_distance[n] > next)
+            {
+                m_distance[n] = next;
+                m_queue.push_back(uint32_t(n));
+            }
+        }
+    }
+    m_queue.clear();
+}
+
+void FlowField::SetBlocked(int32_t x, int32_t y, bool blocked)
+{
+    if (x < 0 || y < 0 || uint32_t(x) >= m_width || uint32_t(y) >= m_height)
+    {
+        return;
+    }
+
+    size_t index = size_t(y) * m_width + x;
+    if (bool(m_blocked[index]) == blocked)
+    {
+        return;
+    }
+
+    auto forEachNeighbor = [&](uint32_t i, auto && fn)
+    {
+        int32_t cx = int32_t(i % m_width);
+        int32_t cy = int32_t(i / m_width);
+        for (auto const & offset : NeighborOffsets)
+        {
+            int32_t nx = cx + offset[0];
+            int32_t ny = cy + offset[1];
+            if (nx >= 0 && ny >= 0 && uint32_t(nx) < m_width && uint32_t(ny) < m_height)
+            {
+                fn(uint32_t(size_t(ny) * m_width + nx));
+            }
+        }
+    };
+
+    m_queue.clear();
+    if (!blocked)
+    {
+        // An opened tile can only shorten paths: take the best neighbour and spread outwards.
+        m_blocked[index] = 0;
+        uint16_t best = Unreachable;
+        forEachNeighbor(uint32_t(index), [&](uint32_t n) { best = std::min(best, m_distance[n]); });
+        if (best < m_maxDistance)
+        {
+            m_distance[index] = uint16_t(best + 1);
+            m_queue.push_back(uint32_t(index));
+        }
+        Propagate(0);
+        return;
+    }
+
+    // A blocked tile can only lengthen paths. First raise every tile whose only shortest path ran
+    // through it, level by level, then re-seed the raised tiles from their neighbours.
+    uint16_t old = m_distance[index];
+    m_blocked[index] = Unreachable;
+    m_distance[index] = Unreachable;
+    if (old == Unreachable)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> raised;
+    raised.push_back(uint32_t(index));
+    m_queue.push_back(uint32_t(index));
+    std::vector<uint16_t> levels(1, old);
+
+    for (size_t head = 0; head < m_queue.size(); head++)
+    {
+        uint16_t level = levels[head];
+        forEachNeighbor(m_queue[head], [&](uint32_t n)
+        {
+            uint16_t d = m_distance[n];
+            if (m_blocked[n] || d != level + 1)
+            {
+                return;
+            }
+
+            // Still supported by a neighbour one step closer that was not raised?
+            bool supported = false;
+            forEachNeighbor(n, [&](uint32_t s) { supported |= m_distance[s] == d - 1; });
+            if (!supported)
+            {
+                m_distance[n] = Unreachable;
+                raised.push_back(n);
+                m_queue.push_back(n);
+                levels.push_back(d);
+            }
+        });
+    }
+
+    // Re-seed in order of the new distance so the propagation stays breadth-first.
+    std::vector<std::pair<uint16_t, uint32_t>> seeds;
+    for (uint32_t r : raised)
+    {
+        if (m_blocked[r])
+        {
+            continue;
+        }
+
+        uint16_t best = Unreachable;
+        forEachNeighbor(r, [&](uint32_t n) { best = std::min(best, m_distance[n]); });
+        if (best < m_maxDistance)
+        {
+            m_distance[r] = uint16_t(best + 1);
+            seeds.emplace_back(m_distance[r], r);
+        }
+    }
+    std::sort(seeds.begin(), seeds.end());
+
+    m_queue.clear();
+    for (auto const & seed : seeds)
+    {
+        m_queue.push_back(seed.second);
+    }
+    Propagate(0);
+}
+
+bool FlowField::NextStep(int32_t x, int32_t y, int32_t & nextX, int32_t & nextY) const
+{
+    uint16_t best = Distance(x, y);
+    bool found = false;
+    for (auto const & offset : NeighborOffsets)
+    {
+        uint16_t d = Distance(x + offset[0], y + offset[1]);
+        if (d < best)
+        {
+            best = d;
+            nextX = x + offset[0];
+            nextY = y + offset[1];
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Relaxes row from the adjacent row source, then left-to-right and right-to-left within the row.
+// Returns true if any distance decreased.
+static bool RelaxRow(uint16_t * row, uint16_t const * source, uint16_t const * blocked, uint32_t width)
+{
+    bool changed = false;
+
+    // Branch-free across the row so the compiler can vectorize it.
+    if (source)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint16_t left = source[x > 0 ? x - 1 : x];
+            uint16_t right = source[x + 1 < width ? x + 1 : x];
+            uint16_t best = std::min(std::min(left, right), source[x]);
+            uint16_t d = uint16_t(std::min(row[x], Step(best)) | blocked[x]);
+            changed |= d != row[x];
+            row[x] = d;
+        }
+    }
+
+    for (uint32_t x = 1; x < width; x++)
+    {
+        uint16_t d = uint16_t(std::min(row[x], Step(row[x - 1])) | blocked[x]);
+        changed |= d != row[x];
+        row[x] = d;
+    }
+
+    for (uint32_t x = width - 1; x-- > 0;)
+    {
+        uint16_t d = uint16_t(std::min(row[x], Step(row[x + 1])) | blocked[x]);
+        changed |= d != row[x];
+        row[x] = d;
+    }
+
+    return changed;
+}
+
+// Sweeps rows [top, bottom) down and then up. above and below are copies of the neighbouring
+// bands' edge rows, or null at the map edge, so bands never read rows another thread writes.
+bool FlowField::SweepBand(uint32_t top, uint32_t bottom, uint16_t const * above, uint16_t const * below)
+{
+    bool changed = false;
+    for (uint32_t y = top; y < bottom; y++)
+    {
+        uint16_t * row = m_distance.data() + size_t(y) * m_width;
+        uint16_t const * source = y == top ? above : row - m_width;
+        changed |= RelaxRow(row, source, m_blocked.data() + size_t(y) * m_width, m_width);
+    }
+    for (uint32_t y = bottom; y-- > top;)
+    {
+        uint16_t * row = m_distance.data() + size_t(y) * m_width;
+        uint16_t const * source = y + 1 == bottom ? below : row + m_width;
+        changed |= RelaxRow(row, source, m_blocked.data() + size_t(y) * m_width, m_width);
+    }
+    return changed;
+}
+
+void FlowField::BuildSweep(WorldMap const & map, std::vector<Goal> const & goals, JobSystem * jobs)
+{
+    if (m_width != map.m_width || m_height != map.m_height || m_blocked.empty())
+    {
+        Reset(map);
+    }
+    m_distance.assign(m_blocked.size(), Unreachable);
+    m_maxDistance = Unreachable - 1;
+    if (m_width == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    for (auto const & goal : goals)
+    {
+        if (map.Contains(goal.x, goal.y))
+        {
+            size_t i = size_t(goal.y) * m_width + goal.x;
+            if (!m_blocked[i])
+            {
+                m_distance[i] = 0;
+            }
+        }
+    }
+
+    uint32_t threads = jobs != nullptr ? jobs->Threads() : 1;
+    uint32_t bands = std::max(1u, std::min(threads, m_height / MinimumBandRows));
+    uint32_t bandRows = (m_height + bands - 1) / bands;
+    bands = (m_height + bandRows - 1) / bandRows;
+
+    // Two ghost rows per band: the row above its top and the row below its bottom.
+    m_ghostRows.resize(size_t(bands) * 2 * m_width);
+    m_bandChanged.resize(bands);
+
+    bool changed = true;
+    while (changed)
+    {
+        for (uint32_t band = 0; band < bands; band++)
+        {
+            uint32_t top = band * bandRows;
+            uint32_t bottom = std::min(top + bandRows, m_height);
+            uint16_t * ghosts = m_ghostRows.data() + size_t(band) * 2 * m_width;
+            if (top > 0)
+            {
+                std::copy_n(m_distance.data() + size_t(top - 1) * m_width, m_width, ghosts);
+            }
+            if (bottom < m_height)
+            {
+                std::copy_n(m_distance.data() + size_t(bottom) * m_width, m_width, ghosts + m_width);
+            }
+        }
+
+        auto sweep = [&](uint32_t band)
+        {
+            uint32_t top = band * bandRows;
+            uint32_t bottom = std::min(top + bandRows, m_height);
+            uint16_t const * ghosts = m_ghostRows.data() + size_t(band) * 2 * m_width;
+            return SweepBand(top, bottom, top > 0 ? ghosts : nullptr, bottom < m_height ? ghosts + m_width : nullptr);
+        };
+
+        auto range = [&](size_t begin, size_t end)
+        {
+            for (size_t band = begin; band < end; band++)
+            {
+                m_bandChanged[band] = sweep(uint32_t(band));
+            }
+        };
+        if (jobs != nullptr && bands > 1)
+        {
+            jobs->ParallelFor(0, bands, 1, range);
+        }
+        else
+        {
+            range(0, bands);
+        }
+
+        changed = std::find(m_bandChanged.begin(), m_bandChanged.end(), 1) != m_bandChanged.end();
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "jobsystem.h"
+#include "worldmap.h"
+
+// Dijkstra map over the whole world: the number of 8-connected steps from every tile to the
+// nearest goal. It is built once per turn and then any number of agents read their next step
+// from it in O(1), instead of each running its own search.
+struct FlowField
+{
+    static constexpr uint16_t Unreachable = 0xffff;
+
+    struct Goal
+    {
+        int32_t x;
+        int32_t y;
+    };
+
+    // Breadth-first build from the goals. Tiles further than maxDistance steps are left Unreachable.
+    // The blocked mask is read from the map on the first build and then kept in sync through
+    // SetBlocked; call Reset after changing terrain any other way.
+    void Build(WorldMap const & map, Goal const * goals, size_t count, uint16_t maxDistance = Unreachable - 1);
+
+    void Build(WorldMap const & map, std::vector<Goal> const & goals, uint16_t maxDistance = Unreachable - 1)
+    {
+        Build(map, goals.data(), goals.size(), maxDistance);
+    }
+
+    // Same result as Build for an unbounded distance, computed by repeated row sweeps that the
+    // compiler vectorizes, with the map split into horizontal bands run on the job system, or
+    // one band if jobs is null. Pays off on large, open maps.
+    void BuildSweep(WorldMap const & map, std::vector<Goal> const & goals, JobSystem * jobs = nullptr);
+
+    // Updates the field after a tile became blocked or open, touching only tiles whose distance changes.
+    void SetBlocked(int32_t x, int32_t y, bool blocked);
+
+    uint16_t Distance(int32_t x, int32_t y) const
+    {
+        if (x < 0 || y < 0 || uint32_t(x) >= m_width || uint32_t(y) >= m_height)
+        {
+            return Unreachable;
+        }
+        return m_distance[size_t(y) * m_width + x];
+    }
+
+    // Picks the neighbouring tile that is closest to a goal. Returns false if no neighbour
+    // is closer than (x, y) itself.
+    bool NextStep(int32_t x, int32_t y, int32_t & nextX, int32_t & nextY) const;
+
+    // Re-reads the blocked mask from the map, entirely or for the tiles [left, right) x [top, bottom).
+    void Reset(WorldMap const & map);
+    void ResetRegion(WorldMap const & map, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom);
+
+    void Propagate(size_t head);
+    bool SweepBand(uint32_t top, uint32_t bottom, uint16_t const * above, uint16_t const * below);
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint16_t m_maxDistance = Unreachable - 1;
+
+    // Row-major distances, and 0xffff for blocked tiles / 0 for open ones so sweeps can OR it in.
+    std::vector<uint16_t> m_distance;
+    std::vector<uint16_t> m_blocked;
+
+    // Scratch space reused between builds.
+    std::vector<uint32_t> m_queue;
+    std::vector<uint16_t> m_ghostRows;
+    std::vector<uint8_t> m_bandChanged;
+};
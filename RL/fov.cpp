@@ -0,0 +1,260 @@
+#include "pch.h"
+
+#include "fov.h"
+
+// Transforms from octant-local (dx, dy) to map offsets: x = dx * xx + dy * xy, y = dx * yx + dy * yy.
+static const int8_t OctantTransforms[8][4] = {
+    // xx, xy, yx, yy
+    { 1, 0, 0, 1 },
+    { 0, 1, 1, 0 },
+    { 0, -1, 1, 0 },
+    { -1, 0, 0, 1 },
+    { -1, 0, 0, -1 },
+    { 0, -1, -1, 0 },
+    { 0, 1, -1, 0 },
+    { 1, 0, 0, -1 },
+};
+
+// Below this many dirty viewers handing them to the job system costs more than it saves.
+static const size_t ParallelViewers = 64;
+static const size_t ViewerGrain = 16;
+
+void VisibilityMask::Reset(int32_t left, int32_t top, uint32_t size)
+{
+    m_left = left;
+    m_top = top;
+    m_size = size;
+    m_wordsPerRow = (size + 63) / 64;
+    m_words.assign(size_t(m_wordsPerRow) * size, 0);
+}
+
+void FovViewer::MoveTo(int32_t x, int32_t y)
+{
+    if (x != m_x || y != m_y)
+    {
+        m_x = x;
+        m_y = y;
+        m_dirtyOctants = 0xff;
+    }
+}
+
+void FovViewer::SetRadius(uint32_t radius)
+{
+    if (radius != m_radius)
+    {
+        m_radius = radius;
+        m_dirtyOctants = 0xff;
+    }
+}
+
+void FovViewer::OnTileChanged(int32_t x, int32_t y)
+{
+    int32_t ox = x - m_x;
+    int32_t oy = y - m_y;
+    if (int64_t(ox) * ox + int64_t(oy) * oy > int64_t(m_radius) * m_radius)
+    {
+        return;
+    }
+
+    if (ox == 0 && oy == 0)
+    {
+        m_dirtyOctants = 0xff;
+        return;
+    }
+
+    // The transforms are signed permutations, so their inverse is the transpose.
+    for (uint32_t octant = 0; octant < 8; octant++)
+    {
+        auto const & t = OctantTransforms[octant];
+        int32_t dx = ox * t[0] + oy * t[2];
+        int32_t dy = ox * t[1] + oy * t[3];
+        if (dy > 0 && dx >= 0 && dx <= dy)
+        {
+            m_dirtyOctants |= uint8_t(1 << octant);
+        }
+    }
+}
+
+void FovViewer::OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    // Distance from the viewer to the nearest tile of the region.
+    int64_t dx = std::max({ int64_t(left) - m_x, int64_t(m_x) - (right - 1), int64_t(0) });
+    int64_t dy = std::max({ int64_t(top) - m_y, int64_t(m_y) - (bottom - 1), int64_t(0) });
+    if (dx * dx + dy * dy <= int64_t(m_radius) * m_radius)
+    {
+        m_dirtyOctants = 0xff;
+    }
+}
+
+bool FovViewer::Update(WorldMap const & map)
+{
+    if (!m_dirtyOctants)
+    {
+        return false;
+    }
+
+    int32_t left = m_x - int32_t(m_radius);
+    int32_t top = m_y - int32_t(m_radius);
+    uint32_t size = m_radius * 2 + 1;
+
+    for (uint32_t octant = 0; octant < 8; octant++)
+    {
+        VisibilityMask & mask = m_octants[octant];
+        if (mask.m_left != left || mask.m_top != top || mask.m_size != size)
+        {
+            mask.Reset(left, top, size);
+            m_dirtyOctants |= uint8_t(1 << octant);
+        }
+
+        if (m_dirtyOctants & (1 << octant))
+        {
+            mask.Clear();
+            CastOctant(map, octant, mask, 1, 1.0f, 0.0f);
+        }
+    }
+    m_dirtyOctants = 0;
+
+    if (m_visible.m_left != left || m_visible.m_top != top || m_visible.m_size != size)
+    {
+        m_visible.Reset(left, top, size);
+    }
+
+    for (size_t i = 0; i < m_visible.m_words.size(); i++)
+    {
+        uint64_t word = 0;
+        for (auto const & mask : m_octants)
+        {
+            word |= mask.m_words[i];
+        }
+        m_visible.m_words[i] = word;
+    }
+
+    if (map.Contains(m_x, m_y))
+    {
+        m_visible.Set(m_x, m_y);
+    }
+    return true;
+}
+
+// Recursive shadowcasting over one octant. Rows are at distance row..radius from the viewer;
+// start and end are the slopes of the still-lit wedge, start > end.
+void FovViewer::CastOctant(WorldMap const & map, uint32_t octant, VisibilityMask & mask, int32_t row, float start, float end) const
+{
+    if (start < end)
+    {
+        return;
+    }
+
+    auto const & t = OctantTransforms[octant];
+    int32_t radius = int32_t(m_radius);
+    int64_t radiusSquared = int64_t(radius) * radius;
+    float newStart = 0.0f;
+
+    for (int32_t distance = row; distance <= radius; distance++)
+    {
+        bool blocked = false;
+        int32_t dy = distance;
+        for (int32_t dx = distance; dx >= 0; dx--)
+        {
+            float leftSlope = (dx + 0.5f) / (dy - 0.5f);
+            float rightSlope = (dx - 0.5f) / (dy + 0.5f);
+            if (start < rightSlope)
+            {
+                continue;
+            }
+            if (end > leftSlope)
+            {
+                break;
+            }
+
+            int32_t x = m_x + dx * t[0] + dy * t[1];
+            int32_t y = m_y + dx * t[2] + dy * t[3];
+            bool inside = map.Contains(x, y);
+            bool opaque = !inside || IsOpaque(map.Tile(x, y));
+
+            if (inside && int64_t(dx) * dx + int64_t(dy) * dy <= radiusSquared)
+            {
+                mask.Set(x, y);
+            }
+
+            if (blocked)
+            {
+                if (opaque)
+                {
+                    newStart = rightSlope;
+                    continue;
+                }
+                blocked = false;
+                start = newStart;
+            }
+            else if (opaque && distance < radius)
+            {
+                blocked = true;
+                CastOctant(map, octant, mask, distance + 1, start, leftSlope);
+                newStart = rightSlope;
+            }
+        }
+
+        if (blocked)
+        {
+            break;
+        }
+    }
+}
+
+uint32_t FovSystem::Add(int32_t x, int32_t y, uint32_t radius)
+{
+    FovViewer viewer;
+    viewer.m_x = x;
+    viewer.m_y = y;
+    viewer.m_radius = radius;
+    m_viewers.push_back(std::move(viewer));
+    return uint32_t(m_viewers.size() - 1);
+}
+
+void FovSystem::OnTileChanged(int32_t x, int32_t y)
+{
+    for (auto & viewer : m_viewers)
+    {
+        viewer.OnTileChanged(x, y);
+    }
+}
+
+void FovSystem::OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    for (auto & viewer : m_viewers)
+    {
+        viewer.OnRegionChanged(left, top, right, bottom);
+    }
+}
+
+uint32_t FovSystem::Update(WorldMap const & map, Arena & scratch, JobSystem * jobs)
+{
+    ArenaVector<FovViewer *> dirty{ ArenaAllocator<FovViewer *>(scratch) };
+    dirty.reserve(m_viewers.size());
+    for (auto & viewer : m_viewers)
+    {
+        if (viewer.IsDirty())
+        {
+            dirty.push_back(&viewer);
+        }
+    }
+
+    // Viewers only read the map and write their own masks, so any range of them runs independently.
+    auto range = [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            dirty[i]->Update(map);
+        }
+    };
+    if (jobs != nullptr && dirty.size() >= ParallelViewers)
+    {
+        jobs->ParallelFor(0, dirty.size(), ViewerGrain, range);
+    }
+    else
+    {
+        range(0, dirty.size());
+    }
+    return uint32_t(dirty.size());
+}
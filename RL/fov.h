@@ -0,0 +1,86 @@
+#pragma once
+
+#include "arena.h"
+#include "jobsystem.h"
+#include "worldmap.h"
+
+// Bit-packed visibility for a square window of the map, 64 tiles per word.
+// Tiles outside the window read as not visible.
+struct VisibilityMask
+{
+    // Covers the size x size tiles whose top-left tile is (left, top), all cleared.
+    void Reset(int32_t left, int32_t top, uint32_t size);
+
+    void Clear() { std::fill(m_words.begin(), m_words.end(), 0); }
+
+    bool Test(int32_t x, int32_t y) const
+    {
+        uint32_t column = uint32_t(x - m_left);
+        uint32_t row = uint32_t(y - m_top);
+        if (column >= m_size || row >= m_size)
+        {
+            return false;
+        }
+        return (m_words[size_t(row) * m_wordsPerRow + (column >> 6)] >> (column & 63)) & 1;
+    }
+
+    void Set(int32_t x, int32_t y)
+    {
+        uint32_t column = uint32_t(x - m_left);
+        uint32_t row = uint32_t(y - m_top);
+        m_words[size_t(row) * m_wordsPerRow + (column >> 6)] |= uint64_t(1) << (column & 63);
+    }
+
+    int32_t m_left = 0;
+    int32_t m_top = 0;
+    uint32_t m_size = 0;
+    uint32_t m_wordsPerRow = 0;
+    std::vector<uint64_t> m_words;
+};
+
+// Field of view of one viewer, computed by recursive shadowcasting over the map's opaque flags.
+// Each of the eight octants keeps its own mask, so a tile change only recasts the octants
+// whose wedge contains it. Moving the viewer shifts every octant's origin and recasts all of them.
+struct FovViewer
+{
+    void MoveTo(int32_t x, int32_t y);
+    void SetRadius(uint32_t radius);
+
+    // Marks the octants that contain (x, y) for recomputation if it is within the radius.
+    void OnTileChanged(int32_t x, int32_t y);
+
+    // Marks every octant for recomputation if the radius reaches into [left, right) x [top, bottom).
+    void OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom);
+
+    bool IsDirty() const { return m_dirtyOctants != 0; }
+
+    // Recasts the dirty octants and rebuilds m_visible. Returns false if nothing was dirty.
+    bool Update(WorldMap const & map);
+
+    void CastOctant(WorldMap const & map, uint32_t octant, VisibilityMask & mask, int32_t row, float start, float end) const;
+
+    int32_t m_x = 0;
+    int32_t m_y = 0;
+    uint32_t m_radius = 8;
+    uint8_t m_dirtyOctants = 0xff;
+
+    VisibilityMask m_octants[8];
+    VisibilityMask m_visible;
+};
+
+// A set of viewers whose fields of view are recomputed together, on the job system when enough
+// are dirty.
+struct FovSystem
+{
+    uint32_t Add(int32_t x, int32_t y, uint32_t radius);
+
+    // Forwards a tile or region change to every viewer that could see it.
+    void OnTileChanged(int32_t x, int32_t y);
+    void OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom);
+
+    // Recomputes every dirty viewer, serially if jobs is null. Returns the number of viewers
+    // recomputed. The list of dirty viewers is gathered in scratch.
+    uint32_t Update(WorldMap const & map, Arena & scratch, JobSystem * jobs = nullptr);
+
+    std::vector<FovViewer> m_viewers;
+};
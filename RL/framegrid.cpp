@@ -0,0 +1,210 @@
+#include "pch.h"
+
+#include "framegrid.h"
+
+// Dirty runs separated by fewer clean cells than this are redrawn as one run.
+static const uint32_t RunMergeGap = 2;
+
+void FrameGrid::Resize(uint32_t width, uint32_t height)
+{
+    m_current.Resize(width, height);
+    m_previous.Resize(width, height);
+    m_invalidated = true;
+}
+
+uint32_t FrameLayout::Update(uint32_t pixelWidth, uint32_t pixelHeight, uint32_t tileWidth, uint32_t tileHeight)
+{
+    uint32_t changed = 0;
+    if (pixelWidth != m_pixelWidth || pixelHeight != m_pixelHeight)
+    {
+        m_pixelWidth = pixelWidth;
+        m_pixelHeight = pixelHeight;
+        changed |= LayoutChange_Pixels;
+    }
+    else if (tileWidth == m_tileWidth && tileHeight == m_tileHeight)
+    {
+        return 0;
+    }
+    m_tileWidth = tileWidth;
+    m_tileHeight = tileHeight;
+
+    uint32_t columns = (pixelWidth + tileWidth - 1) / tileWidth;
+    uint32_t rows = (pixelHeight + tileHeight - 1) / tileHeight;
+    if (columns != m_columns || rows != m_rows)
+    {
+        m_columns = columns;
+        m_rows = rows;
+        changed |= LayoutChange_Cells;
+    }
+
+    int32_t originX = -int32_t((columns * tileWidth - pixelWidth + 1) / 2);
+    int32_t originY = -int32_t((rows * tileHeight - pixelHeight + 1) / 2);
+    if (originX != m_originX || originY != m_originY)
+    {
+        m_originX = originX;
+        m_originY = originY;
+        changed |= LayoutChange_Origin;
+    }
+
+    if (pixelWidth > m_capacityWidth || pixelHeight > m_capacityHeight)
+    {
+        m_capacityWidth = std::max(m_capacityWidth, (pixelWidth + CapacityStep - 1) / CapacityStep * CapacityStep);
+        m_capacityHeight = std::max(m_capacityHeight, (pixelHeight + CapacityStep - 1) / CapacityStep * CapacityStep);
+        changed |= LayoutChange_Capacity;
+    }
+    return changed;
+}
+
+static uint64_t Area(CellRect const & rect)
+{
+    return uint64_t(rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+static CellRect Union(CellRect const & a, CellRect const & b)
+{
+    return {
+        std::min(a.left, b.left),
+        std::min(a.top, b.top),
+        std::max(a.right, b.right),
+        std::max(a.bottom, b.bottom),
+    };
+}
+
+void FrameGrid::Diff(std::vector<CellRect> & rects, size_t maxRects)
+{
+    rects.clear();
+
+    uint32_t width = m_current.m_width;
+    uint32_t height = m_current.m_height;
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
+
+    if (m_invalidated)
+    {
+        m_invalidated = false;
+        rects.push_back({ 0, 0, width, height });
+        m_previous.m_cells = m_current.m_cells;
+        m_stats.cellsDirty += uint64_t(width) * height;
+        m_stats.cellsRedrawn += uint64_t(width) * height;
+        return;
+    }
+
+    // Rectangles that reached the previous row and can still grow downwards.
+    size_t open = 0;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        Cell const * current = &m_current.At(0, y);
+        Cell const * previous = &m_previous.At(0, y);
+        size_t rowBegin = rects.size();
+
+        uint32_t x = 0;
+        while (x < width)
+        {
+            if (current[x] == previous[x])
+            {
+                x++;
+                continue;
+            }
+
+            uint32_t left = x;
+            uint32_t right = x + 1;
+            m_stats.cellsDirty++;
+            for (x = right; x < width && x - right < RunMergeGap; x++)
+            {
+                if (current[x] != previous[x])
+                {
+                    right = x + 1;
+                    m_stats.cellsDirty++;
+                }
+            }
+            x = right;
+
+            // Extend an open rectangle from the row above if the run overlaps it.
+            CellRect run = { left, y, right, y + 1 };
+            bool extended = false;
+            for (size_t i = open; i < rowBegin; i++)
+            {
+                CellRect & rect = rects[i];
+                if (rect.bottom == y && run.left <= rect.right && rect.left <= run.right)
+                {
+                    rect = Union(rect, run);
+                    extended = true;
+                    break;
+                }
+            }
+
+            if (!extended)
+            {
+                rects.push_back(run);
+            }
+        }
+
+        // Rectangles that did not reach this row are closed; move them before the open range.
+        for (size_t i = open; i < rects.size(); i++)
+        {
+            if (rects[i].bottom < y + 1)
+            {
+                std::swap(rects[i], rects[open]);
+                open++;
+            }
+        }
+    }
+
+    MergeDirtyRects(rects, maxRects);
+
+    for (auto const & rect : rects)
+    {
+        m_stats.cellsRedrawn += Area(rect);
+    }
+
+    m_previous.m_cells = m_current.m_cells;
+}
+
+void MergeDirtyRects(std::vector<CellRect> & rects, size_t maxRects)
+{
+    maxRects = std::max<size_t>(maxRects, 1);
+    if (rects.size() <= maxRects)
+    {
+        return;
+    }
+
+    // Pairwise merging is quadratic; past this point a bounding box is cheaper than the search.
+    if (rects.size() > maxRects * 16)
+    {
+        CellRect bounds = rects[0];
+        for (auto const & rect : rects)
+        {
+            bounds = Union(bounds, rect);
+        }
+        rects.assign(1, bounds);
+        return;
+    }
+
+    while (rects.size() > maxRects)
+    {
+        size_t bestA = 0;
+        size_t bestB = 1;
+        int64_t bestCost = INT64_MAX;
+        for (size_t a = 0; a < rects.size(); a++)
+        {
+            for (size_t b = a + 1; b < rects.size(); b++)
+            {
+                // Overlapping pairs can have a negative cost, which makes them the best candidates.
+                int64_t cost = int64_t(Area(Union(rects[a], rects[b]))) - int64_t(Area(rects[a])) - int64_t(Area(rects[b]));
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        }
+
+        rects[bestA] = Union(rects[bestA], rects[bestB]);
+        rects[bestB] = rects.back();
+        rects.pop_back();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cellgrid.h"
+
+// Double-buffered cell grid. The renderer fills m_current each frame, and Diff
+// reports which cells changed since the previous frame as a few merged rectangles.
+struct FrameGrid
+{
+    // Resizes both buffers. The next Diff reports the whole grid as dirty.
+    void Resize(uint32_t width, uint32_t height);
+
+    // Forces the next Diff to report the whole grid, e.g. after the target was recreated.
+    void Invalidate() { m_invalidated = true; }
+
+    // Compares m_current against the previous frame, writes at most maxRects rectangles
+    // covering every changed cell, and makes m_current the new previous frame.
+    void Diff(std::vector<CellRect> & rects, size_t maxRects);
+
+    CellGrid m_current;
+    CellGrid m_previous;
+    bool m_invalidated = true;
+
+    struct {
+        uint64_t cellsDirty = 0;
+        uint64_t cellsRedrawn = 0;
+    } m_stats;
+};
+
+// Bits of what FrameLayout::Update changed.
+enum LayoutChange : uint32_t
+{
+    LayoutChange_Cells = 1 << 0,        // The grid has a different number of columns or rows.
+    LayoutChange_Origin = 1 << 1,       // The grid moved within the frame.
+    LayoutChange_Pixels = 1 << 2,       // The frame is a different size in pixels.
+    LayoutChange_Capacity = 1 << 3,     // The frame outgrew the pixels reserved for it.
+};
+
+// Where the cell grid sits in a frame: enough tiles to cover it, centred, so the partial tiles
+// at the edges are cut evenly. Update works out what a new frame size changes, so the renderer
+// only rebuilds what depends on it: during a drag-resize most sizes keep the columns and rows,
+// and the reserved pixels only grow, in steps, so the frame bitmap is rarely recreated.
+struct FrameLayout
+{
+    // Reserved pixels are rounded up to a multiple of this.
+    static constexpr uint32_t CapacityStep = 256;
+
+    // Returns the LayoutChange bits for a frame of the given size, 0 if nothing changed.
+    uint32_t Update(uint32_t pixelWidth, uint32_t pixelHeight, uint32_t tileWidth, uint32_t tileHeight);
+
+    uint32_t m_tileWidth = 0;
+    uint32_t m_tileHeight = 0;
+    uint32_t m_pixelWidth = 0;
+    uint32_t m_pixelHeight = 0;
+    uint32_t m_columns = 0;
+    uint32_t m_rows = 0;
+
+    // Pixel position of the top left cell; zero or negative.
+    int32_t m_originX = 0;
+    int32_t m_originY = 0;
+
+    uint32_t m_capacityWidth = 0;
+    uint32_t m_capacityHeight = 0;
+};
+
+// Merges dirty row runs into rectangles and then merges rectangles pairwise,
+// cheapest area growth first, until at most maxRects remain.
+void MergeDirtyRects(std::vector<CellRect> & rects, size_t maxRects);
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+
+enum class RedrawMode : uint8_t
+{
+    OnDemand,       // Draw only when something may have changed or an animation asks for a frame.
+    Continuous,     // Draw every vertical blank.
+};
+
+// Decides when the render loop draws. It keeps no clock of its own, so the same decisions can
+// be replayed against a simulated one.
+struct FramePacer
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Something on screen may have changed: input, a resize, a new snapshot.
+    void Invalidate() { m_dirty = true; }
+
+    // An animation wants a frame at the given time. Requests are one-shot: a running animation
+    // asks again each time it is drawn, and an animation that has finished stops asking, so a
+    // static screen is not drawn at all.
+    void RequestFrame(Clock::time_point at) { m_deadline = std::min(m_deadline, at); }
+
+    void SetMode(RedrawMode mode)
+    {
+        m_mode = mode;
+        m_dirty = true;
+    }
+
+    // Returns true if a frame should be drawn now. Otherwise wake is when to look again, or
+    // Clock::time_point::max() if only an event can make a frame necessary.
+    bool ShouldDraw(Clock::time_point now, Clock::time_point & wake) const
+    {
+        if (m_mode == RedrawMode::Continuous || m_dirty || m_deadline <= now)
+        {
+            return true;
+        }
+        wake = m_deadline;
+        return false;
+    }
+
+    // Call after drawing, with the time the frame was started: it covers every invalidation
+    // before it and every request that had come due.
+    void FrameDrawn(Clock::time_point now)
+    {
+        m_dirty = false;
+        if (m_deadline <= now)
+        {
+            m_deadline = Clock::time_point::max();
+        }
+        m_stats.frames++;
+    }
+
+    RedrawMode m_mode = RedrawMode::OnDemand;
+    bool m_dirty = true;
+    Clock::time_point m_deadline = Clock::time_point::max();
+
+    struct {
+        uint64_t frames = 0;
+    } m_stats;
+};
+
+// Collects window size changes between frames. A drag-resize sends many more size changes than
+// there are frames; the render loop takes the newest size once per frame, before drawing it, so
+// the swap chain is resized at most once a frame, and not at all if the size ended up where it was.
+struct ResizeCoalescer
+{
+    using Clock = FramePacer::Clock;
+
+    void Request(uint32_t width, uint32_t height, Clock::time_point now)
+    {
+        if (!m_pending)
+        {
+            m_pending = true;
+            m_since = now;
+        }
+        m_width = width;
+        m_height = height;
+        m_stats.requests++;
+    }
+
+    // The size the window resources have; a request back to it needs no resize.
+    void Applied(uint32_t width, uint32_t height)
+    {
+        m_appliedWidth = width;
+        m_appliedHeight = height;
+    }
+
+    // Returns true, with the size to resize to, if a resize is due. latency is how long the
+    // oldest request it covers waited.
+    bool Take(Clock::time_point now, uint32_t & width, uint32_t & height, Clock::duration & latency)
+    {
+        if (!m_pending)
+        {
+            return false;
+        }
+        m_pending = false;
+        if (m_width == m_appliedWidth && m_height == m_appliedHeight)
+        {
+            return false;
+        }
+
+        Applied(m_width, m_height);
+        width = m_width;
+        height = m_height;
+        latency = now - m_since;
+        m_stats.resizes++;
+        m_stats.totalLatency += latency;
+        m_stats.maxLatency = std::max(m_stats.maxLatency, latency);
+        return true;
+    }
+
+    bool m_pending = false;
+    Clock::time_point m_since;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_appliedWidth = 0;
+    uint32_t m_appliedHeight = 0;
+
+    struct {
+        uint64_t requests = 0;
+        uint64_t resizes = 0;
+        Clock::duration totalLatency{ 0 };
+        Clock::duration maxLatency{ 0 };
+    } m_stats;
+};
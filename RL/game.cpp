@@ -0,0 +1,488 @@
+#include "pch.h"
+
+#include "game.h"
+
+#include "profiler.h"
+
+static const int8_t Directions[8][2] = {
+    { -1, -1 }, { 0, -1 }, { 1, -1 },
+    { -1, 0 }, { 1, 0 },
+    { -1, 1 }, { 0, 1 }, { 1, 1 },
+};
+
+static const uint32_t PlayerVisionRadius = 12;
+
+// What the map is lit by away from any light, and the player's torch.
+static const uint32_t AmbientLight = 0x505a6e;
+static const uint32_t TorchRadius = 9;
+static const uint32_t TorchColor = 0xffc88c;
+
+// Actors within this many steps of the player chase them; the rest wander.
+static const uint16_t ChaseDistance = 32;
+
+// Runs of actions shorter than this are decided on the calling thread; longer ones are
+// spread across the job system, this many actions to a job.
+static const size_t ParallelActions = 1024;
+static const size_t ActionGrain = 256;
+
+struct MonsterKind
+{
+    char const * name;
+    char32_t glyph;
+    uint32_t color;
+    uint16_t speed;
+};
+
+static const MonsterKind MonsterKinds[] = {
+    { "goblin", U'g', 0xff7fbf3f, TurnScheduler::NormalSpeed },
+    { "zombie", U'z', 0xff9f9f7f, TurnScheduler::NormalSpeed / 2 },
+    { "bat", U'b', 0xffbf7f3f, TurnScheduler::NormalSpeed * 3 / 2 },
+};
+
+Game::Game(std::shared_ptr<WorldMap const> world, uint64_t seed)
+    : m_world(std::move(world))
+    , m_random(seed)
+{
+    // Start on the open tile nearest the middle row, and nearest the middle column within it.
+    int32_t middle = int32_t(m_world->m_height / 2);
+    int32_t centre = int32_t(m_world->m_width / 2);
+    bool placed = false;
+    for (int32_t offset = 0; offset <= middle && !placed; offset++)
+    {
+        for (int32_t y : { middle + offset, middle - offset })
+        {
+            for (int32_t column = 0; column <= centre && !placed; column++)
+            {
+                for (int32_t x : { centre - column, centre + column })
+                {
+                    if (!placed && IsPassable(x, y))
+                    {
+                        m_playerX = x;
+                        m_playerY = y;
+                        placed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    m_occupancy.Reset(m_world->m_width, m_world->m_height);
+
+    // The player starts ready, so the first command is applied straight away.
+    m_playerTurn = m_scheduler.Add(EntityHandle(), TurnScheduler::NormalSpeed, TurnScheduler::ActionCost);
+
+    m_vision.Add(m_playerX, m_playerY, PlayerVisionRadius);
+    m_vision.Update(*m_world, m_turnArena, m_jobs);
+
+    m_lighting.SetAmbient(AmbientLight);
+    m_playerLight = m_lighting.Add(m_playerX, m_playerY, TorchRadius, TorchColor);
+    UpdateLighting();
+}
+
+bool Game::IsPassable(int32_t x, int32_t y) const
+{
+    return m_world->Contains(x, y) && !IsBlocked(m_world->Tile(x, y));
+}
+
+void Game::SpawnActors(uint32_t count, uint32_t radius)
+{
+    int32_t left = 0;
+    int32_t top = 0;
+    uint32_t width = m_world->m_width;
+    uint32_t height = m_world->m_height;
+    if (radius > 0)
+    {
+        left = m_playerX - int32_t(radius);
+        top = m_playerY - int32_t(radius);
+        width = height = radius * 2 + 1;
+    }
+
+    // Give up on areas that are (almost) entirely walls rather than looping forever.
+    uint64_t attempts = uint64_t(count) * 64;
+    while (count > 0 && attempts-- > 0)
+    {
+        int32_t x = left + int32_t(m_random.Below(width));
+        int32_t y = top + int32_t(m_random.Below(height));
+        if (IsPassable(x, y))
+        {
+            AddMonster(x, y, uint16_t(m_random.Below(uint32_t(std::size(MonsterKinds)))));
+            count--;
+        }
+    }
+}
+
+EntityHandle Game::AddMonster(int32_t x, int32_t y, uint16_t kind)
+{
+    MonsterKind const & definition = MonsterKinds[kind % std::size(MonsterKinds)];
+    EntityHandle monster = m_entities.Create(Position{ x, y }, Appearance{ definition.glyph, definition.color }, Monster{ kind, 0 });
+
+    // Random starting energy spreads the monsters over the ticks of a turn.
+    uint32_t turn = m_scheduler.Add(monster, definition.speed, int32_t(m_random.Below(TurnScheduler::ActionCost)));
+    m_scheduler.Spend(turn, 0);
+    m_entities.Get<Monster>(monster)->turn = turn;
+    m_occupancy.Insert(monster, x, y);
+
+    if (m_actorVisionRadius > 0)
+    {
+        m_entities.Add(monster, Sight{ m_vision.Add(x, y, m_actorVisionRadius) });
+    }
+    return monster;
+}
+
+void Game::EnableActorVision(uint32_t radius)
+{
+    m_actorVisionRadius = radius;
+    m_vision.m_viewers.resize(1);
+
+    // Adding a component moves the entity to another table, so collect the monsters first.
+    std::vector<EntityHandle> monsters;
+    m_entities.ForEachChunk<Monster>([&](size_t count, EntityHandle const * entities, Monster *)
+    {
+        monsters.insert(monsters.end(), entities, entities + count);
+    });
+
+    for (auto monster : monsters)
+    {
+        Position const & position = *m_entities.Get<Position>(monster);
+        m_entities.Add(monster, Sight{ m_vision.Add(position.x, position.y, radius) });
+    }
+}
+
+void Game::Apply(Command const & command)
+{
+    if (command.type == CommandType::None)
+    {
+        return;
+    }
+
+    m_turnArena.Reset();
+
+    auto start = std::chrono::steady_clock::now();
+    ApplyPlayer(command);
+    m_scheduler.Spend(m_playerTurn);
+
+    auto pathing = std::chrono::steady_clock::now();
+    UpdatePathing();
+
+    auto actors = std::chrono::steady_clock::now();
+    RunActors();
+
+    auto vision = std::chrono::steady_clock::now();
+    UpdateVision();
+
+    auto lighting = std::chrono::steady_clock::now();
+    UpdateLighting();
+
+    auto end = std::chrono::steady_clock::now();
+    m_phaseTimes[TurnPhase_Player] += pathing - start;
+    m_phaseTimes[TurnPhase_Pathing] += actors - pathing;
+    m_phaseTimes[TurnPhase_Actors] += vision - actors;
+    m_phaseTimes[TurnPhase_Vision] += lighting - vision;
+    m_phaseTimes[TurnPhase_Lighting] += end - lighting;
+
+#if RL_PROFILE
+    // The phases are timed anyway, so the profiler gets them for free.
+    if (ProfilingEnabled())
+    {
+        RecordProfileScope("Player", ProfileTime(start), ProfileTime(pathing));
+        RecordProfileScope("Pathing", ProfileTime(pathing), ProfileTime(actors));
+        RecordProfileScope("Actors", ProfileTime(actors), ProfileTime(vision));
+        RecordProfileScope("Vision", ProfileTime(vision), ProfileTime(lighting));
+        RecordProfileScope("Lighting", ProfileTime(lighting), ProfileTime(end));
+    }
+#endif
+
+    m_turn++;
+}
+
+void Game::ApplyPlayer(Command const & command)
+{
+    if (command.type != CommandType::Move)
+    {
+        return;
+    }
+
+    if (IsPassable(m_playerX + command.dx, m_playerY + command.dy))
+    {
+        m_playerX += command.dx;
+        m_playerY += command.dy;
+    }
+    else
+    {
+        m_messages.Add("Something blocks your way.");
+    }
+}
+
+void Game::UpdatePathing()
+{
+    FlowField::Goal player = { m_playerX, m_playerY };
+    m_chaseField.Build(*m_world, &player, 1, ChaseDistance);
+}
+
+void Game::RunActors()
+{
+    // Take every batch of monsters that is ready before the player. Monsters ready on the same
+    // tick as the player still act first. What an actor does has no effect on when it acts
+    // next, so the whole turn's order of actions is known before anyone moves.
+    ArenaVector<EntityHandle> actors{ ArenaAllocator<EntityHandle>(m_turnArena) };
+    actors.reserve(ActorCount());
+    bool playerReady = false;
+    while (!playerReady && m_scheduler.NextBatch(m_due))
+    {
+        for (uint32_t turn : m_due)
+        {
+            if (turn == m_playerTurn)
+            {
+                playerReady = true;
+                continue;
+            }
+
+            actors.push_back(m_scheduler.Owner(turn));
+            m_scheduler.Spend(turn);
+        }
+    }
+
+    // Actors acting twice in a turn decide their second action from where the first left
+    // them, so the actions run in stretches that end before an actor's second action.
+    size_t begin = 0;
+    while (begin < actors.size())
+    {
+        if (++m_actionRun == 0)
+        {
+            std::fill(m_actionRuns.begin(), m_actionRuns.end(), 0);
+            m_actionRun = 1;
+        }
+
+        size_t end = begin;
+        for (; end < actors.size(); end++)
+        {
+            uint32_t index = actors[end].index;
+            if (index >= m_actionRuns.size())
+            {
+                m_actionRuns.resize(size_t(index) + 1, 0);
+            }
+            if (m_actionRuns[index] == m_actionRun)
+            {
+                break;
+            }
+            m_actionRuns[index] = m_actionRun;
+        }
+
+        RunActions(actors.data() + begin, end - begin);
+        begin = end;
+    }
+}
+
+void Game::RunActions(EntityHandle const * actors, size_t count)
+{
+    ArenaVector<ActorIntent> intents{ ArenaAllocator<ActorIntent>(m_turnArena) };
+    intents.resize(count);
+
+    auto forEach = [&](auto && fn)
+    {
+        auto range = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                fn(intents[i]);
+            }
+        };
+        if (m_jobs != nullptr && count >= ParallelActions)
+        {
+            m_jobs->ParallelFor(0, count, ActionGrain, range);
+        }
+        else
+        {
+            range(0, count);
+        }
+    };
+
+    // Chasing actors decide straight away. Wandering ones draw their directions from the
+    // shared stream in action order, as they would one at a time, and decide after.
+    forEach([&](ActorIntent & intent)
+    {
+        size_t i = size_t(&intent - intents.data());
+        intent.owner = actors[i];
+        intent.position = m_entities.Get<Position>(actors[i]);
+        intent.wanders = m_chaseField.Distance(intent.position->x, intent.position->y) == FlowField::Unreachable;
+        if (!intent.wanders)
+        {
+            DecideActor(intent);
+        }
+    });
+
+    bool wanderers = false;
+    for (ActorIntent & intent : intents)
+    {
+        if (intent.wanders)
+        {
+            intent.direction = uint8_t(m_random.Below(8));
+            wanderers = true;
+        }
+    }
+
+    if (wanderers)
+    {
+        forEach([&](ActorIntent & intent)
+        {
+            if (intent.wanders)
+            {
+                DecideActor(intent);
+            }
+        });
+    }
+
+    // Carried out in action order, so the result is the same however they were decided.
+    for (ActorIntent const & intent : intents)
+    {
+        if (CommitActor(intent))
+        {
+            char message[64];
+            snprintf(message, sizeof(message), "The %s closes in on you.", MonsterKinds[m_entities.Get<Monster>(intent.owner)->kind % std::size(MonsterKinds)].name);
+            m_messages.Add(message);
+        }
+    }
+}
+
+void Game::DecideActor(ActorIntent & intent) const
+{
+    // Actors near the player step down the chase field; the rest take their random direction
+    // if the tile is open.
+    Position const & actor = *intent.position;
+    int32_t x = actor.x;
+    int32_t y = actor.y;
+    uint16_t distance = m_chaseField.Distance(x, y);
+    if (distance != FlowField::Unreachable)
+    {
+        if (distance > 1)
+        {
+            m_chaseField.NextStep(actor.x, actor.y, x, y);
+        }
+    }
+    else
+    {
+        auto const & direction = Directions[intent.direction];
+        x += direction[0];
+        y += direction[1];
+    }
+
+    // Down the chase field from two steps away is next to the player.
+    intent.x = x;
+    intent.y = y;
+    intent.moves = IsPassable(x, y);
+    intent.arrived = intent.moves && distance == 2 && (x != actor.x || y != actor.y);
+}
+
+bool Game::CommitActor(ActorIntent const & intent)
+{
+    if (!intent.moves)
+    {
+        return false;
+    }
+
+    intent.position->x = intent.x;
+    intent.position->y = intent.y;
+    m_occupancy.Move(intent.owner, intent.x, intent.y);
+    return intent.arrived;
+}
+
+void Game::UpdateVision()
+{
+    m_vision.m_viewers[0].MoveTo(m_playerX, m_playerY);
+    m_entities.Each<Position, Sight>([&](Position const & position, Sight const & sight)
+    {
+        m_vision.m_viewers[sight.viewer].MoveTo(position.x, position.y);
+    });
+
+    m_vision.Update(*m_world, m_turnArena, m_jobs);
+}
+
+void Game::UpdateLighting()
+{
+    m_lighting.Move(m_playerLight, m_playerX, m_playerY);
+    m_lighting.Follow(m_playerX, m_playerY);
+    m_lighting.Update(*m_world);
+}
+
+uint64_t Game::StateHash()
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&](uint64_t value) { hash = (hash ^ value) * 0x100000001b3ull; };
+
+    mix(m_turn);
+    mix(uint32_t(m_playerX));
+    mix(uint32_t(m_playerY));
+    mix(m_scheduler.m_now);
+    for (uint64_t word : m_random.m_state)
+    {
+        mix(word);
+    }
+    m_entities.Each<Position, Monster>([&](Position const & position, Monster const & monster)
+    {
+        mix((uint64_t(uint32_t(position.x)) << 32) | uint32_t(position.y));
+        mix(monster.kind);
+    });
+    return hash;
+}
+
+void Game::OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    m_chaseField.ResetRegion(*m_world, uint32_t(std::max(left, 0)), uint32_t(std::max(top, 0)), uint32_t(std::max(right, 0)), uint32_t(std::max(bottom, 0)));
+    m_vision.OnRegionChanged(left, top, right, bottom);
+    m_lighting.OnRegionChanged(left, top, right, bottom);
+}
+
+void Game::InstallChunks(std::vector<ChunkUpdate> const & chunks)
+{
+    // The copy shares every chunk it does not replace.
+    auto next = std::make_shared<WorldMap>(*m_world);
+    for (auto const & update : chunks)
+    {
+        next->SetChunk(update.chunkX, update.chunkY, update.chunk);
+    }
+    m_world = std::move(next);
+
+    for (auto const & update : chunks)
+    {
+        int32_t left = int32_t(update.chunkX << ChunkShift);
+        int32_t top = int32_t(update.chunkY << ChunkShift);
+        OnRegionChanged(left, top, left + int32_t(ChunkSize), top + int32_t(ChunkSize));
+    }
+    UpdateVision();
+    UpdateLighting();
+}
+
+std::shared_ptr<WorldMap const> CreateDemoWorld()
+{
+    return std::make_shared<WorldMap const>(WorldMap::FromRows({
+        "#####################",
+        "#        #          #",
+        "#        #    ~~    #",
+        "#        #   ~~~~   #",
+        "#        +    ~~    #",
+        "#        #          #",
+        "####'#####          #",
+        "#                   #",
+        "#                   #",
+        "#####################",
+    }));
+}
+
+std::shared_ptr<WorldMap const> CreateRandomWorld(uint32_t width, uint32_t height, uint64_t seed)
+{
+    auto world = std::make_shared<WorldMap>(width, height);
+    Random random(seed);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            bool border = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+            if (border || random.Chance(8))
+            {
+                world->Set(x, y, Tile_Wall);
+            }
+        }
+    }
+    return world;
+}
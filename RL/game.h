@@ -0,0 +1,158 @@
+#pragma once
+
+#include "components.h"
+#include "entities.h"
+#include "flowfield.h"
+#include "fov.h"
+#include "jobsystem.h"
+#include "lighting.h"
+#include "messagelog.h"
+#include "random.h"
+#include "scheduler.h"
+#include "spatialindex.h"
+#include "worldmap.h"
+
+#include <chrono>
+
+enum class CommandType : uint8_t
+{
+    None,
+    Move,
+    Wait,
+    Save,   // Handled by the simulation; not a turn.
+    Load,
+};
+
+// A player command. Each command that is applied advances the game by one turn.
+struct Command
+{
+    CommandType type = CommandType::None;
+    int8_t dx = 0;
+    int8_t dy = 0;
+};
+
+// What a monster does with one action, decided against the map and the chase field without
+// changing anything, so the actions of a turn can be decided in parallel and then carried out
+// in order.
+struct ActorIntent
+{
+    EntityHandle owner;
+    Position * position;
+    bool wanders;       // Off the chase field, so it steps in direction, a random draw.
+    uint8_t direction;
+    bool moves;         // Whether the tile it steps to, (x, y), is open.
+    bool arrived;       // Stepped next to the player.
+    int32_t x;
+    int32_t y;
+};
+
+// The parts of a turn, in the order they run. Apply accumulates the time spent in each.
+enum TurnPhase
+{
+    TurnPhase_Player,
+    TurnPhase_Pathing,
+    TurnPhase_Actors,
+    TurnPhase_Vision,
+    TurnPhase_Lighting,
+    TurnPhase_Count,
+};
+
+// Game state and rules, independent of threading and presentation, so the same core
+// runs under the windowed app and the headless driver.
+struct Game
+{
+    explicit Game(std::shared_ptr<WorldMap const> world, uint64_t seed = 0);
+
+    bool IsPassable(int32_t x, int32_t y) const;
+
+    // Places count monsters on random open tiles, within radius tiles of the player if radius is not 0.
+    void SpawnActors(uint32_t count, uint32_t radius = 0);
+    EntityHandle AddMonster(int32_t x, int32_t y, uint16_t kind);
+
+    // Gives every monster, including ones spawned later, a field of view of the given radius.
+    void EnableActorVision(uint32_t radius);
+
+    // Runs one turn: the player's command, then every monster that becomes ready before the
+    // player is ready again.
+    void Apply(Command const & command);
+
+    void ApplyPlayer(Command const & command);
+    void UpdatePathing();
+    void RunActors();
+
+    // Decides and carries out count actions in order. Every actor acts at most once among
+    // them, so none of the decisions depend on each other.
+    void RunActions(EntityHandle const * actors, size_t count);
+
+    // Fills in the rest of an intent with owner and position set, and the direction drawn if
+    // it wanders. Safe to call for many intents at once.
+    void DecideActor(ActorIntent & intent) const;
+
+    // Returns true if the actor stepped next to the player.
+    bool CommitActor(ActorIntent const & intent);
+    void UpdateVision();
+    void UpdateLighting();
+
+    // Call after the tiles [left, right) x [top, bottom) of m_world changed, or m_world was
+    // replaced by a map that differs there.
+    void OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom);
+
+    // Puts whole chunks into a copy of m_world, so snapshots already handed out keep the map
+    // they were made with, then refreshes everything that depends on the changed tiles.
+    void InstallChunks(std::vector<ChunkUpdate> const & chunks);
+
+    size_t ActorCount() const { return m_entities.Count<Monster>(); }
+
+    // Hash of the state that turns evolve: turn, player, monsters, scheduler clock and random
+    // stream. Two runs that agree on it after every turn have played out identically.
+    uint64_t StateHash();
+
+    FovViewer const & PlayerView() const { return m_vision.m_viewers[0]; }
+
+    std::shared_ptr<WorldMap const> m_world;
+    Random m_random;
+    int32_t m_playerX = 0;
+    int32_t m_playerY = 0;
+    EntityStore m_entities;
+    uint64_t m_turn = 0;
+
+    // Where every monster is, kept up to date as they move.
+    SpatialIndex m_occupancy;
+
+    // Who acts when. The player is in the scheduler too, with no owning entity.
+    TurnScheduler m_scheduler;
+    uint32_t m_playerTurn = 0;
+    std::vector<uint32_t> m_due;
+
+    // Scratch memory for the turn being applied, rewound when the next one starts.
+    Arena m_turnArena;
+
+    // Runs monster decisions in parallel when set; not owned. Results are the same without.
+    JobSystem * m_jobs = nullptr;
+
+    // Per entity index, the last run of actions its actor took part in.
+    std::vector<uint32_t> m_actionRuns;
+    uint32_t m_actionRun = 0;
+
+    // Distance to the player, shared by every chasing actor.
+    FlowField m_chaseField;
+
+    // Viewer 0 is the player; monsters with a Sight component own the others.
+    FovSystem m_vision;
+    uint32_t m_actorVisionRadius = 0;
+
+    // Light around the player, who carries a torch. Presentation only; not part of StateHash.
+    LightingSystem m_lighting;
+    uint32_t m_playerLight = 0;
+
+    // What happened, for the player to read. Not part of StateHash.
+    MessageLog m_messages;
+
+    std::chrono::nanoseconds m_phaseTimes[TurnPhase_Count] = {};
+};
+
+// The starting map.
+std::shared_ptr<WorldMap const> CreateDemoWorld();
+
+// A bordered map of the given size with randomly scattered walls.
+std::shared_ptr<WorldMap const> CreateRandomWorld(uint32_t width, uint32_t height, uint64_t seed);
@@ -0,0 +1,175 @@
+#include "pch.h"
+
+#include "glyphatlas.h"
+
+GlyphAtlas::GlyphAtlas(uint32_t pageSize, Rasterizer rasterizer)
+    : m_pageSize(pageSize)
+    , m_rasterizer(std::move(rasterizer))
+{
+}
+
+void GlyphAtlas::Clear()
+{
+    m_pages.clear();
+    m_slots.clear();
+}
+
+bool GlyphAtlas::Allocate(Page & page, uint32_t width, uint32_t height, uint32_t & x, uint32_t & y)
+{
+    // Glyphs share a cell size, so the first shelf that is tall enough is a tight fit.
+    for (auto & shelf : page.shelves)
+    {
+        if (height <= shelf.height && shelf.cursor + width <= m_pageSize)
+        {
+            x = shelf.cursor;
+            y = shelf.y;
+            shelf.cursor += width;
+            return true;
+        }
+    }
+
+    if (page.top + height > m_pageSize)
+    {
+        return false;
+    }
+
+    page.shelves.push_back({ page.top, height, width });
+    x = 0;
+    y = page.top;
+    page.top += height;
+    return true;
+}
+
+AtlasSlot const & GlyphAtlas::Find(GlyphKey key, uint32_t width, uint32_t height)
+{
+    auto it = m_slots.find(key);
+    if (it != m_slots.end())
+    {
+        m_stats.hits++;
+        return it->second;
+    }
+
+    m_stats.misses++;
+
+    width = std::min(width, m_pageSize);
+    height = std::min(height, m_pageSize);
+
+    uint32_t x = 0;
+    uint32_t y = 0;
+    if (m_pages.empty() || !Allocate(m_pages.back(), width, height, x, y))
+    {
+        Page page;
+        page.coverage.assign(size_t(m_pageSize) * m_pageSize, 0);
+        m_pages.push_back(std::move(page));
+        Allocate(m_pages.back(), width, height, x, y);
+    }
+
+    uint8_t * coverage = m_pages.back().coverage.data() + size_t(y) * m_pageSize + x;
+    if (m_rasterizer)
+    {
+        m_rasterizer(key, width, height, coverage, m_pageSize);
+    }
+
+    AtlasSlot slot = {
+        uint16_t(m_pages.size() - 1),
+        uint16_t(x),
+        uint16_t(y),
+        uint16_t(width),
+        uint16_t(height),
+    };
+    return m_slots.emplace(key, slot).first->second;
+}
+
+void BuildGlyphQuads(
+    CellGrid const & grid,
+    CellRect const & region,
+    GridLayout const & layout,
+    GlyphAtlas & atlas,
+    std::vector<GlyphQuad> & quads)
+{
+    for (uint32_t y = region.top; y < region.bottom; y++)
+    {
+        Cell const * row = &grid.At(0, y);
+        for (uint32_t x = region.left; x < region.right; x++)
+        {
+            Cell const & cell = row[x];
+            if (cell.glyph == U' ' || cell.glyph == 0)
+            {
+                continue;
+            }
+
+            GlyphQuad quad;
+            quad.x = layout.originX + int32_t(x * layout.tileWidth);
+            quad.y = layout.originY + int32_t(y * layout.tileHeight);
+            quad.source = atlas.Find({ cell.glyph, cell.style }, layout.tileWidth, layout.tileHeight);
+            quad.color = cell.foreground;
+            quads.push_back(quad);
+        }
+    }
+}
+
+void BgraSurface::FillRect(int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t color)
+{
+    left = std::max(left, 0);
+    top = std::max(top, 0);
+    right = std::min(right, int32_t(m_width));
+    bottom = std::min(bottom, int32_t(m_height));
+
+    for (int32_t y = top; y < bottom; y++)
+    {
+        uint32_t * row = m_pixels.data() + size_t(y) * m_width;
+        std::fill(row + left, row + right, color);
+    }
+}
+
+// Blends color (straight alpha, opaque) over dst with coverage a.
+static inline uint32_t BlendCoverage(uint32_t dst, uint32_t color, uint32_t a)
+{
+    uint32_t inv = 255 - a;
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t v = ((color >> shift) & 0xff) * a + ((dst >> shift) & 0xff) * inv;
+        // Exact division by 255 for v in [0, 255 * 255].
+        v = (v + 1 + (v >> 8)) >> 8;
+        result |= v << shift;
+    }
+    return result;
+}
+
+void CompositeGlyphQuads(
+    std::vector<GlyphQuad> const & quads,
+    GlyphAtlas const & atlas,
+    BgraSurface & surface)
+{
+    int32_t surfaceWidth = int32_t(surface.m_width);
+    int32_t surfaceHeight = int32_t(surface.m_height);
+
+    for (auto const & quad : quads)
+    {
+        int32_t left = std::max(quad.x, 0);
+        int32_t top = std::max(quad.y, 0);
+        int32_t right = std::min(quad.x + int32_t(quad.source.width), surfaceWidth);
+        int32_t bottom = std::min(quad.y + int32_t(quad.source.height), surfaceHeight);
+        if (left >= right || top >= bottom)
+        {
+            continue;
+        }
+
+        uint8_t const * coverage = atlas.Coverage(quad.source);
+        for (int32_t y = top; y < bottom; y++)
+        {
+            uint8_t const * src = coverage + size_t(y - quad.y) * atlas.m_pageSize + (left - quad.x);
+            uint32_t * dst = surface.m_pixels.data() + size_t(y) * surface.m_width;
+            for (int32_t x = left; x < right; x++, src++)
+            {
+                uint32_t a = *src;
+                if (a == 0)
+                {
+                    continue;
+                }
+                dst[x] = a == 255 ? quad.color : BlendCoverage(dst[x], quad.color, a);
+            }
+        }
+    }
+}
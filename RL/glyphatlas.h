@@ -0,0 +1,136 @@
+#pragma once
+
+#include "cellgrid.h"
+
+// Identifies one rasterized glyph: a codepoint drawn in a given style.
+struct GlyphKey
+{
+    char32_t codepoint;
+    uint32_t style;
+};
+
+inline bool operator==(GlyphKey const & a, GlyphKey const & b)
+{
+    return a.codepoint == b.codepoint && a.style == b.style;
+}
+
+struct GlyphKeyHash
+{
+    size_t operator()(GlyphKey const & key) const
+    {
+        return std::hash<uint64_t>()((uint64_t(key.style) << 32) | key.codepoint);
+    }
+};
+
+// Location of a rasterized glyph inside one of the atlas pages.
+struct AtlasSlot
+{
+    uint16_t page;
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+// Caches 8-bit coverage masks for glyphs in square pages packed with a shelf allocator.
+// Each glyph is rasterized once, on the first lookup that misses.
+struct GlyphAtlas
+{
+    // Fills a width x height coverage buffer (0 = transparent, 255 = opaque) for the glyph.
+    using Rasterizer = std::function<void(GlyphKey key, uint32_t width, uint32_t height, uint8_t * coverage, size_t stride)>;
+
+    GlyphAtlas(uint32_t pageSize, Rasterizer rasterizer);
+
+    // Returns the slot for the glyph, rasterizing it into the atlas if needed.
+    // All glyphs of one atlas are expected to share a cell size; call Clear when it changes.
+    AtlasSlot const & Find(GlyphKey key, uint32_t width, uint32_t height);
+
+    // Returns the top-left coverage byte of the slot. Rows are m_pageSize bytes apart.
+    uint8_t const * Coverage(AtlasSlot const & slot) const
+    {
+        return m_pages[slot.page].coverage.data() + size_t(slot.y) * m_pageSize + slot.x;
+    }
+
+    void Clear();
+
+    struct Shelf
+    {
+        uint32_t y;
+        uint32_t height;
+        uint32_t cursor;
+    };
+
+    struct Page
+    {
+        std::vector<uint8_t> coverage;
+        std::vector<Shelf> shelves;
+        uint32_t top = 0;
+    };
+
+    bool Allocate(Page & page, uint32_t width, uint32_t height, uint32_t & x, uint32_t & y);
+
+    uint32_t m_pageSize;
+    Rasterizer m_rasterizer;
+    std::vector<Page> m_pages;
+    std::unordered_map<GlyphKey, AtlasSlot, GlyphKeyHash> m_slots;
+
+    struct {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    } m_stats;
+};
+
+// Places the cell grid on screen: the pixel size of a tile and the pixel offset of cell (0, 0).
+struct GridLayout
+{
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    int32_t originX;
+    int32_t originY;
+};
+
+// One atlas blit: copy the slot's coverage to (x, y) tinted with color.
+struct GlyphQuad
+{
+    int32_t x;
+    int32_t y;
+    AtlasSlot source;
+    uint32_t color;
+};
+
+// Appends one quad per non-blank cell inside region, tinted with the cell's foreground color,
+// rasterizing uncached glyphs on the way.
+void BuildGlyphQuads(
+    CellGrid const & grid,
+    CellRect const & region,
+    GridLayout const & layout,
+    GlyphAtlas & atlas,
+    std::vector<GlyphQuad> & quads);
+
+// CPU-side frame buffer in premultiplied BGRA, one uint32_t (0xAARRGGBB) per pixel.
+struct BgraSurface
+{
+    void Resize(uint32_t width, uint32_t height)
+    {
+        m_width = width;
+        m_height = height;
+        m_pixels.assign(size_t(width) * height, 0);
+    }
+
+    void Fill(uint32_t color)
+    {
+        std::fill(m_pixels.begin(), m_pixels.end(), color);
+    }
+
+    void FillRect(int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t color);
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<uint32_t> m_pixels;
+};
+
+// Reference compositor: blends every quad's coverage over the surface, clipped to its bounds.
+void CompositeGlyphQuads(
+    std::vector<GlyphQuad> const & quads,
+    GlyphAtlas const & atlas,
+    BgraSurface & surface);
@@ -0,0 +1,134 @@
+#include "pch.h"
+
+#include "deviceresources.h"
+#include "gpuprofiler.h"
+
+void GpuProfiler::Initialize(ID3D11Device * device)
+{
+    if (!m_track)
+    {
+        m_track = &CreateProfileTrack("GPU");
+    }
+
+    D3D11_QUERY_DESC disjoint = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+    D3D11_QUERY_DESC timestamp = { D3D11_QUERY_TIMESTAMP, 0 };
+    for (auto & frame : m_frames)
+    {
+        frame = Frame();
+        ReturnIfFailed(device->CreateQuery(&disjoint, &frame.disjoint));
+        ReturnIfFailed(device->CreateQuery(&timestamp, &frame.begin));
+        ReturnIfFailed(device->CreateQuery(&timestamp, &frame.end));
+        for (uint32_t i = 0; i < MaxPasses; i++)
+        {
+            ReturnIfFailed(device->CreateQuery(&timestamp, &frame.passBegin[i]));
+            ReturnIfFailed(device->CreateQuery(&timestamp, &frame.passEnd[i]));
+        }
+    }
+    m_current = 0;
+    m_recording = false;
+    m_inPass = false;
+}
+
+void GpuProfiler::BeginFrame(ID3D11DeviceContext * context)
+{
+    // A frame abandoned part way through (by a failed draw) is closed off first.
+    EndPass(context);
+    EndFrame(context);
+
+    m_recording = m_track && ProfilingEnabled();
+    if (!m_recording)
+    {
+        return;
+    }
+
+    Frame & frame = m_frames[m_current];
+    if (frame.pending)
+    {
+        Resolve(context, frame);
+    }
+
+    context->Begin(frame.disjoint.Get());
+    context->End(frame.begin.Get());
+    frame.cpuBegin = ProfileNow();
+    frame.passCount = 0;
+}
+
+void GpuProfiler::EndFrame(ID3D11DeviceContext * context)
+{
+    if (!m_recording)
+    {
+        return;
+    }
+
+    Frame & frame = m_frames[m_current];
+    context->End(frame.end.Get());
+    context->End(frame.disjoint.Get());
+    frame.pending = true;
+    m_current = (m_current + 1) % FrameLatency;
+    m_recording = false;
+}
+
+void GpuProfiler::BeginPass(ID3D11DeviceContext * context, char const * name)
+{
+    Frame & frame = m_frames[m_current];
+    if (!m_recording || m_inPass || frame.passCount == MaxPasses)
+    {
+        return;
+    }
+
+    context->End(frame.passBegin[frame.passCount].Get());
+    frame.names[frame.passCount] = name;
+    m_inPass = true;
+}
+
+void GpuProfiler::EndPass(ID3D11DeviceContext * context)
+{
+    if (!m_inPass)
+    {
+        return;
+    }
+
+    Frame & frame = m_frames[m_current];
+    context->End(frame.passEnd[frame.passCount].Get());
+    frame.passCount++;
+    m_inPass = false;
+}
+
+void GpuProfiler::Resolve(ID3D11DeviceContext * context, Frame & frame)
+{
+    frame.pending = false;
+
+    auto get = [&](ID3D11Query * query, void * data, UINT size)
+    {
+        return context->GetData(query, data, size, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+    };
+
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    if (!get(frame.disjoint.Get(), &disjoint, sizeof(disjoint)) || disjoint.Disjoint || disjoint.Frequency == 0)
+    {
+        return;
+    }
+
+    UINT64 begin;
+    UINT64 end;
+    if (!get(frame.begin.Get(), &begin, sizeof(begin)) || !get(frame.end.Get(), &end, sizeof(end)))
+    {
+        return;
+    }
+
+    auto toCpu = [&](UINT64 timestamp)
+    {
+        return frame.cpuBegin + int64_t(double(timestamp - begin) * 1e9 / double(disjoint.Frequency));
+    };
+
+    m_track->Push("GPU frame", frame.cpuBegin, toCpu(end) - frame.cpuBegin, ProfileEvent_Scope);
+    for (uint32_t i = 0; i < frame.passCount; i++)
+    {
+        UINT64 passBegin;
+        UINT64 passEnd;
+        if (get(frame.passBegin[i].Get(), &passBegin, sizeof(passBegin)) && get(frame.passEnd[i].Get(), &passEnd, sizeof(passEnd)))
+        {
+            m_track->Push(frame.names[i], toCpu(passBegin), toCpu(passEnd) - toCpu(passBegin), ProfileEvent_Scope);
+        }
+    }
+}
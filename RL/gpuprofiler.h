@@ -0,0 +1,69 @@
+#pragma once
+
+#include "profiler.h"
+
+// Times GPU work with D3D11 timestamp queries and records it on a "GPU" profile track. A frame's
+// queries are read back FrameLatency frames later, when the GPU has long finished with them, and
+// never waited on: a frame whose results are still not ready by then is dropped.
+//
+// GPU timestamps are placed on the CPU timeline relative to when BeginFrame was called, so passes
+// line up with the CPU work that submitted them rather than with when the GPU actually ran them.
+struct GpuProfiler
+{
+    static constexpr uint32_t FrameLatency = 4;
+    static constexpr uint32_t MaxPasses = 8;
+
+    void Initialize(ID3D11Device * device);
+
+    // Does nothing for frames that begin while profiling is disabled. A frame that was never
+    // ended is ended here.
+    void BeginFrame(ID3D11DeviceContext * context);
+    void EndFrame(ID3D11DeviceContext * context);
+
+    // Passes do not nest; past MaxPasses in a frame, passes are not timed.
+    void BeginPass(ID3D11DeviceContext * context, char const * name);
+    void EndPass(ID3D11DeviceContext * context);
+
+    struct Frame
+    {
+        Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+        Microsoft::WRL::ComPtr<ID3D11Query> begin;
+        Microsoft::WRL::ComPtr<ID3D11Query> end;
+        Microsoft::WRL::ComPtr<ID3D11Query> passBegin[MaxPasses];
+        Microsoft::WRL::ComPtr<ID3D11Query> passEnd[MaxPasses];
+        char const * names[MaxPasses];
+        uint32_t passCount = 0;
+        int64_t cpuBegin = 0;
+        bool pending = false;
+    };
+
+    // Records a finished frame's timings, if they are available.
+    void Resolve(ID3D11DeviceContext * context, Frame & frame);
+
+    Frame m_frames[FrameLatency];
+    uint32_t m_current = 0;
+    bool m_recording = false;
+    bool m_inPass = false;
+    ProfileRing * m_track = nullptr;
+};
+
+// Times one GPU pass for the length of its scope.
+struct GpuProfileScope
+{
+    GpuProfileScope(GpuProfiler & profiler, ID3D11DeviceContext * context, char const * name)
+        : m_profiler(profiler), m_context(context)
+    {
+        m_profiler.BeginPass(m_context, name);
+    }
+
+    ~GpuProfileScope()
+    {
+        m_profiler.EndPass(m_context);
+    }
+
+    GpuProfileScope(GpuProfileScope const &) = delete;
+    GpuProfileScope & operator=(GpuProfileScope const &) = delete;
+
+    GpuProfiler & m_profiler;
+    ID3D11DeviceContext * m_context;
+};
@@ -0,0 +1,711 @@
+#include "pch.h"
+
+#include "headless.h"
+
+#include "journal.h"
+#include "profiler.h"
+#include "worldgen.h"
+
+#include <cstdio>
+#include <new>
+#include <queue>
+
+#if defined(_WIN32)
+#include <psapi.h>
+#pragma comment(lib, "psapi")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Headless driver: runs the game core with no window or renderer and reports how fast it
+// advances turns. It is excluded from the app build; on Linux build it with
+//
+//     g++ -std=c++17 -O2 -pthread -o rl-headless headless.cpp headlessdraw.cpp headlessgame.cpp headlessworld.cpp arena.cpp camera.cpp entities.cpp cellbatch.cpp files.cpp flowfield.cpp fov.cpp framegrid.cpp game.cpp glyphatlas.cpp jobsystem.cpp journal.cpp lighting.cpp messagelog.cpp profiler.cpp savegame.cpp scheduler.cpp sceneview.cpp simulation.cpp spatialindex.cpp taskgraph.cpp terminalrenderer.cpp textlayout.cpp worldgen.cpp worldmap.cpp
+//
+// and run, for example, rl-headless --seed 1 --width 1024 --height 1024 --actors 10000 --turns 1000
+// Pass --vision R to give every actor a field of view of radius R, and --compare-pathing 1 to
+// time one flow field against a separate A* search per actor towards the player.
+// --compare-scheduler 1 times the turn scheduler against ticking every actor's energy each tick.
+//
+// Sessions: --record PATH plays --turns random turns of a streamed session on a --width x --height
+// world and journals them; --replay PATH re-runs a journal (from the app or --record) at full
+// speed, checks the state hashes it recorded, and with --hash-every N prints the hash every N turns.
+//
+// --profile PATH records the run (or the replay) with the profiler, prints its summary and writes
+// a Chrome trace to PATH.
+//
+// The benchmarks and checks in Modes below each run in place of the default session, one at a
+// time, and exit non-zero if anything they check is wrong. Each is described where it is defined:
+// headlessworld.cpp for the world, map and entity storage, headlessdraw.cpp for drawing and the
+// render loop, and headlessgame.cpp for turns, threads and memory.
+
+// Allocations from the global heap while --count-allocations is counting. Replacing operator new
+// here replaces it for the whole program, so every form is replaced, each paired with the delete
+// that matches it, and counting costs nothing outside that mode.
+std::atomic<bool> g_countAllocations{ false };
+std::atomic<uint64_t> g_allocations{ 0 };
+
+static void * Allocate(size_t size, std::nothrow_t const &) noexcept
+{
+    if (g_countAllocations.load(std::memory_order_relaxed))
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return malloc(size > 0 ? size : 1);
+}
+
+static void * Allocate(size_t size)
+{
+    if (void * memory = Allocate(size, std::nothrow))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+static void * AllocateAligned(size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    if (g_countAllocations.load(std::memory_order_relaxed))
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    // aligned_alloc wants a whole number of alignments.
+    size_t align = size_t(alignment);
+    size = (std::max<size_t>(size, 1) + align - 1) & ~(align - 1);
+#if defined(_WIN32)
+    return _aligned_malloc(size, align);
+#else
+    return aligned_alloc(align, size);
+#endif
+}
+
+static void * AllocateAligned(size_t size, std::align_val_t alignment)
+{
+    if (void * memory = AllocateAligned(size, alignment, std::nothrow))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+static void FreeAligned(void * memory) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void * operator new(size_t size) { return Allocate(size); }
+void * operator new[](size_t size) { return Allocate(size); }
+void * operator new(size_t size, std::nothrow_t const & tag) noexcept { return Allocate(size, tag); }
+void * operator new[](size_t size, std::nothrow_t const & tag) noexcept { return Allocate(size, tag); }
+void * operator new(size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void * operator new[](size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void * operator new(size_t size, std::align_val_t alignment, std::nothrow_t const & tag) noexcept { return AllocateAligned(size, alignment, tag); }
+void * operator new[](size_t size, std::align_val_t alignment, std::nothrow_t const & tag) noexcept { return AllocateAligned(size, alignment, tag); }
+
+void operator delete(void * memory) noexcept { free(memory); }
+void operator delete[](void * memory) noexcept { free(memory); }
+void operator delete(void * memory, size_t) noexcept { free(memory); }
+void operator delete[](void * memory, size_t) noexcept { free(memory); }
+void operator delete(void * memory, std::nothrow_t const &) noexcept { free(memory); }
+void operator delete[](void * memory, std::nothrow_t const &) noexcept { free(memory); }
+void operator delete(void * memory, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete[](void * memory, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete(void * memory, size_t, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete[](void * memory, size_t, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete(void * memory, std::align_val_t, std::nothrow_t const &) noexcept { FreeAligned(memory); }
+void operator delete[](void * memory, std::align_val_t, std::nothrow_t const &) noexcept { FreeAligned(memory); }
+
+// In the order they were added, which is also the order the usage lists them in.
+static const HeadlessMode Modes[] = {
+    { "--bench-worldgen", "N", 1, BenchWorldgen },
+    { "--bench-save", "PATH", 0, BenchSave },
+    { "--bench-profiler", "N", 1, BenchProfiler },
+    { "--bench-startup", "N", 0, BenchStartup },
+    { "--bench-text", "N", 1, BenchText },
+    { "--bench-batch", "N", 1, BenchBatch },
+    { "--bench-lighting", "N", 1, BenchLighting },
+    { "--simulate-pacing", "S", 1, SimulatePacing },
+    { "--bench-terminal", "N", 1, BenchTerminal },
+    { "--bench-spatial", "N", 1, BenchSpatial },
+    { "--count-allocations", "N", 1, CountAllocations },
+    { "--bench-ai", "N [--ai-threads N]", 1, BenchAi },
+    { "--bench-tiles", "N", 1, BenchTiles },
+    { "--simulate-resize", "N", 1, SimulateResize },
+    { "--bench-diff", "N", 1, BenchDiff },
+    { "--bench-map", "N", 1, BenchMap },
+    { "--check-camera", "N", 1, CheckCamera },
+    { "--stress-handoff", "N", 1, StressHandoff },
+    { "--bench-entities", "N", 1, BenchEntities },
+    { "--bench-atlas", "N", 1, BenchAtlas },
+};
+
+static void PrintUsage(char const * program)
+{
+    fprintf(stderr, "usage: %s [--seed N] [--width N] [--height N] [--actors N] [--turns N] [--vision N] [--compare-pathing 0|1] [--compare-scheduler 0|1] [--record PATH] [--replay PATH [--hash-every N]] [--profile PATH]", program);
+    for (HeadlessMode const & mode : Modes)
+    {
+        fprintf(stderr, " [%s %s]", mode.option, mode.argument);
+    }
+    fprintf(stderr, "\n");
+}
+
+static bool ParseOptions(int argc, char ** argv, HeadlessOptions & options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "missing value for %s\n", name.c_str());
+            return false;
+        }
+
+        char const * text = argv[++i];
+        uint64_t value = strtoull(text, nullptr, 10);
+        HeadlessMode const * mode = nullptr;
+        for (HeadlessMode const & candidate : Modes)
+        {
+            mode = name == candidate.option ? &candidate : mode;
+        }
+
+        if (mode)
+        {
+            if (options.mode)
+            {
+                fprintf(stderr, "%s and %s cannot run together\n", options.mode->option, mode->option);
+                return false;
+            }
+            if (value < mode->least || *text == 0)
+            {
+                fprintf(stderr, "bad value %s for %s\n", text, name.c_str());
+                return false;
+            }
+            options.mode = mode;
+            options.count = value;
+            options.path = text;
+        }
+        else if (name == "--seed") options.seed = value;
+        else if (name == "--width") options.width = uint32_t(value);
+        else if (name == "--height") options.height = uint32_t(value);
+        else if (name == "--actors") options.actors = uint32_t(value);
+        else if (name == "--turns") options.turns = value;
+        else if (name == "--vision") options.vision = uint32_t(value);
+        else if (name == "--compare-pathing") options.comparePathing = value != 0;
+        else if (name == "--compare-scheduler") options.compareScheduler = value != 0;
+        else if (name == "--record") options.recordPath = text;
+        else if (name == "--replay") options.replayPath = text;
+        else if (name == "--hash-every") options.hashEvery = value;
+        else if (name == "--profile") options.profilePath = text;
+        else if (name == "--ai-threads") options.aiThreads = uint32_t(value);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t PeakMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+uint64_t CurrentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.WorkingSetSize;
+#else
+    unsigned long long pages = 0;
+    unsigned long long resident = 0;
+    if (FILE * statm = fopen("/proc/self/statm", "r"))
+    {
+        if (fscanf(statm, "%llu %llu", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident * uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// Reference per-agent search for the pathing comparison: A* with unit-cost 8-way moves and a
+// Chebyshev heuristic. Scratch arrays are reused across searches; stamps mark which entries are live.
+struct AStar
+{
+    bool FindNextStep(Game const & game, int32_t fromX, int32_t fromY, int32_t toX, int32_t toY, int32_t & stepX, int32_t & stepY)
+    {
+        WorldMap const & map = *game.m_world;
+        size_t size = size_t(map.m_width) * map.m_height;
+        if (m_cost.size() != size)
+        {
+            m_cost.assign(size, 0);
+            m_parent.assign(size, 0);
+            m_stamp.assign(size, 0);
+        }
+        m_search++;
+
+        auto heuristic = [&](int32_t x, int32_t y) { return uint32_t(std::max(std::abs(x - toX), std::abs(y - toY))); };
+        auto index = [&](int32_t x, int32_t y) { return uint32_t(size_t(y) * map.m_width + x); };
+
+        using Entry = std::pair<uint32_t, uint32_t>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+        uint32_t start = index(fromX, fromY);
+        uint32_t goal = index(toX, toY);
+        m_stamp[start] = m_search;
+        m_cost[start] = 0;
+        m_parent[start] = start;
+        open.push({ heuristic(fromX, fromY), start });
+
+        while (!open.empty())
+        {
+            uint32_t current = open.top().second;
+            open.pop();
+            if (current == goal)
+            {
+                // Walk back to the tile after the start.
+                while (m_parent[current] != start)
+                {
+                    current = m_parent[current];
+                }
+                stepX = int32_t(current % map.m_width);
+                stepY = int32_t(current / map.m_width);
+                return current != start;
+            }
+
+            int32_t x = int32_t(current % map.m_width);
+            int32_t y = int32_t(current / map.m_width);
+            for (int32_t dy = -1; dy <= 1; dy++)
+            {
+                for (int32_t dx = -1; dx <= 1; dx++)
+                {
+                    if ((dx == 0 && dy == 0) || !game.IsPassable(x + dx, y + dy))
+                    {
+                        continue;
+                    }
+
+                    uint32_t next = index(x + dx, y + dy);
+                    uint32_t cost = m_cost[current] + 1;
+                    if (m_stamp[next] != m_search || cost < m_cost[next])
+                    {
+                        m_stamp[next] = m_search;
+                        m_cost[next] = cost;
+                        m_parent[next] = current;
+                        open.push({ cost + heuristic(x + dx, y + dy), next });
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<uint32_t> m_cost;
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_stamp;
+    uint32_t m_search = 0;
+};
+
+double Milliseconds(std::chrono::nanoseconds duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void PrintPhases(Game const & game)
+{
+    printf("  player      %10.3f ms\n", Milliseconds(game.m_phaseTimes[TurnPhase_Player]));
+    printf("  pathing     %10.3f ms\n", Milliseconds(game.m_phaseTimes[TurnPhase_Pathing]));
+    printf("  actors      %10.3f ms\n", Milliseconds(game.m_phaseTimes[TurnPhase_Actors]));
+    printf("  vision      %10.3f ms  (%zu viewers)\n", Milliseconds(game.m_phaseTimes[TurnPhase_Vision]), game.m_vision.m_viewers.size());
+    printf("  lighting    %10.3f ms  (%llu lights recast)\n", Milliseconds(game.m_phaseTimes[TurnPhase_Lighting]), (unsigned long long)game.m_lighting.m_stats.recast);
+}
+
+void BoxCoverage(GlyphKey key, uint32_t width, uint32_t height, uint8_t * coverage, size_t stride)
+{
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            bool inside = x > 2 && y > 4 && x + 2 < width && y + 4 < height && (x * y + key.codepoint) % 3 != 0;
+            coverage[y * stride + x] = inside ? (key.style & CellStyle_Dim ? 102 : 255) : 0;
+        }
+    }
+}
+
+void InstallGenerated(Game & game, uint64_t seed, std::vector<std::pair<uint32_t, uint32_t>> const & coordinates, std::vector<ChunkUpdate> & chunks)
+{
+    chunks.clear();
+    for (auto const & chunk : coordinates)
+    {
+        ChunkUpdate update = { chunk.first, chunk.second, std::make_shared<MapChunk>() };
+        GenerateChunk(seed, chunk.first, chunk.second, *update.chunk);
+        chunks.push_back(std::move(update));
+    }
+    game.InstallChunks(chunks);
+}
+
+SceneFrames CaptureScenes(uint64_t seed, uint32_t frames)
+{
+    Game game = CreateSessionGame(seed, 1024, 1024);
+    std::vector<std::pair<uint32_t, uint32_t>> missing;
+    std::vector<ChunkUpdate> chunks;
+    auto stream = [&]
+    {
+        missing.clear();
+        ForEachMissingChunk(*game.m_world, game.m_playerX, game.m_playerY, Simulation::StreamRadius, [&](uint32_t chunkX, uint32_t chunkY)
+        {
+            missing.emplace_back(chunkX, chunkY);
+        });
+        if (!missing.empty())
+        {
+            InstallGenerated(game, seed, missing, chunks);
+        }
+    };
+    stream();
+
+    // Walking keeps heading one way for a while.
+    SceneFrames scenes;
+    Random input(seed ^ 0x7e4);
+    scenes.walking.resize(frames);
+    Command command;
+    command.type = CommandType::Move;
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        if (frame % 16 == 0)
+        {
+            command.dx = int8_t(int32_t(input.Below(3)) - 1);
+            command.dy = int8_t(int32_t(input.Below(3)) - 1);
+        }
+        game.Apply(command);
+        stream();
+        CaptureSnapshot(game, scenes.walking[frame]);
+    }
+
+    scenes.messages.resize(frames);
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        char text[96];
+        snprintf(text, sizeof(text), "Message %u: the goblin %s.", frame, input.Chance(2) ? "hits you" : "misses you by a hair's breadth");
+        game.m_messages.Add(text);
+        CaptureSnapshot(game, scenes.messages[frame]);
+    }
+
+    CaptureSnapshot(game, scenes.still);
+    return scenes;
+}
+
+// Prints the profiler's summary of the whole run and writes the trace, if --profile was given.
+static void FinishProfile(HeadlessOptions const & options)
+{
+    if (options.profilePath.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> lines;
+    Arena scratch;
+    FormatProfileOverlay(INT64_MIN, lines, scratch);
+    printf("profile:\n");
+    for (auto const & line : lines)
+    {
+        printf("  %s\n", line.c_str());
+    }
+
+    if (WriteChromeTrace(options.profilePath))
+    {
+        printf("trace written to %s\n", options.profilePath.c_str());
+    }
+    else
+    {
+        fprintf(stderr, "cannot write %s\n", options.profilePath.c_str());
+    }
+}
+
+static int Record(HeadlessOptions const & options)
+{
+    Game game = CreateSessionGame(options.seed, options.width, options.height);
+    JournalWriter journal;
+    if (!journal.Open(options.recordPath, options.seed, options.width, options.height))
+    {
+        fprintf(stderr, "cannot write %s\n", options.recordPath.c_str());
+        return 1;
+    }
+
+    // Same cadence as the simulation: commands, a hash every 100 turns, then any chunks that
+    // became due. Chunks arrive straight away here rather than a few ticks later.
+    Random input(options.seed ^ 0x5eed);
+    std::vector<std::pair<uint32_t, uint32_t>> missing;
+    std::vector<ChunkUpdate> chunks;
+    for (uint64_t turn = 0; turn < options.turns; turn++)
+    {
+        Command command;
+        command.type = input.Chance(10) ? CommandType::Wait : CommandType::Move;
+        command.dx = int8_t(int32_t(input.Below(3)) - 1);
+        command.dy = int8_t(int32_t(input.Below(3)) - 1);
+        if (command.type == CommandType::Wait)
+        {
+            command.dx = command.dy = 0;
+        }
+
+        journal.RecordCommand(command);
+        game.Apply(command);
+        if (game.m_turn % 100 == 0)
+        {
+            journal.RecordHash(game.m_turn, game.StateHash());
+        }
+
+        missing.clear();
+        ForEachMissingChunk(*game.m_world, game.m_playerX, game.m_playerY, 4, [&](uint32_t chunkX, uint32_t chunkY)
+        {
+            missing.emplace_back(chunkX, chunkY);
+        });
+        if (!missing.empty())
+        {
+            InstallGenerated(game, options.seed, missing, chunks);
+            journal.RecordChunks(chunks);
+        }
+    }
+    journal.Close();
+
+    printf("recorded %llu turns to %s, player at (%d, %d)\n", (unsigned long long)game.m_turn, options.recordPath.c_str(), game.m_playerX, game.m_playerY);
+    return 0;
+}
+
+static int Replay(HeadlessOptions const & options)
+{
+    JournalReader reader;
+    if (!reader.Open(options.replayPath))
+    {
+        fprintf(stderr, "cannot read journal %s\n", options.replayPath.c_str());
+        return 1;
+    }
+
+    JournalHeader const & header = reader.m_header;
+    Game game = CreateSessionGame(header.seed, header.width, header.height);
+
+    JournalRecord record;
+    std::vector<ChunkUpdate> chunks;
+    std::chrono::nanoseconds chunkTime{};
+    uint64_t checked = 0;
+    uint64_t mismatched = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (reader.Next(record))
+    {
+        switch (record.kind)
+        {
+        case JournalRecord_Command:
+            for (uint64_t i = 0; i < record.count; i++)
+            {
+                game.Apply(record.command);
+                if (options.hashEvery > 0 && game.m_turn % options.hashEvery == 0)
+                {
+                    printf("turn %8llu  hash %016llx\n", (unsigned long long)game.m_turn, (unsigned long long)game.StateHash());
+                }
+            }
+            break;
+
+        case JournalRecord_Chunks:
+        {
+            auto chunkStart = std::chrono::steady_clock::now();
+            InstallGenerated(game, header.seed, record.chunks, chunks);
+            chunkTime += std::chrono::steady_clock::now() - chunkStart;
+            break;
+        }
+
+        case JournalRecord_Hash:
+            checked++;
+            if (record.turn != game.m_turn || record.hash != game.StateHash())
+            {
+                if (mismatched++ == 0)
+                {
+                    printf("desync: journal has turn %llu hash %016llx, replay is at turn %llu hash %016llx\n",
+                        (unsigned long long)record.turn, (unsigned long long)record.hash,
+                        (unsigned long long)game.m_turn, (unsigned long long)game.StateHash());
+                }
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("replayed %s: seed %llu, map %ux%u, %llu turns, %zu bytes\n", options.replayPath.c_str(),
+        (unsigned long long)header.seed, header.width, header.height, (unsigned long long)game.m_turn, reader.m_data.size());
+    printf("replay        %10.3f ms  (%.1f turns/sec)\n", seconds * 1000.0, seconds > 0 ? game.m_turn / seconds : 0.0);
+    PrintPhases(game);
+    printf("  chunks      %10.3f ms\n", Milliseconds(chunkTime));
+    printf("hashes        %llu checked, %llu mismatched\n", (unsigned long long)checked, (unsigned long long)mismatched);
+    printf("player at (%d, %d)\n", game.m_playerX, game.m_playerY);
+    FinishProfile(options);
+    return mismatched == 0 ? 0 : 1;
+}
+
+int main(int argc, char ** argv)
+{
+    HeadlessOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (!options.profilePath.empty())
+    {
+        NameProfileThread("Main");
+        EnableProfiling(true);
+    }
+
+    if (!options.recordPath.empty())
+    {
+        return Record(options);
+    }
+    if (!options.replayPath.empty())
+    {
+        return Replay(options);
+    }
+    if (options.mode)
+    {
+        return options.mode->run(options);
+    }
+
+    auto setupStart = std::chrono::steady_clock::now();
+    Game game(CreateRandomWorld(options.width, options.height, options.seed), options.seed);
+    if (options.vision > 0)
+    {
+        game.EnableActorVision(options.vision);
+    }
+    game.SpawnActors(options.Actors());
+    auto setupEnd = std::chrono::steady_clock::now();
+
+    // The player wanders randomly, driven by its own stream so the game's stream is unaffected.
+    Random input(options.seed ^ 0x5eed);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t turn = 0; turn < options.turns; turn++)
+    {
+        Command command;
+        command.type = CommandType::Move;
+        command.dx = int8_t(int32_t(input.Below(3)) - 1);
+        command.dy = int8_t(int32_t(input.Below(3)) - 1);
+
+        ProfileScope("Turn");
+        game.Apply(command);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("seed %llu, map %ux%u, %zu actors, %llu turns\n",
+        (unsigned long long)options.seed, options.width, options.height, game.ActorCount(), (unsigned long long)game.m_turn);
+    printf("setup         %10.3f ms\n", Milliseconds(setupEnd - setupStart));
+    printf("turns         %10.3f ms  (%.1f turns/sec)\n", seconds * 1000.0, seconds > 0 ? options.turns / seconds : 0.0);
+    PrintPhases(game);
+    printf("peak memory   %10.1f MiB\n", PeakMemory() / (1024.0 * 1024.0));
+    printf("player at (%d, %d)\n", game.m_playerX, game.m_playerY);
+    FinishProfile(options);
+
+    if (options.comparePathing)
+    {
+        // One unbounded flow field plus an O(1) step per actor, against one A* search per actor.
+        std::vector<Position> actors;
+        game.m_entities.Each<Position, Monster>([&](Position const & position, Monster const &)
+        {
+            actors.push_back(position);
+        });
+        std::vector<std::pair<int32_t, int32_t>> steps(actors.size());
+
+        auto flowStart = std::chrono::steady_clock::now();
+        FlowField field;
+        field.Build(*game.m_world, { { game.m_playerX, game.m_playerY } });
+        size_t flowReached = 0;
+        for (size_t i = 0; i < actors.size(); i++)
+        {
+            flowReached += field.NextStep(actors[i].x, actors[i].y, steps[i].first, steps[i].second);
+        }
+        auto flowEnd = std::chrono::steady_clock::now();
+
+        AStar search;
+        size_t searchReached = 0;
+        for (size_t i = 0; i < actors.size(); i++)
+        {
+            searchReached += search.FindNextStep(game, actors[i].x, actors[i].y, game.m_playerX, game.m_playerY, steps[i].first, steps[i].second);
+        }
+        auto searchEnd = std::chrono::steady_clock::now();
+
+        printf("pathing for %zu actors\n", actors.size());
+        printf("  flow field  %10.3f ms  (%zu reachable)\n", Milliseconds(flowEnd - flowStart), flowReached);
+        printf("  A*          %10.3f ms  (%zu reachable)\n", Milliseconds(searchEnd - flowEnd), searchReached);
+    }
+
+    if (options.compareScheduler)
+    {
+        // Run the same actors for as many ticks as the game's turns took, once through the
+        // timing wheel and once by adding every actor's speed to its energy on every tick.
+        uint64_t ticks = options.turns * TurnScheduler::ActionCost / TurnScheduler::NormalSpeed;
+        std::vector<uint16_t> speeds(options.Actors());
+        for (auto & speed : speeds)
+        {
+            speed = uint16_t(50 + input.Below(151));
+        }
+
+        auto wheelStart = std::chrono::steady_clock::now();
+        TurnScheduler scheduler;
+        for (auto speed : speeds)
+        {
+            scheduler.Spend(scheduler.Add(EntityHandle(), speed), 0);
+        }
+        std::vector<uint32_t> due;
+        uint64_t wheelActions = 0;
+        uint64_t batches = 0;
+        while (scheduler.NextBatch(due) && scheduler.m_now <= ticks)
+        {
+            for (uint32_t id : due)
+            {
+                scheduler.Spend(id);
+            }
+            wheelActions += due.size();
+            batches++;
+        }
+        auto wheelEnd = std::chrono::steady_clock::now();
+
+        std::vector<int32_t> energy(speeds.size(), 0);
+        uint64_t scanActions = 0;
+        for (uint64_t tick = 0; tick < ticks; tick++)
+        {
+            for (size_t i = 0; i < speeds.size(); i++)
+            {
+                energy[i] += speeds[i];
+                if (energy[i] >= TurnScheduler::ActionCost)
+                {
+                    energy[i] -= TurnScheduler::ActionCost;
+                    scanActions++;
+                }
+            }
+        }
+        auto scanEnd = std::chrono::steady_clock::now();
+
+        printf("scheduling %zu actors over %llu ticks\n", speeds.size(), (unsigned long long)ticks);
+        printf("  wheel       %10.3f ms  (%llu actions in %llu batches)\n",
+            Milliseconds(wheelEnd - wheelStart), (unsigned long long)wheelActions, (unsigned long long)batches);
+        printf("  scan        %10.3f ms  (%llu actions)\n", Milliseconds(scanEnd - wheelEnd), (unsigned long long)scanActions);
+    }
+
+    return 0;
+}
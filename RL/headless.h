@@ -0,0 +1,117 @@
+#pragma once
+
+#include "game.h"
+#include "glyphatlas.h"
+#include "simulation.h"
+
+#include <atomic>
+#include <chrono>
+
+// Shared by the headless driver in headless.cpp and the benchmarks and checks it can run in place
+// of its default session, which live in headlessworld.cpp, headlessdraw.cpp and headlessgame.cpp.
+
+struct HeadlessMode;
+
+struct HeadlessOptions
+{
+    uint64_t seed = 1;
+    uint32_t width = 256;
+    uint32_t height = 256;
+    uint32_t actors = 0;
+    uint64_t turns = 1000;
+    uint32_t vision = 0;
+    bool comparePathing = false;
+    bool compareScheduler = false;
+    std::string recordPath;
+    std::string replayPath;
+    uint64_t hashEvery = 0;
+    std::string profilePath;
+    uint32_t aiThreads = 0;
+
+    // The benchmark or check to run instead of the default session, and its argument: a count,
+    // or the text of a path for the modes that take one.
+    HeadlessMode const * mode = nullptr;
+    uint64_t count = 0;
+    std::string path;
+
+    // --actors, or the given default when it was left out.
+    uint32_t Actors(uint32_t fallback = 1000) const
+    {
+        return actors > 0 ? actors : fallback;
+    }
+};
+
+// A benchmark or check: the option that selects it, its argument as the usage shows it, the
+// smallest count it accepts (paths must not be empty) and the function that runs it, which
+// returns the exit code: non-zero if anything it checks was wrong.
+struct HeadlessMode
+{
+    char const * option;
+    char const * argument;
+    uint64_t least;
+    int (*run)(HeadlessOptions const & options);
+};
+
+// World, map and entity storage; in headlessworld.cpp.
+int BenchWorldgen(HeadlessOptions const & options);
+int BenchSave(HeadlessOptions const & options);
+int BenchStartup(HeadlessOptions const & options);
+int BenchLighting(HeadlessOptions const & options);
+int BenchSpatial(HeadlessOptions const & options);
+int BenchTiles(HeadlessOptions const & options);
+int BenchMap(HeadlessOptions const & options);
+int BenchEntities(HeadlessOptions const & options);
+
+// Drawing and the render loop; in headlessdraw.cpp.
+int BenchAtlas(HeadlessOptions const & options);
+int BenchText(HeadlessOptions const & options);
+int BenchBatch(HeadlessOptions const & options);
+int BenchTerminal(HeadlessOptions const & options);
+int BenchDiff(HeadlessOptions const & options);
+int CheckCamera(HeadlessOptions const & options);
+int SimulatePacing(HeadlessOptions const & options);
+int SimulateResize(HeadlessOptions const & options);
+
+// Turns, threads and memory; in headlessgame.cpp.
+int BenchAi(HeadlessOptions const & options);
+int CountAllocations(HeadlessOptions const & options);
+int BenchProfiler(HeadlessOptions const & options);
+int StressHandoff(HeadlessOptions const & options);
+
+// Allocations from the global heap while g_countAllocations is set. headless.cpp replaces
+// operator new for the whole program to count them.
+extern std::atomic<bool> g_countAllocations;
+extern std::atomic<uint64_t> g_allocations;
+
+// The most dirty rectangles the app's renderer redraws a frame with.
+static const size_t AppDirtyRects = 8;
+
+double Milliseconds(std::chrono::nanoseconds duration);
+
+// Peak resident set size of the process in bytes.
+uint64_t PeakMemory();
+
+// Resident set size of the process right now, in bytes.
+uint64_t CurrentMemory();
+
+// Prints the time the game spent in each phase of its turns.
+void PrintPhases(Game const & game);
+
+// Glyph coverage for the atlas when there is no font. It only has to be deterministic: a box
+// with soft edges.
+void BoxCoverage(GlyphKey key, uint32_t width, uint32_t height, uint8_t * coverage, size_t stride);
+
+// Generates the given chunks on this thread and installs them, as the simulation would once
+// its workers hand them over.
+void InstallGenerated(Game & game, uint64_t seed, std::vector<std::pair<uint32_t, uint32_t>> const & coordinates, std::vector<ChunkUpdate> & chunks);
+
+// Snapshots of a streamed session for the typical frames: walking, where the camera scrolls as
+// well as the player moving within it; a new message each frame; and standing still.
+struct SceneFrames
+{
+    std::vector<RenderSnapshot> walking;
+    std::vector<RenderSnapshot> messages;
+    RenderSnapshot still;
+};
+
+SceneFrames CaptureScenes(uint64_t seed, uint32_t frames);
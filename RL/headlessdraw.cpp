@@ -0,0 +1,991 @@
+#include "pch.h"
+
+#include "headless.h"
+
+#include "camera.h"
+#include "cellbatch.h"
+#include "framegrid.h"
+#include "framepacer.h"
+#include "messagelog.h"
+#include "profiler.h"
+#include "sceneview.h"
+#include "terminalrenderer.h"
+#include "worldgen.h"
+
+#include <cstdio>
+#include <thread>
+
+// Headless benchmarks and checks of drawing: the glyph atlas, the scene view, camera, message
+// log, frame diffs, cell batches and terminal output, and the render loop's pacing and resizing on
+// a simulated clock. Each runs in place of the default session when its option is given to
+// rl-headless; see headless.cpp.
+
+// --bench-atlas N looks up N glyphs of varied sizes, each a different codepoint and style, in a
+// small glyph atlas and times allocating their slots, finding them again, and compositing a
+// screenful of them. Every slot is checked to lie inside its page without overlapping another and
+// to be found again unchanged, and the glyphs must spill onto a new page once one is full.
+int BenchAtlas(HeadlessOptions const & options)
+{
+    uint32_t count = uint32_t(options.count);
+    const uint32_t pageSize = 256;
+    static const uint32_t Heights[] = { 10, 14, 18, 22, 26, 30 };
+
+    struct Glyph
+    {
+        GlyphKey key;
+        uint32_t width;
+        uint32_t height;
+    };
+    std::vector<Glyph> glyphs(count);
+    Random random(options.seed);
+    uint64_t area = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        glyphs[i] = { { char32_t(0x20 + i / 4), i % 4 }, 4 + random.Below(21), Heights[random.Below(6)] };
+        area += glyphs[i].width * glyphs[i].height;
+    }
+
+    // Without a rasterizer, the first pass times only the shelf allocator and the slot table.
+    GlyphAtlas atlas(pageSize, nullptr);
+    std::vector<AtlasSlot> slots(count);
+    auto allocateStart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        slots[i] = atlas.Find(glyphs[i].key, glyphs[i].width, glyphs[i].height);
+    }
+    auto allocateEnd = std::chrono::steady_clock::now();
+    uint64_t changed = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AtlasSlot const & slot = atlas.Find(glyphs[i].key, glyphs[i].width, glyphs[i].height);
+        changed += memcmp(&slot, &slots[i], sizeof(AtlasSlot)) != 0;
+    }
+    auto findEnd = std::chrono::steady_clock::now();
+
+    // Marks every slot's pixels on its page; a pixel marked twice belongs to two slots.
+    uint64_t outside = 0;
+    uint64_t overlapping = 0;
+    std::vector<std::vector<uint8_t>> used(atlas.m_pages.size(), std::vector<uint8_t>(size_t(pageSize) * pageSize, 0));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AtlasSlot const & slot = slots[i];
+        if (slot.page >= used.size() || slot.x + slot.width > pageSize || slot.y + slot.height > pageSize ||
+            slot.width != glyphs[i].width || slot.height != glyphs[i].height)
+        {
+            outside++;
+            continue;
+        }
+        bool overlaps = false;
+        for (uint32_t y = slot.y; y < uint32_t(slot.y + slot.height); y++)
+        {
+            uint8_t * row = used[slot.page].data() + size_t(y) * pageSize;
+            for (uint32_t x = slot.x; x < uint32_t(slot.x + slot.width); x++)
+            {
+                overlaps |= row[x] != 0;
+                row[x] = 1;
+            }
+        }
+        overlapping += overlaps;
+    }
+    bool rolledOver = area <= uint64_t(pageSize) * pageSize || atlas.m_pages.size() > 1;
+
+    printf("glyph atlas, %u glyphs on %zu pages of %ux%u (%.0f%% of their area used)\n", count, atlas.m_pages.size(),
+        pageSize, pageSize, 100.0 * area / (double(atlas.m_pages.size()) * pageSize * pageSize));
+    printf("  allocate    %8.1f ns per glyph\n", Milliseconds(allocateEnd - allocateStart) * 1000000.0 / count);
+    printf("  find again  %8.1f ns per glyph  (%llu changed)\n", Milliseconds(findEnd - allocateEnd) * 1000000.0 / count,
+        (unsigned long long)changed);
+    printf("  %llu outside their page or resized, %llu overlapping, %s\n", (unsigned long long)outside,
+        (unsigned long long)overlapping, rolledOver ? "new pages when full" : "NO NEW PAGE");
+
+    // A 1920x1080 screen of 14x22 cells, each drawing one of the glyphs rasterized as boxes.
+    GlyphAtlas drawn(1024, BoxCoverage);
+    BgraSurface surface;
+    surface.Resize(1920, 1080);
+    std::vector<GlyphQuad> quads;
+    for (uint32_t y = 0; y + 22 <= surface.m_height; y += 22)
+    {
+        for (uint32_t x = 0; x + 14 <= surface.m_width; x += 14)
+        {
+            Glyph const & glyph = glyphs[random.Below(count)];
+            AtlasSlot const & slot = drawn.Find(glyph.key, std::min(glyph.width, 14u), std::min(glyph.height, 22u));
+            quads.push_back({ int32_t(x), int32_t(y), slot, 0xff000000 | random.Below(0x1000000) });
+        }
+    }
+    const uint32_t frames = 100;
+    auto compositeStart = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        CompositeGlyphQuads(quads, drawn, surface);
+    }
+    auto compositeEnd = std::chrono::steady_clock::now();
+    printf("  composite   %8.3f ms per frame  (%zu quads)\n", Milliseconds(compositeEnd - compositeStart) / frames, quads.size());
+
+    if (changed != 0 || outside != 0 || overlapping != 0 || !rolledOver)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-text N fills a message log with N random messages and times drawing a log panel from
+// it: laid out every frame, from the layout cache, with a new message each frame, scrolling, and
+// resizing. Every cached layout is checked against a fresh one.
+int BenchText(HeadlessOptions const & options)
+{
+    uint32_t textMessages = uint32_t(options.count);
+    static const char * const Words[] = {
+        "the", "goblin", "hits", "you", "misses", "zombie", "shambles", "closer", "bat", "flutters",
+        "past", "something", "blocks", "your", "way", "you", "feel", "much", "better", "now",
+        "an", "unreasonably", "long", "incomprehensibilities", "\u00e9t\u00e9", "\u4e16\u754c", "e\u0301",
+    };
+
+    Random words(options.seed);
+    MessageLog log;
+    std::string text;
+    auto addMessage = [&]
+    {
+        text.clear();
+        uint32_t count = 2 + words.Below(24);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            text += i > 0 ? " " : "";
+            text += Words[words.Below(uint32_t(std::size(Words)))];
+        }
+        log.Add(text);
+    };
+    for (uint32_t i = 0; i < textMessages; i++)
+    {
+        addMessage();
+    }
+
+    const uint32_t panelWidth = 80;
+    const uint32_t panelHeight = 10;
+    const uint32_t frames = 10000;
+    CellGrid grid;
+    grid.Resize(panelWidth, panelHeight);
+    CellRect area = { 0, 0, panelWidth, panelHeight };
+    TextLayoutCache cache(MonospaceWidth);
+    MessageLogPanel panel;
+
+    auto report = [&](char const * name, std::chrono::nanoseconds duration)
+    {
+        printf("  %-26s %10.3f us per frame\n", name, duration.count() / 1e3 / frames);
+    };
+    printf("message log, %zu messages, %ux%u panel, %u frames\n", log.Count(), panelWidth, panelHeight, frames);
+
+    // What laying out with every draw costs: each visible message from scratch, every frame.
+    TextLayout layout;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        uint32_t row = panelHeight;
+        for (size_t i = 0; i < log.Count() && row > 0; i++)
+        {
+            std::string_view message = log.Recent(i);
+            LayoutText(message, panelWidth, MonospaceWidth, layout);
+            for (size_t line = layout.lines.size(); line-- > 0 && row > 0;)
+            {
+                DrawTextLine(grid, 0, --row, panelWidth, message, layout.lines[line], MonospaceWidth);
+            }
+        }
+    }
+    report("layout every frame", std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        panel.Draw(log, cache, grid, area);
+        cache.EndFrame();
+    }
+    report("cached", std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        panel.Draw(log, cache, grid, area);
+        cache.EndFrame();
+        addMessage();
+    }
+    report("cached, a message a frame", std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        panel.Scroll(frame % 200 < 100 ? 1 : -1);
+        panel.Draw(log, cache, grid, area);
+        cache.EndFrame();
+    }
+    report("cached, scrolling", std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        uint32_t width = panelWidth - frame % 16;
+        panel.Draw(log, cache, grid, CellRect{ 0, 0, width, panelHeight });
+        cache.EndFrame();
+    }
+    report("cached, resizing", std::chrono::steady_clock::now() - start);
+    printf("  layout cache: %llu hits, %llu misses, %zu cached\n",
+        (unsigned long long)cache.m_stats.hits, (unsigned long long)cache.m_stats.misses, cache.m_entries.size());
+
+    // Cached layouts must match fresh ones, and no line may be wider than the panel.
+    size_t mismatched = 0;
+    for (size_t i = 0; i < log.Count(); i++)
+    {
+        std::string_view message = log.Recent(i);
+        TextLayout const & cached = cache.Layout(message, panelWidth);
+        LayoutText(message, panelWidth, MonospaceWidth, layout);
+        bool same = cached.lines.size() == layout.lines.size();
+        for (size_t line = 0; same && line < layout.lines.size(); line++)
+        {
+            same = memcmp(&cached.lines[line], &layout.lines[line], sizeof(TextLine)) == 0 && layout.lines[line].width <= panelWidth;
+        }
+        mismatched += !same;
+    }
+    printf("  %zu layouts checked, %zu wrong\n", log.Count(), mismatched);
+    if (mismatched != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-batch N draws a 160x48 screen of generated map N times, once a fill and a glyph per
+// cell and once through the run-length batches, and compares draw calls, color changes, time
+// and the pixels produced.
+int BenchBatch(HeadlessOptions const & options)
+{
+    uint32_t batchFrames = uint32_t(options.count);
+
+    // A screenful of generated map around the centre of a world, dimmed outside a circle
+    // the way the field of view dims it.
+    const uint32_t columns = 160;
+    const uint32_t rows = 48;
+    auto world = CreateProceduralWorld(1024, 1024, options.seed, 4);
+    CellGrid grid;
+    grid.Resize(columns, rows);
+    for (uint32_t y = 0; y < rows; y++)
+    {
+        for (uint32_t x = 0; x < columns; x++)
+        {
+            TileType tile = world->Tile(512 - columns / 2 + x, 512 - rows / 2 + y);
+            uint32_t background = TileBackgrounds[tile];
+            int32_t dx = int32_t(x) - int32_t(columns / 2);
+            int32_t dy = int32_t(y) - int32_t(rows / 2);
+            bool seen = dx * dx + dy * dy * 4 < 24 * 24;
+            Cell & cell = grid.At(x, y);
+            cell.glyph = TileGlyphs[tile];
+            cell.style = seen ? CellStyle_Normal : CellStyle_Dim;
+            cell.foreground = TileForegrounds[tile];
+            cell.background = seen ? background : (background & 0xff000000) | ((background >> 1) & 0x7f7f7f);
+        }
+    }
+
+    GlyphAtlas atlas(1024, BoxCoverage);
+    GridLayout layout = { 14, 22, 0, 0 };
+    CellRect region = { 0, 0, columns, rows };
+    BgraSurface perCell;
+    BgraSurface batched;
+    perCell.Resize(columns * layout.tileWidth, rows * layout.tileHeight);
+    batched.Resize(columns * layout.tileWidth, rows * layout.tileHeight);
+
+    // Drawing cell by cell sets the background color, fills, sets the glyph color and
+    // draws, changing the brush whenever the color differs from the last one used.
+    uint64_t cellFills = uint64_t(columns) * rows;
+    uint64_t cellGlyphs = 0;
+    uint64_t cellColorChanges = 0;
+    uint32_t lastColor = 0;
+    for (Cell const & cell : grid.m_cells)
+    {
+        cellColorChanges += cell.background != lastColor;
+        lastColor = cell.background;
+        if (cell.glyph != U' ' && cell.glyph != 0)
+        {
+            cellGlyphs++;
+            cellColorChanges += cell.foreground != lastColor;
+            lastColor = cell.foreground;
+        }
+    }
+
+    std::vector<GlyphQuad> quads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < batchFrames; frame++)
+    {
+        for (uint32_t y = 0; y < rows; y++)
+        {
+            for (uint32_t x = 0; x < columns; x++)
+            {
+                int32_t left = int32_t(x * layout.tileWidth);
+                int32_t top = int32_t(y * layout.tileHeight);
+                perCell.FillRect(left, top, left + int32_t(layout.tileWidth), top + int32_t(layout.tileHeight), grid.At(x, y).background);
+            }
+        }
+        quads.clear();
+        BuildGlyphQuads(grid, region, layout, atlas, quads);
+        CompositeGlyphQuads(quads, atlas, perCell);
+    }
+    auto perCellTime = std::chrono::steady_clock::now() - start;
+
+    CellBatches batches;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < batchFrames; frame++)
+    {
+        batches.Clear();
+        BuildCellBatches(grid, region, layout, atlas, batches);
+        FinishCellBatches(batches);
+        CompositeCellBatches(batches, atlas, batched);
+    }
+    auto batchedTime = std::chrono::steady_clock::now() - start;
+
+    // Fills are one color each, and the glyphs of a batch share the next one.
+    uint64_t batchColorChanges = 0;
+    lastColor = 0;
+    for (auto const & span : batches.spans)
+    {
+        batchColorChanges += span.color != lastColor;
+        lastColor = span.color;
+    }
+    batchColorChanges += batches.batches.size();
+
+    printf("%ux%u cells, %u frames\n", columns, rows, batchFrames);
+    printf("  per cell   %6llu fills  %6llu glyph draws  %6llu color changes  %8.3f ms per frame\n",
+        (unsigned long long)cellFills, (unsigned long long)cellGlyphs, (unsigned long long)cellColorChanges,
+        Milliseconds(perCellTime) / batchFrames);
+    printf("  batched    %6zu fills  %6zu glyph batches %5llu color changes  %8.3f ms per frame\n",
+        batches.spans.size(), batches.batches.size(), (unsigned long long)batchColorChanges,
+        Milliseconds(batchedTime) / batchFrames);
+    printf("  pixels %s\n", perCell.m_pixels == batched.m_pixels ? "identical" : "DIFFERENT");
+    if (perCell.m_pixels != batched.m_pixels)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-terminal N draws N frames of each of a few typical scenes (idle, walking through a
+// streamed world, a new message every frame, scrolling the log, and a full redraw) on a 120x40
+// terminal, in 24-bit and 256 colors, and reports the bytes, cells, cursor moves and color
+// changes the terminal renderer emits per frame and the time to lay out and encode a frame.
+int BenchTerminal(HeadlessOptions const & options)
+{
+    uint32_t frames = uint32_t(options.count);
+    const uint32_t columns = 120;
+    const uint32_t rows = 40;
+
+    // The scenes are captured up front, so both color modes draw the same frames.
+    SceneFrames scenes = CaptureScenes(options.seed, frames);
+    auto const & walking = scenes.walking;
+    auto const & messages = scenes.messages;
+    auto const & still = scenes.still;
+
+    static char const * const SceneNames[] = { "idle", "walking", "new message", "log scroll", "full redraw" };
+    printf("terminal frames, %ux%u cells, %u frames per scene\n", columns, rows, frames);
+    for (TerminalColors colors : { TerminalColors::TrueColor, TerminalColors::Palette256 })
+    {
+        printf(colors == TerminalColors::TrueColor ? "  24-bit color\n" : "  256 colors\n");
+        for (uint32_t scene = 0; scene < 5; scene++)
+        {
+            SceneView view;
+            view.m_textLayouts = std::make_unique<TextLayoutCache>(MonospaceWidth);
+            TerminalRenderer renderer;
+            renderer.m_colors = colors;
+            CellGrid grid;
+            grid.Resize(columns, rows);
+
+            // The first frame of every scene writes the whole screen and is not counted.
+            RenderSnapshot const & first = scene == 1 ? walking[0] : scene == 2 ? messages[0] : still;
+            view.Draw(first, grid, true);
+            renderer.Render(grid);
+            auto before = renderer.m_stats;
+
+            std::chrono::nanoseconds elapsed{ 0 };
+            for (uint32_t frame = 0; frame < frames; frame++)
+            {
+                RenderSnapshot const * snapshot = &still;
+                if (scene == 1) snapshot = &walking[frame];
+                else if (scene == 2) snapshot = &messages[frame];
+                else if (scene == 3) view.m_logPanel.Scroll(frame % 8 < 4 ? 1 : -1);
+                else if (scene == 4) renderer.Invalidate();
+
+                auto start = std::chrono::steady_clock::now();
+                view.Draw(*snapshot, grid, renderer.m_full);
+                renderer.Render(grid);
+                elapsed += std::chrono::steady_clock::now() - start;
+            }
+
+            auto const & after = renderer.m_stats;
+            printf("    %-12s %8.0f bytes %7.1f cells %6.1f moves %6.1f colors per frame  %7.3f ms per frame\n",
+                SceneNames[scene],
+                double(after.bytes - before.bytes) / frames,
+                double(after.cellsWritten - before.cellsWritten) / frames,
+                double(after.cursorMoves - before.cursorMoves) / frames,
+                double(after.colorChanges - before.colorChanges) / frames,
+                Milliseconds(elapsed) / frames);
+        }
+    }
+    return 0;
+}
+
+// --bench-diff N diffs N frames of random changes on grids of random sizes, checking that the
+// dirty cells FrameGrid counts are exactly the cells that changed and that the merged rectangles
+// cover all of them within the limit. It then draws N frames of each typical scene (idle,
+// walking, a new message every frame, scrolling the log) on a 120x40 grid, diffs them as the app
+// does, and reports the cells changed, the cells redrawn and the rectangles per frame.
+int BenchDiff(HeadlessOptions const & options)
+{
+    uint32_t diffFrames = uint32_t(options.count);
+
+    // Random frames: a few scattered cells, or a block, change on top of the previous frame.
+    Random random(options.seed ^ 0xd1ff);
+    uint64_t changedCells = 0;
+    uint64_t failures = 0;
+    std::vector<CellRect> rects;
+    std::vector<uint8_t> dirtyCells;
+    std::vector<uint8_t> covered;
+    FrameGrid frame;
+    for (uint32_t trial = 0; trial < diffFrames; trial++)
+    {
+        if (trial % 64 == 0)
+        {
+            frame.Resize(1 + random.Below(160), 1 + random.Below(60));
+            frame.Diff(rects, AppDirtyRects);
+        }
+        uint32_t width = frame.m_current.m_width;
+        uint32_t height = frame.m_current.m_height;
+        size_t maxRects = 1 + random.Below(16);
+
+        uint32_t changes = random.Chance(8) ? 0 : 1 + random.Below(width * height / 8 + 1);
+        bool block = random.Chance(4);
+        uint32_t blockLeft = random.Below(width);
+        uint32_t blockTop = random.Below(height);
+        for (uint32_t i = 0; i < changes; i++)
+        {
+            uint32_t x = block ? std::min(blockLeft + random.Below(8), width - 1) : random.Below(width);
+            uint32_t y = block ? std::min(blockTop + random.Below(4), height - 1) : random.Below(height);
+            Cell & cell = frame.m_current.At(x, y);
+            cell.glyph = U'a' + random.Below(26);
+            cell.foreground = random.Chance(2) ? 0xffffffff : 0xff5f5f5f;
+        }
+
+        uint32_t changed = 0;
+        dirtyCells.assign(size_t(width) * height, 0);
+        for (size_t i = 0; i < dirtyCells.size(); i++)
+        {
+            dirtyCells[i] = frame.m_current.m_cells[i] != frame.m_previous.m_cells[i];
+            changed += dirtyCells[i];
+        }
+
+        uint64_t dirtyBefore = frame.m_stats.cellsDirty;
+        frame.Diff(rects, maxRects);
+
+        covered.assign(size_t(width) * height, 0);
+        bool valid = rects.size() <= maxRects && (changed > 0 || rects.empty());
+        for (auto const & rect : rects)
+        {
+            valid &= rect.left < rect.right && rect.top < rect.bottom && rect.right <= width && rect.bottom <= height;
+            for (uint32_t y = rect.top; y < std::min(rect.bottom, height); y++)
+            {
+                for (uint32_t x = rect.left; x < std::min(rect.right, width); x++)
+                {
+                    covered[size_t(y) * width + x] = 1;
+                }
+            }
+        }
+        for (size_t i = 0; i < dirtyCells.size(); i++)
+        {
+            valid &= covered[i] || !dirtyCells[i];
+        }
+        valid &= frame.m_stats.cellsDirty - dirtyBefore == changed;
+        valid &= frame.m_previous.m_cells == frame.m_current.m_cells;
+        changedCells += changed;
+        failures += !valid;
+    }
+    printf("frame diffs, %u random frames, %llu cells changed: %llu wrong\n", diffFrames,
+        (unsigned long long)changedCells, (unsigned long long)failures);
+
+    // Typical frames, drawn and diffed the way the app draws them.
+    const uint32_t columns = 120;
+    const uint32_t rows = 40;
+    SceneFrames scenes = CaptureScenes(options.seed, diffFrames);
+    static char const * const SceneNames[] = { "idle", "walking", "new message", "log scroll" };
+    printf("redrawn cells, %ux%u grid, %u frames per scene, at most %zu rectangles\n", columns, rows, diffFrames, AppDirtyRects);
+    for (uint32_t scene = 0; scene < 4; scene++)
+    {
+        SceneView view;
+        view.m_textLayouts = std::make_unique<TextLayoutCache>(MonospaceWidth);
+        FrameGrid grid;
+        grid.Resize(columns, rows);
+
+        // The first frame of every scene is a full redraw and is not counted.
+        RenderSnapshot const & first = scene == 1 ? scenes.walking[0] : scene == 2 ? scenes.messages[0] : scenes.still;
+        view.Draw(first, grid.m_current, true);
+        grid.Diff(rects, AppDirtyRects);
+        auto before = grid.m_stats;
+
+        uint64_t rectCount = 0;
+        uint32_t idleFrames = 0;
+        for (uint32_t frame = 0; frame < diffFrames; frame++)
+        {
+            RenderSnapshot const * snapshot = &scenes.still;
+            if (scene == 1) snapshot = &scenes.walking[frame];
+            else if (scene == 2) snapshot = &scenes.messages[frame];
+            else if (scene == 3) view.m_logPanel.Scroll(frame % 8 < 4 ? 1 : -1);
+
+            view.Draw(*snapshot, grid.m_current, false);
+            grid.Diff(rects, AppDirtyRects);
+            rectCount += rects.size();
+            idleFrames += rects.empty();
+        }
+
+        auto const & after = grid.m_stats;
+        uint64_t dirty = after.cellsDirty - before.cellsDirty;
+        uint64_t redrawn = after.cellsRedrawn - before.cellsRedrawn;
+        printf("  %-12s %7.1f changed %7.1f redrawn cells %5.2f rects per frame  %5.1f%% of the grid, %u frames with nothing to draw\n",
+            SceneNames[scene],
+            double(dirty) / diffFrames,
+            double(redrawn) / diffFrames,
+            double(rectCount) / diffFrames,
+            100.0 * redrawn / (double(diffFrames) * columns * rows),
+            idleFrames);
+    }
+    if (failures != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --check-camera N moves a camera N times over maps and screens of random sizes, many of them
+// maps smaller than the screen, by centring, scrolling and following a target. After every move
+// it checks the view stays inside the map, or is centred on an axis where the map is smaller,
+// that a followed target stays on screen, and that the visible range is exactly the cells that
+// show the map. It then draws N frames of a scene view following a player about such maps and
+// checks every map cell shows the tile the camera puts there, and cells off the map are blank.
+int CheckCamera(HeadlessOptions const & options)
+{
+    uint32_t cameraTrials = uint32_t(options.count);
+    Random random(options.seed ^ 0xca3);
+    uint64_t cameraFailures = 0;
+    Camera camera;
+    for (uint32_t trial = 0; trial < cameraTrials; trial++)
+    {
+        if (trial % 32 == 0)
+        {
+            camera.SetViewport(random.Below(200), random.Below(80));
+            camera.SetMapSize(random.Below(300), random.Below(120));
+        }
+
+        int32_t targetX = -1;
+        int32_t targetY = -1;
+        switch (random.Below(3))
+        {
+        case 0:
+            camera.CenterOn(int32_t(random.Below(400)) - 50, int32_t(random.Below(200)) - 50);
+            break;
+        case 1:
+            camera.Scroll(int32_t(random.Below(41)) - 20, int32_t(random.Below(41)) - 20);
+            break;
+        default:
+            if (camera.m_mapWidth > 0 && camera.m_mapHeight > 0)
+            {
+                targetX = int32_t(random.Below(camera.m_mapWidth));
+                targetY = int32_t(random.Below(camera.m_mapHeight));
+                camera.Follow(targetX, targetY);
+            }
+            break;
+        }
+
+        // Each axis is clamped to the map, or centred when the map is no bigger than the screen.
+        auto clamped = [](int32_t origin, uint32_t view, uint32_t map)
+        {
+            if (map <= view)
+            {
+                return origin == -int32_t((view - map) / 2);
+            }
+            return origin >= 0 && origin <= int32_t(map - view);
+        };
+        bool valid = clamped(camera.m_x, camera.m_viewWidth, camera.m_mapWidth) && clamped(camera.m_y, camera.m_viewHeight, camera.m_mapHeight);
+        if (targetX >= 0 && camera.m_viewWidth > 0 && camera.m_viewHeight > 0)
+        {
+            valid &= targetX >= camera.m_x && targetX < camera.m_x + int32_t(camera.m_viewWidth);
+            valid &= targetY >= camera.m_y && targetY < camera.m_y + int32_t(camera.m_viewHeight);
+        }
+
+        // The visible range is every screen cell whose tile is on the map, and nothing else.
+        VisibleRange visible = camera.Visible();
+        auto axis = [](int32_t origin, uint32_t view, uint32_t map, int32_t screen, int32_t mapStart, uint32_t length)
+        {
+            uint32_t onMap = 0;
+            int32_t first = -1;
+            for (uint32_t cell = 0; cell < view; cell++)
+            {
+                int64_t tile = int64_t(origin) + cell;
+                if (tile >= 0 && tile < int64_t(map))
+                {
+                    first = first < 0 ? int32_t(cell) : first;
+                    onMap++;
+                }
+            }
+            return onMap == length && (onMap == 0 || (first == screen && mapStart == origin + screen));
+        };
+        valid &= axis(camera.m_x, camera.m_viewWidth, camera.m_mapWidth, visible.screenX, visible.mapX, visible.width);
+        valid &= axis(camera.m_y, camera.m_viewHeight, camera.m_mapHeight, visible.screenY, visible.mapY, visible.height);
+        cameraFailures += !valid;
+    }
+    printf("camera, %u moves: %llu wrong\n", cameraTrials, (unsigned long long)cameraFailures);
+
+    // Frames of a scene following a player, on maps of every tile but empty so blank cells
+    // can only be off the map. The view keeps its grid between frames, as the app does, and
+    // the debug overlay grows, shrinks and turns off, so any of it left behind shows up.
+    SceneView view;
+    view.m_textLayouts = std::make_unique<TextLayoutCache>(MonospaceWidth);
+    CellGrid grid;
+    RenderSnapshot snapshot;
+    uint64_t frameFailures = 0;
+    for (uint32_t frame = 0; frame < cameraTrials; frame++)
+    {
+        bool clear = false;
+        if (frame % 32 == 0)
+        {
+            uint32_t width = 1 + random.Below(random.Chance(2) ? 60 : 300);
+            uint32_t height = 1 + random.Below(random.Chance(2) ? 20 : 120);
+            auto world = std::make_shared<WorldMap>(width, height);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    world->Set(x, y, TileType(Tile_Floor + (x * 3 + y * 7) % (Tile_Ungenerated - Tile_Floor)));
+                }
+            }
+            snapshot.world = world;
+            grid.Resize(1 + random.Below(160), 1 + random.Below(60));
+            clear = true;
+        }
+        WorldMap const & map = *snapshot.world;
+        snapshot.playerX = int32_t(random.Below(map.m_width));
+        snapshot.playerY = int32_t(random.Below(map.m_height));
+        view.m_overlay.resize(random.Chance(2) ? 0 : random.Below(8));
+        size_t overlayWidth = 0;
+        for (auto & line : view.m_overlay)
+        {
+            line.assign(random.Below(40), '#');
+            overlayWidth = std::max(overlayWidth, line.size());
+        }
+        view.Draw(snapshot, grid, clear);
+
+        Camera const & camera = view.m_camera;
+        uint32_t mapRows = camera.m_viewHeight;
+        bool valid = true;
+        for (uint32_t y = 0; y < mapRows; y++)
+        {
+            for (uint32_t x = 0; x < grid.m_width; x++)
+            {
+                Cell const & cell = grid.At(x, SceneView::StatusRows + y);
+                int64_t mapX = int64_t(camera.m_x) + x;
+                int64_t mapY = int64_t(camera.m_y) + y;
+                if (SceneView::StatusRows + y < view.m_overlay.size() && x < overlayWidth)
+                {
+                    valid &= cell.glyph == (x < view.m_overlay[SceneView::StatusRows + y].size() ? U'#' : U' ');
+                }
+                else if (mapX == snapshot.playerX && mapY == snapshot.playerY)
+                {
+                    valid &= cell.glyph == U'@';
+                }
+                else if (mapX >= 0 && mapY >= 0 && mapX < int64_t(map.m_width) && mapY < int64_t(map.m_height))
+                {
+                    TileType tile = map.Tile(uint32_t(mapX), uint32_t(mapY));
+                    valid &= cell.glyph == TileGlyphs[tile] && cell.foreground == TileForegrounds[tile];
+                }
+                else
+                {
+                    valid &= cell == Cell{};
+                }
+            }
+        }
+        if (mapRows > 0)
+        {
+            // The player is always somewhere on screen.
+            valid &= snapshot.playerX >= camera.m_x && snapshot.playerX < camera.m_x + int32_t(grid.m_width);
+            valid &= snapshot.playerY >= camera.m_y && snapshot.playerY < camera.m_y + int32_t(mapRows);
+        }
+        frameFailures += !valid;
+    }
+    printf("scene view, %u frames: %llu wrong\n", cameraTrials, (unsigned long long)frameFailures);
+    if (cameraFailures != 0 || frameFailures != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --simulate-pacing S replays S seconds of a made-up session (bursts of key presses, each turn
+// published on the next tick, a resize, and the profiler overlay animating for a while) against
+// the render loop's frame pacer on a simulated clock, and reports frames drawn, how often the
+// loop slept, and how long a change waited to be drawn in each redraw mode.
+int SimulatePacing(HeadlessOptions const & options)
+{
+    uint32_t pacingSeconds = uint32_t(options.count);
+    using Clock = FramePacer::Clock;
+    const Clock::duration refresh = std::chrono::microseconds(16667);
+    const Clock::duration tick = std::chrono::microseconds(1000000 / 60);
+    const Clock::duration drawTime = std::chrono::milliseconds(2);
+    const Clock::duration overlayInterval = std::chrono::milliseconds(500);
+    const Clock::time_point start;
+    const Clock::time_point end = start + std::chrono::seconds(pacingSeconds);
+    const Clock::time_point overlayOn = start + (end - start) * 2 / 5;
+    const Clock::time_point overlayOff = start + (end - start) * 3 / 5;
+
+    // Everything that invalidates the screen: key presses a tenth of a second to two seconds
+    // apart, the turn each one starts being published on the next simulation tick, a resize
+    // and the overlay turning on and off.
+    Random random(options.seed);
+    std::vector<Clock::time_point> changes;
+    for (Clock::time_point at = start + std::chrono::milliseconds(500); at < end;)
+    {
+        changes.push_back(at);
+        changes.push_back(start + ((at - start) / tick + 1) * tick);
+        at += std::chrono::milliseconds(random.Below(8) == 0 ? 100 + random.Below(1900) : 100 + random.Below(300));
+    }
+    changes.push_back(start + (end - start) * 4 / 5);
+    changes.push_back(overlayOn);
+    changes.push_back(overlayOff);
+    std::sort(changes.begin(), changes.end());
+
+    printf("frame pacing, %u simulated seconds, %zu screen changes\n", pacingSeconds, changes.size());
+    for (RedrawMode mode : { RedrawMode::OnDemand, RedrawMode::Continuous })
+    {
+        FramePacer pacer;
+        pacer.SetMode(mode);
+        Clock::time_point now = start;
+        Clock::time_point overlayUpdate = overlayOn;
+        Clock::time_point pendingSince = Clock::time_point::max();
+        Clock::duration totalLatency{ 0 };
+        Clock::duration maxLatency{ 0 };
+        uint64_t drawnChanges = 0;
+        uint64_t sleeps = 0;
+        size_t next = 0;
+
+        while (now < end)
+        {
+            for (; next < changes.size() && changes[next] <= now; next++)
+            {
+                pacer.Invalidate();
+                pendingSince = std::min(pendingSince, changes[next]);
+            }
+
+            if (now >= overlayOn && now < overlayOff)
+            {
+                if (now >= overlayUpdate)
+                {
+                    pacer.Invalidate();
+                    overlayUpdate = now + overlayInterval;
+                }
+                pacer.RequestFrame(overlayUpdate);
+            }
+
+            Clock::time_point wake;
+            if (!pacer.ShouldDraw(now, wake))
+            {
+                // Sleep until the next change or the requested frame, whichever is first.
+                sleeps++;
+                now = std::min(next < changes.size() ? changes[next] : end, wake);
+                continue;
+            }
+
+            if (pendingSince != Clock::time_point::max())
+            {
+                Clock::duration latency = now - pendingSince;
+                totalLatency += latency;
+                maxLatency = std::max(maxLatency, latency);
+                drawnChanges++;
+                pendingSince = Clock::time_point::max();
+            }
+            pacer.FrameDrawn(now);
+
+            // Drawing takes a while, and presenting waits for the next vertical blank.
+            now = start + ((now + drawTime - start) / refresh + 1) * refresh;
+        }
+
+        printf("  %-11s %6llu frames  %6llu sleeps  change drawn after %6.2f ms on average, %6.2f ms at most\n",
+            mode == RedrawMode::OnDemand ? "on demand" : "continuous",
+            (unsigned long long)pacer.m_stats.frames,
+            (unsigned long long)sleeps,
+            drawnChanges > 0 ? Milliseconds(totalLatency) / drawnChanges : 0.0,
+            Milliseconds(maxLatency));
+    }
+    return 0;
+}
+
+// --simulate-resize N replays a drag-resize of N window size changes, four milliseconds apart,
+// against a 60 Hz render loop on a simulated clock: once resizing the swap chain for every change
+// and rebuilding the renderer's grids and frame bitmap whenever the size differs, and once
+// coalescing the changes to a resize per frame and updating the frame layout incrementally. It
+// reports swap chain resizes, grid and surface reallocations, frame bitmaps created, the time the
+// relayout takes, and how long a size change waited for its resize. Every incremental layout is
+// checked against one worked out from scratch.
+int SimulateResize(HeadlessOptions const & options)
+{
+    uint32_t resizeEvents = uint32_t(options.count);
+    using Clock = FramePacer::Clock;
+    const Clock::duration refresh = std::chrono::microseconds(16667);
+    const Clock::duration eventInterval = std::chrono::milliseconds(4);
+    const uint32_t tileWidth = 14;
+    const uint32_t tileHeight = 22;
+    const Clock::time_point start;
+
+    // The window edge keeps going one way for a while, a few pixels per size change.
+    Random random(options.seed);
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+    int32_t width = 1280;
+    int32_t height = 720;
+    int32_t dx = 0;
+    int32_t dy = 0;
+    for (uint32_t i = 0; i < resizeEvents; i++)
+    {
+        if (i % 64 == 0)
+        {
+            dx = int32_t(random.Below(9)) - 4;
+            dy = int32_t(random.Below(9)) - 4;
+        }
+        width = std::min(std::max(width + dx, 320), 2560);
+        height = std::min(std::max(height + dy, 240), 1440);
+        sizes.emplace_back(uint32_t(width), uint32_t(height));
+    }
+    Clock::time_point end = start + eventInterval * resizeEvents + refresh;
+
+    printf("resizing, %u size changes %lld ms apart, %.1f ms frames\n", resizeEvents,
+        (long long)std::chrono::duration_cast<std::chrono::milliseconds>(eventInterval).count(), Milliseconds(refresh));
+    size_t wrongLayouts = 0;
+    for (bool coalesce : { false, true })
+    {
+        ResizeCoalescer resize;
+        resize.Applied(1280, 720);
+        uint32_t appliedWidth = 1280;
+        uint32_t appliedHeight = 720;
+
+        FrameLayout layout;
+        FrameGrid grid;
+        BgraSurface surface;
+        uint32_t bitmapWidth = 0;
+        uint32_t bitmapHeight = 0;
+
+        uint64_t swapResizes = 0;
+        uint64_t gridResizes = 0;
+        uint64_t surfaceAllocations = 0;
+        uint64_t bitmaps = 0;
+        uint64_t frames = 0;
+        std::chrono::nanoseconds relayout{ 0 };
+        size_t next = 0;
+        for (Clock::time_point now = start; now < end; now += refresh)
+        {
+            for (; next < sizes.size() && start + eventInterval * next <= now; next++)
+            {
+                if (coalesce)
+                {
+                    resize.Request(sizes[next].first, sizes[next].second, start + eventInterval * next);
+                }
+                else
+                {
+                    // Resized there and then, in the size change handler.
+                    appliedWidth = sizes[next].first;
+                    appliedHeight = sizes[next].second;
+                    swapResizes++;
+                }
+            }
+
+            uint32_t newWidth = 0;
+            uint32_t newHeight = 0;
+            Clock::duration latency;
+            if (coalesce && resize.Take(now, newWidth, newHeight, latency))
+            {
+                appliedWidth = newWidth;
+                appliedHeight = newHeight;
+                swapResizes++;
+            }
+
+            // What the renderer does with the frame's size before drawing.
+            size_t capacity = surface.m_pixels.capacity();
+            auto relayoutStart = std::chrono::steady_clock::now();
+            bool full = false;
+            if (coalesce)
+            {
+                uint32_t changed = layout.Update(appliedWidth, appliedHeight, tileWidth, tileHeight);
+                if (changed & LayoutChange_Cells)
+                {
+                    grid.Resize(layout.m_columns, layout.m_rows);
+                    gridResizes++;
+                }
+                if (changed & LayoutChange_Capacity)
+                {
+                    surface.m_pixels.reserve(size_t(layout.m_capacityWidth) * layout.m_capacityHeight);
+                }
+                if (changed & LayoutChange_Pixels)
+                {
+                    surface.Resize(appliedWidth, appliedHeight);
+                }
+                if (changed & LayoutChange_Capacity)
+                {
+                    bitmapWidth = layout.m_capacityWidth;
+                    bitmapHeight = layout.m_capacityHeight;
+                    bitmaps++;
+                }
+                full = changed != 0;
+            }
+            else
+            {
+                uint32_t columns = (appliedWidth + tileWidth - 1) / tileWidth;
+                uint32_t rows = (appliedHeight + tileHeight - 1) / tileHeight;
+                if (grid.m_current.m_width != columns || grid.m_current.m_height != rows)
+                {
+                    grid.Resize(columns, rows);
+                    gridResizes++;
+                }
+                if (surface.m_width != appliedWidth || surface.m_height != appliedHeight)
+                {
+                    surface.Resize(appliedWidth, appliedHeight);
+                    bitmapWidth = appliedWidth;
+                    bitmapHeight = appliedHeight;
+                    bitmaps++;
+                    full = true;
+                }
+            }
+            if (full)
+            {
+                surface.Fill(0xff000000);
+            }
+            relayout += std::chrono::steady_clock::now() - relayoutStart;
+            surfaceAllocations += surface.m_pixels.capacity() != capacity;
+            frames++;
+
+            if (coalesce)
+            {
+                // The layout the renderer used to work out every frame.
+                int32_t originX = int32_t(floor((float(appliedWidth) - float(layout.m_columns * tileWidth)) / 2.0f));
+                int32_t originY = int32_t(floor((float(appliedHeight) - float(layout.m_rows * tileHeight)) / 2.0f));
+                bool right = layout.m_columns == uint32_t(ceil(float(appliedWidth) / tileWidth)) &&
+                    layout.m_rows == uint32_t(ceil(float(appliedHeight) / tileHeight)) &&
+                    layout.m_originX == originX && layout.m_originY == originY &&
+                    grid.m_current.m_width == layout.m_columns && grid.m_current.m_height == layout.m_rows &&
+                    bitmapWidth >= appliedWidth && bitmapHeight >= appliedHeight;
+                wrongLayouts += !right;
+            }
+        }
+
+        printf("  %-12s %6llu swap chain resizes  %5llu grid resizes  %4llu surface allocations  %5llu frame bitmaps  relayout %7.3f ms per frame\n",
+            coalesce ? "coalesced" : "per change",
+            (unsigned long long)swapResizes, (unsigned long long)gridResizes, (unsigned long long)surfaceAllocations,
+            (unsigned long long)bitmaps, Milliseconds(relayout) / frames);
+        if (coalesce)
+        {
+            printf("  resize latency %6.2f ms on average, %6.2f ms at most, over %llu frames\n",
+                resize.m_stats.resizes > 0 ? Milliseconds(resize.m_stats.totalLatency) / resize.m_stats.resizes : 0.0,
+                Milliseconds(resize.m_stats.maxLatency), (unsigned long long)frames);
+        }
+    }
+    printf("  layouts checked, %zu wrong\n", wrongLayouts);
+    if (wrongLayouts > 0)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,349 @@
+#include "pch.h"
+
+#include "headless.h"
+
+#include "cellbatch.h"
+#include "framegrid.h"
+#include "journal.h"
+#include "profiler.h"
+#include "sceneview.h"
+#include "spscqueue.h"
+#include "terminalrenderer.h"
+#include "triplebuffer.h"
+
+#include <cstdio>
+#include <thread>
+
+// Headless benchmarks and checks of running turns: deciding monster actions on the job system,
+// allocations in steady state, the profiler's cost, and the handoffs between the UI and simulation
+// threads. Each runs in place of the default session when its option is given to rl-headless; see
+// headless.cpp.
+
+// --bench-ai N plays N turns with --actors monsters (20000 by default, so that many act at once)
+// on a --width x --height world, deciding their actions serially and then on the job system with
+// 1, 2, 4 and so on up to every hardware thread, or up to --ai-threads N threads, and reports the
+// time per turn spent on monsters, the speedup over serial and how many jobs were stolen. The
+// largest run has at least four threads, even on a smaller machine, so the parallel path is always
+// exercised; it fails if no run of actions was long enough to be split into jobs. Every run's
+// state hash is checked against the serial run's after every turn.
+int BenchAi(HeadlessOptions const & options)
+{
+    uint32_t aiTurns = uint32_t(options.count);
+    uint32_t actors = options.Actors(20000);
+    auto world = CreateRandomWorld(options.width, options.height, options.seed);
+
+    // Plays the same turns with the given job system, or serially without one, and returns
+    // the time spent on monsters and the state hash after each turn.
+    auto play = [&](JobSystem * jobs, std::vector<uint64_t> & hashes)
+    {
+        Game game(world, options.seed);
+        game.SpawnActors(actors);
+        game.m_jobs = jobs;
+
+        Random input(options.seed);
+        Command command;
+        command.type = CommandType::Move;
+        hashes.clear();
+        for (uint32_t turn = 0; turn < aiTurns; turn++)
+        {
+            if (turn % 16 == 0)
+            {
+                command.dx = int8_t(int32_t(input.Below(3)) - 1);
+                command.dy = int8_t(int32_t(input.Below(3)) - 1);
+            }
+            game.Apply(command);
+            hashes.push_back(game.StateHash());
+        }
+        return game.m_phaseTimes[TurnPhase_Actors];
+    };
+
+    std::vector<uint64_t> reference;
+    std::vector<uint64_t> hashes;
+    auto serial = play(nullptr, reference);
+    printf("monster actions, %u turns, %u actors, %u hardware threads\n", aiTurns, actors, std::thread::hardware_concurrency());
+    printf("  serial      %10.3f ms per turn\n", Milliseconds(serial) / aiTurns);
+
+    // Four threads at least, so the jobs are split and stolen even on a machine with fewer cores.
+    uint32_t most = options.aiThreads > 0 ? options.aiThreads : std::thread::hardware_concurrency();
+    most = std::max(most, 4u);
+    bool identical = true;
+    uint64_t lastJobs = 0;
+    for (uint32_t threads = 1;; threads = std::min(threads * 2, most))
+    {
+        JobSystem jobs(threads);
+        auto parallel = play(&jobs, hashes);
+        bool same = hashes == reference;
+        identical &= same;
+
+        printf("  %2u threads  %10.3f ms per turn  (%.2fx, %llu jobs, %llu stolen, %s)\n", threads,
+            Milliseconds(parallel) / aiTurns, parallel.count() > 0 ? double(serial.count()) / parallel.count() : 0.0,
+            (unsigned long long)jobs.m_stats.jobs.load(), (unsigned long long)jobs.m_stats.steals.load(),
+            same ? "identical" : "DIFFERENT");
+        lastJobs = jobs.m_stats.jobs.load();
+        if (threads == most)
+        {
+            break;
+        }
+    }
+
+    if (lastJobs == 0)
+    {
+        printf("  NO JOBS: no run of actions was long enough to split across threads; try more --actors\n");
+    }
+    if (!identical || lastJobs == 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --count-allocations N walks a streamed session with --actors monsters about, seeing --vision
+// tiles, until its caches and scratch memory have grown to size, then counts the heap
+// allocations made by the next N turns and by drawing each of them with the profiler overlay
+// refreshed, both as a terminal frame and the way the app draws one: diffed into dirty
+// rectangles, batched and composited. It reports how far the turn and frame arenas filled.
+// Frames should allocate nothing; turns only do when monsters first crowd into a part of the
+// map, growing the occupancy index.
+int CountAllocations(HeadlessOptions const & options)
+{
+    uint32_t turns = uint32_t(options.count);
+
+    // Enough turns to walk into new chunks and for the layout cache to fill and turn over
+    // a few times.
+    const uint32_t warmup = 5000;
+    bool wasEnabled = ProfilingEnabled();
+    EnableProfiling(true);
+
+    Game game = CreateSessionGame(options.seed, 1024, 1024);
+    std::vector<std::pair<uint32_t, uint32_t>> missing;
+    std::vector<ChunkUpdate> chunks;
+    auto stream = [&]
+    {
+        missing.clear();
+        ForEachMissingChunk(*game.m_world, game.m_playerX, game.m_playerY, Simulation::StreamRadius, [&](uint32_t chunkX, uint32_t chunkY)
+        {
+            missing.emplace_back(chunkX, chunkY);
+        });
+        if (!missing.empty())
+        {
+            InstallGenerated(game, options.seed, missing, chunks);
+        }
+    };
+    stream();
+    game.SpawnActors(options.Actors(), 64);
+    if (options.vision > 0)
+    {
+        game.EnableActorVision(options.vision);
+    }
+
+    SceneView view;
+    view.m_textLayouts = std::make_unique<TextLayoutCache>(MonospaceWidth);
+    TerminalRenderer renderer;
+    FrameGrid frame;
+    frame.Resize(120, 40);
+    RenderSnapshot snapshot;
+
+    // The app's path for the same frame: the dirty rectangles batched and composited into a
+    // frame in memory.
+    GlyphAtlas atlas(1024, BoxCoverage);
+    GridLayout layout = { 14, 22, 0, 0 };
+    BgraSurface surface;
+    surface.Resize(120 * layout.tileWidth, 40 * layout.tileHeight);
+    std::vector<CellRect> rects;
+    CellBatches batches;
+
+    // Streaming in chunks is the generator's work, so it is left out of the counts. Every
+    // turn posts a message, which the log panel lays out.
+    Random input(options.seed ^ 0xa110c);
+    Command command;
+    command.type = CommandType::Move;
+    uint64_t turnAllocations = 0;
+    uint64_t frameAllocations = 0;
+    g_countAllocations.store(true, std::memory_order_relaxed);
+    for (uint32_t turn = 0; turn < warmup + turns; turn++)
+    {
+        if (turn % 16 == 0)
+        {
+            command.dx = int8_t(int32_t(input.Below(3)) - 1);
+            command.dy = int8_t(int32_t(input.Below(3)) - 1);
+        }
+        char text[96];
+        snprintf(text, sizeof(text), "Turn %u: the goblin %s.", turn, input.Chance(2) ? "hits you" : "misses you by a hair's breadth");
+        game.m_messages.Add(text);
+
+        uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        game.Apply(command);
+        uint64_t applied = g_allocations.load(std::memory_order_relaxed);
+        stream();
+
+        uint64_t streamed = g_allocations.load(std::memory_order_relaxed);
+        CaptureSnapshot(game, snapshot);
+        FormatProfileOverlay(ProfileNow() - 1000000000, view.m_overlay, view.m_frameArena);
+        view.Draw(snapshot, frame.m_current, false);
+        renderer.Render(frame.m_current);
+        frame.Diff(rects, AppDirtyRects);
+        batches.Clear();
+        for (auto const & rect : rects)
+        {
+            BuildCellBatches(frame.m_current, rect, layout, atlas, batches);
+        }
+        FinishCellBatches(batches);
+        CompositeCellBatches(batches, atlas, surface);
+        uint64_t drawn = g_allocations.load(std::memory_order_relaxed);
+
+        if (turn >= warmup)
+        {
+            turnAllocations += applied - before;
+            frameAllocations += drawn - streamed;
+        }
+    }
+    g_countAllocations.store(false, std::memory_order_relaxed);
+    EnableProfiling(wasEnabled);
+
+    Arena const & turnArena = game.m_turnArena;
+    Arena const & frameArena = view.m_frameArena;
+    printf("heap allocations, %u turns after %u to warm up, %u actors\n", turns, warmup, options.Actors());
+    printf("  turns       %8llu  (%.3f per turn)\n", (unsigned long long)turnAllocations, double(turnAllocations) / turns);
+    printf("  frames      %8llu  (%.3f per frame)  %s\n", (unsigned long long)frameAllocations,
+        double(frameAllocations) / turns, frameAllocations == 0 ? "none" : "ALLOCATING");
+    printf("  turn arena  %8zu bytes high water in %zu blocks\n", turnArena.m_stats.highWater, turnArena.m_blocks.size());
+    printf("  frame arena %8zu bytes high water in %zu blocks\n", frameArena.m_stats.highWater, frameArena.m_blocks.size());
+    if (frameAllocations != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-profiler N times N empty profile scopes, disabled and enabled.
+int BenchProfiler(HeadlessOptions const & options)
+{
+    uint32_t profilerScopes = uint32_t(options.count);
+
+    // What a scope costs compiled in: disabled, then enabled and writing to this thread's ring.
+    bool wasEnabled = ProfilingEnabled();
+    auto time = [&](bool enabled)
+    {
+        EnableProfiling(enabled);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < profilerScopes; i++)
+        {
+            ProfileScope("Empty");
+        }
+        return std::chrono::steady_clock::now() - start;
+    };
+    auto disabled = time(false);
+    auto enabled = time(true);
+    EnableProfiling(wasEnabled);
+
+    printf("%llu profile scopes\n", (unsigned long long)profilerScopes);
+    printf("  disabled    %10.3f ms  (%.2f ns per scope)\n", Milliseconds(disabled), double(disabled.count()) / profilerScopes);
+    printf("  enabled     %10.3f ms  (%.2f ns per scope)\n", Milliseconds(enabled), double(enabled.count()) / profilerScopes);
+    return 0;
+}
+
+// --stress-handoff N passes N numbers through the command queue from one thread to another,
+// checking they arrive in order with none lost or repeated, then publishes N snapshots through
+// the triple buffer while another thread picks them up, checking it never sees one half written
+// or older than one it already had, and ends on the last. Build with -fsanitize=thread to have
+// ThreadSanitizer watch both as well.
+int StressHandoff(HeadlessOptions const & options)
+{
+    uint64_t items = options.count;
+
+    // The queue is small so the producer keeps filling it and the consumer keeps emptying it.
+    auto queue = std::make_unique<SpscQueue<uint64_t, 64>>();
+    uint64_t fullPushes = 0;
+    uint64_t outOfOrder = 0;
+    uint64_t received = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&]
+    {
+        for (uint64_t i = 0; i < items; i++)
+        {
+            while (!queue->TryPush(i))
+            {
+                fullPushes++;
+                std::this_thread::yield();
+            }
+        }
+    });
+    while (received < items)
+    {
+        uint64_t value;
+        if (!queue->TryPop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        outOfOrder += value != received;
+        received = value + 1;
+    }
+    producer.join();
+    uint64_t value;
+    outOfOrder += queue->TryPop(value);
+    auto queueTime = std::chrono::steady_clock::now() - start;
+    printf("command queue, %llu items  %8.3f ms  (%llu pushes found it full): %llu out of order\n",
+        (unsigned long long)items, Milliseconds(queueTime), (unsigned long long)fullPushes, (unsigned long long)outOfOrder);
+
+    // Each snapshot fills every word from its sequence number, so a torn one has words that
+    // disagree.
+    struct Stamped
+    {
+        uint64_t sequence;
+        uint64_t words[31];
+    };
+    auto buffer = std::make_unique<TripleBuffer<Stamped>>();
+    std::atomic<bool> done{ false };
+    uint64_t acquired = 0;
+    uint64_t torn = 0;
+    uint64_t stale = 0;
+    uint64_t last = 0;
+    auto check = [&]
+    {
+        Stamped const & front = buffer->Front();
+        for (uint64_t word : front.words)
+        {
+            torn += word != front.sequence * 0x9e3779b97f4a7c15ull;
+        }
+        stale += front.sequence <= last;
+        last = front.sequence;
+        acquired++;
+    };
+    start = std::chrono::steady_clock::now();
+    producer = std::thread([&]
+    {
+        for (uint64_t i = 1; i <= items; i++)
+        {
+            Stamped & back = buffer->Back();
+            back.sequence = i;
+            for (uint64_t & word : back.words)
+            {
+                word = i * 0x9e3779b97f4a7c15ull;
+            }
+            buffer->Publish();
+        }
+        done.store(true, std::memory_order_release);
+    });
+    while (!done.load(std::memory_order_acquire))
+    {
+        if (buffer->Acquire())
+        {
+            check();
+        }
+    }
+    producer.join();
+    if (buffer->Acquire())
+    {
+        check();
+    }
+    auto bufferTime = std::chrono::steady_clock::now() - start;
+    printf("triple buffer, %llu snapshots  %8.3f ms  (%llu picked up): %llu torn, %llu stale, ended on %s\n",
+        (unsigned long long)items, Milliseconds(bufferTime), (unsigned long long)acquired,
+        (unsigned long long)torn, (unsigned long long)stale, last == items ? "the last" : "an old one");
+    if (outOfOrder != 0 || torn != 0 || stale != 0 || last != items)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,842 @@
+#include "pch.h"
+
+#include "headless.h"
+
+#include "journal.h"
+#include "lighting.h"
+#include "savegame.h"
+#include "spatialindex.h"
+#include "taskgraph.h"
+#include "worldgen.h"
+
+#include <cstdio>
+#include <thread>
+
+// Headless benchmarks and checks of the world: generating, saving and loading it, starting a
+// session, lighting it, and the map, tile, entity and occupancy storage. Each runs in place of the
+// default session when its option is given to rl-headless; see headless.cpp.
+
+// --bench-worldgen N generates a block of chunks on 1 to N worker threads, reports chunks/sec for
+// each and checks every chunk is byte-identical to one generated on the calling thread.
+int BenchWorldgen(HeadlessOptions const & options)
+{
+    uint32_t worldgenThreads = uint32_t(options.count);
+
+    // A block of chunks from the same seed, generated once here as the reference.
+    uint32_t const side = 32;
+    std::vector<MapChunk> reference(side * side);
+    for (uint32_t i = 0; i < side * side; i++)
+    {
+        GenerateChunk(options.seed, i % side, i / side, reference[i]);
+    }
+
+    printf("generating %u chunks\n", side * side);
+    bool identical = true;
+    for (uint32_t threads = 1; threads <= worldgenThreads; threads++)
+    {
+        ChunkGenerator generator(options.seed, threads);
+        std::vector<ChunkUpdate> results;
+
+        auto generateStart = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < side * side; i++)
+        {
+            generator.Request(i % side, i / side);
+        }
+        while (results.size() < side * side)
+        {
+            if (!generator.Collect(results))
+            {
+                std::this_thread::yield();
+            }
+        }
+        auto generateEnd = std::chrono::steady_clock::now();
+
+        size_t differing = 0;
+        for (auto const & result : results)
+        {
+            MapChunk const & expected = reference[result.chunkY * side + result.chunkX];
+            differing += memcmp(result.chunk.get(), &expected, sizeof(MapChunk)) != 0;
+        }
+        identical &= differing == 0;
+
+        double seconds = std::chrono::duration<double>(generateEnd - generateStart).count();
+        printf("  %2u threads  %10.3f ms  (%.0f chunks/sec, %s)\n", threads, seconds * 1000.0,
+            seconds > 0 ? side * side / seconds : 0.0, differing == 0 ? "identical" : "DIFFERENT");
+    }
+
+    if (!identical)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-save PATH saves a fully generated 4096x4096 world to PATH in the background, then
+// loads it back lazily and reports the times and how much memory the load made resident.
+int BenchSave(HeadlessOptions const & options)
+{
+    uint32_t const size = 4096;
+    uint32_t const loadRadius = 4;
+    double const mebibyte = 1024.0 * 1024.0;
+    {
+        auto world = std::make_shared<WorldMap>(size, size, Tile_Ungenerated);
+        for (uint32_t chunkY = 0; chunkY < world->m_chunkRows; chunkY++)
+        {
+            for (uint32_t chunkX = 0; chunkX < world->m_chunkColumns; chunkX++)
+            {
+                auto chunk = std::make_shared<MapChunk>();
+                GenerateChunk(options.seed, chunkX, chunkY, *chunk);
+                world->SetChunk(chunkX, chunkY, std::move(chunk));
+            }
+        }
+        Game full(world, options.seed);
+        full.SpawnActors(options.Actors());
+
+        // The pause is what the game would see: capturing the state and starting the writer.
+        BackgroundSaver saver;
+        auto saveStart = std::chrono::steady_clock::now();
+        saver.Save(options.path, SaveState::Capture(full, true, options.seed));
+        auto savePause = std::chrono::steady_clock::now();
+        while (saver.Busy())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto saveEnd = std::chrono::steady_clock::now();
+
+        printf("saving %ux%u world, %zu chunks\n", size, size, world->m_chunks.size());
+        printf("  pause       %10.3f ms\n", Milliseconds(savePause - saveStart));
+        printf("  write       %10.3f ms  (%s)\n", Milliseconds(saveEnd - saveStart), saver.Succeeded() ? "ok" : "FAILED");
+        if (!saver.Succeeded())
+        {
+            return 1;
+        }
+    }
+
+    uint64_t residentBefore = CurrentMemory();
+    auto loadStart = std::chrono::steady_clock::now();
+    auto save = SaveFile::Open(options.path);
+    if (!save)
+    {
+        printf("  load        FAILED\n");
+        return 1;
+    }
+    Game loaded(save->CreateWorld(loadRadius), options.seed);
+    save->Restore(loaded);
+    auto loadEnd = std::chrono::steady_clock::now();
+    uint64_t residentLoaded = CurrentMemory();
+
+    // For comparison, validate every chunk, which reads the whole file.
+    size_t valid = 0;
+    for (uint32_t chunkY = 0; chunkY < save->m_chunkRows; chunkY++)
+    {
+        for (uint32_t chunkX = 0; chunkX < save->m_chunkColumns; chunkX++)
+        {
+            valid += save->Chunk(chunkX, chunkY) != nullptr;
+        }
+    }
+    auto readEnd = std::chrono::steady_clock::now();
+    uint64_t residentRead = CurrentMemory();
+
+    printf("loading around (%d, %d), radius %u chunks\n", loaded.m_playerX, loaded.m_playerY, loadRadius);
+    printf("  load        %10.3f ms  (+%.1f MiB resident, %zu monsters)\n", Milliseconds(loadEnd - loadStart),
+        (int64_t(residentLoaded) - int64_t(residentBefore)) / mebibyte, loaded.ActorCount());
+    printf("  read all    %10.3f ms  (+%.1f MiB resident, %zu chunks valid)\n", Milliseconds(readEnd - loadEnd),
+        (int64_t(residentRead) - int64_t(residentBefore)) / mebibyte, valid);
+    return 0;
+}
+
+// --bench-startup N runs a streamed session's startup (the world, the chunks around the player
+// and the first turn) as a task graph on 0 to N workers, printing each task's timing and checking
+// the result matches the serial one.
+int BenchStartup(HeadlessOptions const & options)
+{
+    uint32_t startupThreads = uint32_t(options.count);
+
+    // The same work the app does before its first turn, split the way its startup graph is:
+    // the session, each chunk in streaming range generated as its own task, then installing
+    // them and playing one turn.
+    auto runStartup = [&](uint32_t threads, std::vector<std::string> & timings)
+    {
+        std::unique_ptr<Game> session;
+        std::vector<ChunkUpdate> chunks;
+        {
+            TaskGraph graph;
+            auto world = graph.Add("Session", [&] { session = std::make_unique<Game>(CreateSessionGame(options.seed, options.width, options.height)); });
+
+            // The session starts in the middle of the map, as CreateSessionGame places it.
+            WorldMap probe(options.width, options.height, Tile_Ungenerated);
+            ForEachMissingChunk(probe, int32_t(options.width / 2), int32_t(options.height / 2), 4, [&](uint32_t chunkX, uint32_t chunkY)
+            {
+                chunks.push_back({ chunkX, chunkY, std::make_shared<MapChunk>() });
+            });
+
+            std::vector<TaskGraph::TaskId> generated = { world };
+            for (auto & update : chunks)
+            {
+                generated.push_back(graph.Add("Chunk", [&] { GenerateChunk(options.seed, update.chunkX, update.chunkY, *update.chunk); }));
+            }
+
+            auto install = graph.Add("Install chunks", [&]
+            {
+                std::vector<ChunkUpdate> missing;
+                for (auto const & update : chunks)
+                {
+                    if (!session->m_world->HasChunk(update.chunkX, update.chunkY))
+                    {
+                        missing.push_back(update);
+                    }
+                }
+                session->InstallChunks(missing);
+            }, generated);
+
+            Command wait;
+            wait.type = CommandType::Wait;
+            graph.Add("First turn", [&] { session->Apply(wait); }, { install });
+
+            graph.Start(threads);
+            graph.WaitAll();
+            graph.FormatTimings(timings);
+        }
+        return session->StateHash();
+    };
+
+    std::vector<std::string> timings;
+    auto serialStart = std::chrono::steady_clock::now();
+    uint64_t expected = runStartup(0, timings);
+    auto serialEnd = std::chrono::steady_clock::now();
+    printf("startup, serial     %10.3f ms\n", Milliseconds(serialEnd - serialStart));
+
+    bool matches = true;
+    for (uint32_t threads = 1; threads <= startupThreads; threads++)
+    {
+        auto parallelStart = std::chrono::steady_clock::now();
+        uint64_t hash = runStartup(threads, timings);
+        auto parallelEnd = std::chrono::steady_clock::now();
+        matches &= hash == expected;
+        printf("startup, %2u workers %10.3f ms  %s\n", threads, Milliseconds(parallelEnd - parallelStart),
+            hash == expected ? "matches serial" : "DIFFERS from serial");
+    }
+
+    // The chunk tasks all look alike; show the first few and the tail of the last graph.
+    for (size_t i = 0; i < timings.size(); i++)
+    {
+        if (i < 4 || i + 3 >= timings.size())
+        {
+            printf("  %s\n", timings[i].c_str());
+        }
+        else if (i == 4)
+        {
+            printf("  ...\n");
+        }
+    }
+    if (!matches)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-lighting N lights the middle of a 4096x4096 generated world with 10 up to N torches
+// that wander while doors open and close, and times the incremental update against relighting
+// everything each turn; the two light maps are checked to be identical. The lights of glowing
+// tiles are then checked against lighting from scratch while the window walks.
+int BenchLighting(HeadlessOptions const & options)
+{
+    uint32_t lights = uint32_t(options.count);
+    const uint32_t turns = 100;
+    const int32_t centre = 2048;
+    auto world = CreateProceduralWorld(4096, 4096, options.seed, LightingSystem::WindowChunks + 1);
+    printf("lighting, %u turns, %u-tile window\n", turns, (LightingSystem::WindowChunks * 2 + 1) * ChunkSize);
+
+    bool identical = true;
+    for (uint32_t count : { 10u, 30u, 100u, 300u, 1000u })
+    {
+        if (count > lights)
+        {
+            break;
+        }
+
+        WorldMap map = *world;
+        Random random(options.seed + count);
+        LightingSystem lighting;
+        lighting.SetAmbient(0x202020);
+        lighting.Follow(centre, centre);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            int32_t x = centre - 140 + int32_t(random.Below(280));
+            int32_t y = centre - 140 + int32_t(random.Below(280));
+            lighting.Add(x, y, 4 + random.Below(7), 0x806040 + random.Below(0x7f7f7f));
+        }
+        lighting.Update(map);
+        LightingSystem everything = lighting;
+
+        // A tenth of the torches take a step each turn, and a door opens or closes.
+        std::chrono::nanoseconds incremental{ 0 };
+        std::chrono::nanoseconds full{ 0 };
+        uint64_t recast = 0;
+        uint64_t packed = lighting.m_stats.tilesPacked;
+        for (uint32_t turn = 0; turn < turns; turn++)
+        {
+            for (uint32_t i = 0; i < std::max(count / 10, 1u); i++)
+            {
+                uint32_t light = random.Below(count);
+                FovViewer const & view = lighting.m_lights[light].m_view;
+                int32_t x = view.m_x + int32_t(random.Below(3)) - 1;
+                int32_t y = view.m_y + int32_t(random.Below(3)) - 1;
+                lighting.Move(light, x, y);
+                everything.Move(light, x, y);
+            }
+
+            int32_t x = centre - 140 + int32_t(random.Below(280));
+            int32_t y = centre - 140 + int32_t(random.Below(280));
+            map.Set(x, y, IsOpaque(map.Tile(x, y)) ? Tile_OpenDoor : Tile_Door);
+            lighting.OnTileChanged(x, y);
+
+            auto start = std::chrono::steady_clock::now();
+            recast += lighting.Update(map);
+            auto middle = std::chrono::steady_clock::now();
+            everything.Invalidate();
+            everything.Update(map);
+            auto end = std::chrono::steady_clock::now();
+            incremental += middle - start;
+            full += end - middle;
+        }
+
+        identical &= lighting.m_map.m_levels == everything.m_map.m_levels;
+        printf("  %5u lights  incremental %8.3f ms per turn (%6.1f recast, %8llu tiles packed)  everything %8.3f ms per turn  %s\n",
+            count,
+            Milliseconds(incremental) / turns,
+            double(recast) / turns,
+            (unsigned long long)((lighting.m_stats.tilesPacked - packed) / turns),
+            Milliseconds(full) / turns,
+            lighting.m_map.m_levels == everything.m_map.m_levels ? "identical" : "DIFFERENT");
+    }
+
+    // The lights of glowing tiles, while the window walks across the world and fungus comes and
+    // goes, against a new system lighting the same window from scratch.
+    WorldMap map = *world;
+    Random random(options.seed);
+    LightingSystem walking;
+    walking.SetAmbient(0x202020);
+    int32_t x = centre;
+    int32_t y = centre;
+    size_t mostTileLights = 0;
+    uint32_t checks = 0;
+    uint32_t wrong = 0;
+    for (uint32_t turn = 0; turn < turns * 4; turn++)
+    {
+        x += int32_t(random.Below(9)) - 4;
+        y += int32_t(random.Below(9)) - 4;
+        int32_t changedX = x - 140 + int32_t(random.Below(280));
+        int32_t changedY = y - 140 + int32_t(random.Below(280));
+        map.Set(uint32_t(changedX), uint32_t(changedY), random.Chance(50) ? Tile_Fungus : Tile_Floor);
+        walking.OnTileChanged(changedX, changedY);
+        walking.Follow(x, y);
+        walking.Update(map);
+        mostTileLights = std::max(mostTileLights, walking.m_tileLights.size());
+
+        if (turn % 16 == 0)
+        {
+            LightingSystem fresh;
+            fresh.SetAmbient(0x202020);
+            fresh.Follow(x, y);
+            fresh.Update(map);
+            checks++;
+            wrong += fresh.m_map.m_levels != walking.m_map.m_levels || fresh.m_tileLights.size() != walking.m_tileLights.size();
+        }
+    }
+    printf("  tile lights, %u turns walking  (up to %zu lit tiles): %u of %u checks wrong\n", turns * 4, mostTileLights, wrong, checks);
+    identical &= wrong == 0;
+
+    if (!identical)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-spatial N puts N entities on a 1024x1024 map in the occupancy index and reports moves
+// per second and the time per tile lookup, radius query and screen-sized rectangle query, with
+// the rectangle and radius queries checked against, and timed beside, a scan of every entity.
+int BenchSpatial(HeadlessOptions const & options)
+{
+    uint32_t count = uint32_t(options.count);
+    const uint32_t size = 1024;
+    const uint32_t rounds = 10;
+    static const int8_t Directions[8][2] = { { -1, -1 }, { 0, -1 }, { 1, -1 }, { -1, 0 }, { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+    Random random(options.seed);
+
+    SpatialIndex index;
+    index.Reset(size, size);
+    std::vector<Position> positions(count);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        positions[i] = { int32_t(random.Below(size)), int32_t(random.Below(size)) };
+        index.Insert(EntityHandle{ i, 0 }, positions[i].x, positions[i].y);
+    }
+    auto inserted = std::chrono::steady_clock::now();
+
+    // Every entity takes a step in a random direction each round, staying on the map. The
+    // steps are drawn up front so only the moves are timed.
+    std::vector<uint8_t> steps(size_t(count) * rounds);
+    for (auto & step : steps)
+    {
+        step = uint8_t(random.Below(8));
+    }
+    auto moveStart = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        uint8_t const * roundSteps = steps.data() + size_t(round) * count;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Position & position = positions[i];
+            position.x = std::min(std::max(position.x + Directions[roundSteps[i]][0], 0), int32_t(size - 1));
+            position.y = std::min(std::max(position.y + Directions[roundSteps[i]][1], 0), int32_t(size - 1));
+            index.Move(EntityHandle{ i, 0 }, position.x, position.y);
+        }
+    }
+    auto moved = std::chrono::steady_clock::now();
+
+    printf("spatial index, %u entities on a %ux%u map\n", count, size, size);
+    printf("  insert      %10.3f ms\n", Milliseconds(inserted - start));
+    printf("  moves       %10.3f ms  (%.1f million moves/sec)\n", Milliseconds(moved - moveStart),
+        double(count) * rounds / std::chrono::duration<double>(moved - moveStart).count() / 1e6);
+
+    const uint32_t lookups = 1000000;
+    uint64_t occupied = 0;
+    auto lookupStart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < lookups; i++)
+    {
+        occupied += index.IsOccupied(int32_t(random.Below(size)), int32_t(random.Below(size))) ? 1 : 0;
+    }
+    auto lookedUp = std::chrono::steady_clock::now();
+    printf("  tile lookup %10.1f ns  (%.1f%% occupied)\n", Milliseconds(lookedUp - lookupStart) * 1e6 / lookups, 100.0 * occupied / lookups);
+
+    // The scan is what finding the same entities costs without the index.
+    const uint32_t queries = 10000;
+    const uint32_t scans = 100;
+    struct Query { char const * name; uint32_t radius; int32_t width; int32_t height; };
+    static const Query Queries[] = {
+        { "radius 4", 4, 0, 0 },
+        { "radius 16", 16, 0, 0 },
+        { "radius 64", 64, 0, 0 },
+        { "rect 120x40", 0, 120, 40 },
+    };
+    std::vector<Position> centres(queries);
+    for (auto & centre : centres)
+    {
+        centre = { int32_t(random.Below(size)), int32_t(random.Below(size)) };
+    }
+
+    bool same = true;
+    for (Query const & query : Queries)
+    {
+        auto run = [&](Position const & centre) -> uint64_t
+        {
+            uint64_t found = 0;
+            if (query.radius > 0)
+            {
+                index.ForEachInRadius(centre.x, centre.y, query.radius, [&](EntityHandle, int32_t, int32_t) { found++; });
+            }
+            else
+            {
+                index.ForEachInRect(centre.x, centre.y, centre.x + query.width, centre.y + query.height, [&](EntityHandle, int32_t, int32_t) { found++; });
+            }
+            return found;
+        };
+        auto scan = [&](Position const & centre) -> uint64_t
+        {
+            uint64_t found = 0;
+            int64_t radiusSquared = int64_t(query.radius) * query.radius;
+            for (Position const & position : positions)
+            {
+                if (query.radius > 0)
+                {
+                    int64_t dx = position.x - centre.x;
+                    int64_t dy = position.y - centre.y;
+                    found += dx * dx + dy * dy <= radiusSquared ? 1 : 0;
+                }
+                else
+                {
+                    found += position.x >= centre.x && position.x < centre.x + query.width && position.y >= centre.y && position.y < centre.y + query.height ? 1 : 0;
+                }
+            }
+            return found;
+        };
+
+        uint64_t found = 0;
+        auto queryStart = std::chrono::steady_clock::now();
+        for (auto const & centre : centres)
+        {
+            found += run(centre);
+        }
+        auto queried = std::chrono::steady_clock::now();
+
+        uint64_t indexed = 0;
+        uint64_t scanned = 0;
+        for (uint32_t i = 0; i < scans; i++)
+        {
+            indexed += run(centres[i]);
+        }
+        auto scanStart = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < scans; i++)
+        {
+            scanned += scan(centres[i]);
+        }
+        auto scanEnd = std::chrono::steady_clock::now();
+
+        printf("  %-11s %10.2f us per query  (%7.1f found)  scan %10.2f us  %s\n",
+            query.name,
+            Milliseconds(queried - queryStart) * 1000.0 / queries,
+            double(found) / queries,
+            Milliseconds(scanEnd - scanStart) * 1000.0 / scans,
+            indexed == scanned ? "same" : "DIFFERENT");
+        same &= indexed == scanned;
+    }
+    if (!same)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-tiles N makes N passes over every tile of a generated 1024x1024 world, counting those
+// that block movement and those that block sight, and times finding out by comparing the glyph
+// each tile is drawn with against the blocking ones and by looking its type up in the tile flag
+// table. Both must count the same tiles.
+int BenchTiles(HeadlessOptions const & options)
+{
+    uint32_t tilePasses = uint32_t(options.count);
+
+    // The whole world in one array, so only the per-tile test differs between the loops.
+    uint32_t const size = 1024;
+    auto world = CreateProceduralWorld(size, size, options.seed, size / ChunkSize / 2);
+    std::vector<TileType> tiles(size_t(size) * size);
+    std::vector<char32_t> glyphs(tiles.size());
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            tiles[size_t(y) * size + x] = world->Tile(x, y);
+            glyphs[size_t(y) * size + x] = TileGlyphs[world->Tile(x, y)];
+        }
+    }
+
+    // Each test returns whether the tile blocks movement in bit 0 and sight in bit 1.
+    struct Counts
+    {
+        uint64_t blocked = 0;
+        uint64_t opaque = 0;
+    };
+    auto time = [&](char const * name, auto && test)
+    {
+        Counts counts;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t pass = 0; pass < tilePasses; pass++)
+        {
+            uint64_t blocked = 0;
+            uint64_t opaque = 0;
+            for (size_t i = 0; i < tiles.size(); i++)
+            {
+                uint32_t bits = test(i);
+                blocked += bits & 1;
+                opaque += bits >> 1;
+            }
+            counts.blocked = blocked;
+            counts.opaque = opaque;
+        }
+        auto end = std::chrono::steady_clock::now();
+        printf("  %-12s %8.3f ns per tile  (%llu blocked, %llu opaque)\n", name,
+            double((end - start).count()) / (double(tiles.size()) * tilePasses),
+            (unsigned long long)counts.blocked, (unsigned long long)counts.opaque);
+        return counts;
+    };
+
+    printf("tile properties, %u passes over %ux%u tiles\n", tilePasses, size, size);
+    Counts chars = time("glyphs", [&](size_t i)
+    {
+        char32_t glyph = glyphs[i];
+        bool blocked = glyph == U'#' || glyph == U'~' || glyph == U'\u2663' || glyph == U'+';
+        bool opaque = glyph == U'#' || glyph == U'\u2663' || glyph == U'+';
+        return uint32_t(blocked) | uint32_t(opaque) << 1;
+    });
+    Counts table = time("tile table", [&](size_t i)
+    {
+        return uint32_t(IsBlocked(tiles[i])) | uint32_t(IsOpaque(tiles[i])) << 1;
+    });
+
+    bool same = chars.blocked == table.blocked && chars.opaque == table.opaque;
+    printf("  %s\n", same ? "agree" : "DIFFERENT");
+    if (!same)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-map N makes N passes over a generated 1024x1024 world, reading a million tiles at
+// random and then every row in turn, both tile by tile and a chunk's span at a time, timed beside
+// the same reads from one flat array. It reports the memory the chunked map uses per million
+// tiles generated, partly generated and never written.
+int BenchMap(HeadlessOptions const & options)
+{
+    uint32_t mapPasses = uint32_t(options.count);
+    const uint32_t size = 1024;
+    auto world = CreateProceduralWorld(size, size, options.seed, size / ChunkSize / 2);
+    std::vector<TileType> flat(size_t(size) * size);
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            flat[size_t(y) * size + x] = world->Tile(x, y);
+        }
+    }
+
+    // Every loop sums the tiles it reads, so they must all agree.
+    auto time = [&](char const * name, uint64_t reads, auto && pass)
+    {
+        uint64_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < mapPasses; i++)
+        {
+            sum = pass();
+        }
+        auto end = std::chrono::steady_clock::now();
+        printf("  %-18s %8.3f ns per tile\n", name, double((end - start).count()) / (double(reads) * mapPasses));
+        return sum;
+    };
+
+    const uint32_t lookups = 1 << 20;
+    Random random(options.seed ^ 0x3a9);
+    std::vector<std::pair<uint32_t, uint32_t>> points(lookups);
+    for (auto & point : points)
+    {
+        point = { random.Below(size), random.Below(size) };
+    }
+
+    printf("map reads, %u passes over %ux%u tiles\n", mapPasses, size, size);
+    uint64_t randomMap = time("random, map", lookups, [&]
+    {
+        uint64_t sum = 0;
+        for (auto const & point : points)
+        {
+            sum += world->Tile(point.first, point.second);
+        }
+        return sum;
+    });
+    uint64_t randomFlat = time("random, flat", lookups, [&]
+    {
+        uint64_t sum = 0;
+        for (auto const & point : points)
+        {
+            sum += flat[size_t(point.second) * size + point.first];
+        }
+        return sum;
+    });
+    uint64_t rowsMap = time("rows, by tile", flat.size(), [&]
+    {
+        uint64_t sum = 0;
+        for (uint32_t y = 0; y < size; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                sum += world->Tile(x, y);
+            }
+        }
+        return sum;
+    });
+    uint64_t rowsSpan = time("rows, by span", flat.size(), [&]
+    {
+        uint64_t sum = 0;
+        for (uint32_t y = 0; y < size; y++)
+        {
+            world->ForEachRowSpan(y, 0, size, [&](uint32_t, uint32_t count, MapChunk const & chunk, uint32_t index)
+            {
+                uint64_t spanSum = 0;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    spanSum += chunk.tiles[index + i];
+                }
+                sum += spanSum;
+            });
+        }
+        return sum;
+    });
+    uint64_t rowsFlat = time("rows, flat", flat.size(), [&]
+    {
+        uint64_t sum = 0;
+        for (TileType tile : flat)
+        {
+            sum += tile;
+        }
+        return sum;
+    });
+    bool agree = randomMap == randomFlat && rowsMap == rowsSpan && rowsMap == rowsFlat;
+    printf("  %s\n", agree ? "agree" : "DIFFERENT");
+
+    // A 4096x4096 world with the chunks around its centre generated, as a session starts.
+    auto partial = CreateProceduralWorld(4096, 4096, options.seed, 4);
+    WorldMap blank(4096, 4096);
+    auto perMillion = [](WorldMap const & map)
+    {
+        return double(map.MemoryUsage()) * 1000000.0 / (double(map.m_width) * map.m_height) / 1024.0;
+    };
+    printf("memory per million tiles\n");
+    printf("  generated          %8.1f KiB\n", perMillion(*world));
+    printf("  partly generated   %8.1f KiB\n", perMillion(*partial));
+    printf("  never written      %8.1f KiB\n", perMillion(blank));
+    printf("  flat array         %8.1f KiB\n", 1000000.0 * sizeof(TileType) / 1024.0);
+    if (!agree)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// --bench-entities N fills an entity store with N entities, three in four of them monsters and
+// the rest items, and reports the time to create them, to iterate over every position and over
+// the monsters' columns, beside a plain array of the same positions, and to churn the store:
+// destroying and recreating a tenth of the entities, and adding and removing a component to
+// move them between tables. The counts are checked after every round.
+int BenchEntities(HeadlessOptions const & options)
+{
+    uint32_t count = uint32_t(options.count);
+    const uint32_t passes = 100;
+    const uint32_t rounds = 20;
+    Random random(options.seed ^ 0xec5);
+
+    EntityStore store;
+    std::vector<EntityHandle> handles(count);
+    auto create = [&](uint32_t i)
+    {
+        Position position = { int32_t(random.Below(1024)), int32_t(random.Below(1024)) };
+        if (i % 4 != 0)
+        {
+            handles[i] = store.Create(position, Appearance{ U'g', 0xff3fbf3f }, Monster{ uint16_t(i % 7), i });
+        }
+        else
+        {
+            handles[i] = store.Create(position, Appearance{ U'!', 0xffbf3f3f });
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        create(i);
+    }
+    auto created = std::chrono::steady_clock::now() - start;
+
+    std::vector<Position> flat;
+    store.Each<Position>([&](Position const & position)
+    {
+        flat.push_back(position);
+    });
+
+    // Each loop sums coordinates so the reads are not optimized away.
+    auto time = [&](auto && pass)
+    {
+        int64_t sum = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < passes; i++)
+        {
+            sum += pass();
+        }
+        return std::make_pair(std::chrono::steady_clock::now() - begin, sum);
+    };
+    auto positions = time([&]
+    {
+        int64_t sum = 0;
+        store.Each<Position>([&](Position const & position)
+        {
+            sum += position.x + position.y;
+        });
+        return sum;
+    });
+    auto monsters = time([&]
+    {
+        int64_t sum = 0;
+        store.ForEachChunk<Position, Monster>([&](size_t rows, EntityHandle const *, Position * position, Monster * monster)
+        {
+            for (size_t i = 0; i < rows; i++)
+            {
+                sum += position[i].x + monster[i].kind;
+            }
+        });
+        return sum;
+    });
+    auto array = time([&]
+    {
+        int64_t sum = 0;
+        for (Position const & position : flat)
+        {
+            sum += position.x + position.y;
+        }
+        return sum;
+    });
+    size_t monsterCount = store.Count<Monster>();
+
+    // Churn: a tenth of the entities die and are replaced, and a tenth gain a field of
+    // view and lose it again, each a move between tables.
+    uint32_t churn = std::max(1u, count / 10);
+    std::vector<uint32_t> picks(churn);
+    std::chrono::nanoseconds replaced{ 0 };
+    std::chrono::nanoseconds moved{ 0 };
+    uint64_t churned = 0;
+    uint32_t wrong = 0;
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        for (auto & pick : picks)
+        {
+            pick = random.Below(count);
+        }
+        std::sort(picks.begin(), picks.end());
+        picks.erase(std::unique(picks.begin(), picks.end()), picks.end());
+
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i : picks)
+        {
+            store.Destroy(handles[i]);
+        }
+        for (uint32_t i : picks)
+        {
+            create(i);
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (uint32_t i : picks)
+        {
+            store.Add(handles[i], Sight{ i });
+        }
+        for (uint32_t i : picks)
+        {
+            store.Remove<Sight>(handles[i]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        replaced += middle - begin;
+        moved += end - middle;
+        churned += picks.size();
+
+        wrong += store.Count<Position>() != count || store.Count<Sight>() != 0 || store.Count<Monster>() != monsterCount;
+        picks.resize(churn);
+    }
+    for (auto const & handle : handles)
+    {
+        wrong += !store.IsAlive(handle);
+    }
+
+    double perEntity = 1000000.0 / passes;
+    printf("entity store, %u entities (%zu monsters) in %zu tables\n", count, monsterCount, store.m_archetypes.size());
+    printf("  create               %8.1f ns per entity\n", double(created.count()) / count);
+    printf("  each position        %8.3f ns per entity\n", Milliseconds(positions.first) * perEntity / count);
+    printf("  monster columns      %8.3f ns per entity\n", Milliseconds(monsters.first) * perEntity / monsterCount);
+    printf("  plain array          %8.3f ns per entity  %s\n", Milliseconds(array.first) * perEntity / count,
+        positions.second == array.second ? "same sum" : "DIFFERENT SUM");
+    printf("  destroy and create   %8.1f ns per entity, %u rounds\n", double(replaced.count()) / churned, rounds);
+    printf("  add and remove       %8.1f ns per entity\n", double(moved.count()) / churned);
+    printf("  %s\n", wrong == 0 ? "counts agree" : "COUNTS WRONG");
+    if (wrong != 0 || positions.second != array.second)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "pch.h"
+
+#include "jobsystem.h"
+
+#include "profiler.h"
+
+// Which system's worker this thread is, if any, and its deque there.
+static thread_local JobSystem const * t_system = nullptr;
+static thread_local uint32_t t_thread = 0;
+
+JobSystem::JobSystem(uint32_t threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (uint32_t i = 1; i < threads; i++)
+    {
+        m_workers.emplace_back([this, i] { Work(i); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto & worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+uint32_t JobSystem::ThreadIndex() const
+{
+    return t_system == this ? t_thread : 0;
+}
+
+void JobSystem::Fork(Counter & counter, Function function, void * context, size_t begin, size_t end, size_t grain)
+{
+    Job job = { function, context, begin, end, std::max<size_t>(grain, 1), &counter };
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    if (!Push(ThreadIndex(), job))
+    {
+        Run(job);
+        counter.pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void JobSystem::Join(Counter & counter)
+{
+    uint32_t thread = ThreadIndex();
+    while (counter.pending.load(std::memory_order_acquire) != 0)
+    {
+        if (!RunOne(thread))
+        {
+            // What is left is running on other threads.
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::Run(Job job)
+{
+    // Split off the upper half until a grain is left, so the biggest pieces are the oldest
+    // in the deque, where thieves take from. With the deque full, the rest runs here.
+    uint32_t thread = ThreadIndex();
+    while (job.end - job.begin > job.grain)
+    {
+        Job upper = job;
+        upper.begin = job.begin + (job.end - job.begin) / 2;
+        job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+        if (!Push(thread, upper))
+        {
+            job.counter->pending.fetch_sub(1, std::memory_order_relaxed);
+            break;
+        }
+        job.end = upper.begin;
+    }
+    job.function(job.context, job.begin, job.end);
+}
+
+bool JobSystem::RunOne(uint32_t thread)
+{
+    Job job;
+    if (!Pop(thread, job) && !Steal(thread, job))
+    {
+        return false;
+    }
+
+    Run(job);
+    m_stats.jobs.fetch_add(1, std::memory_order_relaxed);
+    job.counter->pending.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool JobSystem::Push(uint32_t thread, Job const & job)
+{
+    Queue & queue = *m_queues[thread];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.count == QueueCapacity)
+        {
+            return false;
+        }
+        queue.jobs[(queue.head + queue.count) % QueueCapacity] = job;
+        queue.count++;
+        m_queued.fetch_add(1);
+    }
+
+    // A worker counts itself as sleeping before it checks for jobs, so either it sees this
+    // job or this sees it sleeping and wakes it.
+    if (m_sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wake.notify_one();
+    }
+    return true;
+}
+
+bool JobSystem::Pop(uint32_t thread, Job & job)
+{
+    Queue & queue = *m_queues[thread];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.count == 0)
+    {
+        return false;
+    }
+
+    queue.count--;
+    job = queue.jobs[(queue.head + queue.count) % QueueCapacity];
+    m_queued.fetch_sub(1);
+    return true;
+}
+
+bool JobSystem::Steal(uint32_t thread, Job & job)
+{
+    uint32_t threads = Threads();
+    for (uint32_t i = 1; i < threads; i++)
+    {
+        Queue & queue = *m_queues[(thread + i) % threads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.count == 0)
+        {
+            continue;
+        }
+
+        job = queue.jobs[queue.head];
+        queue.head = (queue.head + 1) % QueueCapacity;
+        queue.count--;
+        m_queued.fetch_sub(1);
+        m_stats.steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::Work(uint32_t thread)
+{
+    t_system = this;
+    t_thread = thread;
+    NameProfileThread("Jobs " + std::to_string(thread));
+
+    for (;;)
+    {
+        uint32_t idle = 0;
+        while (idle < SpinRounds)
+        {
+            if (RunOne(thread))
+            {
+                idle = 0;
+                continue;
+            }
+            idle++;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleeping.fetch_add(1);
+        m_wake.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+        m_sleeping.fetch_sub(1);
+        if (m_stopping)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Fork/join parallelism on a pool of worker threads. Every thread has a deque of jobs: it
+// pushes and pops the jobs it forks at the back, and when its own deque is empty it steals
+// the oldest, and so usually the largest, job from the front of another's. A thread joining
+// a fork runs jobs while it waits rather than blocking, so forks can nest, and a system with
+// a single thread runs everything on the caller.
+//
+// A job is a function pointer, a context and a range, so forking allocates nothing. Every
+// thread that is not a worker shares the first deque, so only one of them may fork at a time.
+struct JobSystem
+{
+    // Counts the jobs of one fork that have not finished.
+    struct Counter
+    {
+        std::atomic<uint32_t> pending{ 0 };
+    };
+
+    using Function = void (*)(void * context, size_t begin, size_t end);
+
+    struct Job
+    {
+        Function function;
+        void * context;
+        size_t begin;
+        size_t end;
+        size_t grain;       // Ranges larger than this are split in two before they run.
+        Counter * counter;
+    };
+
+    // Jobs a deque holds; a fork that finds its deque full runs the job straight away.
+    static constexpr uint32_t QueueCapacity = 256;
+
+    // Times an idle worker looks for work again before it sleeps.
+    static constexpr uint32_t SpinRounds = 64;
+
+    // threads counts the caller: 1 starts no workers, and 0 uses every hardware thread.
+    explicit JobSystem(uint32_t threads = 0);
+    ~JobSystem();
+
+    JobSystem(JobSystem const &) = delete;
+    JobSystem & operator=(JobSystem const &) = delete;
+
+    uint32_t Threads() const { return uint32_t(m_queues.size()); }
+
+    // Queues function(context, begin, end) for [begin, end), split into ranges of at most
+    // grain, counting the job in counter until it and every job it split off have finished.
+    void Fork(Counter & counter, Function function, void * context, size_t begin, size_t end, size_t grain);
+
+    // Runs jobs until every job counted in counter has finished.
+    void Join(Counter & counter);
+
+    // Calls fn(begin, end) over [begin, end) in ranges of at most grain, spread across the
+    // threads, and returns once every range has run.
+    template<typename Fn>
+    void ParallelFor(size_t begin, size_t end, size_t grain, Fn && fn)
+    {
+        using Body = std::remove_reference_t<Fn>;
+        Function function = [](void * context, size_t rangeBegin, size_t rangeEnd)
+        {
+            (*static_cast<Body *>(context))(rangeBegin, rangeEnd);
+        };
+
+        Counter counter;
+        Run({ function, const_cast<void *>(static_cast<void const *>(&fn)), begin, end, std::max<size_t>(grain, 1), &counter });
+        Join(counter);
+    }
+
+    // Runs a job on this thread, first handing off all but a grain of it as jobs of its own.
+    void Run(Job job);
+
+    // Takes a job from thread's deque, or failing that steals one, and runs it. Returns false
+    // if there was none.
+    bool RunOne(uint32_t thread);
+
+    // Returns false, leaving the job to the caller, if the deque is full.
+    bool Push(uint32_t thread, Job const & job);
+    bool Pop(uint32_t thread, Job & job);
+    bool Steal(uint32_t thread, Job & job);
+
+    // Index of the calling thread's deque.
+    uint32_t ThreadIndex() const;
+
+    void Work(uint32_t thread);
+
+    // A ring of jobs, oldest at head.
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        Job jobs[QueueCapacity];
+        uint32_t head = 0;
+        uint32_t count = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+
+    // Jobs in all deques, so idle workers know when to sleep.
+    std::atomic<uint32_t> m_queued{ 0 };
+    std::atomic<uint32_t> m_sleeping{ 0 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+
+    std::vector<std::thread> m_workers;
+
+    struct {
+        std::atomic<uint64_t> jobs{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+    } m_stats;
+};
@@ -0,0 +1,237 @@
+#include "pch.h"
+
+#include "journal.h"
+
+#include "files.h"
+#include "worldgen.h"
+
+// Monsters a new session starts with, spawned this close to the player.
+static const uint32_t SessionMonsters = 5;
+static const uint32_t SessionSpawnRadius = ChunkSize / 2;
+
+Game CreateSessionGame(uint64_t seed, uint32_t width, uint32_t height)
+{
+    Game game(CreateProceduralWorld(width, height, seed, 1), seed);
+    game.SpawnActors(SessionMonsters, SessionSpawnRadius);
+    return game;
+}
+
+uint8_t EncodeCommand(Command const & command)
+{
+    if (command.type == CommandType::Move)
+    {
+        return uint8_t((command.dy + 1) * 3 + (command.dx + 1));
+    }
+    return uint8_t(9 + uint8_t(command.type));
+}
+
+Command DecodeCommand(uint8_t code)
+{
+    Command command;
+    if (code < 9)
+    {
+        command.type = CommandType::Move;
+        command.dx = int8_t(code % 3) - 1;
+        command.dy = int8_t(code / 3) - 1;
+    }
+    else
+    {
+        command.type = CommandType(code - 9);
+    }
+    return command;
+}
+
+bool JournalWriter::Open(std::string const & path, uint64_t seed, uint32_t width, uint32_t height)
+{
+    Close();
+    m_file = OpenFile(path, "wb");
+    if (!m_file)
+    {
+        return false;
+    }
+
+    JournalHeader header = {};
+    memcpy(header.magic, JournalMagic, sizeof(JournalMagic));
+    header.version = JournalVersion;
+    header.seed = seed;
+    header.width = width;
+    header.height = height;
+    memcpy(m_buffer, &header, sizeof(header));
+    m_used = sizeof(header);
+    m_hasLast = false;
+    m_repeats = 0;
+    return true;
+}
+
+void JournalWriter::Close()
+{
+    if (m_file)
+    {
+        FlushRepeats();
+        Flush();
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void JournalWriter::WriteVarint(uint64_t value)
+{
+    // A varint is at most ten bytes; make room for a whole one first.
+    if (m_used + 10 > BufferSize)
+    {
+        Flush();
+    }
+
+    while (value >= 0x80)
+    {
+        m_buffer[m_used++] = uint8_t(value | 0x80);
+        value >>= 7;
+    }
+    m_buffer[m_used++] = uint8_t(value);
+}
+
+void JournalWriter::Flush()
+{
+    if (m_used > 0)
+    {
+        fwrite(m_buffer, 1, m_used, m_file);
+        m_used = 0;
+    }
+}
+
+void JournalWriter::FlushRepeats()
+{
+    if (m_repeats > 0)
+    {
+        WriteVarint((m_repeats << 2) | JournalRecord_Repeat);
+        m_repeats = 0;
+    }
+}
+
+void JournalWriter::RecordCommand(Command const & command)
+{
+    if (!m_file)
+    {
+        return;
+    }
+
+    uint8_t code = EncodeCommand(command);
+    if (m_hasLast && code == m_lastCode)
+    {
+        m_repeats++;
+        return;
+    }
+
+    FlushRepeats();
+    WriteVarint((uint64_t(code) << 2) | JournalRecord_Command);
+    m_lastCode = code;
+    m_hasLast = true;
+}
+
+void JournalWriter::RecordChunks(std::vector<ChunkUpdate> const & chunks)
+{
+    if (!m_file || chunks.empty())
+    {
+        return;
+    }
+
+    FlushRepeats();
+    WriteVarint((uint64_t(chunks.size()) << 2) | JournalRecord_Chunks);
+    for (auto const & update : chunks)
+    {
+        WriteVarint(update.chunkX);
+        WriteVarint(update.chunkY);
+    }
+}
+
+void JournalWriter::RecordHash(uint64_t turn, uint64_t hash)
+{
+    if (!m_file)
+    {
+        return;
+    }
+
+    FlushRepeats();
+    WriteVarint((turn << 2) | JournalRecord_Hash);
+    WriteVarint(hash);
+    Flush();
+    fflush(m_file);
+}
+
+bool JournalReader::Open(std::string const & path)
+{
+    if (!ReadFile(path, m_data) || m_data.size() < sizeof(JournalHeader))
+    {
+        return false;
+    }
+
+    memcpy(&m_header, m_data.data(), sizeof(m_header));
+    m_position = sizeof(m_header);
+    m_last = Command();
+    return memcmp(m_header.magic, JournalMagic, sizeof(JournalMagic)) == 0 && m_header.version == JournalVersion;
+}
+
+bool JournalReader::ReadVarint(uint64_t & value)
+{
+    value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7)
+    {
+        if (m_position >= m_data.size())
+        {
+            return false;
+        }
+
+        uint8_t byte = m_data[m_position++];
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JournalReader::Next(JournalRecord & record)
+{
+    uint64_t head;
+    if (!ReadVarint(head))
+    {
+        return false;
+    }
+
+    uint64_t payload = head >> 2;
+    record.kind = JournalRecordKind(head & 3);
+    switch (record.kind)
+    {
+    case JournalRecord_Command:
+        m_last = DecodeCommand(uint8_t(payload));
+        record.command = m_last;
+        record.count = 1;
+        return true;
+
+    case JournalRecord_Repeat:
+        record.kind = JournalRecord_Command;
+        record.command = m_last;
+        record.count = payload;
+        return true;
+
+    case JournalRecord_Chunks:
+        record.chunks.clear();
+        for (uint64_t i = 0; i < payload; i++)
+        {
+            uint64_t chunkX;
+            uint64_t chunkY;
+            if (!ReadVarint(chunkX) || !ReadVarint(chunkY))
+            {
+                return false;
+            }
+            record.chunks.emplace_back(uint32_t(chunkX), uint32_t(chunkY));
+        }
+        return true;
+
+    case JournalRecord_Hash:
+        record.turn = payload;
+        return ReadVarint(record.hash);
+    }
+    return false;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "game.h"
+
+#include <cstdio>
+
+// Record of a streamed session: the seed and map size it started from, then every player
+// command and every chunk the world streamed in, in the order the game saw them. Replaying
+// it from CreateSessionGame reproduces the session turn for turn.
+//
+// After a fixed 32-byte little-endian JournalHeader the file is a stream of records. Each
+// record starts with a LEB128 varint whose low two bits are its JournalRecordKind and whose
+// remaining bits are a payload:
+//
+//     Command  payload = command code (a move direction 0-8, or 9 + CommandType)
+//     Repeat   payload = how many more times the previous command was applied
+//     Chunks   payload = count, followed by count (chunkX, chunkY) varint pairs
+//     Hash     payload = turn, followed by the StateHash after that turn as a varint
+//
+// Commands encode to one byte, and held-down keys collapse into Repeat records.
+
+static const char JournalMagic[8] = { 'R', 'L', 'J', 'R', 'N', 'L', 0, 0 };
+static const uint32_t JournalVersion = 1;
+
+struct JournalHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t seed;
+    uint32_t width;
+    uint32_t height;
+};
+
+static_assert(sizeof(JournalHeader) == 32, "JournalHeader is part of the file format");
+
+enum JournalRecordKind : uint8_t
+{
+    JournalRecord_Command,
+    JournalRecord_Repeat,
+    JournalRecord_Chunks,
+    JournalRecord_Hash,
+};
+
+// The game a streamed session starts from. The simulation and replays both build it here,
+// so they start out identical.
+Game CreateSessionGame(uint64_t seed, uint32_t width, uint32_t height);
+
+// Appends records to a journal file through a fixed buffer; recording a turn never allocates.
+struct JournalWriter
+{
+    static constexpr size_t BufferSize = 64 * 1024;
+
+    JournalWriter() = default;
+    ~JournalWriter() { Close(); }
+
+    JournalWriter(JournalWriter const &) = delete;
+    JournalWriter & operator=(JournalWriter const &) = delete;
+
+    bool Open(std::string const & path, uint64_t seed, uint32_t width, uint32_t height);
+    void Close();
+    bool IsOpen() const { return m_file != nullptr; }
+
+    void RecordCommand(Command const & command);
+    void RecordChunks(std::vector<ChunkUpdate> const & chunks);
+
+    // Also flushes, so a crash loses at most the turns since the last hash.
+    void RecordHash(uint64_t turn, uint64_t hash);
+
+    void WriteVarint(uint64_t value);
+    void FlushRepeats();
+    void Flush();
+
+    FILE * m_file = nullptr;
+    size_t m_used = 0;
+    uint8_t m_lastCode = 0;
+    bool m_hasLast = false;
+    uint64_t m_repeats = 0;
+    uint8_t m_buffer[BufferSize];
+};
+
+struct JournalRecord
+{
+    JournalRecordKind kind;
+
+    // Command: the command and how many times in a row it was applied.
+    Command command;
+    uint64_t count = 0;
+
+    // Chunks
+    std::vector<std::pair<uint32_t, uint32_t>> chunks;
+
+    // Hash
+    uint64_t turn = 0;
+    uint64_t hash = 0;
+};
+
+// Reads a whole journal into memory and decodes it record by record.
+struct JournalReader
+{
+    bool Open(std::string const & path);
+
+    // Decodes the next record; Repeat records come back as Command records with the
+    // previous command. Returns false at the end, or if the rest of the file is malformed.
+    bool Next(JournalRecord & record);
+
+    bool ReadVarint(uint64_t & value);
+
+    JournalHeader m_header = {};
+    std::vector<uint8_t> m_data;
+    size_t m_position = 0;
+    Command m_last;
+};
+
+uint8_t EncodeCommand(Command const & command);
+Command DecodeCommand(uint8_t code);
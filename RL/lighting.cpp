@@ -0,0 +1,420 @@
+#include "pch.h"
+
+#include "lighting.h"
+
+// Summing and packing work on four tiles at a time where SSE2 is available; ARM builds take
+// the scalar loops, which give the same results.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RL_LIGHTING_SSE2 1
+#else
+#define RL_LIGHTING_SSE2 0
+#endif
+
+// Adds (or subtracts) count packed levels to count tiles of sums.
+static void AccumulateRow(uint32_t * sums, uint32_t const * levels, uint32_t count, bool subtract)
+{
+    uint32_t i = 0;
+#if RL_LIGHTING_SSE2
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<__m128i const *>(levels + i));
+
+        // Most of a light's square is in shadow or past its radius.
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(packed, zero)) == 0xffff)
+        {
+            continue;
+        }
+
+        // Widen each tile's four bytes to four 32-bit lanes.
+        __m128i low = _mm_unpacklo_epi8(packed, zero);
+        __m128i high = _mm_unpackhi_epi8(packed, zero);
+        __m128i tiles[4] = {
+            _mm_unpacklo_epi16(low, zero),
+            _mm_unpackhi_epi16(low, zero),
+            _mm_unpacklo_epi16(high, zero),
+            _mm_unpackhi_epi16(high, zero),
+        };
+
+        __m128i * sum = reinterpret_cast<__m128i *>(sums + size_t(i) * 4);
+        for (uint32_t tile = 0; tile < 4; tile++)
+        {
+            __m128i value = _mm_loadu_si128(sum + tile);
+            value = subtract ? _mm_sub_epi32(value, tiles[tile]) : _mm_add_epi32(value, tiles[tile]);
+            _mm_storeu_si128(sum + tile, value);
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        uint32_t level = levels[i];
+        uint32_t * sum = sums + size_t(i) * 4;
+        for (uint32_t channel = 0; channel < 3; channel++)
+        {
+            uint32_t value = (level >> (channel * 8)) & 0xff;
+            sum[channel] = subtract ? sum[channel] - value : sum[channel] + value;
+        }
+    }
+}
+
+// Packs count tiles of sums plus the ambient level into levels, saturating each channel at 255.
+static void PackRow(uint32_t const * sums, uint32_t ambient, uint32_t * levels, uint32_t count)
+{
+    uint32_t i = 0;
+#if RL_LIGHTING_SSE2
+    __m128i ambientLanes = _mm_set_epi32(0, (ambient >> 16) & 0xff, (ambient >> 8) & 0xff, ambient & 0xff);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i const * sum = reinterpret_cast<__m128i const *>(sums + size_t(i) * 4);
+        __m128i tile0 = _mm_add_epi32(_mm_loadu_si128(sum + 0), ambientLanes);
+        __m128i tile1 = _mm_add_epi32(_mm_loadu_si128(sum + 1), ambientLanes);
+        __m128i tile2 = _mm_add_epi32(_mm_loadu_si128(sum + 2), ambientLanes);
+        __m128i tile3 = _mm_add_epi32(_mm_loadu_si128(sum + 3), ambientLanes);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(tile0, tile1), _mm_packs_epi32(tile2, tile3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(levels + i), packed);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        uint32_t const * sum = sums + size_t(i) * 4;
+        uint32_t level = 0;
+        for (uint32_t channel = 0; channel < 3; channel++)
+        {
+            uint32_t value = sum[channel] + ((ambient >> (channel * 8)) & 0xff);
+            level |= std::min(value, 255u) << (channel * 8);
+        }
+        levels[i] = level;
+    }
+}
+
+// Fills the light's contribution from its field of view.
+static void CastLight(WorldMap const & map, LightSource & light)
+{
+    FovViewer & view = light.m_view;
+    view.Update(map);
+
+    VisibilityMask const & visible = view.m_visible;
+    light.m_left = visible.m_left;
+    light.m_top = visible.m_top;
+    light.m_size = visible.m_size;
+    light.m_contribution.assign(size_t(visible.m_size) * visible.m_size, 0);
+
+    float reach = float(view.m_radius + 1);
+    for (uint32_t row = 0; row < visible.m_size; row++)
+    {
+        int32_t y = visible.m_top + int32_t(row);
+        for (uint32_t column = 0; column < visible.m_size; column++)
+        {
+            int32_t x = visible.m_left + int32_t(column);
+            if (!visible.Test(x, y))
+            {
+                continue;
+            }
+
+            float dx = float(x - view.m_x);
+            float dy = float(y - view.m_y);
+            float intensity = 1.0f - sqrtf(dx * dx + dy * dy) / reach;
+            uint32_t level = 0;
+            for (uint32_t channel = 0; channel < 3; channel++)
+            {
+                float value = float((light.m_color >> (channel * 8)) & 0xff) * intensity;
+                level |= uint32_t(value + 0.5f) << (channel * 8);
+            }
+            light.m_contribution[size_t(row) * visible.m_size + column] = level;
+        }
+    }
+}
+
+static uint64_t TileKey(int32_t x, int32_t y)
+{
+    return (uint64_t(uint32_t(y)) << 32) | uint32_t(x);
+}
+
+uint32_t LightingSystem::Add(int32_t x, int32_t y, uint32_t radius, uint32_t color)
+{
+    LightSource light;
+    light.m_view.m_x = x;
+    light.m_view.m_y = y;
+    light.m_view.m_radius = radius;
+    light.m_color = color & 0xffffff;
+    light.m_active = true;
+
+    if (!m_free.empty())
+    {
+        uint32_t index = m_free.back();
+        m_free.pop_back();
+        m_lights[index] = std::move(light);
+        return index;
+    }
+    m_lights.push_back(std::move(light));
+    return uint32_t(m_lights.size() - 1);
+}
+
+void LightingSystem::Remove(uint32_t index)
+{
+    LightSource & light = m_lights[index];
+    if (light.m_size > 0 && !m_windowMoved)
+    {
+        Accumulate(light, true);
+    }
+    light = LightSource();
+    m_free.push_back(index);
+}
+
+void LightingSystem::Move(uint32_t light, int32_t x, int32_t y)
+{
+    m_lights[light].m_view.MoveTo(x, y);
+}
+
+void LightingSystem::SetColor(uint32_t index, uint32_t color)
+{
+    LightSource & light = m_lights[index];
+    if (light.m_color != (color & 0xffffff))
+    {
+        light.m_color = color & 0xffffff;
+        light.m_changed = true;
+    }
+}
+
+void LightingSystem::SetAmbient(uint32_t color)
+{
+    if (m_map.m_ambient != (color & 0xffffff))
+    {
+        m_map.m_ambient = color & 0xffffff;
+        m_ambientChanged = true;
+    }
+}
+
+void LightingSystem::Follow(int32_t x, int32_t y)
+{
+    int32_t size = int32_t(WindowChunks * 2 + 1) << ChunkShift;
+    int32_t left = ((x >> ChunkShift) - int32_t(WindowChunks)) * int32_t(ChunkSize);
+    int32_t top = ((y >> ChunkShift) - int32_t(WindowChunks)) * int32_t(ChunkSize);
+    if (left != m_map.m_left || top != m_map.m_top || uint32_t(size) != m_map.m_size)
+    {
+        m_map.m_left = left;
+        m_map.m_top = top;
+        m_map.m_size = uint32_t(size);
+        m_windowMoved = true;
+        m_tileLightsMoved = true;
+    }
+}
+
+void LightingSystem::OnTileChanged(int32_t x, int32_t y)
+{
+    m_changedAreas.push_back({ x, y, x + 1, y + 1 });
+    for (auto & light : m_lights)
+    {
+        if (light.m_active)
+        {
+            light.m_view.OnTileChanged(x, y);
+        }
+    }
+}
+
+void LightingSystem::OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    m_changedAreas.push_back({ left, top, right, bottom });
+    for (auto & light : m_lights)
+    {
+        if (light.m_active)
+        {
+            light.m_view.OnRegionChanged(left, top, right, bottom);
+        }
+    }
+}
+
+void LightingSystem::Invalidate()
+{
+    m_windowMoved = true;
+    for (auto & light : m_lights)
+    {
+        light.m_changed = light.m_active;
+        light.m_view.m_dirtyOctants = 0xff;
+    }
+}
+
+bool LightingSystem::Overlaps(int32_t left, int32_t top, uint32_t size) const
+{
+    int32_t windowRight = m_map.m_left + int32_t(m_map.m_size);
+    int32_t windowBottom = m_map.m_top + int32_t(m_map.m_size);
+    return left < windowRight && top < windowBottom && left + int32_t(size) > m_map.m_left && top + int32_t(size) > m_map.m_top;
+}
+
+void LightingSystem::AddTileLights(WorldMap const & map, int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    // Only tiles whose light can reach the window are lit.
+    int32_t reach = int32_t(MaxTileLightRadius());
+    left = std::max({ left, m_map.m_left - reach, 0 });
+    top = std::max({ top, m_map.m_top - reach, 0 });
+    right = std::min({ right, m_map.m_left + int32_t(m_map.m_size) + reach, int32_t(map.m_width) });
+    bottom = std::min({ bottom, m_map.m_top + int32_t(m_map.m_size) + reach, int32_t(map.m_height) });
+
+    for (int32_t y = top; y < bottom; y++)
+    {
+        map.ForEachRowSpan(uint32_t(y), uint32_t(std::min(left, right)), uint32_t(right), [&](uint32_t x, uint32_t count, MapChunk const & chunk, uint32_t index)
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                TileType tile = chunk.tiles[index + i];
+                if (!EmitsLight(tile))
+                {
+                    continue;
+                }
+                int32_t tileX = int32_t(x + i);
+                if (m_tileLights.find(TileKey(tileX, y)) == m_tileLights.end())
+                {
+                    m_tileLights.emplace(TileKey(tileX, y), Add(tileX, y, TileLightRadii[tile], TileLightColors[tile]));
+                }
+            }
+        });
+    }
+}
+
+void LightingSystem::RemoveTileLights(int32_t left, int32_t top, int32_t right, int32_t bottom, bool inside)
+{
+    for (auto it = m_tileLights.begin(); it != m_tileLights.end();)
+    {
+        int32_t x = int32_t(uint32_t(it->first));
+        int32_t y = int32_t(uint32_t(it->first >> 32));
+        if ((x >= left && y >= top && x < right && y < bottom) == inside)
+        {
+            Remove(it->second);
+            it = m_tileLights.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void LightingSystem::Accumulate(LightSource const & light, bool subtract)
+{
+    int32_t left = std::max(light.m_left, m_map.m_left);
+    int32_t top = std::max(light.m_top, m_map.m_top);
+    int32_t right = std::min(light.m_left + int32_t(light.m_size), m_map.m_left + int32_t(m_map.m_size));
+    int32_t bottom = std::min(light.m_top + int32_t(light.m_size), m_map.m_top + int32_t(m_map.m_size));
+    if (left >= right || top >= bottom)
+    {
+        return;
+    }
+
+    for (int32_t y = top; y < bottom; y++)
+    {
+        size_t window = size_t(y - m_map.m_top) * m_map.m_size + size_t(left - m_map.m_left);
+        size_t local = size_t(y - light.m_top) * light.m_size + size_t(left - light.m_left);
+        AccumulateRow(m_sums.data() + window * 4, light.m_contribution.data() + local, uint32_t(right - left), subtract);
+    }
+
+    m_dirty.push_back({
+        uint32_t(left - m_map.m_left),
+        uint32_t(top - m_map.m_top),
+        uint32_t(right - m_map.m_left),
+        uint32_t(bottom - m_map.m_top),
+    });
+}
+
+uint32_t LightingSystem::Update(WorldMap const & map)
+{
+    uint32_t size = m_map.m_size;
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    // Changed tiles lose their lights and are looked at again. A moved window drops the tile
+    // lights that can no longer reach it and picks up the ones that now can.
+    for (auto const & area : m_changedAreas)
+    {
+        RemoveTileLights(area[0], area[1], area[2], area[3], true);
+        AddTileLights(map, area[0], area[1], area[2], area[3]);
+    }
+    m_changedAreas.clear();
+    if (m_tileLightsMoved)
+    {
+        int32_t reach = int32_t(MaxTileLightRadius());
+        int32_t left = m_map.m_left - reach;
+        int32_t top = m_map.m_top - reach;
+        int32_t right = m_map.m_left + int32_t(size) + reach;
+        int32_t bottom = m_map.m_top + int32_t(size) + reach;
+        RemoveTileLights(left, top, right, bottom, false);
+        AddTileLights(map, left, top, right, bottom);
+        m_tileLightsMoved = false;
+    }
+
+    // A moved window starts from nothing, and re-adds every contribution that is still valid.
+    bool rebuild = m_windowMoved;
+    if (rebuild)
+    {
+        m_sums.assign(size_t(size) * size * 4, 0);
+        m_map.m_levels.assign(size_t(size) * size, 0);
+        m_dirty.clear();
+        m_windowMoved = false;
+    }
+
+    uint32_t recast = 0;
+    for (auto & light : m_lights)
+    {
+        if (!light.m_active)
+        {
+            continue;
+        }
+
+        FovViewer const & view = light.m_view;
+        int32_t radius = int32_t(view.m_radius);
+        bool inside = Overlaps(view.m_x - radius, view.m_y - radius, view.m_radius * 2 + 1);
+        if (!light.m_changed && !view.IsDirty())
+        {
+            if (rebuild)
+            {
+                Accumulate(light, false);
+            }
+            continue;
+        }
+
+        if (!rebuild && light.m_size > 0)
+        {
+            Accumulate(light, true);
+        }
+
+        // A light that left the window stays dirty, and is cast when it comes back.
+        if (!inside)
+        {
+            light.m_size = 0;
+            continue;
+        }
+
+        CastLight(map, light);
+        light.m_changed = false;
+        Accumulate(light, false);
+        recast++;
+    }
+
+    if (rebuild || m_ambientChanged)
+    {
+        m_dirty.assign(1, CellRect{ 0, 0, size, size });
+        m_ambientChanged = false;
+    }
+
+    for (auto const & rect : m_dirty)
+    {
+        for (uint32_t y = rect.top; y < rect.bottom; y++)
+        {
+            size_t index = size_t(y) * size + rect.left;
+            PackRow(m_sums.data() + index * 4, m_map.m_ambient, m_map.m_levels.data() + index, rect.right - rect.left);
+        }
+        m_stats.tilesPacked += uint64_t(rect.right - rect.left) * (rect.bottom - rect.top);
+    }
+    if (!m_dirty.empty())
+    {
+        m_map.m_version++;
+        m_dirty.clear();
+    }
+
+    m_stats.recast += recast;
+    return recast;
+}
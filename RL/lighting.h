@@ -0,0 +1,119 @@
+#pragma once
+
+#include "cellgrid.h"
+#include "fov.h"
+
+// Light levels for a square window of the map, one packed 0x00RRGGBB level per tile, where
+// 255 in a channel is full brightness. Tiles outside the window read as the ambient level.
+struct LightMap
+{
+    uint32_t At(int32_t x, int32_t y) const
+    {
+        uint32_t column = uint32_t(x - m_left);
+        uint32_t row = uint32_t(y - m_top);
+        if (column >= m_size || row >= m_size)
+        {
+            return m_ambient;
+        }
+        return m_levels[size_t(row) * m_size + column];
+    }
+
+    int32_t m_left = 0;
+    int32_t m_top = 0;
+    uint32_t m_size = 0;
+    uint32_t m_ambient = 0;
+    std::vector<uint32_t> m_levels;
+
+    // Changes whenever any level does.
+    uint64_t m_version = 0;
+};
+
+// A point light. It is shadowcast from its tile like a field of view, so a tile change only
+// recasts the octants that can see it, and fades linearly to nothing just past its radius.
+struct LightSource
+{
+    FovViewer m_view;
+    uint32_t m_color = 0;
+    bool m_active = false;
+
+    // Set when the color changed or the light was added, so m_contribution is out of date.
+    bool m_changed = true;
+
+    // What the light adds to the tiles it reaches, as packed levels in an m_size x m_size
+    // square whose top-left tile is (m_left, m_top); the square is empty until it is cast.
+    int32_t m_left = 0;
+    int32_t m_top = 0;
+    uint32_t m_size = 0;
+    std::vector<uint32_t> m_contribution;
+};
+
+// Lights the part of the map around a point, usually the player. Every light keeps its own
+// contribution, and the window keeps the running sum of them, so an update only recasts the
+// lights that moved, changed or can see a changed tile: their old contribution is subtracted,
+// the new one added, and only the tiles they reach are repacked into the light map.
+//
+// Besides the lights added by hand, every tile near the window whose definition emits light
+// gets one, with the tile's radius and color. Update adds and removes them as the window moves
+// and tiles change.
+struct LightingSystem
+{
+    // The window covers the chunks within this many chunks of the one it follows, the same
+    // area the simulation keeps generated.
+    static constexpr uint32_t WindowChunks = 4;
+
+    uint32_t Add(int32_t x, int32_t y, uint32_t radius, uint32_t color);
+    void Remove(uint32_t light);
+    void Move(uint32_t light, int32_t x, int32_t y);
+    void SetColor(uint32_t light, uint32_t color);
+    void SetAmbient(uint32_t color);
+
+    // Centres the window on the chunk that holds (x, y).
+    void Follow(int32_t x, int32_t y);
+
+    void OnTileChanged(int32_t x, int32_t y);
+    void OnRegionChanged(int32_t left, int32_t top, int32_t right, int32_t bottom);
+
+    // Forgets every contribution, so the next Update recasts every light and sums from scratch.
+    void Invalidate();
+
+    // Brings m_map up to date. Lights wholly outside the window are left until they are
+    // inside it. Returns the number of lights recast.
+    uint32_t Update(WorldMap const & map);
+
+    // Adds (or subtracts) the part of the light's contribution that falls in the window, and
+    // records the tiles it touched for repacking.
+    void Accumulate(LightSource const & light, bool subtract);
+
+    bool Overlaps(int32_t left, int32_t top, uint32_t size) const;
+
+    // Adds a light for every tile in the area that emits one and has none yet, or removes the
+    // tile lights inside (or outside) the area.
+    void AddTileLights(WorldMap const & map, int32_t left, int32_t top, int32_t right, int32_t bottom);
+    void RemoveTileLights(int32_t left, int32_t top, int32_t right, int32_t bottom, bool inside);
+
+    std::vector<LightSource> m_lights;
+    std::vector<uint32_t> m_free;
+
+    // The light of each lit tile, by the tile's y in the high half and x in the low half.
+    std::unordered_map<uint64_t, uint32_t> m_tileLights;
+
+    // Areas whose tiles changed since the last Update, as left, top, right and bottom, and
+    // whether the window moved, so tile lights are looked for again.
+    std::vector<std::array<int32_t, 4>> m_changedAreas;
+    bool m_tileLightsMoved = true;
+
+    // Per window tile, the sum of every light as four 32-bit lanes: blue, green, red, unused.
+    std::vector<uint32_t> m_sums;
+    bool m_windowMoved = true;
+    bool m_ambientChanged = true;
+
+    // Window rectangles whose sums changed since they were last packed.
+    std::vector<CellRect> m_dirty;
+
+    LightMap m_map;
+
+    struct {
+        uint64_t recast = 0;
+        uint64_t tilesPacked = 0;
+    } m_stats;
+};
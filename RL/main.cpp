@@ -1,18 +1,82 @@
 ﻿#include "pch.h"
 
 #include "deviceresources.h"
+#include "framepacer.h"
+#include "profiler.h"
 #include "renderer.h"
+#include "simulation.h"
+#include "taskgraph.h"
 
 using namespace winrt;
 using namespace winrt::Windows::ApplicationModel::Core;
 using namespace winrt::Windows::Foundation;
+using namespace winrt::Windows::Storage;
+using namespace winrt::Windows::System;
+using namespace winrt::Windows::System::Threading;
 using namespace winrt::Windows::UI::Core;
 
+// Width and height of the procedural world, in tiles.
+static const uint32_t WorldSize = 1024;
+
+// How often the profiler overlay is refreshed, and the window it averages over.
+static const std::chrono::milliseconds OverlayInterval{ 500 };
+
+// How long the UI thread helps with startup tasks before it handles window events again.
+static const std::chrono::milliseconds StartupPoll{ 10 };
+
+static Command CommandForKey(VirtualKey key)
+{
+    Command command;
+    command.type = CommandType::Move;
+
+    switch (key)
+    {
+    case VirtualKey::Left:
+    case VirtualKey::NumberPad4: command.dx = -1; break;
+    case VirtualKey::Right:
+    case VirtualKey::NumberPad6: command.dx = 1; break;
+    case VirtualKey::Up:
+    case VirtualKey::NumberPad8: command.dy = -1; break;
+    case VirtualKey::Down:
+    case VirtualKey::NumberPad2: command.dy = 1; break;
+    case VirtualKey::NumberPad7: command.dx = -1; command.dy = -1; break;
+    case VirtualKey::NumberPad9: command.dx = 1; command.dy = -1; break;
+    case VirtualKey::NumberPad1: command.dx = -1; command.dy = 1; break;
+    case VirtualKey::NumberPad3: command.dx = 1; command.dy = 1; break;
+    case VirtualKey::NumberPad5:
+    case VirtualKey::Space: command.type = CommandType::Wait; break;
+    case VirtualKey::F5: command.type = CommandType::Save; break;
+    case VirtualKey::F9: command.type = CommandType::Load; break;
+    default: command.type = CommandType::None; break;
+    }
+
+    return command;
+}
+
 struct AppView : implements<AppView, IFrameworkView>
 {
     void Initialize(CoreApplicationView const & view)
     {
-        m_renderer.InitializeDeviceDependentResources(m_deviceResources);
+        // Startup runs as a task graph, so device creation, glyph warmup and world generation
+        // overlap, and the first frame waits only for what it draws with.
+        TaskGraph & graph = m_startup;
+        auto d2dFactory = graph.Add("D2D factory", [this] { m_deviceResources.InitializeD2DFactory(); });
+        auto dwriteFactory = graph.Add("DWrite factory", [this] { m_deviceResources.InitializeDWriteFactory(); });
+        auto wicFactory = graph.Add("WIC factory", [this] { m_deviceResources.InitializeWicFactory(); });
+        auto d3dDevice = graph.Add("D3D device", [this] { m_deviceResources.InitializeD3DDevice(); });
+        m_startupTasks.devices = graph.Add("D2D device", [this] { m_deviceResources.InitializeD2DDevice(); }, { d2dFactory, d3dDevice });
+
+        auto rendererResources = graph.Add("Renderer resources", [this] { m_renderer.InitializeDeviceDependentResources(m_deviceResources); }, { m_startupTasks.devices });
+        auto glyphResources = graph.Add("Glyph resources", [this] { m_renderer.InitializeGlyphResources(m_deviceResources); }, { d2dFactory, dwriteFactory, wicFactory });
+        auto glyphWarmup = graph.Add("Glyph warmup", [this] { m_renderer.WarmGlyphs(); }, { glyphResources });
+
+        uint64_t seed = uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+        auto world = graph.Add("World", [this, seed] { m_simulation = std::make_unique<Simulation>(WorldSize, WorldSize, seed); });
+
+        m_startupTasks.firstFrame = graph.Add("First frame ready", [] {}, { rendererResources, glyphWarmup, world });
+
+        // Workers join the multithreaded apartment for the COM-based WIC factory.
+        graph.Start(std::max(2u, std::thread::hardware_concurrency()) - 1, [] { init_apartment(); });
     }
 
     void Load(hstring)
@@ -30,23 +94,204 @@ struct AppView : implements<AppView, IFrameworkView>
         CoreWindow window = CoreWindow::GetForCurrentThread();
         window.Activate();
 
+        NameProfileThread("Render");
+        auto overlayUpdate = std::chrono::steady_clock::now();
+
         CoreDispatcher dispatcher = window.Dispatcher();
+        m_dispatcher = dispatcher;
         while (!m_state.closed)
         {
-            if (m_state.visible)
+            if (!m_state.visible)
+            {
+                dispatcher.ProcessEvents(CoreProcessEventsOption::ProcessOneAndAllPending);
+                continue;
+            }
+
+            dispatcher.ProcessEvents(CoreProcessEventsOption::ProcessAllIfPresent);
+
+            if (m_state.activated && !m_state.started)
+            {
+                if (!m_startup.Wait(m_startupTasks.firstFrame, StartupPoll))
+                {
+                    continue;
+                }
+                StartSimulation();
+            }
+
+            if (!m_state.started)
             {
-                dispatcher.ProcessEvents(CoreProcessEventsOption::ProcessAllIfPresent);
+                continue;
+            }
 
-                if (m_state.activated)
+            // The profiler overlay is the one animation: while it is shown it asks for a frame
+            // each time it is due to refresh.
+            auto now = std::chrono::steady_clock::now();
+            if (m_state.overlay)
+            {
+                if (now >= overlayUpdate)
                 {
-                    m_renderer.Render(m_deviceResources);
-                    m_deviceResources.Present();
+                    UpdateOverlay(ProfileTime(now - OverlayInterval));
+                    overlayUpdate = now + OverlayInterval;
+                    m_pacer.Invalidate();
                 }
+                m_pacer.RequestFrame(overlayUpdate);
             }
-            else
+
+            FramePacer::Clock::time_point wake;
+            if (!m_pacer.ShouldDraw(now, wake))
             {
+                // Nothing to draw: sleep until input, a new snapshot or the next animation frame.
+                if (wake != FramePacer::Clock::time_point::max())
+                {
+                    WakeAt(wake);
+                }
                 dispatcher.ProcessEvents(CoreProcessEventsOption::ProcessOneAndAllPending);
+                continue;
             }
+
+            DrawFrame();
+            m_pacer.FrameDrawn(now);
+        }
+
+        if (m_state.started)
+        {
+            m_simulation->Stop();
+        }
+    }
+
+    void DrawFrame()
+    {
+        ProfileScope("Frame");
+
+        // However many size changes arrived since the last frame, resize once, to the newest.
+        uint32_t width = 0;
+        uint32_t height = 0;
+        FramePacer::Clock::duration latency;
+        if (m_resize.Take(FramePacer::Clock::now(), width, height, latency))
+        {
+            m_deviceResources.ResizeWindowResources(width, height);
+            ProfileCount("resize latency us", std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        }
+
+        m_deviceResources.WaitForFrame();
+        if (m_renderer.Render(m_deviceResources, m_simulation->Snapshot()))
+        {
+            m_deviceResources.Present(m_renderer.m_frame.presentRects);
+            if (!m_state.presented)
+            {
+                m_state.presented = true;
+                ReportStartup();
+            }
+        }
+        else if (m_pacer.m_mode == RedrawMode::Continuous)
+        {
+            // Nothing changed; keep to the refresh rate without presenting.
+            m_deviceResources.WaitForVBlank();
+        }
+    }
+
+    // Makes ProcessEvents return at the given time by queueing an empty event then.
+    void WakeAt(FramePacer::Clock::time_point at)
+    {
+        if (at == m_wake.at)
+        {
+            return;
+        }
+
+        if (m_wake.timer)
+        {
+            m_wake.timer.Cancel();
+        }
+        m_wake.at = at;
+
+        auto delay = std::max(at - FramePacer::Clock::now(), FramePacer::Clock::duration::zero());
+        CoreDispatcher dispatcher = m_dispatcher;
+        m_wake.timer = ThreadPoolTimer::CreateTimer([dispatcher](ThreadPoolTimer const &)
+        {
+            dispatcher.RunAsync(CoreDispatcherPriority::Normal, [] {});
+        }, std::chrono::duration_cast<TimeSpan>(delay));
+    }
+
+    void StartSimulation()
+    {
+        // F5 saves to and F9 loads from a single quicksave slot. Each run journals its session,
+        // so it can be replayed with the headless driver.
+        std::string folder = to_string(ApplicationData::Current().LocalFolder().Path());
+        m_simulation->m_savePath = folder + "\\quicksave.rls";
+        m_simulation->m_journalPath = folder + "\\session.rlj";
+        m_tracePath = folder + "\\trace.json";
+
+        // A snapshot that draws differently wakes the render loop, once however many arrive
+        // before it gets to them.
+        m_simulation->m_onChanged = [this]
+        {
+            if (!m_wakePending.exchange(true))
+            {
+                m_dispatcher.RunAsync(CoreDispatcherPriority::Normal, [this]
+                {
+                    m_wakePending = false;
+                    m_pacer.Invalidate();
+                });
+            }
+        };
+        m_simulation->Start();
+        m_state.started = true;
+    }
+
+    // Writes how long each startup task took, and when the first frame was presented, to the
+    // debugger output.
+    void ReportStartup()
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "startup: first frame presented after %.3f ms\n", (ProfileNow() - m_startup.m_started) / 1e6);
+        OutputDebugStringA(line);
+
+        std::vector<std::string> lines;
+        m_startup.FormatTimings(lines);
+        for (auto const & timing : lines)
+        {
+            OutputDebugStringA(("startup: " + timing + "\n").c_str());
+        }
+    }
+
+    void UpdateOverlay(int64_t since)
+    {
+        if (m_state.overlay && ProfilingEnabled())
+        {
+            FormatProfileOverlay(since, m_renderer.m_scene.m_overlay, m_renderer.m_scene.m_frameArena);
+        }
+        else
+        {
+            m_renderer.m_scene.m_overlay.clear();
+        }
+    }
+
+    // Keys handled by the app rather than the game. Page Up and Page Down scroll the message
+    // log, F3 turns profiling and its overlay on and off, F4 writes what has been recorded
+    // as a trace, and F6 switches between drawing on demand and every vertical blank.
+    bool HandleInterfaceKey(VirtualKey key)
+    {
+        switch (key)
+        {
+        case VirtualKey::PageUp:
+            m_renderer.m_scene.m_logPanel.Scroll(1);
+            return true;
+        case VirtualKey::PageDown:
+            m_renderer.m_scene.m_logPanel.Scroll(-1);
+            return true;
+        case VirtualKey::F3:
+            m_state.overlay = !m_state.overlay;
+            EnableProfiling(m_state.overlay);
+            UpdateOverlay(ProfileNow());
+            return true;
+        case VirtualKey::F4:
+            WriteChromeTrace(m_tracePath);
+            return true;
+        case VirtualKey::F6:
+            m_pacer.SetMode(m_pacer.m_mode == RedrawMode::OnDemand ? RedrawMode::Continuous : RedrawMode::OnDemand);
+            return true;
+        default:
+            return false;
         }
     }
 
@@ -61,12 +306,30 @@ struct AppView : implements<AppView, IFrameworkView>
 
         window.SizeChanged([=](auto &&, WindowSizeChangedEventArgs const & args)
         {
-            m_deviceResources.InitializeWindowResources(window);
+            auto size = args.Size();
+            m_resize.Request(uint32_t(lround(size.Width)), uint32_t(lround(size.Height)), FramePacer::Clock::now());
+            m_pacer.Invalidate();
+        });
+
+        window.KeyDown([=](auto &&, KeyEventArgs const & args)
+        {
+            m_pacer.Invalidate();
+            if (HandleInterfaceKey(args.VirtualKey()))
+            {
+                return;
+            }
+
+            Command command = CommandForKey(args.VirtualKey());
+            if (command.type != CommandType::None && m_state.started)
+            {
+                m_simulation->Post(command);
+            }
         });
 
         window.VisibilityChanged([=](auto &&, VisibilityChangedEventArgs const & args)
         {
             m_state.visible = args.Visible();
+            m_pacer.Invalidate();
         });
 
         window.Closed([=](auto &&, CoreWindowEventArgs const & args)
@@ -74,7 +337,11 @@ struct AppView : implements<AppView, IFrameworkView>
             m_state.closed = true;
         });
 
+        // The swap chain needs the devices; help finish them if they are not ready yet.
+        m_startup.Wait(m_startupTasks.devices);
         m_deviceResources.InitializeWindowResources(window);
+        auto size = m_deviceResources.m_windowDependentResources.d3d.renderTargetSize;
+        m_resize.Applied(uint32_t(size.Width), uint32_t(size.Height));
         m_state.activated = true;
 
         return{};
@@ -85,11 +352,37 @@ struct AppView : implements<AppView, IFrameworkView>
     DeviceResources m_deviceResources;
     ConsoleRenderer m_renderer;
 
+    std::string m_tracePath;
+
+    CoreDispatcher m_dispatcher{ nullptr };
+    FramePacer m_pacer;
+    ResizeCoalescer m_resize;
+    std::atomic<bool> m_wakePending{ false };
+
+    struct {
+        ThreadPoolTimer timer{ nullptr };
+        FramePacer::Clock::time_point at;
+    } m_wake;
+
+    // Created by the startup graph.
+    std::unique_ptr<Simulation> m_simulation;
+
     struct {
         bool activated = false;
         bool closed = false;
         bool visible = true;
+        bool overlay = false;
+        bool started = false;
+        bool presented = false;
     } m_state;
+
+    struct {
+        TaskGraph::TaskId devices = 0;
+        TaskGraph::TaskId firstFrame = 0;
+    } m_startupTasks;
+
+    // Declared last so it is destroyed first: it waits for any startup task still using the members above.
+    TaskGraph m_startup;
 };
 
 struct AppViewSource : implements<AppViewSource, IFrameworkViewSource>
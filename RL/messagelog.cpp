@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "messagelog.h"
+
+void MessageLog::Add(std::string_view text)
+{
+    // Back up to the start of a UTF-8 sequence rather than cut one in half.
+    size_t length = text.size();
+    if (length > MaxLength)
+    {
+        length = MaxLength;
+        while (length > 0 && (uint8_t(text[length]) & 0xc0) == 0x80)
+        {
+            length--;
+        }
+    }
+
+    Message & message = m_messages[m_added % Capacity];
+    message.length = uint16_t(length);
+    memcpy(message.text, text.data(), length);
+    m_added++;
+}
+
+void MessageLogPanel::Scroll(int32_t lines)
+{
+    m_scroll = uint32_t(std::max<int64_t>(int64_t(m_scroll) + lines, 0));
+}
+
+void MessageLogPanel::Draw(MessageLog const & log, TextLayoutCache & cache, CellGrid & grid, CellRect const & area)
+{
+    uint32_t width = area.right - area.left;
+    uint32_t height = area.bottom - area.top;
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
+
+    // Keep a scrolled-back view on the same lines as messages arrive. Messages that have
+    // already left the ring no longer count.
+    size_t arrived = size_t(std::min<uint64_t>(log.m_added - m_seen, log.Count()));
+    if (m_scroll > 0)
+    {
+        for (size_t i = 0; i < arrived; i++)
+        {
+            m_scroll += uint32_t(cache.Layout(log.Recent(i), width).lines.size());
+        }
+    }
+    m_seen = log.m_added;
+
+    // Walk back from the newest message until the panel is filled, skipping the lines the
+    // view is scrolled past. Rows are filled from the bottom up.
+    uint32_t skip = m_scroll;
+    uint32_t row = height;
+    size_t total = 0;
+    for (size_t i = 0; i < log.Count() && row > 0; i++)
+    {
+        std::string_view text = log.Recent(i);
+        TextLayout const & layout = cache.Layout(text, width);
+        total += layout.lines.size();
+        for (size_t line = layout.lines.size(); line-- > 0 && row > 0;)
+        {
+            if (skip > 0)
+            {
+                skip--;
+                continue;
+            }
+            DrawTextLine(grid, area.left, area.top + --row, width, text, layout.lines[line], cache.m_measurer);
+        }
+    }
+
+    if (m_scroll > 0 && (skip > 0 || row > 0))
+    {
+        // Scrolled back past the oldest line: pin it to the top of the panel and draw again.
+        m_scroll = total > height ? uint32_t(total - height) : 0;
+        Draw(log, cache, grid, area);
+        return;
+    }
+
+    for (uint32_t y = area.top; y < area.top + row; y++)
+    {
+        DrawTextLine(grid, area.left, y, width, {}, TextLine{ 0, 0, 0 }, cache.m_measurer);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "textlayout.h"
+
+// The most recent messages, in a fixed ring: adding one copies it into the oldest slot and
+// never allocates. Messages longer than MaxLength bytes are cut at a character boundary.
+struct MessageLog
+{
+    static constexpr size_t Capacity = 128;
+    static constexpr size_t MaxLength = 126;
+
+    void Add(std::string_view text);
+
+    size_t Count() const { return size_t(std::min<uint64_t>(m_added, Capacity)); }
+
+    // 0 is the newest message.
+    std::string_view Recent(size_t index) const
+    {
+        Message const & message = m_messages[(m_added - 1 - index) % Capacity];
+        return std::string_view(message.text, message.length);
+    }
+
+    struct Message
+    {
+        uint16_t length;
+        char text[MaxLength];
+    };
+
+    Message m_messages[Capacity];
+
+    // How many messages were ever added; it changes exactly when the log does.
+    uint64_t m_added = 0;
+};
+
+// Draws a message log newest-last at the bottom of a panel, wrapped to its width, and scrolls
+// back through it a line at a time. Layouts come from a cache, so a frame where the log has not
+// changed does no layout work, and only the messages that are on screen are looked at.
+struct MessageLogPanel
+{
+    void Draw(MessageLog const & log, TextLayoutCache & cache, CellGrid & grid, CellRect const & area);
+
+    // Positive scrolls back to older messages. The next Draw clamps to what the log holds.
+    void Scroll(int32_t lines);
+
+    // Lines scrolled back from the newest. While scrolled back, new messages push the view
+    // further back so the lines on screen stay put.
+    uint32_t m_scroll = 0;
+    uint64_t m_seen = 0;
+};
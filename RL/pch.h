@@ -1,5 +1,16 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
 #pragma comment(lib, "windowsapp")
 #pragma warning(disable : 4467)
 
@@ -14,4 +25,8 @@
 
 #include <winrt/Windows.ApplicationModel.Core.h>
 #include <winrt/Windows.Foundation.h>
-#include <winrt/Windows.UI.Core.h>
\ No newline at end of file
+#include <winrt/Windows.Storage.h>
+#include <winrt/Windows.System.h>
+#include <winrt/Windows.System.Threading.h>
+#include <winrt/Windows.UI.Core.h>
+#endif
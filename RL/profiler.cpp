@@ -0,0 +1,254 @@
+#include "pch.h"
+
+#include "profiler.h"
+
+#include "files.h"
+
+#include <mutex>
+
+std::atomic<bool> g_profiling{ false };
+
+// Every ring ever created. Rings outlive their threads so their events can still be exported.
+static std::mutex s_tracksMutex;
+static std::vector<std::unique_ptr<ProfileRing>> s_tracks;
+
+static thread_local ProfileRing * t_ring = nullptr;
+
+void EnableProfiling(bool enabled)
+{
+    g_profiling.store(enabled, std::memory_order_relaxed);
+}
+
+template<typename Events>
+uint64_t ProfileRing::Read(uint64_t since, Events & events) const
+{
+    uint64_t written = m_written.load(std::memory_order_acquire);
+    uint64_t first = std::max(since, written > Capacity ? written - Capacity : 0);
+
+    size_t begin = events.size();
+    for (uint64_t i = first; i < written; i++)
+    {
+        Slot const & slot = m_slots[i & (Capacity - 1)];
+        ProfileEvent event;
+        event.name = slot.name.load(std::memory_order_relaxed);
+        event.start = slot.start.load(std::memory_order_relaxed);
+        event.value = slot.value.load(std::memory_order_relaxed);
+        event.type = slot.type.load(std::memory_order_relaxed);
+        events.push_back(event);
+    }
+
+    // The writer may have lapped the oldest slots while they were being copied.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = m_written.load(std::memory_order_relaxed);
+    if (after > Capacity && after - Capacity > first)
+    {
+        uint64_t lost = std::min(after - Capacity, written) - first;
+        events.erase(events.begin() + begin, events.begin() + begin + size_t(lost));
+    }
+    return written;
+}
+
+static ProfileRing & AddTrack(std::string name)
+{
+    std::lock_guard<std::mutex> lock(s_tracksMutex);
+    auto ring = std::make_unique<ProfileRing>();
+    ring->m_track = uint32_t(s_tracks.size());
+    ring->m_name = name.empty() ? "Thread " + std::to_string(ring->m_track) : std::move(name);
+    s_tracks.push_back(std::move(ring));
+    return *s_tracks.back();
+}
+
+ProfileRing & ThreadProfileRing()
+{
+    if (!t_ring)
+    {
+        t_ring = &AddTrack({});
+    }
+    return *t_ring;
+}
+
+void NameProfileThread(std::string name)
+{
+    if (!t_ring)
+    {
+        t_ring = &AddTrack(std::move(name));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(s_tracksMutex);
+    t_ring->m_name = std::move(name);
+}
+
+ProfileRing & CreateProfileTrack(std::string name)
+{
+    return AddTrack(std::move(name));
+}
+
+void SummarizeProfile(int64_t since, ArenaVector<ProfileStat> & stats)
+{
+    stats.clear();
+
+    std::lock_guard<std::mutex> lock(s_tracksMutex);
+    ArenaVector<ProfileEvent> events(stats.get_allocator());
+    events.reserve(ProfileRing::Capacity);
+    for (auto const & ring : s_tracks)
+    {
+        events.clear();
+        ring->Read(0, events);
+
+        // Names are literals, so identical names in one track almost always share a pointer.
+        size_t first = stats.size();
+        for (auto const & event : events)
+        {
+            int64_t time = event.type == ProfileEvent_Scope ? event.start + event.value : event.start;
+            if (time < since)
+            {
+                continue;
+            }
+
+            auto stat = std::find_if(stats.begin() + first, stats.end(), [&](ProfileStat const & s)
+            {
+                return s.type == event.type && (s.name == event.name || strcmp(s.name, event.name) == 0);
+            });
+            if (stat == stats.end())
+            {
+                stats.push_back({ event.name, ring->m_track, event.type, 0, 0, event.value, 0 });
+                stat = stats.end() - 1;
+            }
+
+            stat->count++;
+            stat->total += event.value;
+            stat->maximum = std::max(stat->maximum, event.value);
+            stat->last = event.value;
+        }
+    }
+}
+
+void FormatProfileOverlay(int64_t since, std::vector<std::string> & lines, Arena & scratch)
+{
+    ArenaVector<ProfileStat> stats{ ArenaAllocator<ProfileStat>(scratch) };
+    SummarizeProfile(since, stats);
+
+    size_t count = 0;
+    auto addLine = [&](char const * text)
+    {
+        if (count == lines.size())
+        {
+            lines.emplace_back();
+        }
+        lines[count++].assign(text);
+    };
+
+    char line[128];
+    uint32_t track = UINT32_MAX;
+    for (auto const & stat : stats)
+    {
+        if (stat.track != track)
+        {
+            track = stat.track;
+            std::lock_guard<std::mutex> lock(s_tracksMutex);
+            addLine(s_tracks[track]->m_name.c_str());
+        }
+
+        if (stat.type == ProfileEvent_Scope)
+        {
+            snprintf(line, sizeof(line), "  %-20.20s %8.3f ms avg %8.3f max %6llu",
+                stat.name, stat.total / 1e6 / stat.count, stat.maximum / 1e6, (unsigned long long)stat.count);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "  %-20.20s %8lld avg %8lld max %6lld last",
+                stat.name, (long long)(stat.total / int64_t(stat.count)), (long long)stat.maximum, (long long)stat.last);
+        }
+        addLine(line);
+    }
+    lines.resize(count);
+}
+
+static void WriteJsonString(FILE * file, char const * text)
+{
+    fputc('"', file);
+    for (; *text; text++)
+    {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(file, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(file, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool WriteChromeTrace(std::string const & path)
+{
+    struct Track
+    {
+        std::string name;
+        std::vector<ProfileEvent> events;
+    };
+
+    std::vector<Track> tracks;
+    {
+        std::lock_guard<std::mutex> lock(s_tracksMutex);
+        tracks.resize(s_tracks.size());
+        for (size_t i = 0; i < s_tracks.size(); i++)
+        {
+            tracks[i].name = s_tracks[i]->m_name;
+            s_tracks[i]->Read(0, tracks[i].events);
+        }
+    }
+
+    // Trace timestamps are microseconds; start them at the first event.
+    int64_t origin = INT64_MAX;
+    for (auto const & track : tracks)
+    {
+        for (auto const & event : track.events)
+        {
+            origin = std::min(origin, event.start);
+        }
+    }
+
+    FILE * file = OpenFile(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (uint32_t tid = 0; tid < tracks.size(); tid++)
+    {
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", tid);
+        WriteJsonString(file, tracks[tid].name.c_str());
+        fprintf(file, "}}");
+        first = false;
+
+        for (auto const & event : tracks[tid].events)
+        {
+            fprintf(file, ",\n{\"name\":");
+            WriteJsonString(file, event.name);
+            if (event.type == ProfileEvent_Scope)
+            {
+                fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    tid, (event.start - origin) / 1e3, event.value / 1e3);
+            }
+            else
+            {
+                fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                    tid, (event.start - origin) / 1e3, (long long)event.value);
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "arena.h"
+
+#include <atomic>
+#include <chrono>
+
+// Low-overhead instrumentation. Scopes and counters are written to a ring buffer owned by the
+// thread that records them, so recording never takes a lock; readers (the trace exporter and
+// the overlay) copy the rings out while they are being written.
+//
+// Compiled in unless RL_PROFILE is defined to 0, and off until EnableProfiling(true): a
+// disabled scope costs one relaxed load and a branch at each end.
+#if !defined(RL_PROFILE)
+#define RL_PROFILE 1
+#endif
+
+enum ProfileEventType : uint32_t
+{
+    ProfileEvent_Scope,   // start and duration, in nanoseconds
+    ProfileEvent_Counter, // a sampled value at start
+};
+
+struct ProfileEvent
+{
+    char const * name; // a string literal: only the pointer is kept
+    int64_t start;
+    int64_t value;
+    ProfileEventType type;
+};
+
+// The events of one thread (or one GPU queue), in the order they were recorded. There is only
+// ever one writer; once full, the oldest events are overwritten.
+struct ProfileRing
+{
+    static constexpr uint64_t Capacity = 1 << 14;
+
+    void Push(char const * name, int64_t start, int64_t value, ProfileEventType type)
+    {
+        uint64_t written = m_written.load(std::memory_order_relaxed);
+        Slot & slot = m_slots[written & (Capacity - 1)];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.type.store(type, std::memory_order_relaxed);
+        m_written.store(written + 1, std::memory_order_release);
+    }
+
+    // Appends the events recorded since the first `since` to events, a vector of ProfileEvent
+    // with any allocator, skipping any that were overwritten before or while they were copied.
+    // Returns the new count to pass as since.
+    template<typename Events>
+    uint64_t Read(uint64_t since, Events & events) const;
+
+    // Relaxed atomics so a reader racing the writer is well defined; Read discards what it raced.
+    struct Slot
+    {
+        std::atomic<char const *> name{ nullptr };
+        std::atomic<int64_t> start{ 0 };
+        std::atomic<int64_t> value{ 0 };
+        std::atomic<ProfileEventType> type{ ProfileEvent_Scope };
+    };
+
+    uint32_t m_track = 0;
+    std::string m_name;
+    std::atomic<uint64_t> m_written{ 0 };
+    Slot m_slots[Capacity];
+};
+
+extern std::atomic<bool> g_profiling;
+
+inline bool ProfilingEnabled()
+{
+    return g_profiling.load(std::memory_order_relaxed);
+}
+
+void EnableProfiling(bool enabled);
+
+// Nanoseconds on the steady clock, the time base of every event.
+inline int64_t ProfileTime(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+inline int64_t ProfileNow()
+{
+    return ProfileTime(std::chrono::steady_clock::now());
+}
+
+// The calling thread's ring, created on first use.
+ProfileRing & ThreadProfileRing();
+
+// Names the calling thread's track in traces and the overlay.
+void NameProfileThread(std::string name);
+
+// A track that is not a thread, such as GPU timings. Only one thread may write to it.
+ProfileRing & CreateProfileTrack(std::string name);
+
+inline void RecordProfileScope(char const * name, int64_t start, int64_t end)
+{
+    ThreadProfileRing().Push(name, start, end - start, ProfileEvent_Scope);
+}
+
+inline void RecordProfileCounter(char const * name, int64_t value)
+{
+    ThreadProfileRing().Push(name, ProfileNow(), value, ProfileEvent_Counter);
+}
+
+// Times its own lifetime.
+struct ProfileTimer
+{
+    explicit ProfileTimer(char const * name)
+        : m_name(name), m_start(ProfilingEnabled() ? ProfileNow() : -1)
+    {
+    }
+
+    ~ProfileTimer()
+    {
+        if (m_start >= 0)
+        {
+            RecordProfileScope(m_name, m_start, ProfileNow());
+        }
+    }
+
+    ProfileTimer(ProfileTimer const &) = delete;
+    ProfileTimer & operator=(ProfileTimer const &) = delete;
+
+    char const * m_name;
+    int64_t m_start;
+};
+
+#define ProfileConcatInner(a, b) a##b
+#define ProfileConcat(a, b) ProfileConcatInner(a, b)
+
+#if RL_PROFILE
+#define ProfileScope(name) ProfileTimer ProfileConcat(profileTimer, __LINE__)(name)
+#define ProfileCount(name, value) { if (ProfilingEnabled()) { RecordProfileCounter(name, int64_t(value)); } }
+#else
+#define ProfileScope(name)
+#define ProfileCount(name, value)
+#endif
+
+// Per-name totals over a window, for the overlay.
+struct ProfileStat
+{
+    char const * name;
+    uint32_t track;
+    ProfileEventType type;
+    uint64_t count;
+    int64_t total;   // scopes: summed duration; counters: summed samples
+    int64_t maximum;
+    int64_t last;
+};
+
+// Gathers every scope that ended and every counter sampled at or after since, grouped by
+// track and name, in the order the tracks were created. The events are copied out into the
+// arena stats allocates from.
+void SummarizeProfile(int64_t since, ArenaVector<ProfileStat> & stats);
+
+// One line per track and per name: average and maximum times per call, or counter averages.
+// Reuses the strings already in lines, and builds the summary in scratch.
+void FormatProfileOverlay(int64_t since, std::vector<std::string> & lines, Arena & scratch);
+
+// Writes everything still in the rings as Chrome trace event JSON (chrome://tracing or
+// Perfetto). Returns false if the file could not be written.
+bool WriteChromeTrace(std::string const & path);
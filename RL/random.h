@@ -0,0 +1,51 @@
+#pragma once
+
+// Deterministic pseudo-random generator (xoshiro256**, seeded with splitmix64).
+// Unlike the std distributions, its output is identical on every compiler and platform,
+// so a seed reproduces the same game everywhere.
+struct Random
+{
+    explicit Random(uint64_t seed = 0)
+    {
+        for (auto & word : m_state)
+        {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t Next()
+    {
+        uint64_t result = Rotate(m_state[1] * 5, 7) * 9;
+        uint64_t t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = Rotate(m_state[3], 45);
+        return result;
+    }
+
+    // Uniform-enough value in [0, bound) using a multiply-shift instead of a division.
+    uint32_t Below(uint32_t bound)
+    {
+        return uint32_t(((Next() >> 32) * bound) >> 32);
+    }
+
+    // True with the given percent probability.
+    bool Chance(uint32_t percent)
+    {
+        return Below(100) < percent;
+    }
+
+    static uint64_t Rotate(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t m_state[4];
+};
@@ -1,14 +1,20 @@
 ﻿#include "pch.h"
 
 #include "deviceresources.h"
+#include "dwritemeasurer.h"
 #include "renderer.h"
 
 using namespace Microsoft::WRL;
 
+// Pixel size of one console cell.
+static const D2D1_SIZE_U TileSize = D2D1::SizeU(14, 22);
+
+// Upper bound on the dirty rectangles passed to Present each frame.
+static const size_t MaxDirtyRects = 8;
+
 void ConsoleRenderer::InitializeDeviceDependentResources(DeviceResources & deviceResources)
 {
-    DeviceDependentResources resources = {};
-
+    auto & resources = m_deviceDependentResources;
     auto context2d = deviceResources.m_deviceDependentResources.d2d.context;
 
     ReturnIfFailed(context2d->CreateSolidColorBrush(
@@ -19,8 +25,15 @@ void ConsoleRenderer::InitializeDeviceDependentResources(DeviceResources & devic
         D2D1::ColorF(D2D1::ColorF::Gray, 1.0f),
         &resources.grayBrush));
 
+    m_gpuProfiler.Initialize(deviceResources.m_deviceDependentResources.d3d.device.Get());
+    m_frame.bitmap = nullptr;
+}
+
+void ConsoleRenderer::InitializeGlyphResources(DeviceResources & deviceResources)
+{
+    auto & resources = m_deviceDependentResources;
+
     // Create device independent resources
-    ComPtr<IDWriteTextFormat> textFormat;
     ReturnIfFailed(deviceResources.m_deviceIndependentResources.dwrite.factory->CreateTextFormat(
         L"Consolas",
         nullptr,
@@ -33,99 +46,311 @@ void ConsoleRenderer::InitializeDeviceDependentResources(DeviceResources & devic
     ReturnIfFailed(resources.textFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER));
     ReturnIfFailed(resources.textFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_CENTER));
 
-    m_deviceDependentResources = resources;
+    m_scene.m_textLayouts = std::make_unique<TextLayoutCache>(CreateDWriteMeasurer(resources.textFormat.Get(), float(TileSize.width)));
+
+    // Glyphs are rasterized one at a time into a tile-sized WIC bitmap, then copied into the atlas.
+    ReturnIfFailed(deviceResources.m_deviceIndependentResources.dwrite.wicFactory->CreateBitmap(
+        TileSize.width,
+        TileSize.height,
+        GUID_WICPixelFormat32bppPBGRA,
+        WICBitmapCacheOnLoad,
+        &resources.glyph.bitmap));
+
+    ReturnIfFailed(deviceResources.m_deviceIndependentResources.d2d.factory->CreateWicBitmapRenderTarget(
+        resources.glyph.bitmap.Get(),
+        D2D1::RenderTargetProperties(
+            D2D1_RENDER_TARGET_TYPE_SOFTWARE,
+            D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED),
+            96,
+            96),
+        &resources.glyph.target));
+    resources.glyph.target->SetTextAntialiasMode(D2D1_TEXT_ANTIALIAS_MODE_GRAYSCALE);
+
+    ReturnIfFailed(resources.glyph.target->CreateSolidColorBrush(
+        D2D1::ColorF(D2D1::ColorF::White, 1.0f),
+        &resources.glyph.brush));
+
+    m_glyphAtlas = std::make_unique<GlyphAtlas>(1024, [this](GlyphKey key, uint32_t width, uint32_t height, uint8_t * coverage, size_t stride)
+    {
+        RasterizeGlyph(key, width, height, coverage, stride);
+    });
+}
+
+void ConsoleRenderer::WarmGlyphs()
+{
+    // Printable ASCII covers the map, the actors and the overlay; trees are the one exception.
+    static const char32_t Extra[] = { U'\u2663' };
+
+    for (uint32_t style : { CellStyle_Normal, CellStyle_Dim })
+    {
+        for (char32_t codepoint = U' ' + 1; codepoint < 0x7f; codepoint++)
+        {
+            m_glyphAtlas->Find({ codepoint, style }, TileSize.width, TileSize.height);
+        }
+        for (char32_t codepoint : Extra)
+        {
+            m_glyphAtlas->Find({ codepoint, style }, TileSize.width, TileSize.height);
+        }
+    }
 }
 
-void ConsoleRenderer::Render(DeviceResources & deviceResources)
+void ConsoleRenderer::RasterizeGlyph(GlyphKey key, uint32_t width, uint32_t height, uint8_t * coverage, size_t stride)
 {
+    auto & glyph = m_deviceDependentResources.glyph;
+
+    WCHAR text[2];
+    UINT32 length = 1;
+    if (key.codepoint >= 0x10000)
+    {
+        char32_t c = key.codepoint - 0x10000;
+        text[0] = WCHAR(0xd800 + (c >> 10));
+        text[1] = WCHAR(0xdc00 + (c & 0x3ff));
+        length = 2;
+    }
+    else
+    {
+        text[0] = WCHAR(key.codepoint);
+    }
+
+    glyph.brush->SetOpacity(key.style & CellStyle_Dim ? 0.4f : 1.0f);
+
+    glyph.target->BeginDraw();
+    glyph.target->Clear(D2D1::ColorF(0, 0.0f));
+    glyph.target->DrawText(
+        text,
+        length,
+        m_deviceDependentResources.textFormat.Get(),
+        D2D1::RectF(0.0f, 0.0f, float(width), float(height)),
+        glyph.brush.Get());
+    ReturnIfFailed(glyph.target->EndDraw());
+
+    WICRect rect = { 0, 0, INT(width), INT(height) };
+    ComPtr<IWICBitmapLock> lock;
+    ReturnIfFailed(glyph.bitmap->Lock(&rect, WICBitmapLockRead, &lock));
+
+    UINT lockStride = 0;
+    UINT bufferSize = 0;
+    BYTE * pixels = nullptr;
+    ReturnIfFailed(lock->GetStride(&lockStride));
+    ReturnIfFailed(lock->GetDataPointer(&bufferSize, &pixels));
+
+    // White text on a transparent background: the alpha channel is the coverage.
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            coverage[y * stride + x] = pixels[y * lockStride + x * 4 + 3];
+        }
+    }
+}
+
+bool ConsoleRenderer::Render(DeviceResources & deviceResources, RenderSnapshot const & snapshot)
+{
+    ProfileScope("Render");
+
     auto context3d = deviceResources.m_deviceDependentResources.d3d.context;
     auto context2d = deviceResources.m_deviceDependentResources.d2d.context;
 
-    // Reset the viewport to target the whole screen.
-    auto viewport = deviceResources.m_windowDependentResources.d3d.screenViewport;
-    context3d->RSSetViewports(1, &viewport);
+    D2D1_SIZE_U pixelSize = context2d->GetPixelSize();
+    const D2D1_SIZE_U tileSize = TileSize;
 
-    // Reset render targets to the screen.
-    ID3D11RenderTargetView *const targets[1] = { deviceResources.m_windowDependentResources.d3d.renderTargetView.Get() };
-    context3d->OMSetRenderTargets(1, targets, deviceResources.m_windowDependentResources.d3d.depthStencilView.Get());
+    // Rebuild only what the size change touched: the grids when the columns or rows change, and
+    // the surface's memory and the frame bitmap when the frame outgrows what was reserved.
+    FrameLayout & frameLayout = m_frame.layout;
+    uint32_t changed = frameLayout.Update(pixelSize.width, pixelSize.height, tileSize.width, tileSize.height);
+    ProfileCount("layout changes", changed != 0);
 
-    // Clear the back buffer and depth stencil view.
-    context3d->ClearRenderTargetView(deviceResources.m_windowDependentResources.d3d.renderTargetView.Get(), DirectX::Colors::Black);
-    context3d->ClearDepthStencilView(deviceResources.m_windowDependentResources.d3d.depthStencilView.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    FrameGrid & frame = m_frame.grid;
+    if (changed & LayoutChange_Cells)
+    {
+        frame.Resize(frameLayout.m_columns, frameLayout.m_rows);
+    }
 
-    context2d->BeginDraw();
+    BgraSurface & surface = m_frame.surface;
+    if (changed & LayoutChange_Capacity)
+    {
+        surface.m_pixels.reserve(size_t(frameLayout.m_capacityWidth) * frameLayout.m_capacityHeight);
+        m_frame.bitmap = nullptr;
+    }
+    if (changed & LayoutChange_Pixels)
+    {
+        surface.Resize(pixelSize.width, pixelSize.height);
+    }
 
+    // A new swap chain target (or frame bitmap) has none of the previous frame's contents, and
+    // a grid that moved has to be drawn again in its new place.
+    ID2D1Bitmap1 * target = deviceResources.m_windowDependentResources.d2d.targetBitmap.Get();
+    bool fullFrame = !m_frame.bitmap || target != m_frame.target || (changed & (LayoutChange_Pixels | LayoutChange_Origin));
+    if (fullFrame)
+    {
+        frame.Invalidate();
+        m_frame.target = target;
+    }
+
+    m_scene.Draw(snapshot, frame.m_current, fullFrame);
+
+    frame.Diff(m_frame.cellRects, MaxDirtyRects);
+    if (m_frame.cellRects.empty())
+    {
+        // Leave the back buffer stale; the rectangles it is missing are redrawn with the next change.
+        return false;
+    }
+
+    GridLayout layout = {
+        tileSize.width,
+        tileSize.height,
+        frameLayout.m_originX,
+        frameLayout.m_originY,
+    };
+
+    // Redraw only the dirty tiles into the CPU surface. The padding around the grid is
+    // outside every cell, so a full frame clears it first.
+    if (fullFrame)
+    {
+        surface.Fill(0xff000000);
+    }
+
+    ProfileScope("Composite");
+    uint64_t glyphMisses = m_glyphAtlas->m_stats.misses;
+    m_frame.batches.Clear();
+    m_frame.presentRects.clear();
+    for (auto const & cellRect : m_frame.cellRects)
+    {
+        RECT rect;
+        rect.left = std::max<LONG>(layout.originX + LONG(cellRect.left * tileSize.width), 0);
+        rect.top = std::max<LONG>(layout.originY + LONG(cellRect.top * tileSize.height), 0);
+        rect.right = std::min<LONG>(layout.originX + LONG(cellRect.right * tileSize.width), LONG(surface.m_width));
+        rect.bottom = std::min<LONG>(layout.originY + LONG(cellRect.bottom * tileSize.height), LONG(surface.m_height));
+        if (rect.left >= rect.right || rect.top >= rect.bottom)
+        {
+            continue;
+        }
+
+        BuildCellBatches(frame.m_current, cellRect, layout, *m_glyphAtlas, m_frame.batches);
+        m_frame.presentRects.push_back(rect);
+    }
+    if (!fullFrame && m_frame.presentRects.empty())
+    {
+        // Every change was off screen.
+        return false;
+    }
+    FinishCellBatches(m_frame.batches);
+    CompositeCellBatches(m_frame.batches, *m_glyphAtlas, surface);
+    ProfileCount("cells drawn", m_frame.batches.quads.size());
+    ProfileCount("background fills", m_frame.batches.spans.size());
+    ProfileCount("glyph colors", m_frame.batches.batches.size());
+    ProfileCount("glyph cache misses", m_glyphAtlas->m_stats.misses - glyphMisses);
+    ProfileCount("dirty rects", m_frame.presentRects.size());
+
+    if (!m_frame.bitmap)
+    {
+        // Sized to the reserved pixels, so it outlives most resizes; only its top left part,
+        // the size of the surface, is ever used.
+        ReturnIfFailed(context2d->CreateBitmap(
+            D2D1::SizeU(frameLayout.m_capacityWidth, frameLayout.m_capacityHeight),
+            nullptr,
+            0,
+            D2D1::BitmapProperties1(
+                D2D1_BITMAP_OPTIONS_NONE,
+                D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED),
+                96,
+                96),
+            &m_frame.bitmap), false);
+    }
+
+    // Upload the dirty parts of the surface.
+    UINT32 pitch = surface.m_width * sizeof(uint32_t);
+    if (fullFrame)
+    {
+        D2D1_RECT_U destination = D2D1::RectU(0, 0, surface.m_width, surface.m_height);
+        ReturnIfFailed(m_frame.bitmap->CopyFromMemory(&destination, surface.m_pixels.data(), pitch), false);
+    }
+    else
+    {
+        for (auto const & rect : m_frame.presentRects)
+        {
+            D2D1_RECT_U destination = D2D1::RectU(rect.left, rect.top, rect.right, rect.bottom);
+            ReturnIfFailed(m_frame.bitmap->CopyFromMemory(
+                &destination,
+                surface.m_pixels.data() + size_t(rect.top) * surface.m_width + rect.left,
+                pitch), false);
+        }
+    }
+
+    m_gpuProfiler.BeginFrame(context3d.Get());
+
+    if (fullFrame)
+    {
+        GpuProfileScope pass(m_gpuProfiler, context3d.Get(), "Clear");
+
+        // Reset the viewport to target the whole screen.
+        auto viewport = deviceResources.m_windowDependentResources.d3d.screenViewport;
+        context3d->RSSetViewports(1, &viewport);
+
+        // Reset render targets to the screen.
+        auto depthStencilView = deviceResources.m_windowDependentResources.d3d.depthStencilView.Get();
+        ID3D11RenderTargetView *const targets[1] = { deviceResources.m_windowDependentResources.d3d.renderTargetView.Get() };
+        context3d->OMSetRenderTargets(1, targets, depthStencilView);
+
+        // Clear the back buffer, and the depth stencil view if there is one.
+        context3d->ClearRenderTargetView(deviceResources.m_windowDependentResources.d3d.renderTargetView.Get(), DirectX::Colors::Black);
+        if (depthStencilView)
+        {
+            context3d->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+        }
+    }
+
+    m_gpuProfiler.BeginPass(context3d.Get(), "Draw");
+    context2d->BeginDraw();
     context2d->SetTransform(D2D1::Matrix3x2F::Identity());
-    context2d->Clear(D2D1::ColorF(D2D1::ColorF::Black));
-
-    D2D1_SIZE_F size = context2d->GetSize();
-
-    const std::string map[] = {
-        "XXXXXXXXXXXXXXXXXXXXX",
-        "X                   X",
-        "X                   X",
-        "X                   X",
-        "X       HELLO       X",
-        "X       WORLD       X",
-        "X                   X",
-        "X                   X",
-        "X                   X",
-        "XXXXXXXXXXXXXXXXXXXXX",
+
+    auto drawRect = [&](RECT const & rect)
+    {
+        D2D1_RECT_F bounds = D2D1::RectF(float(rect.left), float(rect.top), float(rect.right), float(rect.bottom));
+        context2d->DrawBitmap(
+            m_frame.bitmap.Get(),
+            bounds,
+            1.0f,
+            D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR,
+            bounds);
     };
-    const D2D1_SIZE_U tileSize = D2D1::SizeU(14, 22);
-
-    D2D1_SIZE_U tileSpan = D2D1::SizeU(
-        (int)ceil(size.width / tileSize.width),
-        (int)ceil(size.height / tileSize.height));
-
-    D2D1_SIZE_F consolePadding = D2D1::SizeF(
-        floor((size.width - tileSpan.width * tileSize.width) / 2.0f),
-        floor((size.height - tileSpan.height * tileSize.height) / 2.0f));
-
-    D2D1_SIZE_U mapSize = D2D1::SizeU(
-        map[0].length(),
-        ARRAYSIZE(map));
-
-    D2D1_SIZE_U mapOffset = D2D1::SizeU(
-        (tileSpan.width - mapSize.width) / 2,
-        (tileSpan.height - mapSize.height) / 2);
-
-    for (auto x = 0; x < tileSpan.width; x++) {
-        for (auto y = 0; y < tileSpan.height; y++) {
-
-            D2D1_POINT_2U mapTile = D2D1::Point2U(
-                x - mapOffset.width,
-                y - mapOffset.height);
-
-            if (mapTile.x < 0 ||
-                mapTile.y < 0 ||
-                mapTile.x >= mapSize.width ||
-                mapTile.y >= mapSize.height)
-            {
-                continue;
-            }
-
-            D2D1_RECT_F tileRect = D2D1::RectF(
-                x * tileSize.width + consolePadding.width,
-                y * tileSize.height + consolePadding.height,
-                (x + 1) * tileSize.width + consolePadding.width,
-                (y + 1) * tileSize.height + consolePadding.height);
-
-            /*
-            context2d->FillRectangle(
-                tileRect,
-                m_deviceDependentResources.grayBrush.Get());
-             */
-
-            WCHAR ch = map[mapTile.y][mapTile.x];
-            context2d->DrawText(
-                &ch,
-                1,
-                m_deviceDependentResources.textFormat.Get(),
-                tileRect,
-                m_deviceDependentResources.whiteBrush.Get());
+
+    if (fullFrame)
+    {
+        D2D1_RECT_F bounds = D2D1::RectF(0.0f, 0.0f, float(surface.m_width), float(surface.m_height));
+        context2d->DrawBitmap(
+            m_frame.bitmap.Get(),
+            bounds,
+            1.0f,
+            D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR,
+            bounds);
+        m_frame.presentRects.clear();
+    }
+    else
+    {
+        // The back buffer is the frame before last, so it also needs what was presented last time.
+        for (auto const & rect : m_frame.staleRects)
+        {
+            drawRect(rect);
+        }
+        for (auto const & rect : m_frame.presentRects)
+        {
+            drawRect(rect);
         }
     }
 
-    context2d->EndDraw();
+    {
+        ProfileScope("EndDraw");
+        ReturnIfFailed(context2d->EndDraw(), false);
+    }
+    m_gpuProfiler.EndPass(context3d.Get());
+    m_gpuProfiler.EndFrame(context3d.Get());
+
+    m_frame.staleRects = m_frame.presentRects;
+    if (fullFrame)
+    {
+        m_frame.staleRects.push_back({ 0, 0, LONG(surface.m_width), LONG(surface.m_height) });
+    }
+
+    return true;
 }
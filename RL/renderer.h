@@ -1,15 +1,68 @@
 #pragma once
 
+#include "cellbatch.h"
+#include "cellgrid.h"
+#include "framegrid.h"
+#include "glyphatlas.h"
+#include "gpuprofiler.h"
+#include "sceneview.h"
+#include "worldmap.h"
+
 struct ConsoleRenderer
 {
-    void Render(DeviceResources & resources);
+    // Redraws the cells that changed since the last frame. Returns false if nothing
+    // changed, in which case there is nothing to present.
+    bool Render(DeviceResources & resources, RenderSnapshot const & snapshot);
 
     struct DeviceDependentResources
     {
         Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> whiteBrush;
         Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> grayBrush;
         Microsoft::WRL::ComPtr<IDWriteTextFormat> textFormat;
+
+        // Offscreen target that glyphs are rasterized into before being copied to the atlas.
+        struct {
+            Microsoft::WRL::ComPtr<IWICBitmap> bitmap;
+            Microsoft::WRL::ComPtr<ID2D1RenderTarget> target;
+            Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> brush;
+        } glyph;
     } m_deviceDependentResources;
 
+    // Brushes and GPU queries; needs the D2D device.
     void InitializeDeviceDependentResources(DeviceResources & deviceResources);
+
+    // The text format, the glyph target and the atlas; needs only the factories, so it can run
+    // while the devices are still being created.
+    void InitializeGlyphResources(DeviceResources & deviceResources);
+
+    // Rasterizes the glyphs nearly every frame uses, so the first frame does not have to.
+    void WarmGlyphs();
+
+    void RasterizeGlyph(GlyphKey key, uint32_t width, uint32_t height, uint8_t * coverage, size_t stride);
+
+    // Composited frame; only the changed parts of the surface are uploaded to the GPU.
+    struct {
+        FrameLayout layout;
+        FrameGrid grid;
+        std::vector<CellRect> cellRects;
+        CellBatches batches;
+        BgraSurface surface;
+        Microsoft::WRL::ComPtr<ID2D1Bitmap1> bitmap;
+
+        // The swap chain target the last frame was drawn to.
+        ID2D1Bitmap1 * target = nullptr;
+
+        // Rectangles passed to Present; empty when the whole frame was presented.
+        std::vector<RECT> presentRects;
+
+        // Rectangles the current back buffer is missing because they were presented from the other buffer.
+        std::vector<RECT> staleRects;
+    } m_frame;
+
+    std::unique_ptr<GlyphAtlas> m_glyphAtlas;
+
+    GpuProfiler m_gpuProfiler;
+
+    // What is on screen; its text is measured with the glyph font.
+    SceneView m_scene;
 };
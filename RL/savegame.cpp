@@ -0,0 +1,385 @@
+#include "pch.h"
+
+#include "savegame.h"
+
+#include "files.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t AlignUp(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t SaveChecksum(void const * data, size_t size)
+{
+    // FNV-1a over 64-bit words: one multiply per eight bytes keeps it well ahead of the disk.
+    uint8_t const * bytes = static_cast<uint8_t const *>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+    for (; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return uint32_t(hash ^ (hash >> 32));
+}
+
+SaveState SaveState::Capture(Game & game, bool streamed, uint64_t seed)
+{
+    SaveState state;
+    state.world = game.m_world;
+    state.streamed = streamed;
+    state.seed = seed;
+    state.turn = game.m_turn;
+    state.playerX = game.m_playerX;
+    state.playerY = game.m_playerY;
+
+    state.positions.reserve(game.ActorCount());
+    state.kinds.reserve(game.ActorCount());
+    game.m_entities.Each<Position, Monster>([&](Position const & position, Monster const & monster)
+    {
+        state.positions.push_back(position);
+        state.kinds.push_back(monster.kind);
+    });
+    return state;
+}
+
+bool WriteSave(std::string const & path, SaveState const & state)
+{
+    WorldMap const & world = *state.world;
+
+    enum { Index, Fill, Chunks, Positions, Kinds, SectionCount };
+    SaveSection sections[SectionCount] = {};
+    uint64_t end = sizeof(SaveHeader) + sizeof(sections);
+    auto place = [&](SaveSection & section, SaveSectionType type, uint64_t count, uint64_t elementSize, uint64_t alignment)
+    {
+        section.type = type;
+        section.offset = AlignUp(end, alignment);
+        section.size = count * elementSize;
+        section.count = count;
+        end = section.offset + section.size;
+    };
+
+    std::vector<uint32_t> stored;
+    for (uint32_t i = 0; i < uint32_t(world.m_chunks.size()); i++)
+    {
+        if (world.m_chunks[i])
+        {
+            stored.push_back(i);
+        }
+    }
+
+    place(sections[Index], SaveSection_ChunkIndex, world.m_chunks.size(), sizeof(SaveChunkEntry), SaveAlignment);
+    place(sections[Fill], SaveSection_Fill, 1, sizeof(MapChunk), SaveAlignment);
+    place(sections[Chunks], SaveSection_Chunks, stored.size(), sizeof(MapChunk), SavePageSize);
+    place(sections[Positions], SaveSection_Positions, state.positions.size(), sizeof(Position), SaveAlignment);
+    place(sections[Kinds], SaveSection_MonsterKinds, state.kinds.size(), sizeof(uint16_t), SaveAlignment);
+
+    std::vector<SaveChunkEntry> index(world.m_chunks.size(), SaveChunkEntry{});
+    for (size_t i = 0; i < stored.size(); i++)
+    {
+        SaveChunkEntry & entry = index[stored[i]];
+        entry.offset = sections[Chunks].offset + i * sizeof(MapChunk);
+        entry.checksum = SaveChecksum(world.m_chunks[stored[i]].get(), sizeof(MapChunk));
+    }
+
+    sections[Index].checksum = SaveChecksum(index.data(), sections[Index].size);
+    sections[Fill].checksum = SaveChecksum(world.m_fill, sizeof(MapChunk));
+    sections[Positions].checksum = SaveChecksum(state.positions.data(), sections[Positions].size);
+    sections[Kinds].checksum = SaveChecksum(state.kinds.data(), sections[Kinds].size);
+
+    SaveHeader header = {};
+    memcpy(header.magic, SaveMagic, sizeof(SaveMagic));
+    header.version = SaveVersion;
+    header.byteOrder = SaveByteOrder;
+    header.seed = state.seed;
+    header.turn = state.turn;
+    header.width = world.m_width;
+    header.height = world.m_height;
+    header.playerX = state.playerX;
+    header.playerY = state.playerY;
+    header.sectionCount = SectionCount;
+    header.flags = state.streamed ? uint8_t(SaveFlag_Streamed) : 0;
+    header.checksum = SaveChecksum(&header, offsetof(SaveHeader, checksum));
+
+    std::string temporary = path + ".tmp";
+    FILE * file = OpenFile(temporary, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    std::vector<char> buffer(1 << 20);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    uint64_t position = 0;
+    bool ok = true;
+    auto write = [&](uint64_t offset, void const * data, size_t size)
+    {
+        static const uint8_t zeros[SavePageSize] = {};
+        while (ok && position < offset)
+        {
+            size_t padding = size_t(std::min<uint64_t>(offset - position, sizeof(zeros)));
+            ok = fwrite(zeros, 1, padding, file) == padding;
+            position += padding;
+        }
+        ok = ok && fwrite(data, 1, size, file) == size;
+        position += size;
+    };
+
+    write(0, &header, sizeof(header));
+    write(sizeof(header), sections, sizeof(sections));
+    write(sections[Index].offset, index.data(), size_t(sections[Index].size));
+    write(sections[Fill].offset, world.m_fill, sizeof(MapChunk));
+    for (size_t i = 0; i < stored.size(); i++)
+    {
+        write(index[stored[i]].offset, world.m_chunks[stored[i]].get(), sizeof(MapChunk));
+    }
+    write(sections[Positions].offset, state.positions.data(), size_t(sections[Positions].size));
+    write(sections[Kinds].offset, state.kinds.data(), size_t(sections[Kinds].size));
+
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        RemoveFile(temporary);
+        return false;
+    }
+    return MoveOver(temporary, path);
+}
+
+SaveFile::Mapping::~Mapping()
+{
+#if defined(_WIN32)
+    if (data)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mapping)
+    {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+#else
+    if (data)
+    {
+        munmap(data, size);
+    }
+#endif
+}
+
+static std::shared_ptr<SaveFile::Mapping> MapFile(std::string const & path)
+{
+    // Mapped copy-on-write: the game may write to chunks in place without changing the file.
+    // Deletes are shared so the next save can be renamed over a file that is still mapped.
+    auto mapping = std::make_shared<SaveFile::Mapping>();
+#if defined(_WIN32)
+    mapping->file = CreateFile2(Widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, OPEN_EXISTING, nullptr);
+    LARGE_INTEGER size;
+    if (mapping->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapping->file, &size) || size.QuadPart == 0)
+    {
+        return nullptr;
+    }
+
+    mapping->mapping = CreateFileMappingFromApp(mapping->file, nullptr, PAGE_WRITECOPY, 0, nullptr);
+    if (!mapping->mapping)
+    {
+        return nullptr;
+    }
+    mapping->data = static_cast<uint8_t *>(MapViewOfFileFromApp(mapping->mapping, FILE_MAP_COPY, 0, 0));
+    mapping->size = size_t(size.QuadPart);
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat status = {};
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void * data = mmap(nullptr, size_t(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED)
+        {
+            mapping->data = static_cast<uint8_t *>(data);
+            mapping->size = size_t(status.st_size);
+        }
+    }
+    close(file);
+#endif
+    return mapping->data ? mapping : nullptr;
+}
+
+std::unique_ptr<SaveFile> SaveFile::Open(std::string const & path)
+{
+    auto mapping = MapFile(path);
+    if (!mapping || mapping->size < sizeof(SaveHeader))
+    {
+        return nullptr;
+    }
+
+    SaveHeader const * header = reinterpret_cast<SaveHeader const *>(mapping->data);
+    if (memcmp(header->magic, SaveMagic, sizeof(SaveMagic)) != 0 ||
+        header->version != SaveVersion ||
+        header->byteOrder != SaveByteOrder ||
+        header->checksum != SaveChecksum(header, offsetof(SaveHeader, checksum)))
+    {
+        return nullptr;
+    }
+
+    uint64_t tableEnd = sizeof(SaveHeader) + uint64_t(header->sectionCount) * sizeof(SaveSection);
+    if (tableEnd > mapping->size)
+    {
+        return nullptr;
+    }
+
+    auto file = std::make_unique<SaveFile>();
+    file->m_mapping = mapping;
+    file->m_header = header;
+    file->m_chunkColumns = (header->width + ChunkMask) >> ChunkShift;
+    file->m_chunkRows = (header->height + ChunkMask) >> ChunkShift;
+
+    // Find and check every section. Unknown sections are skipped so newer writers can add them.
+    SaveSection const * sections = reinterpret_cast<SaveSection const *>(mapping->data + sizeof(SaveHeader));
+    SaveSection const * found[SaveSection_MonsterKinds + 1] = {};
+    for (uint32_t i = 0; i < header->sectionCount; i++)
+    {
+        SaveSection const & section = sections[i];
+        if (section.offset < tableEnd || section.offset % SaveAlignment != 0 ||
+            section.size > mapping->size || section.offset > mapping->size - section.size)
+        {
+            return nullptr;
+        }
+
+        if (section.type == SaveSection_Chunks)
+        {
+            file->m_chunksBegin = section.offset;
+            file->m_chunksEnd = section.offset + section.size;
+        }
+        else if (section.checksum != SaveChecksum(mapping->data + section.offset, size_t(section.size)))
+        {
+            return nullptr;
+        }
+
+        if (section.type < std::size(found))
+        {
+            found[section.type] = &section;
+        }
+    }
+
+    auto array = [&](SaveSectionType type, size_t elementSize, uint64_t count) -> void const *
+    {
+        SaveSection const * section = found[type];
+        if (!section || section->count != count || section->size != count * elementSize)
+        {
+            return nullptr;
+        }
+        return mapping->data + section->offset;
+    };
+
+    uint64_t monsters = found[SaveSection_Positions] ? found[SaveSection_Positions]->count : 0;
+    file->m_chunkIndex = static_cast<SaveChunkEntry const *>(array(SaveSection_ChunkIndex, sizeof(SaveChunkEntry), uint64_t(file->m_chunkColumns) * file->m_chunkRows));
+    file->m_fill = static_cast<MapChunk const *>(array(SaveSection_Fill, sizeof(MapChunk), 1));
+    file->m_positions = static_cast<Position const *>(array(SaveSection_Positions, sizeof(Position), monsters));
+    file->m_kinds = static_cast<uint16_t const *>(array(SaveSection_MonsterKinds, sizeof(uint16_t), monsters));
+    file->m_monsterCount = size_t(monsters);
+    if (!file->m_chunkIndex || !file->m_fill || !found[SaveSection_Chunks] || (monsters > 0 && (!file->m_positions || !file->m_kinds)))
+    {
+        return nullptr;
+    }
+    return file;
+}
+
+std::shared_ptr<MapChunk> SaveFile::Chunk(uint32_t chunkX, uint32_t chunkY) const
+{
+    SaveChunkEntry const & entry = m_chunkIndex[size_t(chunkY) * m_chunkColumns + chunkX];
+    if (entry.offset < m_chunksBegin || entry.offset >= m_chunksEnd || (entry.offset - m_chunksBegin) % sizeof(MapChunk) != 0)
+    {
+        return nullptr;
+    }
+
+    MapChunk * chunk = reinterpret_cast<MapChunk *>(m_mapping->data + entry.offset);
+    if (SaveChecksum(chunk, sizeof(MapChunk)) != entry.checksum)
+    {
+        return nullptr;
+    }
+
+    // Shares ownership of the mapping, which stays mapped while any chunk in it is in use.
+    return std::shared_ptr<MapChunk>(m_mapping, chunk);
+}
+
+std::shared_ptr<WorldMap> SaveFile::CreateWorld(uint32_t radius) const
+{
+    auto world = std::make_shared<WorldMap>(m_header->width, m_header->height);
+    world->SetFill(std::shared_ptr<MapChunk const>(m_mapping, m_fill));
+
+    int32_t centreX = m_header->playerX >> ChunkShift;
+    int32_t centreY = m_header->playerY >> ChunkShift;
+    for (int32_t chunkY = centreY - int32_t(radius); chunkY <= centreY + int32_t(radius); chunkY++)
+    {
+        for (int32_t chunkX = centreX - int32_t(radius); chunkX <= centreX + int32_t(radius); chunkX++)
+        {
+            if (chunkX >= 0 && chunkY >= 0 && uint32_t(chunkX) < m_chunkColumns && uint32_t(chunkY) < m_chunkRows &&
+                HasChunk(uint32_t(chunkX), uint32_t(chunkY)))
+            {
+                world->SetChunk(uint32_t(chunkX), uint32_t(chunkY), Chunk(uint32_t(chunkX), uint32_t(chunkY)));
+            }
+        }
+    }
+    return world;
+}
+
+void SaveFile::Restore(Game & game) const
+{
+    game.m_turn = m_header->turn;
+    game.m_playerX = m_header->playerX;
+    game.m_playerY = m_header->playerY;
+    for (size_t i = 0; i < m_monsterCount; i++)
+    {
+        game.AddMonster(m_positions[i].x, m_positions[i].y, m_kinds[i]);
+    }
+    game.UpdateVision();
+    game.UpdateLighting();
+}
+
+BackgroundSaver::~BackgroundSaver()
+{
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+bool BackgroundSaver::Save(std::string path, SaveState state)
+{
+    if (m_busy.load())
+    {
+        return false;
+    }
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    m_busy = true;
+    m_thread = std::thread([this, path = std::move(path), state = std::move(state)]
+    {
+        m_succeeded = WriteSave(path, state);
+        m_busy = false;
+    });
+    return true;
+}
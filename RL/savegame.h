@@ -0,0 +1,168 @@
+#pragma once
+
+#include "game.h"
+
+#include <atomic>
+#include <thread>
+
+// Binary save format. Everything is little-endian and every section is an array of fixed-size
+// records at an aligned offset, referenced by offset rather than pointer, so a mapped file is
+// used in place: chunks are handed to the WorldMap as pointers into the mapping and only the
+// ones the game touches are ever read from disk.
+//
+//     SaveHeader
+//     SaveSection[sectionCount]
+//     sections, each aligned to SaveAlignment (the chunk section to SavePageSize)
+//
+// Each section carries a checksum of its bytes, except the chunk section: its chunks are
+// checked one at a time, against the checksums in the chunk index, when they are first used.
+
+static const char SaveMagic[8] = { 'R', 'L', 'S', 'A', 'V', 'E', 0, 0 };
+static const uint32_t SaveVersion = 2;
+static const uint32_t SaveByteOrder = 0x01020304;
+static const uint64_t SaveAlignment = 64;
+static const uint64_t SavePageSize = 4096;
+
+enum SaveSectionType : uint32_t
+{
+    SaveSection_ChunkIndex = 1, // SaveChunkEntry per chunk of the map, row-major
+    SaveSection_Fill,           // one MapChunk, what chunks never written read as
+    SaveSection_Chunks,         // MapChunk per stored chunk
+    SaveSection_Positions,      // Position per monster
+    SaveSection_MonsterKinds,   // uint16_t kind per monster
+};
+
+struct SaveHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t seed;
+    uint64_t turn;
+    uint32_t width;
+    uint32_t height;
+    int32_t playerX;
+    int32_t playerY;
+    uint32_t sectionCount;
+    uint32_t flags;
+    uint32_t checksum; // of the bytes before this field
+    uint32_t reserved;
+};
+
+enum SaveFlag : uint32_t
+{
+    SaveFlag_Streamed = 1 << 0, // chunks that were not stored are generated from the seed
+};
+
+struct SaveSection
+{
+    uint32_t type;
+    uint32_t checksum;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t count;
+};
+
+struct SaveChunkEntry
+{
+    uint64_t offset; // 0 if the chunk was never written
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SaveHeader) == 64, "SaveHeader is part of the file format");
+static_assert(sizeof(SaveSection) == 32, "SaveSection is part of the file format");
+static_assert(sizeof(SaveChunkEntry) == 16, "SaveChunkEntry is part of the file format");
+static_assert(sizeof(MapChunk) % SaveAlignment == 0, "MapChunk is stored as is");
+static_assert(std::is_trivially_copyable<MapChunk>::value, "MapChunk is stored as is");
+
+uint32_t SaveChecksum(void const * data, size_t size);
+
+// Everything a save holds, captured on the simulation thread. The world is a copy-on-write
+// copy, so capturing is cheap and the game can keep changing the map while this is written.
+struct SaveState
+{
+    static SaveState Capture(Game & game, bool streamed, uint64_t seed);
+
+    std::shared_ptr<WorldMap const> world;
+    bool streamed = false;
+    uint64_t seed = 0;
+    uint64_t turn = 0;
+    int32_t playerX = 0;
+    int32_t playerY = 0;
+    std::vector<Position> positions;
+    std::vector<uint16_t> kinds;
+};
+
+// Writes to a temporary file next to path and renames it over path once complete, so a failed
+// save leaves the previous one intact. Returns false on any I/O error.
+bool WriteSave(std::string const & path, SaveState const & state);
+
+// A save file mapped into memory. Open validates the header and every checksummed section;
+// chunks are validated by Chunk as they are requested.
+struct SaveFile
+{
+    static std::unique_ptr<SaveFile> Open(std::string const & path);
+
+    SaveFile() = default;
+    SaveFile(SaveFile const &) = delete;
+    SaveFile & operator=(SaveFile const &) = delete;
+
+    bool HasChunk(uint32_t chunkX, uint32_t chunkY) const
+    {
+        return m_chunkIndex[size_t(chunkY) * m_chunkColumns + chunkX].offset != 0;
+    }
+
+    // The stored chunk, pointing into the mapping, or null if it was not stored or is corrupt.
+    // Pages are copy-on-write, so the chunk may be modified without touching the file.
+    std::shared_ptr<MapChunk> Chunk(uint32_t chunkX, uint32_t chunkY) const;
+
+    // An empty map of the saved size and fill, with the stored chunks within radius chunks
+    // of the player already in place.
+    std::shared_ptr<WorldMap> CreateWorld(uint32_t radius) const;
+
+    // Puts the saved player, turn and monsters into a game created on CreateWorld's map.
+    void Restore(Game & game) const;
+
+    struct Mapping
+    {
+        ~Mapping();
+
+        uint8_t * data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
+
+    std::shared_ptr<Mapping> m_mapping;
+    SaveHeader const * m_header = nullptr;
+    uint32_t m_chunkColumns = 0;
+    uint32_t m_chunkRows = 0;
+    SaveChunkEntry const * m_chunkIndex = nullptr;
+    MapChunk const * m_fill = nullptr;
+    uint64_t m_chunksBegin = 0;
+    uint64_t m_chunksEnd = 0;
+    Position const * m_positions = nullptr;
+    uint16_t const * m_kinds = nullptr;
+    size_t m_monsterCount = 0;
+};
+
+// Writes saves on a thread of its own so the game never waits for the disk.
+struct BackgroundSaver
+{
+    ~BackgroundSaver();
+
+    // Starts writing state to path. Returns false if the previous save is still being written.
+    bool Save(std::string path, SaveState state);
+
+    bool Busy() const { return m_busy.load(); }
+
+    // Whether the last finished save succeeded.
+    bool Succeeded() const { return m_succeeded.load(); }
+
+    std::thread m_thread;
+    std::atomic<bool> m_busy{ false };
+    std::atomic<bool> m_succeeded{ false };
+};
@@ -0,0 +1,141 @@
+#include "pch.h"
+
+#include "sceneview.h"
+
+// Darkens a background outside the field of view to match its dimmed glyph.
+static uint32_t DimColor(uint32_t color)
+{
+    uint32_t result = color & 0xff000000;
+    for (uint32_t shift = 0; shift < 24; shift += 8)
+    {
+        result |= (((color >> shift) & 0xff) * 2 / 5) << shift;
+    }
+    return result;
+}
+
+// Shades a color by a packed light level, where 255 in a channel leaves it as it is.
+static uint32_t LightColor(uint32_t color, uint32_t light)
+{
+    uint32_t result = color & 0xff000000;
+    for (uint32_t shift = 0; shift < 24; shift += 8)
+    {
+        result |= (((color >> shift) & 0xff) * ((light >> shift) & 0xff) / 255) << shift;
+    }
+    return result;
+}
+
+void SceneView::Draw(RenderSnapshot const & snapshot, CellGrid & grid, bool clear)
+{
+    m_frameArena.Reset();
+    WorldMap const & map = *snapshot.world;
+
+    uint32_t mapRows = grid.m_height > StatusRows + LogRows ? grid.m_height - StatusRows - LogRows : 0;
+    m_camera.SetMapSize(map.m_width, map.m_height);
+    m_camera.SetViewport(grid.m_width, mapRows);
+    m_camera.Follow(snapshot.playerX, snapshot.playerY);
+
+    // The grid keeps last frame's cells, so cells outside the visible range are already
+    // blank unless the range moved, or last frame's overlay covered them.
+    VisibleRange visible = m_camera.Visible();
+    if (clear || memcmp(&visible, &m_visible, sizeof(visible)) != 0)
+    {
+        grid.Clear();
+        m_visible = visible;
+    }
+    else
+    {
+        for (uint32_t row = 0; row < m_overlayHeight && row < grid.m_height; row++)
+        {
+            for (uint32_t column = 0; column < m_overlayWidth && column < grid.m_width; column++)
+            {
+                grid.At(column, row) = Cell{};
+            }
+        }
+    }
+
+    // Copy only the visible part of the map into the grid, one chunk-sized span at a time.
+    // Tiles in the player's field of view are lit by the light map; the rest are dimmed.
+    VisibilityMask const & fov = snapshot.fov;
+    LightMap const & light = snapshot.light;
+    for (uint32_t row = 0; row < visible.height; row++)
+    {
+        int32_t mapY = visible.mapY + int32_t(row);
+        Cell * cells = &grid.At(visible.screenX, StatusRows + visible.screenY + row);
+        map.ForEachRowSpan(mapY, visible.mapX, visible.mapX + visible.width, [&](uint32_t mapX, uint32_t count, MapChunk const & chunk, uint32_t index)
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                TileType tile = chunk.tiles[index + i];
+                uint32_t foreground = TileForegrounds[tile];
+                uint32_t background = TileBackgrounds[tile];
+                cells[i].glyph = TileGlyphs[tile];
+                if (fov.Test(int32_t(mapX + i), mapY))
+                {
+                    uint32_t level = light.At(int32_t(mapX + i), mapY);
+                    cells[i].style = CellStyle_Normal;
+                    cells[i].foreground = LightColor(foreground, level);
+                    cells[i].background = LightColor(background, level);
+                }
+                else
+                {
+                    cells[i].style = CellStyle_Dim;
+                    cells[i].foreground = foreground;
+                    cells[i].background = DimColor(background);
+                }
+            }
+            cells += count;
+        });
+    }
+
+    auto drawActor = [&](int32_t x, int32_t y, char32_t glyph, uint32_t color)
+    {
+        x -= m_camera.m_x;
+        y -= m_camera.m_y;
+        if (x >= 0 && y >= 0 && uint32_t(x) < grid.m_width && uint32_t(y) < mapRows)
+        {
+            Cell & cell = grid.At(x, StatusRows + y);
+            cell.glyph = glyph;
+            cell.foreground = color;
+        }
+    };
+
+    auto const & entities = snapshot.entities;
+    for (size_t i = 0; i < entities.positions.size(); i++)
+    {
+        Position const & position = entities.positions[i];
+        if (fov.Test(position.x, position.y))
+        {
+            drawActor(position.x, position.y, entities.appearances[i].glyph, entities.appearances[i].color);
+        }
+    }
+    drawActor(snapshot.playerX, snapshot.playerY, U'@', 0xffffffff);
+
+    // Interface panels. The log's layouts are cached, so text that has not changed is not
+    // laid out again, and the grid diff keeps it from being redrawn. The status bar changes
+    // every turn, so caching it would only push the log's layouts out.
+    char status[96];
+    snprintf(status, sizeof(status), "Turn %llu   (%d, %d)", (unsigned long long)snapshot.turn, snapshot.playerX, snapshot.playerY);
+    LayoutText(status, grid.m_width, m_textLayouts->m_measurer, m_statusLayout);
+    DrawTextLine(grid, 0, 0, grid.m_width, status, m_statusLayout.lines[0], m_textLayouts->m_measurer);
+
+    uint32_t logTop = std::min(StatusRows + mapRows, grid.m_height);
+    m_logPanel.Draw(snapshot.messages, *m_textLayouts, grid, CellRect{ 0, logTop, grid.m_width, grid.m_height });
+    m_textLayouts->EndFrame();
+
+    // The overlay is padded to its widest line so the map does not show through between words.
+    size_t overlayWidth = 0;
+    for (auto const & line : m_overlay)
+    {
+        overlayWidth = std::max(overlayWidth, line.size());
+    }
+    for (uint32_t row = 0; row < m_overlay.size() && row < grid.m_height; row++)
+    {
+        std::string const & line = m_overlay[row];
+        for (uint32_t column = 0; column < overlayWidth && column < grid.m_width; column++)
+        {
+            grid.At(column, row) = Cell{ column < line.size() ? char32_t((unsigned char)line[column]) : U' ', CellStyle_Normal };
+        }
+    }
+    m_overlayWidth = uint32_t(overlayWidth);
+    m_overlayHeight = uint32_t(m_overlay.size());
+}
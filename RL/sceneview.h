@@ -0,0 +1,45 @@
+#pragma once
+
+#include "arena.h"
+#include "camera.h"
+#include "cellgrid.h"
+#include "messagelog.h"
+#include "simulation.h"
+
+// Lays a snapshot out on a cell grid: a status bar on top, the map under it and the message
+// log at the bottom, with any debug overlay over the top-left. Backends only draw the grid,
+// so the window and the terminal show the same thing.
+struct SceneView
+{
+    // Rows of the screen taken by the status bar and the message log. The map gets the rows
+    // in between.
+    static constexpr uint32_t StatusRows = 1;
+    static constexpr uint32_t LogRows = 5;
+
+    // Fills a grid the size of the screen. The grid is expected to hold the last frame drawn,
+    // so cells outside the map are only cleared when the map moved on screen, or when clear
+    // is set because the grid was resized or lost.
+    void Draw(RenderSnapshot const & snapshot, CellGrid & grid, bool clear);
+
+    Camera m_camera;
+
+    // The part of the map the grid was filled from last frame.
+    VisibleRange m_visible = {};
+
+    // Interface text, measured the way the backend draws it. Set before the first Draw.
+    std::unique_ptr<TextLayoutCache> m_textLayouts;
+    MessageLogPanel m_logPanel;
+    TextLayout m_statusLayout;
+
+    // Debug text drawn over the top-left of the map, one string per row.
+    std::vector<std::string> m_overlay;
+
+    // The cells the overlay covered last frame, blanked before the next so whatever it no
+    // longer covers is drawn again.
+    uint32_t m_overlayWidth = 0;
+    uint32_t m_overlayHeight = 0;
+
+    // Scratch memory for work done once a frame, such as formatting the overlay. Rewound at
+    // the start of every Draw.
+    Arena m_frameArena;
+};
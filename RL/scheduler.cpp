@@ -0,0 +1,184 @@
+#include "pch.h"
+
+#include "scheduler.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static uint32_t LowestBit(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctzll(bits));
+#endif
+}
+
+uint32_t TurnScheduler::Add(EntityHandle owner, uint16_t speed, int32_t energy)
+{
+    uint32_t id;
+    if (!m_free.empty())
+    {
+        id = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        id = uint32_t(m_entries.size());
+        m_entries.emplace_back();
+    }
+
+    Entry & entry = m_entries[id];
+    entry.owner = owner;
+    entry.energy = energy;
+    entry.speed = std::max<uint16_t>(speed, 1);
+    entry.position = NotScheduled;
+    return id;
+}
+
+void TurnScheduler::Remove(uint32_t id)
+{
+    if (IsWaiting(id))
+    {
+        Unlink(id);
+    }
+    m_entries[id].owner = EntityHandle();
+    m_free.push_back(id);
+}
+
+void TurnScheduler::SetSpeed(uint32_t id, uint16_t speed)
+{
+    Entry & entry = m_entries[id];
+    if (IsWaiting(id))
+    {
+        // Take back the energy the actor would have gained between now and its due tick.
+        entry.energy -= int32_t(entry.due - m_now) * entry.speed;
+        Unlink(id);
+        entry.speed = std::max<uint16_t>(speed, 1);
+        Schedule(id);
+    }
+    else
+    {
+        entry.speed = std::max<uint16_t>(speed, 1);
+    }
+}
+
+void TurnScheduler::Spend(uint32_t id, int32_t cost)
+{
+    m_entries[id].energy -= cost;
+    Schedule(id);
+}
+
+void TurnScheduler::Schedule(uint32_t id)
+{
+    Entry & entry = m_entries[id];
+
+    uint64_t ticks = 0;
+    if (entry.energy < ActionCost)
+    {
+        ticks = (uint64_t(ActionCost - entry.energy) + entry.speed - 1) / entry.speed;
+        entry.energy += int32_t(ticks * entry.speed);
+    }
+    entry.due = m_now + ticks;
+
+    uint32_t slot = uint32_t(entry.due & WheelMask);
+    entry.position = uint32_t(m_slots[slot].size());
+    m_slots[slot].push_back(id);
+    m_occupied[slot / 64] |= uint64_t(1) << (slot % 64);
+    m_waiting++;
+}
+
+void TurnScheduler::Unlink(uint32_t id)
+{
+    Entry & entry = m_entries[id];
+    uint32_t slot = uint32_t(entry.due & WheelMask);
+    std::vector<uint32_t> & entries = m_slots[slot];
+
+    uint32_t last = entries.back();
+    entries[entry.position] = last;
+    m_entries[last].position = entry.position;
+    entries.pop_back();
+    if (entries.empty())
+    {
+        m_occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+
+    entry.position = NotScheduled;
+    m_waiting--;
+}
+
+uint32_t TurnScheduler::NextOccupied(uint32_t slot) const
+{
+    // Scan the occupancy words from slot round to just before it. The first word is visited
+    // twice: its bits at and above slot first, then the ones below after wrapping.
+    uint32_t const words = WheelSize / 64;
+    for (uint32_t step = 0; step <= words; step++)
+    {
+        uint32_t word = (slot / 64 + step) % words;
+        uint64_t bits = m_occupied[word];
+        if (step == 0)
+        {
+            bits &= ~uint64_t(0) << (slot % 64);
+        }
+        else if (step == words)
+        {
+            bits &= (uint64_t(1) << (slot % 64)) - 1;
+        }
+
+        if (bits != 0)
+        {
+            return word * 64 + LowestBit(bits);
+        }
+    }
+    return slot;
+}
+
+bool TurnScheduler::NextBatch(std::vector<uint32_t> & due)
+{
+    due.clear();
+    if (m_waiting == 0)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        uint32_t slot = NextOccupied(uint32_t(m_now & WheelMask));
+        m_now += (slot - m_now) & WheelMask;
+
+        // Split the slot in one pass, keeping both halves in filing order.
+        std::vector<uint32_t> & entries = m_slots[slot];
+        uint32_t kept = 0;
+        for (uint32_t id : entries)
+        {
+            Entry & entry = m_entries[id];
+            if (entry.due == m_now)
+            {
+                entry.position = NotScheduled;
+                due.push_back(id);
+            }
+            else
+            {
+                entry.position = kept;
+                entries[kept++] = id;
+            }
+        }
+        entries.resize(kept);
+        if (kept == 0)
+        {
+            m_occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+        }
+
+        if (!due.empty())
+        {
+            m_waiting -= due.size();
+            return true;
+        }
+
+        // Everyone in this slot is a revolution or more away.
+        m_now++;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "entities.h"
+
+// Energy-based turn order. Every tick an actor gains energy equal to its speed and it may act
+// once it has ActionCost; acting spends energy and the actor waits until it has enough again.
+// Rather than ticking every actor, each one is filed under the tick it will next be ready on a
+// timing wheel, so finding who acts next, removing an actor or changing its speed is O(1)
+// amortized regardless of how many actors are waiting.
+struct TurnScheduler
+{
+    static constexpr int32_t ActionCost = 1200;
+    static constexpr uint16_t NormalSpeed = 100;
+    static constexpr uint32_t WheelSize = 256;
+    static constexpr uint32_t WheelMask = WheelSize - 1;
+    static constexpr uint32_t NotScheduled = UINT32_MAX;
+
+    // Registers an actor without scheduling it. Returns its id. Speeds below 1 count as 1.
+    uint32_t Add(EntityHandle owner, uint16_t speed, int32_t energy = 0);
+    void Remove(uint32_t id);
+
+    // Takes effect immediately: a waiting actor is moved to the tick its remaining energy now
+    // takes to recover.
+    void SetSpeed(uint32_t id, uint16_t speed);
+
+    // Charges an actor that is not waiting (new, or just returned by NextBatch) for an action
+    // and files it under the tick it will be ready again. A cost of 0 only waits for readiness.
+    void Spend(uint32_t id, int32_t cost = ActionCost);
+
+    // Advances to the next tick on which any actor is ready and moves every actor ready on that
+    // tick into due, in a deterministic order. They stay unscheduled until Spend or Remove.
+    // Returns false if nobody is waiting.
+    bool NextBatch(std::vector<uint32_t> & due);
+
+    EntityHandle Owner(uint32_t id) const { return m_entries[id].owner; }
+    bool IsWaiting(uint32_t id) const { return m_entries[id].position != NotScheduled; }
+    size_t Waiting() const { return m_waiting; }
+
+    struct Entry
+    {
+        EntityHandle owner;
+        uint64_t due = 0;
+        int32_t energy = 0; // energy on the due tick while waiting, current energy otherwise
+        uint16_t speed = 0;
+        uint32_t position = NotScheduled; // index in m_slots[due & WheelMask]
+    };
+
+    // Files a non-waiting actor under the tick its current energy reaches ActionCost.
+    void Schedule(uint32_t id);
+    void Unlink(uint32_t id);
+    uint32_t NextOccupied(uint32_t slot) const;
+
+    uint64_t m_now = 0;
+    size_t m_waiting = 0;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_free;
+
+    // A slot holds every waiting actor whose due tick is congruent to it; actors more than a
+    // revolution away share the slot and are skipped until their tick comes round.
+    std::vector<uint32_t> m_slots[WheelSize];
+    uint64_t m_occupied[WheelSize / 64] = {};
+};
@@ -0,0 +1,250 @@
+#include "pch.h"
+
+#include "simulation.h"
+
+#include "profiler.h"
+
+Simulation::Simulation(std::shared_ptr<WorldMap const> world)
+    : m_game(std::move(world), uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()))
+    , m_jobs(std::make_unique<JobSystem>())
+{
+    m_game.m_jobs = m_jobs.get();
+    m_game.SpawnActors(5);
+
+    // Make a snapshot available before the thread has run its first tick.
+    Publish();
+}
+
+Simulation::Simulation(uint32_t width, uint32_t height, uint64_t seed)
+    : m_game(CreateSessionGame(seed, width, height))
+    , m_jobs(std::make_unique<JobSystem>())
+    , m_generator(std::make_unique<ChunkGenerator>(seed))
+{
+    m_game.m_jobs = m_jobs.get();
+    Publish();
+}
+
+Simulation::~Simulation()
+{
+    Stop();
+}
+
+void Simulation::Start()
+{
+    if (m_running.exchange(true))
+    {
+        return;
+    }
+
+    // Only a session that is still where CreateSessionGame left it can be journaled.
+    if (!m_journalPath.empty() && m_generator && m_game.m_turn == 0)
+    {
+        m_journal.Open(m_journalPath, m_generator->m_seed, m_game.m_world->m_width, m_game.m_world->m_height);
+    }
+
+    m_thread = std::thread([this] { Run(); });
+}
+
+void Simulation::Stop()
+{
+    m_running = false;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    m_journal.Close();
+}
+
+void Simulation::Run()
+{
+    NameProfileThread("Simulation");
+    auto next = std::chrono::steady_clock::now();
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        Command command;
+        while (m_commands.TryPop(command))
+        {
+            switch (command.type)
+            {
+            case CommandType::Save: Save(); break;
+            case CommandType::Load: Load(); break;
+            default: Apply(command); break;
+            }
+        }
+
+        m_tick++;
+        StreamChunks();
+        Publish();
+
+        // Fixed timestep: if the thread fell behind, skip ahead rather than running a burst of ticks.
+        next += TickDuration;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now)
+        {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void Simulation::Apply(Command const & command)
+{
+    if (command.type == CommandType::None)
+    {
+        return;
+    }
+
+    ProfileScope("Turn");
+    m_journal.RecordCommand(command);
+    m_game.Apply(command);
+    if (m_game.m_turn % JournalHashInterval == 0)
+    {
+        m_journal.RecordHash(m_game.m_turn, m_game.StateHash());
+    }
+}
+
+void Simulation::StreamChunks()
+{
+    if (!m_generator && !m_save)
+    {
+        return;
+    }
+
+    ProfileScope("StreamChunks");
+
+    // Take the missing chunks around the player from the save if it has them and ask the
+    // generator for the rest.
+    m_generated.clear();
+    ForEachMissingChunk(*m_game.m_world, m_game.m_playerX, m_game.m_playerY, StreamRadius, [&](uint32_t chunkX, uint32_t chunkY)
+    {
+        std::shared_ptr<MapChunk> saved;
+        if (m_save && m_save->HasChunk(chunkX, chunkY))
+        {
+            saved = m_save->Chunk(chunkX, chunkY);
+        }
+
+        if (saved)
+        {
+            m_generated.push_back({ chunkX, chunkY, std::move(saved) });
+        }
+        else if (m_generator)
+        {
+            m_generator->Request(chunkX, chunkY);
+        }
+    });
+
+    if (m_generator)
+    {
+        m_generator->Collect(m_generated);
+    }
+    if (m_generated.empty())
+    {
+        return;
+    }
+
+    ProfileCount("chunks installed", m_generated.size());
+    m_journal.RecordChunks(m_generated);
+    m_game.InstallChunks(m_generated);
+}
+
+void CaptureSnapshot(Game & game, RenderSnapshot & snapshot)
+{
+    snapshot.turn = game.m_turn;
+    snapshot.playerX = game.m_playerX;
+    snapshot.playerY = game.m_playerY;
+
+    // Only entities the player can see are drawn, and they are all inside the square the
+    // field of view covers, so the occupancy index finds them without a pass over the rest.
+    VisibilityMask const & visible = game.PlayerView().m_visible;
+    int32_t right = visible.m_left + int32_t(visible.m_size);
+    int32_t bottom = visible.m_top + int32_t(visible.m_size);
+    snapshot.entities.positions.clear();
+    snapshot.entities.appearances.clear();
+    game.m_occupancy.ForEachInRect(visible.m_left, visible.m_top, right, bottom, [&](EntityHandle entity, int32_t x, int32_t y)
+    {
+        if (Appearance const * appearance = game.m_entities.Get<Appearance>(entity))
+        {
+            snapshot.entities.positions.push_back({ x, y });
+            snapshot.entities.appearances.push_back(*appearance);
+        }
+    });
+
+    // The log only changes with new messages, so most ticks skip the copy.
+    if (snapshot.messages.m_added != game.m_messages.m_added)
+    {
+        snapshot.messages = game.m_messages;
+    }
+
+    // Likewise the light map, which only changes when a light or the window does.
+    if (snapshot.light.m_version != game.m_lighting.m_map.m_version)
+    {
+        snapshot.light = game.m_lighting.m_map;
+    }
+
+    snapshot.fov = visible;
+    snapshot.world = game.m_world;
+}
+
+void Simulation::Publish()
+{
+    ProfileScope("Publish");
+    RenderSnapshot & snapshot = m_snapshots.Back();
+    snapshot.tick = m_tick;
+    CaptureSnapshot(m_game, snapshot);
+
+    // Most ticks only advance the tick counter, which nothing draws.
+    bool changed = snapshot.turn != m_published.turn || snapshot.messages.m_added != m_published.messages ||
+        snapshot.light.m_version != m_published.light || snapshot.world.get() != m_published.world;
+    m_published.turn = snapshot.turn;
+    m_published.messages = snapshot.messages.m_added;
+    m_published.light = snapshot.light.m_version;
+    m_published.world = snapshot.world.get();
+
+    m_snapshots.Publish();
+    if (changed && m_onChanged)
+    {
+        m_onChanged();
+    }
+}
+
+void Simulation::Save()
+{
+    bool streamed = m_generator != nullptr;
+    if (m_saver.Save(m_savePath, SaveState::Capture(m_game, streamed, streamed ? m_generator->m_seed : 0)))
+    {
+        m_game.m_messages.Add("Saving the game.");
+    }
+    else
+    {
+        m_game.m_messages.Add("The last save has not finished yet.");
+    }
+}
+
+void Simulation::Load()
+{
+    auto save = SaveFile::Open(m_savePath);
+    if (!save)
+    {
+        m_game.m_messages.Add("There is no saved game to load.");
+        return;
+    }
+
+    Game game(save->CreateWorld(StreamRadius), save->m_header->seed ^ save->m_header->turn);
+    save->Restore(game);
+    game.m_messages = m_game.m_messages;
+    game.m_jobs = m_jobs.get();
+    // Snapshots only take the light map when its version changes, so keep counting from the old one.
+    game.m_lighting.m_map.m_version += m_game.m_lighting.m_map.m_version + 1;
+    m_game = std::move(game);
+
+    // Replays start from a new session, not from a save.
+    m_journal.Close();
+
+    m_generator.reset();
+    if (save->m_header->flags & SaveFlag_Streamed)
+    {
+        m_generator = std::make_unique<ChunkGenerator>(save->m_header->seed);
+    }
+    m_save = std::move(save);
+    m_game.m_messages.Add("Game loaded.");
+}
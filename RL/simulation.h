@@ -0,0 +1,115 @@
+#pragma once
+
+#include "game.h"
+#include "journal.h"
+#include "savegame.h"
+#include "spscqueue.h"
+#include "triplebuffer.h"
+#include "worldgen.h"
+
+#include <chrono>
+#include <thread>
+
+// Immutable view of the game handed from the simulation thread to the render loop.
+struct RenderSnapshot
+{
+    uint64_t tick = 0;
+    uint64_t turn = 0;
+    int32_t playerX = 0;
+    int32_t playerY = 0;
+
+    // Drawable entities in the square the player's field of view covers, as parallel columns.
+    struct {
+        std::vector<Position> positions;
+        std::vector<Appearance> appearances;
+    } entities;
+
+    VisibilityMask fov;
+    LightMap light;
+    std::shared_ptr<WorldMap const> world;
+    MessageLog messages;
+};
+
+// Copies what is drawn of the game into a snapshot, skipping the parts that have not changed
+// since the snapshot was last filled.
+void CaptureSnapshot(Game & game, RenderSnapshot & snapshot);
+
+// Runs the game on its own thread at a fixed tick rate. Commands arrive through a bounded
+// queue and every tick publishes a RenderSnapshot through a triple buffer, so neither the
+// input thread nor the render loop ever blocks on the simulation.
+struct Simulation
+{
+    static constexpr std::chrono::microseconds TickDuration{ 1000000 / 60 };
+
+    // Chunks within this many chunks of the player's are generated ahead of time. The camera
+    // follows the player, so this keeps a margin of generated terrain beyond the screen edges.
+    static constexpr int32_t StreamRadius = 4;
+
+    // A journaled session records the state hash this often, in turns.
+    static constexpr uint64_t JournalHashInterval = 100;
+
+    explicit Simulation(std::shared_ptr<WorldMap const> world);
+
+    // Streams a procedural world of the given size, starting at its centre.
+    Simulation(uint32_t width, uint32_t height, uint64_t seed);
+    ~Simulation();
+
+    void Start();
+    void Stop();
+
+    // Called from the input thread. Returns false if the queue is full and the command was dropped.
+    bool Post(Command const & command) { return m_commands.TryPush(command); }
+
+    // Called from the render loop. Returns the newest published snapshot.
+    RenderSnapshot const & Snapshot()
+    {
+        m_snapshots.Acquire();
+        return m_snapshots.Front();
+    }
+
+    void Run();
+    void Apply(Command const & command);
+    void StreamChunks();
+    void Publish();
+
+    // Save writes m_savePath in the background; Load replaces the game with it.
+    void Save();
+    void Load();
+
+    Game m_game;
+    uint64_t m_tick = 0;
+
+    // Decides monster actions in parallel, on every hardware thread.
+    std::unique_ptr<JobSystem> m_jobs;
+
+    // Null for fixed maps.
+    std::unique_ptr<ChunkGenerator> m_generator;
+    std::vector<ChunkUpdate> m_generated;
+
+    // Set before Start. After a load, chunks not yet used come from m_save before the generator.
+    std::string m_savePath;
+    std::unique_ptr<SaveFile> m_save;
+    BackgroundSaver m_saver;
+
+    // Set before Start to journal a new streamed session.
+    std::string m_journalPath;
+    JournalWriter m_journal;
+
+    // Called on the simulation thread after publishing a snapshot that draws differently from
+    // the one before, so an idle render loop knows to wake up. Set before Start.
+    std::function<void()> m_onChanged;
+
+    // What the last published snapshot was drawn from.
+    struct {
+        uint64_t turn = 0;
+        uint64_t messages = 0;
+        uint64_t light = 0;
+        WorldMap const * world = nullptr;
+    } m_published;
+
+    SpscQueue<Command, 256> m_commands;
+    TripleBuffer<RenderSnapshot> m_snapshots;
+
+    std::atomic<bool> m_running{ false };
+    std::thread m_thread;
+};
@@ -0,0 +1,170 @@
+#include "pch.h"
+
+#include "spatialindex.h"
+
+void SpatialIndex::Reset(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    m_columns = (width + ChunkMask) >> ChunkShift;
+    uint32_t rows = (height + ChunkMask) >> ChunkShift;
+    m_buckets.clear();
+    m_buckets.resize(size_t(m_columns) * rows);
+    m_nodes.clear();
+}
+
+// Where a tile's list head is in its bucket.
+static uint32_t TileSlot(int32_t x, int32_t y)
+{
+    return (uint32_t(y & ChunkMask) << ChunkShift) | uint32_t(x & ChunkMask);
+}
+
+void SpatialIndex::LinkTile(uint32_t index)
+{
+    Node & node = m_nodes[index];
+    uint32_t & head = m_buckets[node.bucket].tiles[TileSlot(node.x, node.y)];
+    node.tilePrev = None;
+    node.tileNext = head;
+    if (head != None)
+    {
+        m_nodes[head].tilePrev = index;
+    }
+    head = index;
+}
+
+void SpatialIndex::UnlinkTile(uint32_t index)
+{
+    Node & node = m_nodes[index];
+    if (node.tilePrev != None)
+    {
+        m_nodes[node.tilePrev].tileNext = node.tileNext;
+    }
+    else
+    {
+        m_buckets[node.bucket].tiles[TileSlot(node.x, node.y)] = node.tileNext;
+    }
+    if (node.tileNext != None)
+    {
+        m_nodes[node.tileNext].tilePrev = node.tilePrev;
+    }
+}
+
+void SpatialIndex::Link(uint32_t index)
+{
+    Node & node = m_nodes[index];
+    if (node.x < 0 || node.y < 0 || uint32_t(node.x) >= m_width || uint32_t(node.y) >= m_height)
+    {
+        node.bucket = None;
+        return;
+    }
+
+    node.bucket = uint32_t(node.y >> ChunkShift) * m_columns + uint32_t(node.x >> ChunkShift);
+    Bucket & bucket = m_buckets[node.bucket];
+    if (bucket.tiles.empty())
+    {
+        bucket.tiles.assign(ChunkArea, None);
+    }
+
+    node.slot = uint32_t(bucket.entries.size());
+    bucket.entries.push_back({ node.entity, node.x, node.y });
+    LinkTile(index);
+}
+
+void SpatialIndex::Unlink(uint32_t index)
+{
+    Node & node = m_nodes[index];
+    if (node.bucket == None)
+    {
+        return;
+    }
+
+    UnlinkTile(index);
+
+    // Swap-remove from the packed entries.
+    Bucket & bucket = m_buckets[node.bucket];
+    Entry & last = bucket.entries.back();
+    m_nodes[last.entity.index].slot = node.slot;
+    bucket.entries[node.slot] = last;
+    bucket.entries.pop_back();
+    node.bucket = None;
+}
+
+void SpatialIndex::Insert(EntityHandle entity, int32_t x, int32_t y)
+{
+    if (entity.index >= m_nodes.size())
+    {
+        m_nodes.resize(size_t(entity.index) + 1);
+    }
+    else if (m_nodes[entity.index].entity.index != UINT32_MAX)
+    {
+        // The slot still holds an entity that was destroyed without being removed.
+        Unlink(entity.index);
+    }
+
+    Node & node = m_nodes[entity.index];
+    node.entity = entity;
+    node.x = x;
+    node.y = y;
+    Link(entity.index);
+}
+
+void SpatialIndex::Remove(EntityHandle entity)
+{
+    if (Contains(entity))
+    {
+        Unlink(entity.index);
+        m_nodes[entity.index] = Node();
+    }
+}
+
+void SpatialIndex::Move(EntityHandle entity, int32_t x, int32_t y)
+{
+    if (!Contains(entity))
+    {
+        return;
+    }
+
+    Node & node = m_nodes[entity.index];
+    if (node.x == x && node.y == y)
+    {
+        return;
+    }
+
+    // Within a bucket only the tile lists and the entry's position change.
+    uint32_t bucket = None;
+    if (x >= 0 && y >= 0 && uint32_t(x) < m_width && uint32_t(y) < m_height)
+    {
+        bucket = uint32_t(y >> ChunkShift) * m_columns + uint32_t(x >> ChunkShift);
+    }
+    if (bucket != None && bucket == node.bucket)
+    {
+        UnlinkTile(entity.index);
+        node.x = x;
+        node.y = y;
+        Entry & entry = m_buckets[bucket].entries[node.slot];
+        entry.x = x;
+        entry.y = y;
+        LinkTile(entity.index);
+        return;
+    }
+
+    Unlink(entity.index);
+    node.x = x;
+    node.y = y;
+    Link(entity.index);
+}
+
+uint32_t SpatialIndex::First(int32_t x, int32_t y) const
+{
+    if (x < 0 || y < 0 || uint32_t(x) >= m_width || uint32_t(y) >= m_height)
+    {
+        return None;
+    }
+
+    Bucket const & bucket = m_buckets[uint32_t(y >> ChunkShift) * m_columns + uint32_t(x >> ChunkShift)];
+    if (bucket.tiles.empty())
+    {
+        return None;
+    }
+    return bucket.tiles[TileSlot(x, y)];
+}
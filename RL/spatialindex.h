@@ -0,0 +1,161 @@
+#pragma once
+
+#include "entities.h"
+#include "worldmap.h"
+
+// Which entities are on which tile. The map is split into buckets the size of its chunks.
+// Every occupied bucket keeps a list head per tile, with each entity linked into the list of
+// its tile, and a packed array of the entities in it, so a move is O(1) and a query visits
+// only the buckets it overlaps: it scans the packed array of a bucket that holds few entities
+// for the tiles it overlaps, and the tile lists of one that holds many. Entities are keyed by
+// their handle's index, so they need no component to find their place in the index.
+struct SpatialIndex
+{
+    static constexpr uint32_t None = UINT32_MAX;
+
+    // Buckets holding fewer entities than this many per overlapped tile are scanned.
+    static constexpr uint32_t ScanDensity = 8;
+
+    // Tile links are entity indices.
+    struct Node
+    {
+        EntityHandle entity;
+        int32_t x;
+        int32_t y;
+        uint32_t bucket = None;     // None while the entity is not indexed.
+        uint32_t slot;              // In the bucket's entries.
+        uint32_t tileNext;
+        uint32_t tilePrev;
+    };
+
+    struct Entry
+    {
+        EntityHandle entity;
+        int32_t x;
+        int32_t y;
+    };
+
+    struct Bucket
+    {
+        std::vector<Entry> entries;
+
+        // Per-tile list heads, in the order WorldMap stores a chunk's tiles. Allocated when
+        // the bucket gets its first entity.
+        std::vector<uint32_t> tiles;
+    };
+
+    // Covers a width x height map, with nothing in it.
+    void Reset(uint32_t width, uint32_t height);
+
+    // An entity off the map is remembered but found by no query until it moves onto it.
+    void Insert(EntityHandle entity, int32_t x, int32_t y);
+    void Remove(EntityHandle entity);
+    void Move(EntityHandle entity, int32_t x, int32_t y);
+
+    bool Contains(EntityHandle entity) const
+    {
+        return entity.index < m_nodes.size() && m_nodes[entity.index].entity == entity;
+    }
+
+    // Index of the first entity on the tile, or None; Node::tileNext leads to the rest.
+    uint32_t First(int32_t x, int32_t y) const;
+
+    bool IsOccupied(int32_t x, int32_t y) const { return First(x, y) != None; }
+
+    // Calls fn(entity) for every entity on the tile.
+    template<typename Fn>
+    void ForEachAt(int32_t x, int32_t y, Fn && fn) const
+    {
+        for (uint32_t node = First(x, y); node != None; node = m_nodes[node].tileNext)
+        {
+            fn(m_nodes[node].entity);
+        }
+    }
+
+    // Calls fn(entity, x, y) for every entity in [left, right) x [top, bottom).
+    template<typename Fn>
+    void ForEachInRect(int32_t left, int32_t top, int32_t right, int32_t bottom, Fn && fn) const
+    {
+        left = std::max(left, 0);
+        top = std::max(top, 0);
+        right = std::min(right, int32_t(m_width));
+        bottom = std::min(bottom, int32_t(m_height));
+        if (left >= right || top >= bottom)
+        {
+            return;
+        }
+
+        for (int32_t bucketY = top >> ChunkShift; bucketY <= (bottom - 1) >> ChunkShift; bucketY++)
+        {
+            int32_t y0 = std::max(top, bucketY << ChunkShift);
+            int32_t y1 = std::min(bottom, (bucketY + 1) << ChunkShift);
+            for (int32_t bucketX = left >> ChunkShift; bucketX <= (right - 1) >> ChunkShift; bucketX++)
+            {
+                Bucket const & bucket = m_buckets[size_t(bucketY) * m_columns + bucketX];
+                if (bucket.entries.empty())
+                {
+                    continue;
+                }
+
+                int32_t x0 = std::max(left, bucketX << ChunkShift);
+                int32_t x1 = std::min(right, (bucketX + 1) << ChunkShift);
+                if (bucket.entries.size() < size_t(ScanDensity) * uint32_t((x1 - x0) * (y1 - y0)))
+                {
+                    for (Entry const & entry : bucket.entries)
+                    {
+                        if (entry.x >= x0 && entry.x < x1 && entry.y >= y0 && entry.y < y1)
+                        {
+                            fn(entry.entity, entry.x, entry.y);
+                        }
+                    }
+                    continue;
+                }
+
+                for (int32_t y = y0; y < y1; y++)
+                {
+                    uint32_t const * heads = bucket.tiles.data() + (uint32_t(y & ChunkMask) << ChunkShift);
+                    for (int32_t x = x0; x < x1; x++)
+                    {
+                        for (uint32_t node = heads[x & ChunkMask]; node != None; node = m_nodes[node].tileNext)
+                        {
+                            fn(m_nodes[node].entity, x, y);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Calls fn(entity, x, y) for every entity within radius tiles of (x, y), measured the way
+    // fields of view are: dx * dx + dy * dy <= radius * radius.
+    template<typename Fn>
+    void ForEachInRadius(int32_t x, int32_t y, uint32_t radius, Fn && fn) const
+    {
+        int64_t radiusSquared = int64_t(radius) * radius;
+        ForEachInRect(x - int32_t(radius), y - int32_t(radius), x + int32_t(radius) + 1, y + int32_t(radius) + 1,
+            [&](EntityHandle entity, int32_t entityX, int32_t entityY)
+        {
+            int64_t dx = entityX - x;
+            int64_t dy = entityY - y;
+            if (dx * dx + dy * dy <= radiusSquared)
+            {
+                fn(entity, entityX, entityY);
+            }
+        });
+    }
+
+    // Add or take the entity at this index from its bucket and tile.
+    void Link(uint32_t index);
+    void Unlink(uint32_t index);
+    void LinkTile(uint32_t index);
+    void UnlinkTile(uint32_t index);
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_columns = 0;
+    std::vector<Bucket> m_buckets;
+
+    // By entity index. Slots of entities that were never inserted or have been removed hold
+    // a default handle.
+    std::vector<Node> m_nodes;
+};
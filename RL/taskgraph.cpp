@@ -0,0 +1,190 @@
+#include "pch.h"
+
+#include "taskgraph.h"
+
+#include "profiler.h"
+
+TaskGraph::~TaskGraph()
+{
+    WaitAll();
+    for (auto & worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+TaskGraph::TaskId TaskGraph::Add(char const * name, std::function<void()> work, std::vector<TaskId> const & dependencies)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    TaskId id = TaskId(m_tasks.size());
+    Task task;
+    task.name = name;
+    task.work = std::move(work);
+    for (TaskId dependency : dependencies)
+    {
+        if (!m_tasks[dependency].done)
+        {
+            m_tasks[dependency].dependents.push_back(id);
+            task.pending++;
+        }
+    }
+    m_tasks.push_back(std::move(task));
+    m_remaining++;
+
+    if (m_tasks[id].pending == 0)
+    {
+        m_ready.push_back(id);
+    }
+    return id;
+}
+
+void TaskGraph::Start(uint32_t threads, std::function<void()> threadStart)
+{
+    m_started = ProfileNow();
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        m_workers.emplace_back([this, i, threadStart] { Work(i + 1, threadStart); });
+    }
+}
+
+void TaskGraph::RunOne(std::unique_lock<std::mutex> & lock, uint32_t thread)
+{
+    TaskId id = m_ready.front();
+    m_ready.pop_front();
+
+    // Tasks are only added before Start, so the reference stays valid while unlocked.
+    Task & task = m_tasks[id];
+    int64_t start = ProfileNow();
+    task.thread = thread;
+    task.start = start;
+    lock.unlock();
+
+    task.work();
+    int64_t end = ProfileNow();
+    if (ProfilingEnabled())
+    {
+        RecordProfileScope(task.name, start, end);
+    }
+
+    lock.lock();
+    task.end = end;
+    task.done = true;
+    m_remaining--;
+    for (TaskId dependent : task.dependents)
+    {
+        if (--m_tasks[dependent].pending == 0)
+        {
+            m_ready.push_back(dependent);
+        }
+    }
+    m_changed.notify_all();
+}
+
+void TaskGraph::Work(uint32_t thread, std::function<void()> const & threadStart)
+{
+    if (threadStart)
+    {
+        threadStart();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_changed.wait(lock, [this] { return !m_ready.empty() || m_remaining == 0; });
+        if (m_ready.empty())
+        {
+            return;
+        }
+        RunOne(lock, thread);
+    }
+}
+
+bool TaskGraph::IsDone(TaskId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks[id].done;
+}
+
+void TaskGraph::Wait(TaskId id)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_tasks[id].done)
+    {
+        if (!m_ready.empty())
+        {
+            RunOne(lock, WaitingThread);
+        }
+        else
+        {
+            m_changed.wait(lock);
+        }
+    }
+}
+
+bool TaskGraph::Wait(TaskId id, std::chrono::nanoseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_tasks[id].done)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+
+        if (!m_ready.empty())
+        {
+            RunOne(lock, WaitingThread);
+        }
+        else
+        {
+            m_changed.wait_until(lock, deadline);
+        }
+    }
+    return true;
+}
+
+void TaskGraph::WaitAll()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_remaining > 0)
+    {
+        if (!m_ready.empty())
+        {
+            RunOne(lock, WaitingThread);
+        }
+        else
+        {
+            m_changed.wait(lock);
+        }
+    }
+}
+
+void TaskGraph::FormatTimings(std::vector<std::string> & lines)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Task const *> done;
+    for (auto const & task : m_tasks)
+    {
+        if (task.done)
+        {
+            done.push_back(&task);
+        }
+    }
+    std::sort(done.begin(), done.end(), [](Task const * a, Task const * b) { return a->start < b->start; });
+
+    // A graph waited on before Start is timed from its first task.
+    int64_t origin = m_started != 0 || done.empty() ? m_started : done.front()->start;
+
+    lines.clear();
+    char line[128];
+    for (Task const * task : done)
+    {
+        snprintf(line, sizeof(line), "%-24.24s %9.3f ms %9.3f ms  thread %u",
+            task->name, (task->start - origin) / 1e6, (task->end - task->start) / 1e6, task->thread);
+        lines.push_back(line);
+    }
+}
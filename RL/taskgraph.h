@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Runs a fixed set of tasks on a pool of worker threads, each as soon as every task it depends
+// on has finished. Threads that wait on a task run ready tasks while they wait, so a graph with
+// no workers runs everything on the waiting thread, in dependency order.
+//
+// Tasks are added before Start. Each task records when and on which thread it ran, so a graph
+// doubles as a timing report of what it ran.
+struct TaskGraph
+{
+    using TaskId = uint32_t;
+
+    // Thread index recorded for tasks run by a waiting thread rather than a worker.
+    static constexpr uint32_t WaitingThread = 0;
+
+    TaskGraph() = default;
+    ~TaskGraph();
+
+    TaskGraph(TaskGraph const &) = delete;
+    TaskGraph & operator=(TaskGraph const &) = delete;
+
+    // Dependencies must already have been added, so a graph can never have a cycle.
+    TaskId Add(char const * name, std::function<void()> work, std::vector<TaskId> const & dependencies = {});
+
+    // Starts the given number of workers, each calling threadStart (if any) before its first task.
+    // Workers exit once every task has run.
+    void Start(uint32_t threads, std::function<void()> threadStart = nullptr);
+
+    bool IsDone(TaskId id);
+
+    // Blocks until the task has run, running ready tasks meanwhile.
+    void Wait(TaskId id);
+
+    // Like Wait, but gives up after roughly timeout (a task started before then is finished
+    // first). Returns whether the task has run.
+    bool Wait(TaskId id, std::chrono::nanoseconds timeout);
+
+    void WaitAll();
+
+    // One line per task in the order they started: start and duration in milliseconds since
+    // Start, and the thread that ran it.
+    void FormatTimings(std::vector<std::string> & lines);
+
+    struct Task
+    {
+        char const * name;
+        std::function<void()> work;
+        std::vector<TaskId> dependents;
+        uint32_t pending = 0;
+        bool done = false;
+
+        uint32_t thread = 0;
+        int64_t start = 0;
+        int64_t end = 0;
+    };
+
+    // Takes a ready task off the queue and runs it. Called with lock held; returns with it held.
+    void RunOne(std::unique_lock<std::mutex> & lock, uint32_t thread);
+
+    void Work(uint32_t thread, std::function<void()> const & threadStart);
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<Task> m_tasks;
+    std::deque<TaskId> m_ready;
+    size_t m_remaining = 0;
+    int64_t m_started = 0;
+
+    std::vector<std::thread> m_workers;
+};
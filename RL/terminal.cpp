@@ -0,0 +1,363 @@
+#include "pch.h"
+
+#include "framepacer.h"
+#include "profiler.h"
+#include "sceneview.h"
+#include "terminalrenderer.h"
+
+#include <cstdio>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Terminal driver: plays the game in an ANSI terminal, drawing the same cell grid as the
+// window through TerminalRenderer. It is excluded from the app build; on Linux build it with
+//
+//     g++ -std=c++17 -O2 -pthread -o rl-terminal terminal.cpp arena.cpp camera.cpp entities.cpp files.cpp flowfield.cpp fov.cpp game.cpp jobsystem.cpp journal.cpp lighting.cpp messagelog.cpp profiler.cpp savegame.cpp scheduler.cpp sceneview.cpp simulation.cpp spatialindex.cpp terminalrenderer.cpp textlayout.cpp worldgen.cpp worldmap.cpp
+//
+// and run rl-terminal [--seed N] [--colors 256]. Arrows, the number keys and hjklyubn move,
+// space, '.' and '5' wait, Page Up and Page Down scroll the log, F5 saves, F9 loads and 'q'
+// quits. On exit it prints how many frames it drew, and their average size and time.
+
+static const uint32_t WorldSize = 1024;
+
+// Written by the resize signal and the simulation thread to wake poll.
+static int s_wakePipe[2] = { -1, -1 };
+static termios s_savedMode;
+static bool s_rawMode = false;
+
+static void Wake(char reason)
+{
+    ssize_t written = write(s_wakePipe[1], &reason, 1);
+    (void)written;
+}
+
+static void OnResize(int)
+{
+    Wake('r');
+}
+
+static void WriteAll(std::string const & text)
+{
+    size_t done = 0;
+    while (done < text.size())
+    {
+        ssize_t written = write(STDOUT_FILENO, text.data() + done, text.size() - done);
+        if (written < 0 && errno != EINTR)
+        {
+            return;
+        }
+        done += written > 0 ? size_t(written) : 0;
+    }
+}
+
+// Raw input, the alternate screen, no cursor and no line wrapping, all undone on exit.
+static bool EnterTerminal()
+{
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &s_savedMode) != 0)
+    {
+        return false;
+    }
+
+    termios mode = s_savedMode;
+    mode.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    mode.c_oflag &= ~OPOST;
+    mode.c_cflag |= CS8;
+    mode.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    mode.c_cc[VMIN] = 0;
+    mode.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &mode) != 0)
+    {
+        return false;
+    }
+    s_rawMode = true;
+
+    WriteAll("\x1b[?1049h\x1b[?25l\x1b[?7l");
+    return true;
+}
+
+static void LeaveTerminal()
+{
+    if (s_rawMode)
+    {
+        WriteAll("\x1b[0m\x1b[?7h\x1b[?25h\x1b[?1049l");
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &s_savedMode);
+        s_rawMode = false;
+    }
+}
+
+static void TerminalSize(uint32_t & width, uint32_t & height)
+{
+    winsize size = {};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0)
+    {
+        width = size.ws_col;
+        height = size.ws_row;
+    }
+    else
+    {
+        width = 80;
+        height = 24;
+    }
+}
+
+// What a key asks for: a game command, a log scroll, or quitting.
+struct KeyAction
+{
+    Command command;
+    int32_t scroll = 0;
+    bool quit = false;
+};
+
+static Command MoveCommand(int8_t dx, int8_t dy)
+{
+    Command command;
+    command.type = CommandType::Move;
+    command.dx = dx;
+    command.dy = dy;
+    return command;
+}
+
+// Decodes the key at input[position] and advances position past it. Returns false, leaving
+// position where it was, if the input ends partway through an escape sequence.
+static bool DecodeKey(std::string const & input, size_t & position, KeyAction & action)
+{
+    action = KeyAction();
+    char c = input[position];
+    if (c != '\x1b')
+    {
+        position++;
+        switch (c)
+        {
+        case 'h': case '4': action.command = MoveCommand(-1, 0); break;
+        case 'l': case '6': action.command = MoveCommand(1, 0); break;
+        case 'k': case '8': action.command = MoveCommand(0, -1); break;
+        case 'j': case '2': action.command = MoveCommand(0, 1); break;
+        case 'y': case '7': action.command = MoveCommand(-1, -1); break;
+        case 'u': case '9': action.command = MoveCommand(1, -1); break;
+        case 'b': case '1': action.command = MoveCommand(-1, 1); break;
+        case 'n': case '3': action.command = MoveCommand(1, 1); break;
+        case ' ': case '.': case '5': action.command.type = CommandType::Wait; break;
+        case 'q': case '\x03': action.quit = true; break;
+        }
+        return true;
+    }
+
+    // ESC [ or ESC O, then parameters, then a final byte. A lone escape is ignored.
+    if (position + 1 >= input.size())
+    {
+        return false;
+    }
+    if (input[position + 1] != '[' && input[position + 1] != 'O')
+    {
+        position++;
+        return true;
+    }
+
+    size_t end = position + 2;
+    while (end < input.size() && (input[end] == ';' || (input[end] >= '0' && input[end] <= '9')))
+    {
+        end++;
+    }
+    if (end >= input.size())
+    {
+        return false;
+    }
+
+    std::string parameters = input.substr(position + 2, end - position - 2);
+    switch (input[end])
+    {
+    case 'A': action.command = MoveCommand(0, -1); break;
+    case 'B': action.command = MoveCommand(0, 1); break;
+    case 'C': action.command = MoveCommand(1, 0); break;
+    case 'D': action.command = MoveCommand(-1, 0); break;
+    case '~':
+        if (parameters == "5") action.scroll = 1;
+        else if (parameters == "6") action.scroll = -1;
+        else if (parameters == "15") action.command.type = CommandType::Save;
+        else if (parameters == "20") action.command.type = CommandType::Load;
+        break;
+    }
+    position = end + 1;
+    return true;
+}
+
+struct TerminalOptions
+{
+    uint64_t seed = 0;
+    TerminalColors colors = TerminalColors::TrueColor;
+};
+
+static bool ParseOptions(int argc, char ** argv, TerminalOptions & options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "missing value for %s\n", name.c_str());
+            return false;
+        }
+
+        uint64_t value = strtoull(argv[++i], nullptr, 10);
+        if (name == "--seed") options.seed = value;
+        else if (name == "--colors") options.colors = value == 256 ? TerminalColors::Palette256 : TerminalColors::TrueColor;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    TerminalOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: %s [--seed N] [--colors 24|256]\n", argv[0]);
+        return 1;
+    }
+    if (options.seed == 0)
+    {
+        options.seed = uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    if (pipe(s_wakePipe) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    fcntl(s_wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(s_wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    Simulation simulation(WorldSize, WorldSize, options.seed);
+    simulation.m_savePath = "quicksave.rls";
+
+    // A snapshot that draws differently wakes the loop, once however many arrive before it
+    // gets to them.
+    std::atomic<bool> wakePending{ false };
+    simulation.m_onChanged = [&]
+    {
+        if (!wakePending.exchange(true))
+        {
+            Wake('s');
+        }
+    };
+
+    if (!EnterTerminal())
+    {
+        fprintf(stderr, "stdin is not a terminal\n");
+        return 1;
+    }
+    signal(SIGWINCH, OnResize);
+    simulation.Start();
+
+    SceneView scene;
+    scene.m_textLayouts = std::make_unique<TextLayoutCache>(MonospaceWidth);
+    TerminalRenderer renderer;
+    renderer.m_colors = options.colors;
+    CellGrid grid;
+    bool resized = true;
+
+    FramePacer pacer;
+    std::string input;
+    int64_t frameTime = 0;
+    bool running = true;
+    while (running)
+    {
+        auto now = FramePacer::Clock::now();
+        FramePacer::Clock::time_point wake = FramePacer::Clock::time_point::max();
+        if (pacer.ShouldDraw(now, wake))
+        {
+            int64_t started = ProfileNow();
+            if (resized)
+            {
+                uint32_t width;
+                uint32_t height;
+                TerminalSize(width, height);
+                grid.Resize(width, height);
+                renderer.Invalidate();
+                resized = false;
+            }
+
+            scene.Draw(simulation.Snapshot(), grid, renderer.m_full);
+            WriteAll(renderer.Render(grid));
+            frameTime += ProfileNow() - started;
+            pacer.FrameDrawn(now);
+            continue;
+        }
+
+        int timeout = -1;
+        if (wake != FramePacer::Clock::time_point::max())
+        {
+            timeout = int(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count()) + 1;
+        }
+
+        pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { s_wakePipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, timeout) <= 0)
+        {
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char reasons[64];
+            ssize_t count = read(s_wakePipe[0], reasons, sizeof(reasons));
+            for (ssize_t i = 0; i < count; i++)
+            {
+                if (reasons[i] == 'r')
+                {
+                    resized = true;
+                }
+                else
+                {
+                    wakePending = false;
+                }
+            }
+            pacer.Invalidate();
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            char bytes[256];
+            ssize_t count = read(STDIN_FILENO, bytes, sizeof(bytes));
+            if (count > 0)
+            {
+                input.append(bytes, size_t(count));
+            }
+
+            size_t position = 0;
+            KeyAction action;
+            while (position < input.size() && DecodeKey(input, position, action))
+            {
+                if (action.quit)
+                {
+                    running = false;
+                }
+                if (action.scroll != 0)
+                {
+                    scene.m_logPanel.Scroll(action.scroll);
+                    pacer.Invalidate();
+                }
+                if (action.command.type != CommandType::None)
+                {
+                    simulation.Post(action.command);
+                }
+            }
+            input.erase(0, position);
+        }
+    }
+
+    simulation.Stop();
+    LeaveTerminal();
+
+    uint64_t frames = renderer.m_stats.frames;
+    printf("%llu frames, %.0f bytes/frame, %.3f ms/frame\n", (unsigned long long)frames,
+        frames > 0 ? double(renderer.m_stats.bytes) / frames : 0.0, frames > 0 ? frameTime / 1e6 / frames : 0.0);
+    return 0;
+}
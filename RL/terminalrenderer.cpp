@@ -0,0 +1,308 @@
+#include "pch.h"
+
+#include "terminalrenderer.h"
+
+#include "textlayout.h"
+
+static void AppendNumber(std::string & output, uint32_t value)
+{
+    char digits[10];
+    uint32_t count = 0;
+    do
+    {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0)
+    {
+        output += digits[--count];
+    }
+}
+
+// The nearest entry of the xterm palette: the 6x6x6 color cube or the gray ramp.
+static uint32_t PaletteIndex(uint32_t color)
+{
+    static const uint32_t CubeLevels[6] = { 0, 95, 135, 175, 215, 255 };
+
+    uint32_t channels[3] = { (color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff };
+    uint32_t cube[3];
+    uint32_t cubeDistance = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        uint32_t level = channels[i] < 48 ? 0 : channels[i] < 115 ? 1 : (channels[i] - 35) / 40;
+        int32_t delta = int32_t(channels[i]) - int32_t(CubeLevels[level]);
+        cube[i] = level;
+        cubeDistance += uint32_t(delta * delta);
+    }
+
+    uint32_t average = (channels[0] + channels[1] + channels[2]) / 3;
+    uint32_t gray = average < 8 ? 0 : std::min((average - 8 + 5) / 10, 23u);
+    uint32_t grayLevel = 8 + gray * 10;
+    uint32_t grayDistance = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        int32_t delta = int32_t(channels[i]) - int32_t(grayLevel);
+        grayDistance += uint32_t(delta * delta);
+    }
+
+    if (grayDistance < cubeDistance)
+    {
+        return 232 + gray;
+    }
+    return 16 + cube[0] * 36 + cube[1] * 6 + cube[2];
+}
+
+uint32_t TerminalGlyphWidth(CellGrid const & grid, uint32_t x, uint32_t y)
+{
+    char32_t glyph = grid.At(x, y).glyph;
+    if (glyph >= 0x1100 && MonospaceWidth(glyph) == 2 && x + 1 < grid.m_width)
+    {
+        return 2;
+    }
+    return 1;
+}
+
+uint32_t TerminalRenderer::Foreground(Cell const & cell) const
+{
+    uint32_t color = cell.foreground & 0xffffff;
+    if (cell.style & CellStyle_Dim)
+    {
+        uint32_t blended = 0;
+        for (uint32_t shift = 0; shift < 24; shift += 8)
+        {
+            uint32_t glyph = (color >> shift) & 0xff;
+            uint32_t background = (cell.background >> shift) & 0xff;
+            blended |= ((glyph * 2 + background * 3) / 5) << shift;
+        }
+        color = blended;
+    }
+    return m_colors == TerminalColors::Palette256 ? PaletteIndex(color) : color;
+}
+
+uint32_t TerminalRenderer::Background(Cell const & cell) const
+{
+    uint32_t color = cell.background & 0xffffff;
+    return m_colors == TerminalColors::Palette256 ? PaletteIndex(color) : color;
+}
+
+uint32_t TerminalRenderer::WriteCell(std::string & output, CellGrid const & grid, uint32_t x, uint32_t y, TerminalPen & pen) const
+{
+    Cell const & cell = grid.At(x, y);
+    uint32_t foreground = Foreground(cell);
+    uint32_t background = Background(cell);
+
+    // One SGR sequence sets whichever of the two colors changed. A space shows no foreground,
+    // so it keeps the pen's rather than switching to its own.
+    bool space = cell.glyph == U' ';
+    bool setForeground = !space && (!pen.known || pen.foreground != foreground);
+    bool setBackground = !pen.known || pen.background != background;
+    if (setForeground || setBackground)
+    {
+        output += "\x1b[";
+        if (setForeground)
+        {
+            output += m_colors == TerminalColors::Palette256 ? "38;5;" : "38;2;";
+            if (m_colors == TerminalColors::Palette256)
+            {
+                AppendNumber(output, foreground);
+            }
+            else
+            {
+                AppendNumber(output, foreground >> 16);
+                output += ';';
+                AppendNumber(output, (foreground >> 8) & 0xff);
+                output += ';';
+                AppendNumber(output, foreground & 0xff);
+            }
+        }
+        if (setBackground)
+        {
+            if (setForeground)
+            {
+                output += ';';
+            }
+            output += m_colors == TerminalColors::Palette256 ? "48;5;" : "48;2;";
+            if (m_colors == TerminalColors::Palette256)
+            {
+                AppendNumber(output, background);
+            }
+            else
+            {
+                AppendNumber(output, background >> 16);
+                output += ';';
+                AppendNumber(output, (background >> 8) & 0xff);
+                output += ';';
+                AppendNumber(output, background & 0xff);
+            }
+        }
+        output += 'm';
+
+        // A pen that was unknown and only had its background set still has an unknown
+        // foreground, so the next glyph sets both.
+        if (setForeground || pen.known)
+        {
+            pen.foreground = setForeground ? foreground : pen.foreground;
+            pen.background = background;
+            pen.known = true;
+        }
+    }
+
+    // Control characters, lone combining marks and wide glyphs cut off by the right edge
+    // would leave the cursor somewhere other than where the cost model thinks it is.
+    uint32_t width = TerminalGlyphWidth(grid, x, y);
+    char32_t glyph = cell.glyph;
+    uint32_t measured = glyph < 0x300 ? 1 : MonospaceWidth(glyph);
+    if (glyph < 0x20 || (glyph >= 0x7f && glyph < 0xa0) || measured != width)
+    {
+        glyph = U' ';
+    }
+    EncodeUtf8(glyph, output);
+    return width;
+}
+
+void TerminalRenderer::MoveCursor(CellGrid const & grid, uint32_t x, uint32_t y)
+{
+    if (m_cursorKnown && m_cursorX == x && m_cursorY == y)
+    {
+        return;
+    }
+
+    // An absolute jump always works: ESC [ row ; column H, with either left out when it is 1.
+    std::string & output = m_output;
+    size_t start = output.size();
+    output += "\x1b[";
+    if (y > 0 || x > 0)
+    {
+        AppendNumber(output, y + 1);
+    }
+    if (x > 0)
+    {
+        output += ';';
+        AppendNumber(output, x + 1);
+    }
+    output += 'H';
+    size_t best = output.size() - start;
+
+    if (m_cursorKnown && m_cursorY < y && x == 0 && y - m_cursorY + 1 < best)
+    {
+        // Carriage return and line feeds down to the row.
+        output.resize(start);
+        output += '\r';
+        output.append(y - m_cursorY, '\n');
+    }
+    else if (m_cursorKnown && m_cursorY == y && m_cursorX < x)
+    {
+        // Forward on the same row: step over the gap with ESC [ n C, or write its cells again
+        // if they take fewer bytes, as they do between changes a few cells apart. Pricing the
+        // rewrite stops as soon as it costs as much as the best jump.
+        uint32_t gap = x - m_cursorX;
+        size_t forward = gap == 1 ? 3 : gap < 10 ? 4 : gap < 100 ? 5 : 6;
+        if (forward < best)
+        {
+            best = forward;
+            output.resize(start);
+            output += "\x1b[";
+            if (gap > 1)
+            {
+                AppendNumber(output, gap);
+            }
+            output += 'C';
+        }
+
+        m_gap.clear();
+        TerminalPen pen = m_pen;
+        uint32_t column = m_cursorX;
+        while (column < x && m_gap.size() < best)
+        {
+            // A wide glyph running past the target would overwrite it.
+            if (column + TerminalGlyphWidth(grid, column, y) > x)
+            {
+                break;
+            }
+            column += WriteCell(m_gap, grid, column, y, pen);
+        }
+
+        if (column == x && m_gap.size() < best)
+        {
+            output.resize(start);
+            output += m_gap;
+            m_pen = pen;
+            m_stats.cellsRewritten += gap;
+        }
+    }
+
+    m_cursorX = x;
+    m_cursorY = y;
+    m_cursorKnown = true;
+    m_stats.cursorMoves++;
+}
+
+std::string const & TerminalRenderer::Render(CellGrid const & grid)
+{
+    m_output.clear();
+    if (m_emitted.m_width != grid.m_width || m_emitted.m_height != grid.m_height)
+    {
+        m_full = true;
+    }
+
+    // Rewriting everything starts from the default attributes, with the cursor and pen unknown.
+    bool full = m_full;
+    if (full)
+    {
+        m_output += "\x1b[0m";
+        m_pen.known = false;
+        m_cursorKnown = false;
+    }
+
+    for (uint32_t y = 0; y < grid.m_height; y++)
+    {
+        Cell const * row = &grid.At(0, y);
+        Cell const * emitted = full ? nullptr : &m_emitted.At(0, y);
+
+        // Whether cell x is the second half of a wide glyph, in the new frame and in the one
+        // the terminal shows. A cell whose half changed is written even if its contents did
+        // not, which also redraws what is left of a wide glyph a write cut in two.
+        bool covered = false;
+        bool emittedCovered = false;
+        uint32_t x = 0;
+        while (x < grid.m_width)
+        {
+            if (!full && covered == emittedCovered && row[x] == emitted[x])
+            {
+                covered = !covered && TerminalGlyphWidth(grid, x, y) == 2;
+                emittedCovered = !emittedCovered && TerminalGlyphWidth(m_emitted, x, y) == 2;
+                x++;
+                continue;
+            }
+
+            // The second half of a wide glyph is drawn by the first.
+            uint32_t left = covered ? x - 1 : x;
+            MoveCursor(grid, left, y);
+            TerminalPen pen = m_pen;
+            uint32_t width = WriteCell(m_output, grid, left, y, m_pen);
+            if (!pen.known || m_pen.foreground != pen.foreground || m_pen.background != pen.background)
+            {
+                m_stats.colorChanges++;
+            }
+            m_cursorX = left + width;
+            m_stats.cellsWritten += width;
+
+            covered = false;
+            for (; !full && x < left + width; x++)
+            {
+                emittedCovered = !emittedCovered && TerminalGlyphWidth(m_emitted, x, y) == 2;
+            }
+            x = left + width;
+        }
+    }
+
+    m_emitted.m_width = grid.m_width;
+    m_emitted.m_height = grid.m_height;
+    m_emitted.m_cells = grid.m_cells;
+    m_full = false;
+
+    m_stats.frames++;
+    m_stats.bytes += m_output.size();
+    return m_output;
+}
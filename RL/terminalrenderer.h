@@ -0,0 +1,80 @@
+#pragma once
+
+#include "cellgrid.h"
+
+#include <string>
+
+enum class TerminalColors : uint8_t
+{
+    TrueColor,      // 24-bit SGR colors.
+    Palette256,     // The xterm 256-color palette, for terminals without 24-bit color.
+};
+
+// The colors the terminal draws the next character with, in the form TerminalRenderer compares
+// them: 0xRRGGBB, or a palette index.
+struct TerminalPen
+{
+    uint32_t foreground = 0;
+    uint32_t background = 0;
+    bool known = false;
+};
+
+// Draws a cell grid on an ANSI terminal. It keeps the frame it last emitted and each frame
+// writes only the cells that differ, choosing for every gap between changed cells whichever
+// is shorter of a cursor jump or rewriting the cells in between, and setting colors only when
+// they change. The escape stream for a frame is built in one string, so the driver can hand
+// it to the terminal in a single write. The driver is expected to turn off line wrapping.
+struct TerminalRenderer
+{
+    // Forgets what the terminal shows, so the next frame rewrites every cell. Call after a
+    // resize, or whenever something else may have drawn on the terminal.
+    void Invalidate() { m_full = true; }
+
+    // Builds the escape sequences that turn the last emitted frame into grid. The result stays
+    // valid until the next call; it is empty if nothing changed.
+    std::string const & Render(CellGrid const & grid);
+
+    // Appends the shortest sequence the cost model finds that moves the cursor to (x, y).
+    void MoveCursor(CellGrid const & grid, uint32_t x, uint32_t y);
+
+    // Appends cell x of row y, changing pen to its colors if need be. Returns the number of
+    // cells the glyph covers.
+    uint32_t WriteCell(std::string & output, CellGrid const & grid, uint32_t x, uint32_t y, TerminalPen & pen) const;
+
+    // Colors in the form the pen holds them. A dimmed glyph is blended into its background,
+    // as the window draws it at 40% opacity.
+    uint32_t Foreground(Cell const & cell) const;
+    uint32_t Background(Cell const & cell) const;
+
+    TerminalColors m_colors = TerminalColors::TrueColor;
+
+    // What the terminal shows. Ignored while m_full is set.
+    CellGrid m_emitted;
+    bool m_full = true;
+
+    // Where the cursor is, in cells; m_cursorKnown is cleared when it could be anywhere. After
+    // writing the last column m_cursorX is the grid width.
+    uint32_t m_cursorX = 0;
+    uint32_t m_cursorY = 0;
+    bool m_cursorKnown = false;
+
+    TerminalPen m_pen;
+
+    std::string m_output;
+
+    // Scratch space for pricing a rewrite.
+    std::string m_gap;
+
+    struct {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t cellsWritten = 0;
+        uint64_t cellsRewritten = 0;    // Unchanged cells written because that beat moving the cursor.
+        uint64_t cursorMoves = 0;
+        uint64_t colorChanges = 0;
+    } m_stats;
+};
+
+// Cells the terminal takes for the glyph at (x, y): 2 for a wide glyph with room for it, 1
+// for everything else. Glyphs that cannot be drawn on their own are written as spaces.
+uint32_t TerminalGlyphWidth(CellGrid const & grid, uint32_t x, uint32_t y);
@@ -0,0 +1,293 @@
+#include "pch.h"
+
+#include "textlayout.h"
+
+char32_t DecodeUtf8(std::string_view text, size_t & position)
+{
+    uint8_t lead = uint8_t(text[position]);
+    if (lead < 0x80)
+    {
+        position++;
+        return lead;
+    }
+
+    size_t length;
+    char32_t codepoint;
+    char32_t minimum;
+    if ((lead & 0xe0) == 0xc0) { length = 2; codepoint = lead & 0x1f; minimum = 0x80; }
+    else if ((lead & 0xf0) == 0xe0) { length = 3; codepoint = lead & 0x0f; minimum = 0x800; }
+    else if ((lead & 0xf8) == 0xf0) { length = 4; codepoint = lead & 0x07; minimum = 0x10000; }
+    else
+    {
+        position++;
+        return 0xfffd;
+    }
+
+    if (position + length > text.size())
+    {
+        position++;
+        return 0xfffd;
+    }
+
+    for (size_t i = 1; i < length; i++)
+    {
+        uint8_t next = uint8_t(text[position + i]);
+        if ((next & 0xc0) != 0x80)
+        {
+            position++;
+            return 0xfffd;
+        }
+        codepoint = (codepoint << 6) | (next & 0x3f);
+    }
+
+    // Overlong encodings, surrogates and values past U+10FFFF are all malformed.
+    if (codepoint < minimum || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff))
+    {
+        position++;
+        return 0xfffd;
+    }
+
+    position += length;
+    return codepoint;
+}
+
+void EncodeUtf8(char32_t codepoint, std::string & text)
+{
+    if ((codepoint >= 0xd800 && codepoint < 0xe000) || codepoint > 0x10ffff)
+    {
+        codepoint = 0xfffd;
+    }
+
+    if (codepoint < 0x80)
+    {
+        text += char(codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        text += char(0xc0 | (codepoint >> 6));
+        text += char(0x80 | (codepoint & 0x3f));
+    }
+    else if (codepoint < 0x10000)
+    {
+        text += char(0xe0 | (codepoint >> 12));
+        text += char(0x80 | ((codepoint >> 6) & 0x3f));
+        text += char(0x80 | (codepoint & 0x3f));
+    }
+    else
+    {
+        text += char(0xf0 | (codepoint >> 18));
+        text += char(0x80 | ((codepoint >> 12) & 0x3f));
+        text += char(0x80 | ((codepoint >> 6) & 0x3f));
+        text += char(0x80 | (codepoint & 0x3f));
+    }
+}
+
+uint32_t MonospaceWidth(char32_t c)
+{
+    // Combining marks and zero-width characters.
+    if ((c >= 0x0300 && c <= 0x036f) || (c >= 0x1ab0 && c <= 0x1aff) || (c >= 0x1dc0 && c <= 0x1dff) ||
+        (c >= 0x20d0 && c <= 0x20ff) || (c >= 0xfe20 && c <= 0xfe2f) || (c >= 0x200b && c <= 0x200f))
+    {
+        return 0;
+    }
+
+    // Hangul, CJK, fullwidth forms and emoji.
+    if ((c >= 0x1100 && c <= 0x115f) || (c >= 0x2e80 && c <= 0xa4cf && c != 0x303f) || (c >= 0xac00 && c <= 0xd7a3) ||
+        (c >= 0xf900 && c <= 0xfaff) || (c >= 0xfe30 && c <= 0xfe4f) || (c >= 0xff00 && c <= 0xff60) ||
+        (c >= 0xffe0 && c <= 0xffe6) || (c >= 0x1f300 && c <= 0x1f64f) || (c >= 0x1f900 && c <= 0x1f9ff) ||
+        (c >= 0x20000 && c <= 0x3fffd))
+    {
+        return 2;
+    }
+    return 1;
+}
+
+void LayoutText(std::string_view text, uint32_t width, TextMeasurer const & measurer, TextLayout & layout)
+{
+    layout.lines.clear();
+    width = std::max(width, 1u);
+
+    uint32_t lineBegin = 0;
+    uint32_t lineWidth = 0;
+
+    // The last space on the current line: where it starts, the line's width before it, and
+    // where and at what width the next line would start if the line broke there.
+    bool canBreak = false;
+    uint32_t breakEnd = 0;
+    uint32_t breakWidth = 0;
+    uint32_t resume = 0;
+    uint32_t resumeWidth = 0;
+
+    size_t position = 0;
+    while (position < text.size())
+    {
+        uint32_t start = uint32_t(position);
+        char32_t codepoint = DecodeUtf8(text, position);
+
+        if (codepoint == U'\n')
+        {
+            layout.lines.push_back({ lineBegin, start, lineWidth });
+            lineBegin = uint32_t(position);
+            lineWidth = 0;
+            canBreak = false;
+            continue;
+        }
+
+        uint32_t advance = measurer(codepoint);
+        if (lineWidth + advance > width && lineWidth > 0)
+        {
+            if (codepoint == U' ')
+            {
+                // Break on the space itself, and drop it.
+                layout.lines.push_back({ lineBegin, start, lineWidth });
+                lineBegin = uint32_t(position);
+                lineWidth = 0;
+                canBreak = false;
+                continue;
+            }
+
+            if (canBreak)
+            {
+                // Move the word in progress to the next line.
+                layout.lines.push_back({ lineBegin, breakEnd, breakWidth });
+                lineBegin = resume;
+                lineWidth -= resumeWidth;
+                canBreak = false;
+            }
+
+            // Still too long: the word fills a line by itself, so split it.
+            if (lineWidth + advance > width && lineWidth > 0)
+            {
+                layout.lines.push_back({ lineBegin, start, lineWidth });
+                lineBegin = start;
+                lineWidth = 0;
+            }
+        }
+
+        if (codepoint == U' ')
+        {
+            canBreak = true;
+            breakEnd = start;
+            breakWidth = lineWidth;
+            resume = uint32_t(position);
+            resumeWidth = lineWidth + advance;
+        }
+        lineWidth += advance;
+    }
+    layout.lines.push_back({ lineBegin, uint32_t(text.size()), lineWidth });
+}
+
+TextLayoutCache::TextLayoutCache(TextMeasurer measurer, size_t capacity)
+    : m_measurer(std::move(measurer))
+    , m_capacity(capacity)
+{
+}
+
+TextLayout const & TextLayoutCache::Layout(std::string_view text, uint32_t width)
+{
+    // FNV-1a over the text, then the width.
+    uint64_t key = 0xcbf29ce484222325ull;
+    for (char c : text)
+    {
+        key = (key ^ uint8_t(c)) * 0x100000001b3ull;
+    }
+    key = (key ^ width) * 0x100000001b3ull;
+
+    auto found = m_entries.find(key);
+    if (found != m_entries.end() && found->second.width == width && found->second.text == text)
+    {
+        m_stats.hits++;
+        found->second.lastUsed = m_frame + 1;
+        return found->second.layout;
+    }
+
+    // A new entry takes over an evicted one, whose text and lines keep their memory.
+    m_stats.misses++;
+    if (found == m_entries.end() && !m_spare.empty())
+    {
+        auto node = std::move(m_spare.back());
+        m_spare.pop_back();
+        node.key() = key;
+        found = m_entries.insert(std::move(node)).position;
+    }
+    else if (found == m_entries.end())
+    {
+        found = m_entries.emplace(key, Entry()).first;
+    }
+
+    // Text gets room to spare, so an entry reused for longer text seldom has to grow again.
+    Entry & entry = found->second;
+    if (entry.text.capacity() < text.size())
+    {
+        entry.text.reserve(text.size() * 2);
+    }
+    entry.text.assign(text.data(), text.size());
+    entry.width = width;
+    entry.lastUsed = m_frame + 1;
+    LayoutText(text, width, m_measurer, entry.layout);
+    return entry.layout;
+}
+
+void TextLayoutCache::EndFrame()
+{
+    m_frame++;
+    if (m_entries.size() <= m_capacity)
+    {
+        return;
+    }
+
+    for (auto i = m_entries.begin(); i != m_entries.end();)
+    {
+        if (i->second.lastUsed < m_frame && m_spare.size() < m_capacity)
+        {
+            auto next = std::next(i);
+            m_spare.push_back(m_entries.extract(i));
+            i = next;
+        }
+        else if (i->second.lastUsed < m_frame)
+        {
+            i = m_entries.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void TextLayoutCache::Clear()
+{
+    m_entries.clear();
+}
+
+void DrawTextLine(CellGrid & grid, uint32_t x, uint32_t y, uint32_t width, std::string_view text, TextLine const & line, TextMeasurer const & measurer, uint32_t style)
+{
+    if (y >= grid.m_height)
+    {
+        return;
+    }
+
+    uint32_t right = std::min(x + width, grid.m_width);
+    uint32_t column = x;
+    size_t position = line.begin;
+    while (position < line.end && column < right)
+    {
+        char32_t codepoint = DecodeUtf8(text, position);
+        uint32_t advance = measurer(codepoint);
+        if (advance == 0)
+        {
+            continue;
+        }
+
+        grid.At(column++, y) = Cell{ codepoint, style };
+        for (uint32_t i = 1; i < advance && column < right; i++)
+        {
+            grid.At(column++, y) = Cell{ U' ', style };
+        }
+    }
+
+    for (; column < right; column++)
+    {
+        grid.At(column, y) = Cell{ U' ', style };
+    }
+}
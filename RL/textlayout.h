@@ -0,0 +1,85 @@
+#pragma once
+
+#include "cellgrid.h"
+
+#include <string_view>
+
+// Decodes the UTF-8 sequence at text[position] and advances position past it. A malformed or
+// truncated sequence decodes as U+FFFD and skips a single byte.
+char32_t DecodeUtf8(std::string_view text, size_t & position);
+
+// Appends the UTF-8 encoding of a codepoint. Surrogates and codepoints past U+10FFFF are
+// encoded as U+FFFD.
+void EncodeUtf8(char32_t codepoint, std::string & text);
+
+// Cells a codepoint takes in a monospaced console: 0 for combining marks, 2 for wide East Asian
+// characters and 1 for everything else.
+uint32_t MonospaceWidth(char32_t codepoint);
+
+// One wrapped line: a byte range of the text and how many cells it takes.
+struct TextLine
+{
+    uint32_t begin;
+    uint32_t end;
+    uint32_t width;
+};
+
+struct TextLayout
+{
+    std::vector<TextLine> lines;
+};
+
+// Returns how many cells a codepoint takes. The console measures in cells rather than pixels,
+// so a backend only has to decide how many cells each codepoint spans.
+using TextMeasurer = std::function<uint32_t(char32_t codepoint)>;
+
+// Word-wraps text to width cells. Lines break at spaces, which are dropped at the break, and at
+// '\n'; words longer than a line are split. Empty text has one empty line.
+void LayoutText(std::string_view text, uint32_t width, TextMeasurer const & measurer, TextLayout & layout);
+
+// Caches layouts by text and width, so text that has not changed is measured once rather than
+// every frame. A resize simply asks for another width; layouts for widths no longer used are
+// evicted by EndFrame.
+struct TextLayoutCache
+{
+    static constexpr size_t DefaultCapacity = 1024;
+
+    explicit TextLayoutCache(TextMeasurer measurer, size_t capacity = DefaultCapacity);
+
+    // The layout stays valid until the next call to Layout, EndFrame or Clear.
+    TextLayout const & Layout(std::string_view text, uint32_t width);
+
+    // Once more than the capacity is cached, drops every layout not used since the last call.
+    void EndFrame();
+
+    // For when the measurer's answers change, such as after a font change.
+    void Clear();
+
+    struct Entry
+    {
+        std::string text;
+        uint32_t width;
+        uint64_t lastUsed;
+        TextLayout layout;
+    };
+
+    TextMeasurer m_measurer;
+    size_t m_capacity;
+    uint64_t m_frame = 0;
+
+    // Keyed by a hash of the text and width; the entry holds both to rule out collisions.
+    std::unordered_map<uint64_t, Entry> m_entries;
+
+    // Evicted entries, kept for reuse so a steady stream of new text stops allocating.
+    std::vector<std::unordered_map<uint64_t, Entry>::node_type> m_spare;
+
+    struct {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    } m_stats;
+};
+
+// Writes one laid-out line into cells [x, x + width) of row y, padding the rest with spaces.
+// Wide characters take their first cell and blank the second; combining marks are dropped,
+// since a cell holds a single codepoint.
+void DrawTextLine(CellGrid & grid, uint32_t x, uint32_t y, uint32_t width, std::string_view text, TextLine const & line, TextMeasurer const & measurer, uint32_t style = CellStyle_Normal);
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Bits of a tile definition's flags.
+enum TileFlag : uint8_t
+{
+    TileFlag_Blocked = 1 << 0,      // Cannot be walked through.
+    TileFlag_Opaque = 1 << 1,       // Cannot be seen through, and stops light.
+    TileFlag_EmitsLight = 1 << 2,   // Shines with its definition's light radius and color.
+};
+
+// What a tile is. Maps store one byte per tile; everything else about it comes from its entry
+// in TileDefinitions, through the lookup tables below. Saves keep the bytes, so new types go
+// at the end.
+enum TileType : uint8_t
+{
+    Tile_Empty,         // Open and drawn as nothing; what a map is until it is written.
+    Tile_Floor,
+    Tile_Wall,
+    Tile_Rock,
+    Tile_Water,
+    Tile_Tree,
+    Tile_Door,
+    Tile_OpenDoor,
+    Tile_Ungenerated,   // Where the procedural world has no chunk yet: solid and dark.
+    Tile_Fungus,        // Open ground that glows.
+    Tile_Count,
+};
+
+struct TileDefinition
+{
+    TileType type;
+    char const * name;
+    char32_t glyph;
+    uint32_t foreground;
+    uint32_t background;
+    uint8_t flags;
+
+    // How far and in what packed 0x00RRGGBB color the tile lights its surroundings, if it has
+    // TileFlag_EmitsLight.
+    uint8_t lightRadius;
+    uint32_t lightColor;
+};
+
+// One entry per type, in TileType order.
+static constexpr TileDefinition TileDefinitions[] = {
+    { Tile_Empty, "empty", U' ', 0xffffffff, 0xff000000, 0, 0, 0 },
+    { Tile_Floor, "floor", U'.', 0xff5f5f5f, 0xff000000, 0, 0, 0 },
+    { Tile_Wall, "wall", U'#', 0xffffffff, 0xff000000, TileFlag_Blocked | TileFlag_Opaque, 0, 0 },
+    { Tile_Rock, "rock", U'#', 0xff8f8f8f, 0xff000000, TileFlag_Blocked | TileFlag_Opaque, 0, 0 },
+    { Tile_Water, "water", U'~', 0xff3f6fcf, 0xff0f2347, TileFlag_Blocked, 0, 0 },
+    { Tile_Tree, "tree", U'\u2663', 0xff2f9f3f, 0xff000000, TileFlag_Blocked | TileFlag_Opaque, 0, 0 },
+    { Tile_Door, "door", U'+', 0xffaf7f3f, 0xff000000, TileFlag_Blocked | TileFlag_Opaque, 0, 0 },
+    { Tile_OpenDoor, "open door", U'\'', 0xffaf7f3f, 0xff000000, 0, 0, 0 },
+    { Tile_Ungenerated, "ungenerated", U' ', 0xffffffff, 0xff000000, TileFlag_Blocked | TileFlag_Opaque, 0, 0 },
+    { Tile_Fungus, "glowing fungus", U'"', 0xff5fdfbf, 0xff000000, TileFlag_EmitsLight, 3, 0x2f7f6f },
+};
+
+// The definition a tile byte reads as. Bytes past the last type, which only a damaged map
+// holds, read as ungenerated: solid, dark and harmless.
+constexpr TileDefinition const & DefinitionOf(uint32_t tile)
+{
+    return TileDefinitions[tile < Tile_Count ? tile : uint32_t(Tile_Ungenerated)];
+}
+
+// A field of the definition of every possible tile byte, so looking one up in a hot loop is
+// a single indexed load with no range check.
+template<typename T>
+constexpr std::array<T, 256> MakeTileTable(T TileDefinition::* field)
+{
+    std::array<T, 256> table = {};
+    for (uint32_t i = 0; i < table.size(); i++)
+    {
+        table[i] = DefinitionOf(i).*field;
+    }
+    return table;
+}
+
+static constexpr std::array<char32_t, 256> TileGlyphs = MakeTileTable(&TileDefinition::glyph);
+static constexpr std::array<uint32_t, 256> TileForegrounds = MakeTileTable(&TileDefinition::foreground);
+static constexpr std::array<uint32_t, 256> TileBackgrounds = MakeTileTable(&TileDefinition::background);
+static constexpr std::array<uint8_t, 256> TileFlags = MakeTileTable(&TileDefinition::flags);
+static constexpr std::array<uint8_t, 256> TileLightRadii = MakeTileTable(&TileDefinition::lightRadius);
+static constexpr std::array<uint32_t, 256> TileLightColors = MakeTileTable(&TileDefinition::lightColor);
+
+// A load and a bit test. Faster than a set of types as a bitmask, which needs a variable shift.
+constexpr bool IsBlocked(uint8_t tile) { return (TileFlags[tile] & TileFlag_Blocked) != 0; }
+constexpr bool IsOpaque(uint8_t tile) { return (TileFlags[tile] & TileFlag_Opaque) != 0; }
+constexpr bool EmitsLight(uint8_t tile) { return (TileFlags[tile] & TileFlag_EmitsLight) != 0; }
+
+// The furthest any tile's light reaches, so lighting knows how far outside its window to look
+// for tiles that shine into it.
+constexpr uint32_t MaxTileLightRadius()
+{
+    uint32_t radius = 0;
+    for (auto const & definition : TileDefinitions)
+    {
+        radius = (definition.flags & TileFlag_EmitsLight) != 0 && definition.lightRadius > radius ? definition.lightRadius : radius;
+    }
+    return radius;
+}
+
+// Per ASCII character, the first type drawn with it, or Tile_Count if none is, for building
+// maps from text.
+constexpr std::array<uint8_t, 128> MakeGlyphTiles()
+{
+    std::array<uint8_t, 128> table = {};
+    for (auto & tile : table)
+    {
+        tile = Tile_Count;
+    }
+    for (uint32_t i = Tile_Count; i-- > 0;)
+    {
+        if (TileDefinitions[i].glyph < table.size())
+        {
+            table[TileDefinitions[i].glyph] = uint8_t(i);
+        }
+    }
+    return table;
+}
+
+static constexpr std::array<uint8_t, 128> GlyphTiles = MakeGlyphTiles();
+
+constexpr bool TileDefinitionsInOrder()
+{
+    for (uint32_t i = 0; i < Tile_Count; i++)
+    {
+        if (TileDefinitions[i].type != i || TileDefinitions[i].glyph == 0 || TileDefinitions[i].name == nullptr)
+        {
+            return false;
+        }
+        if (((TileDefinitions[i].flags & TileFlag_EmitsLight) != 0) != (TileDefinitions[i].lightRadius > 0 && TileDefinitions[i].lightColor != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(sizeof(TileDefinitions) / sizeof(TileDefinitions[0]) == Tile_Count, "every tile type needs a definition");
+static_assert(TileDefinitionsInOrder(), "tile definitions must be complete and in TileType order, and light exactly when flagged");
+static_assert(Tile_Count <= 256, "tile types are stored in a byte");
+static_assert(!IsBlocked(Tile_Empty) && !IsOpaque(Tile_Empty), "maps start out open");
+static_assert(IsBlocked(Tile_Water) && !IsOpaque(Tile_Water), "water blocks movement but not sight");
+static_assert(IsBlocked(Tile_Door) && !IsBlocked(Tile_OpenDoor), "doors open");
+static_assert(EmitsLight(Tile_Fungus) && !IsBlocked(Tile_Fungus) && !IsOpaque(Tile_Fungus), "fungus glows without getting in the way");
+static_assert(!EmitsLight(255) && MaxTileLightRadius() == TileLightRadii[Tile_Fungus], "unknown bytes do not glow");
+static_assert(IsBlocked(255) && IsOpaque(255) && TileFlags[255] == TileFlags[Tile_Ungenerated], "unknown bytes read as ungenerated");
+static_assert(TileGlyphs[Tile_Tree] == U'\u2663' && TileForegrounds[Tile_Water] == 0xff3f6fcf, "tables follow the definitions");
+static_assert(GlyphTiles['#'] == Tile_Wall && GlyphTiles[' '] == Tile_Empty && GlyphTiles['X'] == Tile_Count, "text maps use the first tile with a glyph");
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single-producer, single-consumer triple buffer. The producer fills Back()
+// and publishes it; the consumer picks up the most recently published value with Acquire.
+// Neither side ever waits, and the consumer never sees a partially written value.
+template<typename T>
+struct TripleBuffer
+{
+    // Producer side: the slot to fill before calling Publish.
+    T & Back() { return m_slots[m_back]; }
+
+    void Publish()
+    {
+        uint8_t previous = m_middle.exchange(uint8_t(m_back | FreshBit), std::memory_order_acq_rel);
+        m_back = previous & IndexMask;
+    }
+
+    // Consumer side: swaps in the latest published value if there is one. Returns true if
+    // Front() changed.
+    bool Acquire()
+    {
+        if (!(m_middle.load(std::memory_order_relaxed) & FreshBit))
+        {
+            return false;
+        }
+
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & IndexMask;
+        return true;
+    }
+
+    T const & Front() const { return m_slots[m_front]; }
+
+    static constexpr uint8_t IndexMask = 0x3;
+    static constexpr uint8_t FreshBit = 0x4;
+
+    T m_slots[3] = {};
+    uint8_t m_back = 0;
+    std::atomic<uint8_t> m_middle{ 1 };
+    uint8_t m_front = 2;
+};
@@ -0,0 +1,179 @@
+#include "pch.h"
+
+#include "worldgen.h"
+
+#include "profiler.h"
+
+static uint64_t Hash(uint64_t seed, int64_t x, int64_t y)
+{
+    // splitmix64 finalizer over the seed and coordinates.
+    uint64_t z = seed + uint64_t(x) * 0x9e3779b97f4a7c15ull + uint64_t(y) * 0xc2b2ae3d27d4eb4full;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Bilinearly interpolated lattice noise in [0, 255] with lattice cells of 1 << shift tiles.
+static uint32_t ValueNoise(uint64_t seed, uint32_t x, uint32_t y, uint32_t shift)
+{
+    uint32_t size = 1u << shift;
+    uint32_t gx = x >> shift;
+    uint32_t gy = y >> shift;
+    uint32_t fx = x & (size - 1);
+    uint32_t fy = y & (size - 1);
+
+    uint32_t v00 = uint32_t(Hash(seed, gx, gy) & 0xff);
+    uint32_t v10 = uint32_t(Hash(seed, gx + 1, gy) & 0xff);
+    uint32_t v01 = uint32_t(Hash(seed, gx, gy + 1) & 0xff);
+    uint32_t v11 = uint32_t(Hash(seed, gx + 1, gy + 1) & 0xff);
+
+    uint32_t top = v00 * (size - fx) + v10 * fx;
+    uint32_t bottom = v01 * (size - fx) + v11 * fx;
+    return (top * (size - fy) + bottom * fy) >> (2 * shift);
+}
+
+void GenerateChunk(uint64_t seed, uint32_t chunkX, uint32_t chunkY, MapChunk & chunk)
+{
+    uint64_t moistureSeed = seed ^ 0x6d6f6973747572ull;
+    for (uint32_t row = 0; row < ChunkSize; row++)
+    {
+        for (uint32_t column = 0; column < ChunkSize; column++)
+        {
+            uint32_t x = (chunkX << ChunkShift) + column;
+            uint32_t y = (chunkY << ChunkShift) + row;
+
+            // Broad shapes from coarse noise, ragged edges from fine noise.
+            uint32_t height = (ValueNoise(seed, x, y, 5) * 2 + ValueNoise(seed, x, y, 3)) / 3;
+            uint32_t moisture = ValueNoise(moistureSeed, x, y, 5);
+
+            TileType tile = Tile_Floor;
+            if (height > 150)
+            {
+                tile = Tile_Rock;
+            }
+            else if (height < 80 && moisture > 120)
+            {
+                tile = Tile_Water;
+            }
+            else if (moisture > 150 && Hash(seed, x, y) % 100 < 15)
+            {
+                tile = Tile_Tree;
+            }
+            else if (moisture > 110 && Hash(seed, x, y) % 1000 >= 996)
+            {
+                // Rare enough that every patch of damp ground has only a few lights.
+                tile = Tile_Fungus;
+            }
+            chunk.tiles[(row << ChunkShift) | column] = tile;
+        }
+    }
+}
+
+std::shared_ptr<WorldMap> CreateProceduralWorld(uint32_t width, uint32_t height, uint64_t seed, uint32_t radius)
+{
+    auto world = std::make_shared<WorldMap>(width, height, Tile_Ungenerated);
+
+    int32_t centreX = int32_t((width / 2) >> ChunkShift);
+    int32_t centreY = int32_t((height / 2) >> ChunkShift);
+    for (int32_t chunkY = centreY - int32_t(radius); chunkY <= centreY + int32_t(radius); chunkY++)
+    {
+        for (int32_t chunkX = centreX - int32_t(radius); chunkX <= centreX + int32_t(radius); chunkX++)
+        {
+            if (chunkX >= 0 && chunkY >= 0 && uint32_t(chunkX) < world->m_chunkColumns && uint32_t(chunkY) < world->m_chunkRows)
+            {
+                auto chunk = std::make_shared<MapChunk>();
+                GenerateChunk(seed, uint32_t(chunkX), uint32_t(chunkY), *chunk);
+                world->SetChunk(uint32_t(chunkX), uint32_t(chunkY), std::move(chunk));
+            }
+        }
+    }
+    return world;
+}
+
+ChunkGenerator::ChunkGenerator(uint64_t seed, uint32_t threads)
+    : m_seed(seed)
+{
+    if (threads == 0)
+    {
+        threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        m_workers.emplace_back([this] { Work(); });
+    }
+}
+
+ChunkGenerator::~ChunkGenerator()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto & worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ChunkGenerator::Request(uint32_t chunkX, uint32_t chunkY)
+{
+    if (!m_requested.insert((uint64_t(chunkY) << 32) | chunkX).second)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.emplace_back(chunkX, chunkY);
+    }
+    m_wake.notify_one();
+}
+
+bool ChunkGenerator::Collect(std::vector<ChunkUpdate> & results)
+{
+    // Never wait on the workers: if one is handing over a chunk right now, pick it up next time.
+    std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+    if (!lock || m_done.empty())
+    {
+        return false;
+    }
+
+    for (auto & result : m_done)
+    {
+        m_requested.erase((uint64_t(result.chunkY) << 32) | result.chunkX);
+        results.push_back(std::move(result));
+    }
+    m_done.clear();
+    return true;
+}
+
+void ChunkGenerator::Work()
+{
+    NameProfileThread("Worldgen");
+    for (;;)
+    {
+        std::pair<uint32_t, uint32_t> coordinates;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping)
+            {
+                return;
+            }
+            coordinates = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        auto chunk = std::make_shared<MapChunk>();
+        {
+            ProfileScope("GenerateChunk");
+            GenerateChunk(m_seed, coordinates.first, coordinates.second, *chunk);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done.push_back({ coordinates.first, coordinates.second, std::move(chunk) });
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "worldmap.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+// Fills chunk (chunkX, chunkY) of the procedural world. The result depends only on the seed and
+// the coordinates, and uses integer arithmetic only, so any chunk can be generated alone, on any
+// thread, in any order, and always comes out byte-for-byte the same. Neighbouring chunks join
+// seamlessly because the terrain is a function of world tile coordinates.
+void GenerateChunk(uint64_t seed, uint32_t chunkX, uint32_t chunkY, MapChunk & chunk);
+
+// A procedural world with the chunks within radius chunks of its centre already generated, and
+// the rest reading as Tile_Ungenerated until they are.
+std::shared_ptr<WorldMap> CreateProceduralWorld(uint32_t width, uint32_t height, uint64_t seed, uint32_t radius);
+
+// Calls fn(chunkX, chunkY) for each chunk within radius chunks of the one holding tile (x, y)
+// that the map does not have yet, nearest ring first.
+template<typename Fn>
+void ForEachMissingChunk(WorldMap const & map, int32_t x, int32_t y, int32_t radius, Fn && fn)
+{
+    int32_t centreX = x >> ChunkShift;
+    int32_t centreY = y >> ChunkShift;
+    for (int32_t ring = 0; ring <= radius; ring++)
+    {
+        for (int32_t chunkY = centreY - ring; chunkY <= centreY + ring; chunkY++)
+        {
+            for (int32_t chunkX = centreX - ring; chunkX <= centreX + ring; chunkX++)
+            {
+                bool onRing = std::abs(chunkX - centreX) == ring || std::abs(chunkY - centreY) == ring;
+                bool inside = chunkX >= 0 && chunkY >= 0 && uint32_t(chunkX) < map.m_chunkColumns && uint32_t(chunkY) < map.m_chunkRows;
+                if (onRing && inside && !map.HasChunk(uint32_t(chunkX), uint32_t(chunkY)))
+                {
+                    fn(uint32_t(chunkX), uint32_t(chunkY));
+                }
+            }
+        }
+    }
+}
+
+// Generates chunks on a pool of worker threads. The owning thread requests chunks and later
+// collects the finished ones; neither call waits for generation.
+struct ChunkGenerator
+{
+    // threads == 0 uses one worker per hardware thread, leaving one for the caller.
+    explicit ChunkGenerator(uint64_t seed, uint32_t threads = 0);
+    ~ChunkGenerator();
+
+    ChunkGenerator(ChunkGenerator const &) = delete;
+    ChunkGenerator & operator=(ChunkGenerator const &) = delete;
+
+    // Queues a chunk unless it is already queued or finished but not collected.
+    // Requests are served in order, so request the most urgent chunks first.
+    void Request(uint32_t chunkX, uint32_t chunkY);
+
+    // Appends every finished chunk to results. Returns false if there were none.
+    bool Collect(std::vector<ChunkUpdate> & results);
+
+    // Chunks requested and not yet collected.
+    size_t Outstanding() const { return m_requested.size(); }
+
+    void Work();
+
+    uint64_t m_seed;
+
+    // Owning thread only.
+    std::unordered_set<uint64_t> m_requested;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::pair<uint32_t, uint32_t>> m_queue;
+    std::vector<ChunkUpdate> m_done;
+    bool m_stopping = false;
+
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,100 @@
+#include "pch.h"
+
+#include "worldmap.h"
+
+MapChunk::MapChunk()
+{
+    std::fill(std::begin(tiles), std::end(tiles), Tile_Empty);
+}
+
+WorldMap::WorldMap(uint32_t width, uint32_t height)
+    : m_width(width)
+    , m_height(height)
+    , m_chunkColumns((width + ChunkMask) >> ChunkShift)
+    , m_chunkRows((height + ChunkMask) >> ChunkShift)
+{
+    m_chunks.resize(size_t(m_chunkColumns) * m_chunkRows);
+}
+
+WorldMap::WorldMap(uint32_t width, uint32_t height, TileType fill)
+    : WorldMap(width, height)
+{
+    auto chunk = std::make_shared<MapChunk>();
+    std::fill(std::begin(chunk->tiles), std::end(chunk->tiles), fill);
+    SetFill(std::move(chunk));
+}
+
+WorldMap WorldMap::FromRows(std::vector<std::string> const & rows)
+{
+    size_t width = 0;
+    for (auto const & row : rows)
+    {
+        width = std::max(width, row.length());
+    }
+
+    WorldMap map(uint32_t(width), uint32_t(rows.size()));
+    for (uint32_t y = 0; y < map.m_height; y++)
+    {
+        for (uint32_t x = 0; x < rows[y].length(); x++)
+        {
+            uint8_t ch = uint8_t(rows[y][x]);
+            uint8_t tile = ch < GlyphTiles.size() ? GlyphTiles[ch] : uint8_t(Tile_Count);
+            if (tile == Tile_Empty)
+            {
+                continue;
+            }
+
+            map.Set(x, y, tile < Tile_Count ? TileType(tile) : Tile_Wall);
+        }
+    }
+    return map;
+}
+
+MapChunk const & WorldMap::EmptyChunk()
+{
+    static const MapChunk empty;
+    return empty;
+}
+
+MapChunk & WorldMap::MutableChunkAt(uint32_t x, uint32_t y)
+{
+    auto & chunk = m_chunks[size_t(y >> ChunkShift) * m_chunkColumns + (x >> ChunkShift)];
+    if (!chunk)
+    {
+        chunk = std::make_shared<MapChunk>(*m_fill);
+    }
+    else if (chunk.use_count() > 1)
+    {
+        chunk = std::make_shared<MapChunk>(*chunk);
+    }
+    return *chunk;
+}
+
+void WorldMap::SetFill(std::shared_ptr<MapChunk const> chunk)
+{
+    m_fill = chunk.get();
+    m_fillOwner = std::move(chunk);
+}
+
+void WorldMap::SetChunk(uint32_t chunkX, uint32_t chunkY, std::shared_ptr<MapChunk> chunk)
+{
+    m_chunks[size_t(chunkY) * m_chunkColumns + chunkX] = std::move(chunk);
+}
+
+void WorldMap::Set(uint32_t x, uint32_t y, TileType tile)
+{
+    MutableChunkAt(x, y).tiles[IndexInChunk(x, y)] = tile;
+}
+
+size_t WorldMap::MemoryUsage() const
+{
+    size_t bytes = m_chunks.capacity() * sizeof(m_chunks[0]);
+    for (auto const & chunk : m_chunks)
+    {
+        if (chunk)
+        {
+            bytes += sizeof(MapChunk);
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "tiles.h"
+
+// Maps are stored in square chunks of ChunkSize x ChunkSize tiles.
+static const uint32_t ChunkShift = 5;
+static const uint32_t ChunkSize = 1u << ChunkShift;
+static const uint32_t ChunkMask = ChunkSize - 1;
+static const uint32_t ChunkArea = ChunkSize * ChunkSize;
+
+// One chunk of the map: the type of every tile, row-major within the chunk, so a row of a
+// chunk is ChunkSize consecutive bytes. How a tile looks and behaves comes from its type.
+struct MapChunk
+{
+    MapChunk();
+
+    TileType tiles[ChunkArea];
+};
+
+// A whole chunk to put into a map at chunk coordinates (chunkX, chunkY).
+struct ChunkUpdate
+{
+    uint32_t chunkX;
+    uint32_t chunkY;
+    std::shared_ptr<MapChunk> chunk;
+};
+
+// Tile map of fixed size, made of lazily allocated chunks. Chunks that were never
+// written read as the fill tile (by default Tile_Empty) without using any memory.
+// Copies share chunks; a chunk is cloned the first time one of the copies writes to it, so
+// a copy can be handed to another thread while this one keeps changing.
+struct WorldMap
+{
+    WorldMap() = default;
+    WorldMap(uint32_t width, uint32_t height);
+    WorldMap(uint32_t width, uint32_t height, TileType fill);
+
+    // Builds a map from rows of text; every character becomes the tile drawn with it, and
+    // characters no tile is drawn with become walls.
+    static WorldMap FromRows(std::vector<std::string> const & rows);
+
+    bool Contains(int32_t x, int32_t y) const
+    {
+        return x >= 0 && y >= 0 && uint32_t(x) < m_width && uint32_t(y) < m_height;
+    }
+
+    // Returns the chunk containing tile (x, y), or the shared fill chunk if it was never written.
+    MapChunk const & ChunkAt(uint32_t x, uint32_t y) const
+    {
+        MapChunk const * chunk = m_chunks[size_t(y >> ChunkShift) * m_chunkColumns + (x >> ChunkShift)].get();
+        return chunk ? *chunk : *m_fill;
+    }
+
+    // Returns the chunk containing tile (x, y) for writing, allocating or unsharing it if needed.
+    MapChunk & MutableChunkAt(uint32_t x, uint32_t y);
+
+    // Whole-chunk access by chunk coordinates.
+    bool HasChunk(uint32_t chunkX, uint32_t chunkY) const
+    {
+        return m_chunks[size_t(chunkY) * m_chunkColumns + chunkX] != nullptr;
+    }
+    void SetChunk(uint32_t chunkX, uint32_t chunkY, std::shared_ptr<MapChunk> chunk);
+
+    // Replaces what chunks that were never written read as. Chunks already written keep their tiles.
+    void SetFill(std::shared_ptr<MapChunk const> chunk);
+
+    static uint32_t IndexInChunk(uint32_t x, uint32_t y)
+    {
+        return ((y & ChunkMask) << ChunkShift) | (x & ChunkMask);
+    }
+
+    TileType Tile(uint32_t x, uint32_t y) const { return ChunkAt(x, y).tiles[IndexInChunk(x, y)]; }
+    void Set(uint32_t x, uint32_t y, TileType tile);
+
+    // Calls fn(x, count, chunk, index) for each run of tiles [x, x + count) of row y within
+    // [left, right) that lies in one chunk. The run's tiles are chunk.tiles[index, index + count).
+    template<typename Fn>
+    void ForEachRowSpan(uint32_t y, uint32_t left, uint32_t right, Fn && fn) const
+    {
+        right = std::min(right, m_width);
+        for (uint32_t x = left; x < right;)
+        {
+            uint32_t count = std::min(ChunkSize - (x & ChunkMask), right - x);
+            fn(x, count, ChunkAt(x, y), IndexInChunk(x, y));
+            x += count;
+        }
+    }
+
+    // Bytes used by allocated chunks and the chunk table.
+    size_t MemoryUsage() const;
+
+    static MapChunk const & EmptyChunk();
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_chunkColumns = 0;
+    uint32_t m_chunkRows = 0;
+    std::vector<std::shared_ptr<MapChunk>> m_chunks;
+    std::shared_ptr<MapChunk const> m_fillOwner;
+    MapChunk const * m_fill = &EmptyChunk();
+};